@@ -16,6 +16,15 @@
 
 #include <esp_log.h>
 #include <esp_err.h>
+#include <esp_idf_version.h>
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+# include <esp_rom_sys.h>
+# define delay_us esp_rom_delay_us
+#else
+# include <rom/ets_sys.h>
+# define delay_us ets_delay_us
+#endif
 
 #include <ak8963.h>
 
@@ -24,82 +33,93 @@
 static const char *tag = "ak8963";
 
 
-/* I2C address to use. */
-static const uint8_t addr = 0x0c;
-
-
-/* I2C master port to use. */
-static i2c_port_t port = -1;
-
-
-/* Sensitivity adjustment data from the device. */
-static float asa[3] = {0, 0, 0};
+/*
+ * When user wants to change operation mode, transit to power-down
+ * mode first and then transit to other modes. After power-down mode
+ * is set, at least 100μs is needed before setting another mode.
+ *
+ * Ticks are too coarse for that, a single one may be over right away.
+ */
+static esp_err_t power_down(const regio *io)
+{
+	REGIO_TRY(regio_put(io, 0x0a, 0x00));
+	delay_us(100);
+	return ESP_OK;
+}
 
 
-void ak8963_init(i2c_port_t _port)
+esp_err_t ak8963_init(ak8963 *dev, const regio *io, const ak8963_config *cfg)
 {
 	uint8_t buf[3];
 
 	ESP_LOGI(tag, "Initializing AK8963...");
-	port = _port;
+	dev->io = *io;
+	io = &dev->io;
 
 	/* Make sure we have reached AK8963. */
-	i2ce_read(port, addr, 0x00, buf, 1);
+	REGIO_TRY(regio_read(io, 0x00, buf, 1));
 
 	if (buf[0] != 0x48) {
 		ESP_LOGE(tag, "AK8963 WAI mismatch: %#hhx != 0x48", buf[0]);
-		abort();
+		return ESP_ERR_NOT_FOUND;
 	}
 
+	/* It may still be measuring when we are setting it up again. */
+	REGIO_TRY(power_down(io));
+
 	/*
 	 * Sensitivity adjustment data for each axis is stored to fuse ROM
 	 * on shipment.  We need to enter the FUSE-access mode to read them.
 	 */
-	i2ce_put(port, addr, 0x0a, 0x0f);
-
-	/*
-	 * When user wants to change operation mode, transit to power-down
-	 * mode first and then transit to other modes. After power-down mode
-	 * is set, at least 100μs is needed before setting another mode.
-	 */
-	vTaskDelay(pdMS_TO_TICKS(1));
+	REGIO_TRY(regio_put(io, 0x0a, 0x0f));
 
 	/* Now read the sensitivity adjustments. */
-	i2ce_read(port, addr, 0x10, buf, 3);
+	REGIO_TRY(regio_read(io, 0x10, buf, 3));
 
-	asa[0] = buf[0] - 128;
-	asa[1] = buf[1] - 128;
-	asa[2] = buf[2] - 128;
+	float lsb = cfg->bits16 ? 0.15 : 0.6;
 
-	/* Power down. */
-	i2ce_put(port, addr, 0x0a, 0x00);
-	vTaskDelay(pdMS_TO_TICKS(1));
+	for (int i = 0; i < 3; i++)
+		dev->scale[i] = lsb * ((buf[i] - 128) / 256.0f + 1);
 
-	/*
-	 * Now move onto the continuous measurement mode with
-	 * 16-bit resolution.
-	 */
-	i2ce_put(port, addr, 0x0a, 0x16);
+	REGIO_TRY(power_down(io));
+
+	/* Now move onto the requested continuous measurement mode. */
+	REGIO_TRY(regio_put(io, 0x0a, (cfg->bits16 ? 0x10 : 0x00) | cfg->mode));
 	vTaskDelay(pdMS_TO_TICKS(1));
+
+	return ESP_OK;
 }
 
 
-bool ak8963_read_raw(float magm[3])
+void ak8963_get_scale(const ak8963 *dev, float dst[3])
 {
-	/* Layout: magm(xx yy zz) status(s) in little-endian. */
-	uint8_t buf[7];
+	dst[0] = dev->scale[0];
+	dst[1] = dev->scale[1];
+	dst[2] = dev->scale[2];
+}
 
-	i2ce_read(port, addr, 0x03, buf, 7);
 
-	/* First, read in the raw values. */
-	magm[0] = (int16_t)((buf[1] << 8) | buf[0]);
-	magm[1] = (int16_t)((buf[3] << 8) | buf[2]);
-	magm[2] = (int16_t)((buf[5] << 8) | buf[4]);
+esp_err_t ak8963_read_raw(const ak8963 *dev, float magm[3], bool *ok)
+{
+	uint8_t buf[AK8963_DATA_LEN];
+
+	REGIO_TRY(regio_read(&dev->io, AK8963_DATA_REG, buf, sizeof(buf)));
+
+	*ok = ak8963_decode(dev, buf, magm);
+	return ESP_OK;
+}
+
 
-	/* Then adjust them using ASA values. */
-	magm[0] += (magm[0] * asa[0]) / 256.0;
-	magm[1] += (magm[1] * asa[1]) / 256.0;
-	magm[2] += (magm[2] * asa[2]) / 256.0;
+bool ak8963_decode(const ak8963 *dev, const uint8_t buf[AK8963_DATA_LEN],
+                   float magm[3])
+{
+	const float *scale = dev->scale;
+
+	/* Layout: magm(xx yy zz) status(s) in little-endian. */
+
+	magm[0] = (int16_t)((buf[1] << 8) | buf[0]) * scale[0];
+	magm[1] = (int16_t)((buf[3] << 8) | buf[2]) * scale[1];
+	magm[2] = (int16_t)((buf[5] << 8) | buf[4]) * scale[2];
 
 	/*
 	 * Magnetic sensor may overflow even though measurement data
@@ -108,3 +128,25 @@ bool ak8963_read_raw(float magm[3])
 	 */
 	return !(buf[6] & 0x08);
 }
+
+
+esp_err_t ak8963_read_counts(const ak8963 *dev, int16_t magm[3], bool *ok)
+{
+	uint8_t buf[AK8963_DATA_LEN];
+
+	REGIO_TRY(regio_read(&dev->io, AK8963_DATA_REG, buf, sizeof(buf)));
+
+	*ok = ak8963_decode_counts(buf, magm);
+	return ESP_OK;
+}
+
+
+bool ak8963_decode_counts(const uint8_t buf[AK8963_DATA_LEN], int16_t magm[3])
+{
+	/* Same layout and overflow as for ak8963_decode(). */
+	magm[0] = (buf[1] << 8) | buf[0];
+	magm[1] = (buf[3] << 8) | buf[2];
+	magm[2] = (buf[5] << 8) | buf[4];
+
+	return !(buf[6] & 0x08);
+}
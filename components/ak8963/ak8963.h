@@ -18,16 +18,90 @@
 #define _COMPONENT_AK8963_H 1
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 
-#include <i2ce.h>
+#include <regio.h>
 
 
-/* Initialize the magnetometer. */
-void ak8963_init(i2c_port_t port);
+/* I2C address of the magnetometer. */
+#define AK8963_ADDR 0x0c
 
+/* Measurement block, from HXL up to and including ST2. */
+#define AK8963_DATA_REG 0x03
+#define AK8963_DATA_LEN 7
 
-/* Take a magnetometer reading. Axis order is XYZ. */
-bool ak8963_read_raw(float magm[3]);
+
+/* Continuous measurement modes. */
+enum ak8963_mode {
+	AK8963_MODE_8HZ = 0x02,
+	AK8963_MODE_100HZ = 0x06,
+};
+
+struct ak8963_config {
+	enum ak8963_mode mode;
+
+	/* Use 16-bit (0.15 μT/LSB) instead of 14-bit (0.6 μT/LSB) output. */
+	bool bits16;
+};
+
+typedef struct ak8963_config ak8963_config;
+
+/* Best resolution at the highest rate. */
+#define AK8963_CONFIG_DEFAULT {			\
+	.mode = AK8963_MODE_100HZ,		\
+	.bits16 = true,				\
+}
+
+
+/* Handle of a single magnetometer. */
+struct ak8963 {
+	/* How to reach the device. */
+	regio io;
+
+	/*
+	 * Sensitivity of each axis in μT/LSB, including the adjustment
+	 * data from the device.
+	 */
+	float scale[3];
+};
+
+typedef struct ak8963 ak8963;
+
+
+/*
+ * Initialize the magnetometer and start measuring. It is reached
+ * either directly over I2C or through the MPU9250 auxiliary master.
+ * Fails when the bus does or when something else answers.
+ */
+esp_err_t ak8963_init(ak8963 *dev, const regio *io, const ak8963_config *cfg);
+
+
+/* Get sensitivity of every axis, in μT/LSB. */
+void ak8963_get_scale(const ak8963 *dev, float scale[3]);
+
+
+/*
+ * Take a magnetometer reading, in μT. Axis order is XYZ. Unless the
+ * bus fails, `ok` tells whether the reading is valid.
+ */
+esp_err_t ak8963_read_raw(const ak8963 *dev, float magm[3], bool *ok);
+
+
+/*
+ * Decode measurement block obtained by other means, such as through
+ * the MPU9250 auxiliary I2C master. Returns false on overflow.
+ */
+bool ak8963_decode(const ak8963 *dev, const uint8_t buf[AK8963_DATA_LEN],
+                   float magm[3]);
+
+
+/*
+ * Same as ak8963_read_raw() and ak8963_decode(), but leave the reading
+ * in signed counts, see ak8963_get_scale().
+ */
+esp_err_t ak8963_read_counts(const ak8963 *dev, int16_t magm[3], bool *ok);
+bool ak8963_decode_counts(const uint8_t buf[AK8963_DATA_LEN], int16_t magm[3]);
 
 
 #endif				/* !_COMPONENT_AK8963_H */
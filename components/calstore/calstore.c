@@ -0,0 +1,201 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <nvs.h>
+
+#include <calstore.h>
+
+
+/* Logging tag. */
+static const char *tag = "calstore";
+
+
+/* Where to keep the record. */
+static const char *nvs_namespace = "headband";
+static const char *nvs_key = "cal";
+
+
+/* Minimum time between two writes, in μs. */
+#define SAVE_INTERVAL (300 * 1000000ll)
+
+
+/* Last record written or loaded and when. */
+static uint8_t last_buf[CALSTORE_SIZE];
+static int64_t last_time = -SAVE_INTERVAL;
+
+
+static void put_f32(uint8_t *buf, float v)
+{
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+
+	buf[0] = u;
+	buf[1] = u >> 8;
+	buf[2] = u >> 16;
+	buf[3] = u >> 24;
+}
+
+
+static float get_f32(const uint8_t *buf)
+{
+	uint32_t u = buf[0] | (buf[1] << 8) | (buf[2] << 16) |
+	             ((uint32_t)buf[3] << 24);
+	float v;
+
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+
+static void put_vec3(uint8_t *buf, vec3 v)
+{
+	for (int i = 0; i < 3; i++)
+		put_f32(buf + 4 * i, v.row[i]);
+}
+
+
+static vec3 get_vec3(const uint8_t *buf)
+{
+	return (vec3){{get_f32(buf), get_f32(buf + 4), get_f32(buf + 8)}};
+}
+
+
+size_t calstore_encode(uint8_t buf[CALSTORE_SIZE], const calstore *c)
+{
+	buf[0] = CALSTORE_VERSION;
+	buf[1] = CALSTORE_VERSION >> 8;
+	buf[2] = CALSTORE_SIZE;
+	buf[3] = CALSTORE_SIZE >> 8;
+
+	put_vec3(buf + 4, c->mag_hard);
+	put_vec3(buf + 16, c->mag_soft.col[0]);
+	put_vec3(buf + 28, c->mag_soft.col[1]);
+	put_vec3(buf + 40, c->mag_soft.col[2]);
+	put_vec3(buf + 52, c->gyro_bias);
+	put_vec3(buf + 64, c->accm_scale);
+
+	return CALSTORE_SIZE;
+}
+
+
+bool calstore_decode(calstore *c, const uint8_t *buf, size_t len)
+{
+	if (len < 4)
+		return false;
+
+	unsigned version = buf[0] | (buf[1] << 8);
+	unsigned size = buf[2] | (buf[3] << 8);
+
+	if (version < 1 || version > CALSTORE_VERSION ||
+	    CALSTORE_SIZE != size || len < CALSTORE_SIZE)
+		return false;
+
+	calstore tmp = {
+		.mag_hard = get_vec3(buf + 4),
+		.mag_soft = {{
+			get_vec3(buf + 16),
+			get_vec3(buf + 28),
+			get_vec3(buf + 40),
+		}},
+		.gyro_bias = get_vec3(buf + 52),
+		.accm_scale = get_vec3(buf + 64),
+	};
+
+	/* Reject garbage, such as NaNs from an interrupted write. */
+	for (int i = 4; i < CALSTORE_SIZE; i += 4)
+		if (!isfinite(get_f32(buf + i)))
+			return false;
+
+	/* Magnetometer used to report raw 16-bit readings, 0.15 μT/LSB. */
+	if (version < 2)
+		tmp.mag_hard = vec3scale(0.15, tmp.mag_hard);
+
+	*c = tmp;
+	return true;
+}
+
+
+bool calstore_load(calstore *c)
+{
+	uint8_t buf[CALSTORE_SIZE];
+	size_t len = sizeof(buf);
+	nvs_handle_t nvs;
+
+	if (nvs_open(nvs_namespace, NVS_READONLY, &nvs))
+		return false;
+
+	esp_err_t err = nvs_get_blob(nvs, nvs_key, buf, &len);
+	nvs_close(nvs);
+
+	if (err) {
+		ESP_LOGI(tag, "No stored calibration: %s", esp_err_to_name(err));
+		return false;
+	}
+
+	if (!calstore_decode(c, buf, len)) {
+		ESP_LOGW(tag, "Ignoring incompatible stored calibration.");
+		return false;
+	}
+
+	ESP_LOGI(tag, "Loaded stored calibration.");
+	memcpy(last_buf, buf, sizeof(last_buf));
+
+	return true;
+}
+
+
+void calstore_save(const calstore *c)
+{
+	uint8_t buf[CALSTORE_SIZE];
+	int64_t now = esp_timer_get_time();
+
+	if (now - last_time < SAVE_INTERVAL)
+		return;
+
+	calstore_encode(buf, c);
+
+	if (!memcmp(buf, last_buf, sizeof(buf)))
+		return;
+
+	nvs_handle_t nvs;
+	esp_err_t err = nvs_open(nvs_namespace, NVS_READWRITE, &nvs);
+
+	if (!err) {
+		err = nvs_set_blob(nvs, nvs_key, buf, sizeof(buf));
+
+		if (!err)
+			err = nvs_commit(nvs);
+
+		nvs_close(nvs);
+	}
+
+	/* Do not retry too often even when failing. */
+	last_time = now;
+
+	if (err) {
+		ESP_LOGE(tag, "Failed to store calibration: %s",
+		         esp_err_to_name(err));
+		return;
+	}
+
+	ESP_LOGI(tag, "Stored calibration.");
+	memcpy(last_buf, buf, sizeof(last_buf));
+}
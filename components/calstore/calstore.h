@@ -0,0 +1,82 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_CALSTORE_H
+#define _COMPONENT_CALSTORE_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * Calibration Store
+ * =================
+ *
+ * Keeps the sensor calibration in the NVS, so that the next boot can
+ * start with it instead of learning everything again.
+ *
+ * The record is stored as a versioned blob, all fields little-endian:
+ *
+ *   0  u16 version
+ *   2  u16 length of the whole record
+ *   4  f32 magnetometer hard iron offset x, y, z, in μT
+ *  16  f32 magnetometer soft iron matrix, column by column
+ *  52  f32 gyroscope bias x, y, z
+ *  64  f32 accelerometer scale x, y, z, reserved
+ *
+ * Whenever the contents change, bump the version and teach
+ * calstore_decode() to convert the older records. Version 1 had the
+ * hard iron offset in 16-bit magnetometer LSB.
+ *
+ * Nothing estimates the accelerometer scale yet, it is stored as ones
+ * and kept only so that a later estimate fits without a new version.
+ */
+
+#define CALSTORE_VERSION 2
+#define CALSTORE_SIZE 76
+
+
+struct calstore {
+	vec3 mag_hard;
+	mat3 mag_soft;
+	vec3 gyro_bias;
+	vec3 accm_scale;
+};
+
+typedef struct calstore calstore;
+
+
+/* Serialize the record. Returns number of bytes used. */
+size_t calstore_encode(uint8_t buf[CALSTORE_SIZE], const calstore *c);
+
+/* Deserialize the record. Returns false when it is not usable. */
+bool calstore_decode(calstore *c, const uint8_t *buf, size_t len);
+
+/* Load the record from the NVS. Returns false when there is none. */
+bool calstore_load(calstore *c);
+
+/*
+ * Store the record to the NVS, unless it did not change since the
+ * last time or the last write happened only recently. This keeps the
+ * flash wear low even when called often.
+ */
+void calstore_save(const calstore *c);
+
+
+#endif				/* !_COMPONENT_CALSTORE_H */
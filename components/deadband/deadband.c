@@ -0,0 +1,52 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <deadband.h>
+
+
+void deadband_init(deadband *d, float threshold, uint64_t heartbeat,
+                   float onset)
+{
+	*d = (deadband){
+		.threshold = threshold,
+		.heartbeat = heartbeat,
+		.onset = onset,
+		.last = {1, 0, 0, 0},
+	};
+}
+
+
+bool deadband_update(deadband *d, uint64_t time, quat q, vec3 rate)
+{
+	bool moving = vec3mag(rate) >= d->onset;
+	bool edge = moving != d->moving;
+
+	d->moving = moving;
+
+	if (d->primed && !edge && time - d->time < d->heartbeat) {
+		/* Half angle of the rotation between the two poses. */
+		float c = fabsf(quatmul(quatconj(d->last), q).w);
+
+		if (c >= cosf(d->threshold / 2))
+			return false;
+	}
+
+	d->last = q;
+	d->time = time;
+	d->primed = true;
+
+	return true;
+}
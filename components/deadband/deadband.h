@@ -0,0 +1,73 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_DEADBAND_H
+#define _COMPONENT_DEADBAND_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <spatial.h>
+
+
+/*
+ * Output Deadband
+ * ===============
+ *
+ * Passes a pose only when it differs from the last one passed by more
+ * than the threshold, so that the output goes quiet while the head
+ * holds still. A heartbeat pose goes out every so often regardless.
+ *
+ * Poses at the motion onset and at its end go out immediately, so that
+ * the receiver neither lags behind the first movement nor rests up to
+ * the threshold away from where the head came to a halt.
+ */
+
+struct deadband {
+	/* Smallest change of orientation worth passing, in rad. */
+	float threshold;
+
+	/* Longest time between two passed poses, in μs. */
+	uint64_t heartbeat;
+
+	/* Angular rate considered motion, in rad/s. */
+	float onset;
+
+	/* Last pose passed and when. */
+	quat last;
+	uint64_t time;
+	bool primed;
+
+	/* Whether the head was moving during the previous update. */
+	bool moving;
+};
+
+typedef struct deadband deadband;
+
+
+/* Pass the very next pose. */
+void deadband_init(deadband *d, float threshold, uint64_t heartbeat,
+                   float onset);
+
+/*
+ * Feed a pose `q` from `time` μs along with the bias-corrected angular
+ * `rate`. Returns whether to output it.
+ */
+bool deadband_update(deadband *d, uint64_t time, quat q, vec3 rate);
+
+
+#endif				/* !_COMPONENT_DEADBAND_H */
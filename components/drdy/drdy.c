@@ -0,0 +1,93 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_sleep.h>
+
+#include <drdy.h>
+
+
+/* Logging tag. */
+static const char *tag = "drdy";
+
+
+/* Task to notify on every edge. */
+static TaskHandle_t waiter = NULL;
+
+
+/* Line to watch and whether it is level triggered. */
+static gpio_num_t pin = -1;
+static bool level = false;
+
+
+static void IRAM_ATTR drdy_isr(void *arg)
+{
+	BaseType_t woken = pdFALSE;
+
+	/* Level stays up until the sample is read, keep quiet till then. */
+	if (level)
+		gpio_intr_disable(pin);
+
+	vTaskNotifyGiveFromISR(waiter, &woken);
+
+	if (woken)
+		portYIELD_FROM_ISR();
+}
+
+
+void drdy_init(gpio_num_t gpio, TaskHandle_t task, bool wakeup)
+{
+	ESP_LOGI(tag, "Installing data-ready interrupt on GPIO %i...",
+	         (int)gpio);
+
+	waiter = task;
+	pin = gpio;
+	level = wakeup;
+
+	gpio_config_t conf = {
+		.pin_bit_mask = 1ull << gpio,
+		.mode = GPIO_MODE_INPUT,
+		.pull_down_en = GPIO_PULLDOWN_ENABLE,
+		.intr_type = GPIO_INTR_POSEDGE,
+	};
+
+	ESP_ERROR_CHECK(gpio_config(&conf));
+
+	if (wakeup) {
+		/*
+		 * Switches the line to level triggering. The handler then
+		 * needs gpio_intr_disable(), which is not in the IRAM.
+		 */
+		ESP_ERROR_CHECK(gpio_wakeup_enable(gpio, GPIO_INTR_HIGH_LEVEL));
+		ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+		ESP_ERROR_CHECK(gpio_install_isr_service(0));
+	} else {
+		ESP_ERROR_CHECK(gpio_install_isr_service(ESP_INTR_FLAG_IRAM));
+	}
+
+	ESP_ERROR_CHECK(gpio_isr_handler_add(gpio, drdy_isr, NULL));
+}
+
+
+unsigned drdy_wait(TickType_t timeout)
+{
+	/* Re-arm, fires right away if the next sample is already there. */
+	if (level)
+		gpio_intr_enable(pin);
+
+	return ulTaskNotifyTake(pdTRUE, timeout);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_DRDY_H
+#define _COMPONENT_DRDY_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <driver/gpio.h>
+
+
+/*
+ * Data Ready
+ * ==========
+ *
+ * Turns rising edges on a sensor interrupt line into task notifications,
+ * so that the acquisition task sleeps until a fresh sample is available.
+ */
+
+/*
+ * Start notifying the `task` on every rising edge of the `gpio`.
+ *
+ * With `wakeup` the line is also allowed to wake the chip from light
+ * sleep. That only works with a level, so the sensor must hold the
+ * line high until the sample is read. The interrupt then stays off
+ * from the moment it fires until the next drdy_wait().
+ */
+void drdy_init(gpio_num_t gpio, TaskHandle_t task, bool wakeup);
+
+/*
+ * Block until the next edge or the `timeout` expires.
+ * Returns the number of edges since the last call, 0 on timeout.
+ * More than one edge means that some samples were missed, which
+ * cannot be detected with `wakeup`.
+ */
+unsigned drdy_wait(TickType_t timeout);
+
+
+#endif				/* !_COMPONENT_DRDY_H */
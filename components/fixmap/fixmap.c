@@ -0,0 +1,56 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <fixmap.h>
+
+
+void fixmap_init(fixmap *f, mat3 m, vec3 b)
+{
+	float mmax = 0, bmax = 0;
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++)
+			mmax = maxf(mmax, fabsf(m.col[j].row[i]));
+
+		bmax = maxf(bmax, fabsf(b.row[i]));
+	}
+
+	/* Take as many fractional bits as both limits allow. */
+	int frac = 30;
+
+	while (frac > -30 && (ldexpf(mmax, frac) >= FIXMAP_COEF_MAX - 0.5f ||
+	                      ldexpf(bmax, frac) >= FIXMAP_OFFSET_MAX - 0.5f))
+		frac--;
+
+	f->diagonal = true;
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			f->m[i][j] = lrintf(ldexpf(m.col[j].row[i], frac));
+
+			if (i != j && f->m[i][j])
+				f->diagonal = false;
+		}
+
+		f->b[i] = lrintf(ldexpf(b.row[i], frac));
+
+		if (f->b[i])
+			f->diagonal = false;
+	}
+
+	f->frac = frac;
+	f->lsb = ldexpf(1, -frac);
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_FIXMAP_H
+#define _COMPONENT_FIXMAP_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * Fixed-Point Mapping
+ * ===================
+ *
+ * Affine map of raw 16-bit sensor counts, evaluated in integers:
+ *
+ *   out = M * counts + b
+ *
+ * All the float factors along the way, such as sensitivity, factory
+ * adjustment, axis alignment and calibration, are folded into `M` and
+ * `b` once and rounded to the Q format with as many fractional bits
+ * as fit. The result is only turned into a float at the very end.
+ *
+ * Coefficients are kept below 2¹⁴, so that three products of a count
+ * and a coefficient add up within 32 bits together with the offset.
+ * Rounding the coefficients costs less than 2⁻¹² of the full scale
+ * output, far below the noise of any of the sensors.
+ */
+
+/* Largest magnitude of a coefficient. */
+#define FIXMAP_COEF_MAX (1 << 14)
+
+/* Largest magnitude of an offset, leaving room for the products. */
+#define FIXMAP_OFFSET_MAX (1 << 29)
+
+
+struct fixmap {
+	/* Coefficients and offsets, Q`frac`. */
+	int32_t m[3][3];
+	int32_t b[3];
+	int frac;
+
+	/* Only the diagonal of `m` is used, without any offset. */
+	bool diagonal;
+
+	/* Value of the least significant bit of the result, 2^-frac. */
+	float lsb;
+};
+
+typedef struct fixmap fixmap;
+
+
+/* Fold and quantize the map `m * counts + b`. */
+void fixmap_init(fixmap *f, mat3 m, vec3 b);
+
+/* Map the counts, result is Q`frac`. */
+inline static void fixmap_apply(const fixmap *f, int32_t dst[3],
+                                const int16_t src[3])
+{
+	if (f->diagonal) {
+		dst[0] = f->m[0][0] * src[0];
+		dst[1] = f->m[1][1] * src[1];
+		dst[2] = f->m[2][2] * src[2];
+		return;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		dst[i] = f->m[i][0] * src[0]
+		       + f->m[i][1] * src[1]
+		       + f->m[i][2] * src[2]
+		       + f->b[i];
+	}
+}
+
+/* Map the counts and convert the result into a float vector. */
+inline static vec3 fixmap_vec3(const fixmap *f, const int16_t src[3])
+{
+	int32_t v[3];
+
+	fixmap_apply(f, v, src);
+
+	return (vec3){{v[0] * f->lsb, v[1] * f->lsb, v[2] * f->lsb}};
+}
+
+
+#endif				/* !_COMPONENT_FIXMAP_H */
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <fusion.h>
+
+
+void fusion_init(fusion *f, float dt)
+{
+	/* Initial values come from an offline fit, see the notebook. */
+	vec3 hard = {{70.61, 51.43, 34.96}};
+	mat3 soft = {{
+		{{0.94, 0.00, 0.00}},
+		{{0.00, 1.03, 0.00}},
+		{{0.00, 0.00, 1.05}},
+	}};
+
+	/* Earth's field is about 45 μT around here. */
+	magcal_init(&f->mcal, hard, soft, 1.0 / 45);
+
+	f->filter = (ahrs){
+		.q = {1, 0, 0, 0},
+		.kp = 2.0,
+		.ki = 0.005,
+	};
+
+	f->ready = false;
+	f->accm_scale = (vec3){{1, 1, 1}};
+	f->dt = dt;
+}
+
+
+vec3 fusion_magm(fusion *f, const float magm[3], bool *updated)
+{
+	/*
+	 * Align magnetometer with the accelerometer and gyroscope.
+	 * https://github.com/kriswiner/MPU9250/pull/370#issuecomment-491806904
+	 */
+	vec3 raw = {{magm[1], magm[0], -magm[2]}};
+
+	*updated = magcal_update(&f->mcal, raw);
+
+	/* Remove hard and soft iron effects. */
+	return magcal_apply(&f->mcal, raw);
+}
+
+
+void fusion_update(fusion *f, const float accm[3], const float gyro[3],
+                   vec3 magm)
+{
+	vec3 a = {{accm[0] * f->accm_scale.row[0],
+	           accm[1] * f->accm_scale.row[1],
+	           accm[2] * f->accm_scale.row[2]}};
+	vec3 g = {{gyro[0], gyro[1], gyro[2]}};
+
+	if (!f->ready) {
+		/* Start from a snapshot to avoid the long convergence. */
+		if (vec3mag(magm) > 0) {
+			f->filter.q = quat_from_triad(a, magm);
+			f->ready = true;
+		}
+
+		return;
+	}
+
+	f->filter = ahrs_update(f->filter, g, a, magm, f->dt);
+}
+
+
+/* Maps magnetometer counts onto the axes of the other sensors. */
+static mat3 magm_align(vec3 lsb)
+{
+	/* Same as in fusion_magm(), with the sensitivity folded in. */
+	return (mat3){{
+		{{0, lsb.row[0], 0}},
+		{{lsb.row[1], 0, 0}},
+		{{0, 0, -lsb.row[2]}},
+	}};
+}
+
+
+/* Fold alignment with the current calibration. */
+static void fold_magm(fusion *f)
+{
+	mat3 align = magm_align(f->magm_lsb);
+	vec3 zero = {{0, 0, 0}};
+
+	/* soft * (align * counts - hard) */
+	fixmap_init(&f->magm_map, mat3mul(f->mcal.soft, align),
+	            magcal_apply(&f->mcal, zero));
+}
+
+
+static mat3 diag(float c)
+{
+	return (mat3){{
+		{{c, 0, 0}},
+		{{0, c, 0}},
+		{{0, 0, c}},
+	}};
+}
+
+
+void fusion_fold(fusion *f, float accm_lsb, float gyro_lsb,
+                 const float magm_lsb[3])
+{
+	vec3 zero = {{0, 0, 0}};
+
+	fixmap_init(&f->accm_map, diag(accm_lsb), zero);
+	fixmap_init(&f->gyro_map, diag(gyro_lsb), zero);
+
+	f->magm_lsb = (vec3){{magm_lsb[0], magm_lsb[1], magm_lsb[2]}};
+	fixmap_init(&f->align_map, magm_align(f->magm_lsb), zero);
+	fold_magm(f);
+}
+
+
+void fusion_convert(const fusion *f, const int16_t accm[3],
+                    const int16_t gyro[3], float accm_dst[3],
+                    float gyro_dst[3])
+{
+	vec3 a = fixmap_vec3(&f->accm_map, accm);
+	vec3 g = fixmap_vec3(&f->gyro_map, gyro);
+
+	for (int i = 0; i < 3; i++) {
+		accm_dst[i] = a.row[i];
+		gyro_dst[i] = g.row[i];
+	}
+}
+
+
+vec3 fusion_magm_counts(fusion *f, const int16_t magm[3], bool *updated)
+{
+	/* Calibration still needs the uncorrected reading. */
+	vec3 raw = fixmap_vec3(&f->align_map, magm);
+
+	*updated = magcal_update(&f->mcal, raw);
+
+	if (*updated)
+		fold_magm(f);
+
+	return fixmap_vec3(&f->magm_map, magm);
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_FUSION_H
+#define _COMPONENT_FUSION_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+#include <magcal.h>
+#include <fixmap.h>
+
+
+/*
+ * Sensor Fusion
+ * =============
+ *
+ * Everything between sensor readings in physical units and the pose:
+ * magnetometer alignment and calibration, initial orientation from a
+ * single sample and the orientation filter. Does not depend on the
+ * platform, so that recorded traces can be replayed on a host through
+ * the very same code.
+ *
+ * Readings can also be passed as raw sensor counts. Sensitivities,
+ * alignment and calibration are then folded into fixed-point maps,
+ * and the readings only become floats once fully corrected.
+ */
+
+struct fusion {
+	/* Magnetometer calibration, refined continuously. */
+	magcal mcal;
+
+	/* Orientation filter, valid once `ready`. */
+	ahrs filter;
+	bool ready;
+
+	/* Accelerometer scale correction, per axis. */
+	vec3 accm_scale;
+
+	/* Time between two consecutive samples, in seconds. */
+	float dt;
+
+	/* Magnetometer sensitivity, for folding the calibration. */
+	vec3 magm_lsb;
+
+	/* Integer pipeline, from counts to physical units. */
+	fixmap accm_map, gyro_map, align_map, magm_map;
+};
+
+typedef struct fusion fusion;
+
+
+/* Start over with the default calibration. */
+void fusion_init(fusion *f, float dt);
+
+/*
+ * Align magnetometer reading with the other sensors and calibrate it.
+ * Sets `updated` when the calibration has just changed.
+ */
+vec3 fusion_magm(fusion *f, const float magm[3], bool *updated);
+
+/*
+ * Feed a single sample to the orientation filter. Pass zero `magm`
+ * when there is no valid magnetometer reading.
+ */
+void fusion_update(fusion *f, const float accm[3], const float gyro[3],
+                   vec3 magm);
+
+
+/*
+ * Prepare the integer pipeline for sensors with given sensitivities
+ * (physical units per count). Call again whenever the magnetometer
+ * calibration is replaced from outside.
+ */
+void fusion_fold(fusion *f, float accm_lsb, float gyro_lsb,
+                 const float magm_lsb[3]);
+
+/*
+ * Convert raw accelerometer and gyroscope counts into readings for
+ * fusion_update().
+ */
+void fusion_convert(const fusion *f, const int16_t accm[3],
+                    const int16_t gyro[3], float accm_dst[3],
+                    float gyro_dst[3]);
+
+/* Same as fusion_magm(), but taking raw magnetometer counts. */
+vec3 fusion_magm_counts(fusion *f, const int16_t magm[3], bool *updated);
+
+
+#endif				/* !_COMPONENT_FUSION_H */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <gyrocal.h>
+
+
+/* Temperature fit is this many times slower than the bias. */
+#define SLOPE_HORIZON 10
+
+/* Least temperature variance to fit the slope from, in °C². */
+#define MIN_TEMP_VAR 0.25f
+
+
+void gyrocal_init(gyrocal *g, float accm_noise, float gyro_noise,
+                  float tau, float dt)
+{
+	memset(g, 0, sizeof(*g));
+
+	g->accm_noise = accm_noise;
+	g->gyro_noise = gyro_noise;
+	g->alpha = minf(1, dt / tau);
+	g->beta = g->alpha / SLOPE_HORIZON;
+}
+
+
+void gyrocal_set_bias(gyrocal *g, vec3 bias)
+{
+	g->bias = bias;
+	g->primed = false;
+}
+
+
+static vec3 square(vec3 v)
+{
+	return (vec3){{v.row[0] * v.row[0],
+	               v.row[1] * v.row[1],
+	               v.row[2] * v.row[2]}};
+}
+
+
+/* Sum of the variances of all axes. */
+static float spread(vec3 sum, vec3 sq, unsigned n)
+{
+	float var = 0;
+
+	for (int i = 0; i < 3; i++) {
+		float mean = sum.row[i] / n;
+		var += sq.row[i] / n - mean * mean;
+	}
+
+	return var;
+}
+
+
+/* Slide the window by one sample, tell whether it is all at rest. */
+static bool window_push(gyrocal *g, vec3 accm, vec3 gyro)
+{
+	if (g->len == GYROCAL_WINDOW) {
+		vec3 a = g->accm[g->pos];
+		vec3 w = g->gyro[g->pos];
+
+		g->accm_sum = vec3add2(g->accm_sum, vec3scale(-1, a));
+		g->accm_sq = vec3add2(g->accm_sq, vec3scale(-1, square(a)));
+		g->gyro_sum = vec3add2(g->gyro_sum, vec3scale(-1, w));
+		g->gyro_sq = vec3add2(g->gyro_sq, vec3scale(-1, square(w)));
+	} else {
+		g->len++;
+	}
+
+	g->accm[g->pos] = accm;
+	g->gyro[g->pos] = gyro;
+	g->pos = (g->pos + 1) % GYROCAL_WINDOW;
+
+	g->accm_sum = vec3add2(g->accm_sum, accm);
+	g->accm_sq = vec3add2(g->accm_sq, square(accm));
+	g->gyro_sum = vec3add2(g->gyro_sum, gyro);
+	g->gyro_sq = vec3add2(g->gyro_sq, square(gyro));
+
+	/* Start over once per window, before rounding errors pile up. */
+	if (!g->pos && g->len == GYROCAL_WINDOW) {
+		vec3 zero = {{0, 0, 0}};
+
+		g->accm_sum = g->accm_sq = g->gyro_sum = g->gyro_sq = zero;
+
+		for (unsigned i = 0; i < GYROCAL_WINDOW; i++) {
+			g->accm_sum = vec3add2(g->accm_sum, g->accm[i]);
+			g->accm_sq = vec3add2(g->accm_sq, square(g->accm[i]));
+			g->gyro_sum = vec3add2(g->gyro_sum, g->gyro[i]);
+			g->gyro_sq = vec3add2(g->gyro_sq, square(g->gyro[i]));
+		}
+	}
+
+	if (g->len < GYROCAL_WINDOW)
+		return false;
+
+	float accm_var = spread(g->accm_sum, g->accm_sq, g->len);
+	float gyro_var = spread(g->gyro_sum, g->gyro_sq, g->len);
+
+	return accm_var < g->accm_noise * g->accm_noise &&
+	       gyro_var < g->gyro_noise * g->gyro_noise;
+}
+
+
+/* Exponentially weighted regression of the bias on the temperature. */
+static void fit_slope(gyrocal *g, vec3 gyro, float temp)
+{
+	if (!g->fitting) {
+		g->temp_mean = temp;
+		g->gyro_mean = gyro;
+		g->fitting = true;
+		return;
+	}
+
+	float b = g->beta;
+	float d = temp - g->temp_mean;
+	vec3 e = vec3add2(gyro, vec3scale(-1, g->gyro_mean));
+
+	g->temp_mean += b * d;
+	g->gyro_mean = vec3add2(g->gyro_mean, vec3scale(b, e));
+
+	g->temp_var = (1 - b) * (g->temp_var + b * d * d);
+	g->cov = vec3scale(1 - b, vec3add2(g->cov, vec3scale(b * d, e)));
+
+	if (g->temp_var >= MIN_TEMP_VAR)
+		g->slope = vec3scale(1 / g->temp_var, g->cov);
+}
+
+
+vec3 gyrocal_update(gyrocal *g, vec3 accm, vec3 gyro, float temp)
+{
+	g->temp = temp;
+
+	if (!g->primed) {
+		g->ref_temp = temp;
+		g->primed = true;
+	}
+
+	g->resting = window_push(g, accm, gyro);
+
+	if (g->resting) {
+		fit_slope(g, gyro, temp);
+
+		/* Bias observed now, moved to the reference temperature. */
+		vec3 off = vec3scale(temp - g->ref_temp, g->slope);
+		vec3 seen = vec3add2(gyro, vec3scale(-1, off));
+
+		g->bias = vec3add2(g->bias, vec3scale(g->alpha,
+		                   vec3add2(seen, vec3scale(-1, g->bias))));
+	}
+
+	return vec3add2(gyro, vec3scale(-1, gyrocal_bias(g)));
+}
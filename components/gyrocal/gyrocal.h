@@ -0,0 +1,107 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_GYROCAL_H
+#define _COMPONENT_GYROCAL_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * Gyroscope Calibration
+ * =====================
+ *
+ * Tracks the gyroscope bias whenever the device rests, so that it can
+ * be removed before the integration. The device rests when neither the
+ * accelerometer nor the gyroscope readings spread much over a sliding
+ * window of recent samples. Every sample taken at rest then moves the
+ * bias estimate a little towards itself.
+ *
+ * Bias drifts with temperature, mostly while the board warms up. The
+ * drift is modelled as linear, with the slope fitted over a longer
+ * horizon than the bias itself, so that the bias keeps following the
+ * temperature even while the device moves. Without enough change of
+ * temperature at rest, the last slope is kept.
+ *
+ * Steady rotation slower than the spread threshold cannot be told
+ * from bias. Heads do not turn like that for long.
+ */
+
+/* Number of samples to judge rest by. */
+#define GYROCAL_WINDOW 64
+
+
+struct gyrocal {
+	/* Largest spread at rest, in m/s² and rad/s over all axes. */
+	float accm_noise, gyro_noise;
+
+	/* Smoothing factors of the bias and of the temperature fit. */
+	float alpha, beta;
+
+	/* Bias at the reference temperature and its change per °C. */
+	vec3 bias, slope;
+	float ref_temp;
+
+	/* Temperature of the last sample, in °C. */
+	float temp;
+
+	/* Whether the reference temperature has been chosen. */
+	bool primed;
+
+	/* Weighted means, variance and covariance for the slope. */
+	float temp_mean, temp_var;
+	vec3 gyro_mean, cov;
+	bool fitting;
+
+	/* Recent samples with their sums and sums of squares. */
+	vec3 accm[GYROCAL_WINDOW], gyro[GYROCAL_WINDOW];
+	vec3 accm_sum, accm_sq, gyro_sum, gyro_sq;
+	unsigned pos, len;
+
+	/* Whether the device rested during the whole window. */
+	bool resting;
+};
+
+typedef struct gyrocal gyrocal;
+
+
+/*
+ * Start without any bias. The bias follows resting samples taken `dt`
+ * seconds apart with time constant `tau` seconds.
+ */
+void gyrocal_init(gyrocal *g, float accm_noise, float gyro_noise,
+                  float tau, float dt);
+
+/* Continue from a bias found earlier, at whatever temperature comes. */
+void gyrocal_set_bias(gyrocal *g, vec3 bias);
+
+/*
+ * Feed a sample with its temperature in °C. Returns the gyroscope
+ * reading without the bias.
+ */
+vec3 gyrocal_update(gyrocal *g, vec3 accm, vec3 gyro, float temp);
+
+/* Current bias estimate, at the temperature of the last sample. */
+inline static vec3 gyrocal_bias(const gyrocal *g)
+{
+	return vec3add2(g->bias, vec3scale(g->temp - g->ref_temp, g->slope));
+}
+
+
+#endif				/* !_COMPONENT_GYROCAL_H */
@@ -16,6 +16,34 @@
 
 #include <esp_log.h>
 #include <esp_err.h>
+#include <esp_idf_version.h>
+#include <driver/gpio.h>
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+# include <esp_rom_sys.h>
+# define delay_us esp_rom_delay_us
+#else
+# include <rom/ets_sys.h>
+# define delay_us ets_delay_us
+#endif
+
+/*
+ * Newer drivers are able to build command links in a buffer we
+ * provide. Older ones allocate every command on the heap and consume
+ * the link while running it, so that it cannot even be reused. There
+ * we program the controller ourselves, see xfer() below.
+ */
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+# define USE_LINKS 1
+#else
+# define USE_LINKS 0
+# include <soc/soc.h>
+# include <soc/i2c_reg.h>
+# include <esp_timer.h>
+# if CONFIG_PM_ENABLE
+#  include <esp_pm.h>
+# endif
+#endif
 
 #include <i2ce.h>
 
@@ -23,11 +51,57 @@
 static const char *tag = "i2ce";
 
 
-void i2ce_master_init(i2c_port_t port,
-                      uint8_t sda, uint8_t scl,
-                      uint32_t freq)
+/* Half of the SCL period during recovery, Standard-mode is safe. */
+#define RECOVER_HALF_US 5
+
+
+/* Everything needed to install the driver anew, with the counters. */
+struct bus {
+	i2c_config_t conf;
+	bool installed;
+	i2ce_stats stats;
+
+#if USE_LINKS
+	TickType_t timeout;
+#else
+	/* Longest a transaction may take, in μs. */
+	int64_t timeout;
+
+#if CONFIG_PM_ENABLE
+	/* Keeps the APB clock, and thus SCL, from changing under us. */
+	esp_pm_lock_handle_t pm_lock;
+#endif
+#endif
+};
+
+static struct bus buses[I2C_NUM_MAX];
+
+
+static esp_err_t install(i2c_port_t port)
 {
-	i2c_config_t conf = {
+	struct bus *bus = buses + port;
+	esp_err_t err = i2c_param_config(port, &bus->conf);
+
+	if (!err)
+		err = i2c_driver_install(port, I2C_MODE_MASTER, 0, 0, 0);
+
+	bus->installed = !err;
+	return err;
+}
+
+
+esp_err_t i2ce_master_init(i2c_port_t port,
+                           uint8_t sda, uint8_t scl,
+                           uint32_t freq, unsigned timeout)
+{
+	if (freq > I2CE_FREQ_MAX) {
+		ESP_LOGW(tag, "Clamping I2C clock to %u Hz.", I2CE_FREQ_MAX);
+		freq = I2CE_FREQ_MAX;
+	}
+
+	struct bus *bus = buses + port;
+
+	bus->conf = (i2c_config_t){
 		.mode = I2C_MODE_MASTER,
 		.sda_io_num = sda,
 		.scl_io_num = scl,
@@ -36,75 +110,382 @@ void i2ce_master_init(i2c_port_t port,
 		},
 	};
 
+#if USE_LINKS
+	/* Waiting for a single tick may end at the very next one. */
+	bus->timeout = (timeout + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+	bus->timeout += 1;
+#else
+	bus->timeout = timeout * 1000ll;
+
+#if CONFIG_PM_ENABLE
+	if (!bus->pm_lock) {
+		esp_err_t err = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0,
+		                                   "i2ce", &bus->pm_lock);
+
+		if (err)
+			return err;
+	}
+#endif
+#endif
+
 	ESP_LOGI(tag, "Initializing I2C master %i...", (int)port);
-	ESP_ERROR_CHECK(i2c_param_config(port, &conf));
-	ESP_ERROR_CHECK(i2c_driver_install(port, conf.mode, 0, 0, 0));
+	return install(port);
 }
 
 
-void i2ce_write(i2c_port_t port,
-                uint8_t addr, uint8_t cmd,
-                const void *src, size_t len)
+esp_err_t i2ce_recover(i2c_port_t port)
 {
-	i2c_cmd_handle_t buf = i2c_cmd_link_create();
-	i2c_master_start(buf);
+	struct bus *bus = buses + port;
+	int sda = bus->conf.sda_io_num;
+	int scl = bus->conf.scl_io_num;
 
-	i2c_master_write_byte(buf, (addr << 1) | I2C_MASTER_WRITE, 1);
-	i2c_master_write_byte(buf, cmd, 1);
-	i2c_master_write(buf, (uint8_t *)src, len, 1);
-	i2c_master_stop(buf);
+	ESP_LOGW(tag, "Recovering I2C bus %i...", (int)port);
+	bus->stats.recoveries++;
 
-	ESP_ERROR_CHECK(i2c_master_cmd_begin(port, buf, pdMS_TO_TICKS(1000)));
+	/* Might have been deleted by a failed recovery already. */
+	i2c_driver_delete(port);
+	bus->installed = false;
 
-	i2c_cmd_link_delete(buf);
+	gpio_config_t conf = {
+		.pin_bit_mask = (1ull << sda) | (1ull << scl),
+		.mode = GPIO_MODE_INPUT_OUTPUT_OD,
+		.pull_up_en = GPIO_PULLUP_ENABLE,
+	};
+
+	esp_err_t err = gpio_config(&conf);
+
+	if (err)
+		return err;
+
+	gpio_set_level(sda, 1);
+	gpio_set_level(scl, 1);
+	delay_us(RECOVER_HALF_US);
+
+	/* Slave lets go after the rest of its byte and the ACK bit. */
+	for (int i = 0; i < 9 && !gpio_get_level(sda); i++) {
+		gpio_set_level(scl, 0);
+		delay_us(RECOVER_HALF_US);
+		gpio_set_level(scl, 1);
+		delay_us(RECOVER_HALF_US);
+	}
+
+	/* Stop condition, SDA rising while SCL is high. */
+	gpio_set_level(scl, 0);
+	delay_us(RECOVER_HALF_US);
+	gpio_set_level(sda, 0);
+	delay_us(RECOVER_HALF_US);
+	gpio_set_level(scl, 1);
+	delay_us(RECOVER_HALF_US);
+	gpio_set_level(sda, 1);
+	delay_us(RECOVER_HALF_US);
+
+	/* Routes the pins back to the peripheral. */
+	return install(port);
 }
 
 
-void i2ce_put(i2c_port_t port, uint8_t addr, uint8_t cmd, uint8_t value)
+/*
+ * Count the failure of a transaction. Recover the bus when it got
+ * stuck or when the driver is gone after a failed recovery.
+ */
+static esp_err_t account(i2c_port_t port, esp_err_t err)
 {
-	i2ce_write(port, addr, cmd, &value, 1);
+	struct bus *bus = buses + port;
+
+	if (!err)
+		return ESP_OK;
+
+	bus->stats.errors++;
+
+	if (ESP_ERR_TIMEOUT == err)
+		bus->stats.timeouts++;
+
+	if (ESP_ERR_TIMEOUT == err || ESP_ERR_INVALID_STATE == err)
+		i2ce_recover(port);
+
+	return err;
 }
 
 
-void i2ce_read(i2c_port_t port,
-               uint8_t addr, uint8_t cmd,
-               void *dst, size_t len)
-{
-	i2c_cmd_handle_t buf;
+#if USE_LINKS
+/* Every transaction we issue fits into a link of this size. */
+#define LINK_SIZE I2C_LINK_RECOMMENDED_SIZE(2)
 
-	/* First activate the command. */
-	buf = i2c_cmd_link_create();
+
+static esp_err_t do_write(i2c_port_t port,
+                          uint8_t addr, uint8_t cmd,
+                          const void *src, size_t len)
+{
+	uint8_t mem[LINK_SIZE];
+	i2c_cmd_handle_t buf = i2c_cmd_link_create_static(mem, sizeof(mem));
 	i2c_master_start(buf);
 
 	i2c_master_write_byte(buf, (addr << 1) | I2C_MASTER_WRITE, 1);
 	i2c_master_write_byte(buf, cmd, 1);
+	i2c_master_write(buf, (uint8_t *)src, len, 1);
 	i2c_master_stop(buf);
 
-	ESP_ERROR_CHECK(i2c_master_cmd_begin(port, buf, pdMS_TO_TICKS(1000)));
+	esp_err_t err = i2c_master_cmd_begin(port, buf, buses[port].timeout);
+
+	i2c_cmd_link_delete_static(buf);
+	return err;
+}
 
-	i2c_cmd_link_delete(buf);
 
-	/* Then read the reply. */
-	buf = i2c_cmd_link_create();
+static esp_err_t do_read(i2c_port_t port,
+                         uint8_t addr, uint8_t cmd,
+                         void *dst, size_t len)
+{
+	uint8_t mem[LINK_SIZE];
+	i2c_cmd_handle_t buf = i2c_cmd_link_create_static(mem, sizeof(mem));
+
+	/* First activate the command. */
+	i2c_master_start(buf);
+	i2c_master_write_byte(buf, (addr << 1) | I2C_MASTER_WRITE, 1);
+	i2c_master_write_byte(buf, cmd, 1);
+
+	/* Then read the reply after a repeated start. */
 	i2c_master_start(buf);
 	i2c_master_write_byte(buf, (addr << 1) | I2C_MASTER_READ, 1);
 	i2c_master_read(buf, dst, len, I2C_MASTER_LAST_NACK);
 	i2c_master_stop(buf);
 
-	ESP_ERROR_CHECK(i2c_master_cmd_begin(port, buf, pdMS_TO_TICKS(1000)));
+	esp_err_t err = i2c_master_cmd_begin(port, buf, buses[port].timeout);
 
-	i2c_cmd_link_delete(buf);
+	i2c_cmd_link_delete_static(buf);
+	return err;
 }
+#else
+/* Depth of the controller FIFOs, in bytes. */
+#define HW_FIFO_LEN 32
+
+/* Controller commands. */
+#define HW_RSTART 0
+#define HW_WRITE 1
+#define HW_READ 2
+#define HW_STOP 3
+#define HW_END 4
+
+/* Check that the slave acknowledged written bytes. */
+#define HW_ACK_CHECK BIT(8)
+
+/* Do not acknowledge read bytes, the last one of a read. */
+#define HW_NACK BIT(10)
+
+/* Every interrupt status bit. */
+#define HW_INTR_ALL 0x3fff
 
-void i2ce_set(i2c_port_t port,
-              uint8_t addr, uint8_t cmd,
-              uint8_t mask, uint8_t bits)
+/* Writes into the FIFO only work through its AHB address. */
+#define HW_FIFO_AHB(port) ((port) ? 0x6002701c : 0x6001301c)
+
+
+static void hw_command(i2c_port_t port, int idx,
+                       unsigned op, unsigned len, uint32_t flags)
+{
+	WRITE_PERI_REG(I2C_COMD0_REG(port) + 4 * idx, op << 11 | flags | len);
+}
+
+
+static void hw_put(i2c_port_t port, uint8_t byte)
+{
+	WRITE_PERI_REG(HW_FIFO_AHB(port), byte);
+}
+
+
+static uint8_t hw_get(i2c_port_t port)
+{
+	return READ_PERI_REG(I2C_DATA_APB_REG(port));
+}
+
+
+/* Run the commands, wait until they reach `until` or fail. */
+static esp_err_t hw_run(i2c_port_t port, int64_t deadline, uint32_t until)
+{
+	WRITE_PERI_REG(I2C_INT_CLR_REG(port), HW_INTR_ALL);
+	SET_PERI_REG_MASK(I2C_CTR_REG(port), I2C_TRANS_START);
+
+	while (true) {
+		uint32_t raw = READ_PERI_REG(I2C_INT_RAW_REG(port));
+
+		if (raw & (I2C_ACK_ERR_INT_RAW | I2C_ARBITRATION_LOST_INT_RAW))
+			return ESP_FAIL;
+
+		if (raw & I2C_TIME_OUT_INT_RAW)
+			return ESP_ERR_TIMEOUT;
+
+		if (raw & until)
+			return ESP_OK;
+
+		if (esp_timer_get_time() > deadline)
+			return ESP_ERR_TIMEOUT;
+	}
+}
+
+
+/*
+ * Send the address and the command, then either write `src` or read
+ * into `dst` after a repeated start, within a single transaction.
+ * Replies longer than the FIFO arrive in parts, the bus is paused
+ * while we collect each of them.
+ */
+static esp_err_t hw_xfer(i2c_port_t port, uint8_t addr, uint8_t cmd,
+                         const uint8_t *src, uint8_t *dst, size_t len)
+{
+	int64_t deadline = esp_timer_get_time() + buses[port].timeout;
+	int idx = 0;
+
+	SET_PERI_REG_MASK(I2C_FIFO_CONF_REG(port),
+	                  I2C_TX_FIFO_RST | I2C_RX_FIFO_RST);
+	CLEAR_PERI_REG_MASK(I2C_FIFO_CONF_REG(port),
+	                    I2C_TX_FIFO_RST | I2C_RX_FIFO_RST);
+
+	hw_put(port, (addr << 1) | I2C_MASTER_WRITE);
+	hw_put(port, cmd);
+	hw_command(port, idx++, HW_RSTART, 0, 0);
+
+	if (src) {
+		for (size_t i = 0; i < len; i++)
+			hw_put(port, src[i]);
+
+		hw_command(port, idx++, HW_WRITE, 2 + len, HW_ACK_CHECK);
+		hw_command(port, idx++, HW_STOP, 0, 0);
+
+		return hw_run(port, deadline, I2C_TRANS_COMPLETE_INT_RAW);
+	}
+
+	hw_put(port, (addr << 1) | I2C_MASTER_READ);
+	hw_command(port, idx++, HW_WRITE, 2, HW_ACK_CHECK);
+	hw_command(port, idx++, HW_RSTART, 0, 0);
+	hw_command(port, idx++, HW_WRITE, 1, HW_ACK_CHECK);
+
+	while (true) {
+		size_t part = len > HW_FIFO_LEN ? HW_FIFO_LEN : len;
+		uint32_t until;
+
+		if (part == len) {
+			if (part > 1)
+				hw_command(port, idx++, HW_READ, part - 1, 0);
+
+			hw_command(port, idx++, HW_READ, 1, HW_NACK);
+			hw_command(port, idx++, HW_STOP, 0, 0);
+			until = I2C_TRANS_COMPLETE_INT_RAW;
+		} else {
+			hw_command(port, idx++, HW_READ, part, 0);
+			hw_command(port, idx++, HW_END, 0, 0);
+			until = I2C_END_DETECT_INT_RAW;
+		}
+
+		esp_err_t err = hw_run(port, deadline, until);
+
+		if (err)
+			return err;
+
+		for (size_t i = 0; i < part; i++)
+			*dst++ = hw_get(port);
+
+		if (!(len -= part))
+			return ESP_OK;
+
+		/* Continue with the first command. */
+		idx = 0;
+	}
+}
+
+
+/*
+ * Run a transaction with the driver interrupts masked, so that it
+ * does not take our events for its own.
+ */
+static esp_err_t xfer(i2c_port_t port, uint8_t addr, uint8_t cmd,
+                      const uint8_t *src, uint8_t *dst, size_t len)
+{
+	struct bus *bus = buses + port;
+
+	if (!bus->installed)
+		return ESP_ERR_INVALID_STATE;
+
+#if CONFIG_PM_ENABLE
+	esp_pm_lock_acquire(bus->pm_lock);
+#endif
+
+	uint32_t ena = READ_PERI_REG(I2C_INT_ENA_REG(port));
+	WRITE_PERI_REG(I2C_INT_ENA_REG(port), 0);
+
+	esp_err_t err = hw_xfer(port, addr, cmd, src, dst, len);
+
+	WRITE_PERI_REG(I2C_INT_CLR_REG(port), HW_INTR_ALL);
+	WRITE_PERI_REG(I2C_INT_ENA_REG(port), ena);
+
+#if CONFIG_PM_ENABLE
+	esp_pm_lock_release(bus->pm_lock);
+#endif
+
+	return err;
+}
+
+
+static esp_err_t do_write(i2c_port_t port,
+                          uint8_t addr, uint8_t cmd,
+                          const void *src, size_t len)
+{
+	return xfer(port, addr, cmd, src, NULL, len);
+}
+
+
+static esp_err_t do_read(i2c_port_t port,
+                         uint8_t addr, uint8_t cmd,
+                         void *dst, size_t len)
+{
+	return xfer(port, addr, cmd, NULL, dst, len);
+}
+#endif
+
+
+esp_err_t i2ce_write(i2c_port_t port,
+                     uint8_t addr, uint8_t cmd,
+                     const void *src, size_t len)
+{
+	if (len > I2CE_WRITE_MAX)
+		return ESP_ERR_INVALID_SIZE;
+
+	return account(port, do_write(port, addr, cmd, src, len));
+}
+
+
+esp_err_t i2ce_put(i2c_port_t port, uint8_t addr, uint8_t cmd, uint8_t value)
+{
+	return i2ce_write(port, addr, cmd, &value, 1);
+}
+
+
+esp_err_t i2ce_read(i2c_port_t port,
+                    uint8_t addr, uint8_t cmd,
+                    void *dst, size_t len)
+{
+	if (!len)
+		return ESP_ERR_INVALID_SIZE;
+
+	return account(port, do_read(port, addr, cmd, dst, len));
+}
+
+
+esp_err_t i2ce_set(i2c_port_t port,
+                   uint8_t addr, uint8_t cmd,
+                   uint8_t mask, uint8_t bits)
 {
 	uint8_t buf[1];
+	esp_err_t err = i2ce_read(port, addr, cmd, &buf, 1);
 
-	i2ce_read(port, addr, cmd, &buf, 1);
+	if (err)
+		return err;
 
 	buf[0] = (buf[0] & mask) | bits;
 
-	i2ce_write(port, addr, cmd, buf, 1);
+	return i2ce_write(port, addr, cmd, buf, 1);
+}
+
+
+i2ce_stats i2ce_get_stats(i2c_port_t port)
+{
+	return buses[port].stats;
 }
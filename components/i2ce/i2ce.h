@@ -19,6 +19,7 @@
 
 #include <stdlib.h>
 
+#include <esp_err.h>
 #include <driver/i2c.h>
 
 
@@ -28,35 +29,79 @@
  *
  * Wraps ESP-IDF <driver/i2c.h> in a less verbose interface geared
  * towards typical I2C usage with mandatory ACKs and command codes.
+ *
+ * Transactions report failures instead of aborting. A transaction
+ * that times out is taken for a stuck bus, which is recovered before
+ * the error is returned, so that the next transaction may succeed.
+ *
+ * Transactions never touch the heap, so that they can run at the full
+ * sample rate. Each port is only ever used by a single task at once.
  */
 
-/* Initialize the I2C master. */
-void i2ce_master_init(i2c_port_t port,
-                      uint8_t sda, uint8_t scl,
-                      uint32_t freq);
+/* Highest bus frequency supported, the Fast-mode. */
+#define I2CE_FREQ_MAX 400000
+
+/* Longest payload of a single write, in bytes. */
+#define I2CE_WRITE_MAX 30
 
-/* First send the command, then write the payload. */
-void i2ce_write(i2c_port_t port,
-                uint8_t addr, uint8_t cmd,
-                const void *src, size_t len);
+/*
+ * Initialize the I2C master. Every transaction is given at least
+ * `timeout` ms, rounded up to whole ticks, before it is abandoned.
+ */
+esp_err_t i2ce_master_init(i2c_port_t port,
+                           uint8_t sda, uint8_t scl,
+                           uint32_t freq, unsigned timeout);
+
+/* First send the command, then write up to I2CE_WRITE_MAX bytes. */
+esp_err_t i2ce_write(i2c_port_t port,
+                     uint8_t addr, uint8_t cmd,
+                     const void *src, size_t len);
 
 /* Same as i2ce_write, but send just a single byte. */
-void i2ce_put(i2c_port_t port,
-              uint8_t addr, uint8_t cmd,
-              uint8_t value);
+esp_err_t i2ce_put(i2c_port_t port,
+                   uint8_t addr, uint8_t cmd,
+                   uint8_t value);
 
-/* First send the command, then read the reply. */
-void i2ce_read(i2c_port_t port,
-               uint8_t addr, uint8_t cmd,
-               void *dst, size_t len);
+/*
+ * First send the command, then read the reply after a repeated start.
+ * Both happen within a single transaction.
+ */
+esp_err_t i2ce_read(i2c_port_t port,
+                    uint8_t addr, uint8_t cmd,
+                    void *dst, size_t len);
 
 /*
  * First read the byte using i2ce_read(), then apply the mask,
  * then set the bits and then write the result back.
  */
-void i2ce_set(i2c_port_t port,
-              uint8_t addr, uint8_t cmd,
-              uint8_t mask, uint8_t bits);
+esp_err_t i2ce_set(i2c_port_t port,
+                   uint8_t addr, uint8_t cmd,
+                   uint8_t mask, uint8_t bits);
+
+/*
+ * Free the bus from a slave holding SDA low in the middle of a byte
+ * by clocking SCL until it lets go, end with a stop condition and
+ * install the driver anew.
+ */
+esp_err_t i2ce_recover(i2c_port_t port);
+
+
+/* Failures of a port, since the start. */
+struct i2ce_stats {
+	/* Transactions that failed, for whatever reason. */
+	unsigned errors;
+
+	/* Those of them that timed out. */
+	unsigned timeouts;
+
+	/* Bus recoveries, whether automatic or requested. */
+	unsigned recoveries;
+};
+
+typedef struct i2ce_stats i2ce_stats;
+
+/* Get failure counters of the port. */
+i2ce_stats i2ce_get_stats(i2c_port_t port);
 
 
 #endif				/* !_COMPONENT_I2CE_H */
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <magcal.h>
+
+
+/* Minimum angle between readings used for the fit, in radians. */
+#define MIN_ANGLE 0.05
+
+/* Readings used before the first and between subsequent solutions. */
+#define SOLVE_EVERY 100
+
+/* Maximum ratio between the longest and the shortest ellipsoid axis. */
+#define MAX_RATIO 2.0
+
+/* Initial covariance, large since we know nothing yet. */
+#define INITIAL_P 1000.0
+
+
+void magcal_init(magcal *c, vec3 hard, mat3 soft, float scale)
+{
+	memset(c, 0, sizeof(*c));
+
+	c->hard = hard;
+	c->soft = soft;
+	c->scale = scale;
+	c->lambda = 0.9995;
+
+	for (int i = 0; i < MAGCAL_PARAMS; i++)
+		c->P[i][i] = INITIAL_P;
+}
+
+
+/* Find eigenvalues `d` and eigenvectors (columns of `v`) using Jacobi. */
+static void eigen3(float a[3][3], float d[3], float v[3][3])
+{
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			v[i][j] = i == j;
+
+	for (int sweep = 0; sweep < 32; sweep++) {
+		/* Pick the largest off-diagonal element. */
+		int p = 0, q = 1;
+
+		if (fabsf(a[0][2]) > fabsf(a[p][q]))
+			p = 0, q = 2;
+
+		if (fabsf(a[1][2]) > fabsf(a[p][q]))
+			p = 1, q = 2;
+
+		if (fabsf(a[p][q]) < 1e-9f)
+			break;
+
+		/* Rotate it away. */
+		float theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+		float t = copysignf(1, theta) /
+		          (fabsf(theta) + sqrtf(theta * theta + 1));
+		float cs = 1 / sqrtf(t * t + 1);
+		float sn = t * cs;
+
+		for (int k = 0; k < 3; k++) {
+			float akp = a[k][p], akq = a[k][q];
+			a[k][p] = cs * akp - sn * akq;
+			a[k][q] = sn * akp + cs * akq;
+		}
+
+		for (int k = 0; k < 3; k++) {
+			float apk = a[p][k], aqk = a[q][k];
+			a[p][k] = cs * apk - sn * aqk;
+			a[q][k] = sn * apk + cs * aqk;
+		}
+
+		for (int k = 0; k < 3; k++) {
+			float vkp = v[k][p], vkq = v[k][q];
+			v[k][p] = cs * vkp - sn * vkq;
+			v[k][q] = sn * vkp + cs * vkq;
+		}
+	}
+
+	for (int i = 0; i < 3; i++)
+		d[i] = a[i][i];
+}
+
+
+/* Turn the quadric into the correction, if it is plausible. */
+static bool solve(magcal *c)
+{
+	const float *t = c->theta;
+
+	float A[3][3] = {
+		{t[0], t[3], t[4]},
+		{t[3], t[1], t[5]},
+		{t[4], t[5], t[2]},
+	};
+
+	/* Center is where the gradient vanishes, -A⁻¹ (g h i). */
+	float det = A[0][0] * (A[1][1] * A[2][2] - A[1][2] * A[2][1])
+	          - A[0][1] * (A[1][0] * A[2][2] - A[1][2] * A[2][0])
+	          + A[0][2] * (A[1][0] * A[2][1] - A[1][1] * A[2][0]);
+
+	if (fabsf(det) < 1e-12f)
+		return false;
+
+	float inv[3][3] = {
+		{
+			(A[1][1] * A[2][2] - A[1][2] * A[2][1]) / det,
+			(A[0][2] * A[2][1] - A[0][1] * A[2][2]) / det,
+			(A[0][1] * A[1][2] - A[0][2] * A[1][1]) / det,
+		}, {
+			(A[1][2] * A[2][0] - A[1][0] * A[2][2]) / det,
+			(A[0][0] * A[2][2] - A[0][2] * A[2][0]) / det,
+			(A[0][2] * A[1][0] - A[0][0] * A[1][2]) / det,
+		}, {
+			(A[1][0] * A[2][1] - A[1][1] * A[2][0]) / det,
+			(A[0][1] * A[2][0] - A[0][0] * A[2][1]) / det,
+			(A[0][0] * A[1][1] - A[0][1] * A[1][0]) / det,
+		},
+	};
+
+	float center[3];
+
+	for (int i = 0; i < 3; i++)
+		center[i] = -(inv[i][0] * t[6] + inv[i][1] * t[7] +
+		              inv[i][2] * t[8]);
+
+	/* Shifted to the center, the quadric becomes x' A x' = k. */
+	float k = 1;
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			k += center[i] * A[i][j] * center[j];
+
+	/*
+	 * When the origin lies outside of the ellipsoid, the whole
+	 * equation comes out negated. Flip it back.
+	 */
+	if (k < 0) {
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 3; j++)
+				A[i][j] = -A[i][j];
+
+		k = -k;
+	}
+
+	if (k < 1e-12f)
+		return false;
+
+	float d[3], v[3][3];
+	eigen3(A, d, v);
+
+	/* Semi-axes of the ellipsoid, all of them must be real. */
+	float r[3];
+
+	for (int i = 0; i < 3; i++) {
+		if (d[i] <= 0)
+			return false;
+
+		r[i] = sqrtf(k / d[i]);
+	}
+
+	float rmin = minf(r[0], minf(r[1], r[2]));
+	float rmax = maxf(r[0], maxf(r[1], r[2]));
+
+	if (rmax > MAX_RATIO * rmin)
+		return false;
+
+	/* Scale every axis to the mean radius. */
+	float mean = cbrtf(r[0] * r[1] * r[2]);
+	mat3 soft;
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			float sum = 0;
+
+			for (int n = 0; n < 3; n++)
+				sum += v[i][n] * (mean / r[n]) * v[j][n];
+
+			soft.col[j].row[i] = sum;
+		}
+	}
+
+	c->soft = soft;
+	c->hard = (vec3){{
+		center[0] / c->scale,
+		center[1] / c->scale,
+		center[2] / c->scale,
+	}};
+
+	return true;
+}
+
+
+bool magcal_update(magcal *c, vec3 raw)
+{
+	vec3 x = vec3scale(c->scale, raw);
+
+	if (c->used && vec3mag(x) > 0 && vec3mag(c->last) > 0) {
+		/* Skip readings that do not bring anything new. */
+		float cosa = vec3dot(vec3unit(x), vec3unit(c->last));
+
+		if (cosa > cosf(MIN_ANGLE))
+			return false;
+	}
+
+	c->last = x;
+	c->used++;
+
+	float px = x.row[0], py = x.row[1], pz = x.row[2];
+	float phi[MAGCAL_PARAMS] = {
+		px * px, py * py, pz * pz,
+		2 * px * py, 2 * px * pz, 2 * py * pz,
+		2 * px, 2 * py, 2 * pz,
+	};
+
+	/*
+	 * Directions the readings do not excite would have their
+	 * covariance grow without bounds, so stop forgetting once
+	 * it gets back to where we started.
+	 */
+	float trace = 0;
+
+	for (int i = 0; i < MAGCAL_PARAMS; i++)
+		trace += c->P[i][i];
+
+	float lambda = trace < MAGCAL_PARAMS * INITIAL_P ? c->lambda : 1;
+
+	/* Gain vector k = P φ / (λ + φᵀ P φ). */
+	float Pphi[MAGCAL_PARAMS];
+	float denom = lambda;
+	float err = 1;
+
+	for (int i = 0; i < MAGCAL_PARAMS; i++) {
+		Pphi[i] = 0;
+
+		for (int j = 0; j < MAGCAL_PARAMS; j++)
+			Pphi[i] += c->P[i][j] * phi[j];
+
+		denom += phi[i] * Pphi[i];
+		err -= phi[i] * c->theta[i];
+	}
+
+	for (int i = 0; i < MAGCAL_PARAMS; i++)
+		c->theta[i] += Pphi[i] / denom * err;
+
+	/* P = (P - k φᵀ P) / λ, kept exactly symmetric. */
+	for (int i = 0; i < MAGCAL_PARAMS; i++) {
+		for (int j = i; j < MAGCAL_PARAMS; j++) {
+			float p = (c->P[i][j] - Pphi[i] * Pphi[j] / denom) /
+			          lambda;
+			c->P[i][j] = c->P[j][i] = p;
+		}
+	}
+
+	if (c->used % SOLVE_EVERY)
+		return false;
+
+	return solve(c);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_MAGCAL_H
+#define _COMPONENT_MAGCAL_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * Magnetometer Calibration
+ * ========================
+ *
+ * Readings distorted by hard and soft iron lie on an ellipsoid instead
+ * of a sphere. We fit a general quadric
+ *
+ *   a x² + b y² + c z² + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+ *
+ * to the readings using recursive least squares with exponential
+ * forgetting, so that the fit keeps tracking slow changes in constant
+ * memory. Every so often the quadric is turned into a hard iron offset
+ * and a symmetric soft iron matrix that maps the ellipsoid back onto
+ * a sphere of the same mean radius:
+ *
+ *   calibrated = soft * (raw - hard)
+ *
+ * A new solution only replaces the current one when it is a plausible
+ * ellipsoid, so a poor fit never makes things worse.
+ */
+
+#define MAGCAL_PARAMS 9
+
+
+struct magcal {
+	/* Current correction. */
+	vec3 hard;
+	mat3 soft;
+
+	/* Readings are multiplied by this to keep the numbers near 1. */
+	float scale;
+
+	/* Forgetting factor, slightly below 1. */
+	float lambda;
+
+	/* Quadric coefficients and their covariance. */
+	float theta[MAGCAL_PARAMS];
+	float P[MAGCAL_PARAMS][MAGCAL_PARAMS];
+
+	/* Last reading used and number of readings used so far. */
+	vec3 last;
+	unsigned used;
+};
+
+typedef struct magcal magcal;
+
+
+/*
+ * Start with the given correction. The `scale` should be about one
+ * over the expected field magnitude in the raw units.
+ */
+void magcal_init(magcal *c, vec3 hard, mat3 soft, float scale);
+
+/*
+ * Feed an uncorrected reading. Readings too close to the last one used
+ * are ignored, so that resting in one place does not skew the fit.
+ * Returns true when the correction has just been updated.
+ */
+bool magcal_update(magcal *c, vec3 raw);
+
+/* Apply the current correction. */
+inline static vec3 magcal_apply(const magcal *c, vec3 raw)
+{
+	vec3 v = vec3add2(raw, vec3scale(-1, c->hard));
+
+	return vec3add3(vec3scale(v.row[0], c->soft.col[0]),
+	                vec3scale(v.row[1], c->soft.col[1]),
+	                vec3scale(v.row[2], c->soft.col[2]));
+}
+
+
+#endif				/* !_COMPONENT_MAGCAL_H */
@@ -14,6 +14,9 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <string.h>
+#include <math.h>
+
 #include <esp_log.h>
 #include <esp_err.h>
 
@@ -24,26 +27,35 @@
 static const char *tag = "mpu9250";
 
 
-/* I2C address to use. */
-static const uint8_t addr = 0x68;
-
-
-/* I2C master port to use. */
-static i2c_port_t port = -1;
+/* Standard gravity, in m/s². */
+#define GRAVITY 9.80665f
 
 
-void mpu9250_init(i2c_port_t _port)
+esp_err_t mpu9250_init(mpu9250 *dev, const regio *io,
+                       const mpu9250_config *cfg)
 {
-	ESP_LOGI(tag, "Initializing MPU9250...");
-	port = _port;
+	ESP_LOGI(tag, "Initializing MPU9250 at %#hhx...", io->addr);
+	dev->io = *io;
+	io = &dev->io;
 
 	/* Reset the internal registers and restore the default settings. */
-	i2ce_put(port, addr, 0x6b, 0x81);
+	REGIO_TRY(regio_put(io, 0x6b, 0x81));
+	vTaskDelay(pdMS_TO_TICKS(100));
 
 	/* Auto select the best available clock source:
 	 * PLL if ready, else use the Internal oscillator.
 	 */
-	i2ce_set(port, addr, 0x6b, 0xfe, 0x01);
+	REGIO_TRY(regio_set(io, 0x6b, 0xfe, 0x01));
+
+	if (REGIO_SPI == io->bus) {
+		/*
+		 * Primary I2C interface shares pins with the SPI and would
+		 * get confused by the traffic. Bypass mode is of no use,
+		 * so the auxiliary bus is left to the I2C master.
+		 */
+		REGIO_TRY(regio_set(io, 0x6a, 0xef, 0x10));
+		return mpu9250_configure(dev, cfg);
+	}
 
 	ESP_LOGI(tag, "Enabling MPU9250 bypass mode...");
 
@@ -51,46 +63,405 @@ void mpu9250_init(i2c_port_t _port)
 	 * Disable I2C Master I/F module;
 	 * pins ES_DA and ES_SCL are logically driven by pins SDA and SCL.
 	 */
-	i2ce_set(port, addr, 0x6a, 0xdf, 0x00);
+	REGIO_TRY(regio_set(io, 0x6a, 0xdf, 0x00));
 
 	/*
 	 * When asserted, the i2c_master interface pins (ES_CL and ES_DA)
 	 * will go into ‘bypass mode’ when the i2c master interface is
 	 * disabled.
 	 */
-	i2ce_set(port, addr, 0x37, 0xfd, 0x02);
+	REGIO_TRY(regio_set(io, 0x37, 0xfd, 0x02));
 
 	/* Make sure the bypass mode is active. */
 	uint8_t buf[1];
-	i2ce_read(port, addr, 0x37, buf, 1);
+	REGIO_TRY(regio_read(io, 0x37, buf, 1));
 
 	if (!(buf[0] & 0x02)) {
 		ESP_LOGE(tag, "Failed to enable bypass mode!");
-		abort();
+		return ESP_ERR_INVALID_RESPONSE;
 	}
+
+	return mpu9250_configure(dev, cfg);
 }
 
 
-void mpu9250_read_raw(float accm[3], float gyro[3], float temp[1])
+esp_err_t mpu9250_configure(mpu9250 *dev, const mpu9250_config *cfg)
 {
-	/* Layout: accm(xx yy zz) temp(tt) gyro(xx yy zz) in big-endian. */
-	uint8_t buf[14];
+	const regio *io = &dev->io;
+
+	if (cfg->gyro_fs > MPU9250_GYRO_2000DPS ||
+	    cfg->accm_fs > MPU9250_ACCM_16G ||
+	    cfg->dlpf < MPU9250_DLPF_184HZ || cfg->dlpf > MPU9250_DLPF_5HZ) {
+		ESP_LOGE(tag, "Invalid configuration!");
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	ESP_LOGI(tag, "Configuring MPU9250: ±%u °/s, ±%u g, DLPF %u, %u Hz",
+	         250u << cfg->gyro_fs, 2u << cfg->accm_fs, cfg->dlpf,
+	         1000u / (1u + cfg->smplrt_div));
+
+	/* Gyroscope DLPF, which also gives us 1 kHz internal sample rate. */
+	REGIO_TRY(regio_set(io, 0x1a, 0xb8, cfg->dlpf));
+
+	/* Gyroscope range, with the DLPF enabled (FCHOICE_B = 0). */
+	REGIO_TRY(regio_set(io, 0x1b, 0xe4, cfg->gyro_fs << 3));
+
+	/* Accelerometer range. */
+	REGIO_TRY(regio_set(io, 0x1c, 0xe7, cfg->accm_fs << 3));
+
+	/* Accelerometer DLPF, configuration values match the gyroscope. */
+	REGIO_TRY(regio_set(io, 0x1d, 0xf0, cfg->dlpf));
+
+	/* Divide the internal rate down to the output rate. */
+	REGIO_TRY(regio_put(io, 0x19, cfg->smplrt_div));
+
+	dev->accm_scale = (2 << cfg->accm_fs) * GRAVITY / 32768;
+	dev->gyro_scale = (250 << cfg->gyro_fs) * (float)M_PI / 180 / 32768;
+
+	return ESP_OK;
+}
+
+
+esp_err_t mpu9250_int_enable(const mpu9250 *dev, bool latch)
+{
+	const regio *io = &dev->io;
+
+	ESP_LOGI(tag, "Enabling MPU9250 data-ready interrupt...");
+
+	/*
+	 * Active high, push-pull, either 50 μs pulse or held until
+	 * the next read. Keep the bypass mode bit as it is.
+	 */
+	REGIO_TRY(regio_set(io, 0x37, 0x0f, latch ? 0x30 : 0x00));
+
+	/* Raw sensor data ready interrupt only. */
+	return regio_put(io, 0x38, 0x01);
+}
+
+
+static esp_err_t master_enable(const regio *io)
+{
+	ESP_LOGI(tag, "Enabling MPU9250 I2C master mode...");
+
+	/* Pins ES_DA and ES_SCL are no longer driven by SDA and SCL. */
+	REGIO_TRY(regio_set(io, 0x37, 0xfd, 0x00));
+
+	/*
+	 * Run the auxiliary bus at 400 kHz and delay the data-ready
+	 * interrupt until the external sensor data are loaded.
+	 */
+	REGIO_TRY(regio_put(io, 0x24, 0x4d));
+
+	/* Enable the I2C Master I/F module. */
+	REGIO_TRY(regio_set(io, 0x6a, 0xdf, 0x20));
+
+	/* Make sure the master mode is active. */
+	uint8_t buf[1];
+	REGIO_TRY(regio_read(io, 0x6a, buf, 1));
+
+	if (!(buf[0] & 0x20)) {
+		ESP_LOGE(tag, "Failed to enable I2C master mode!");
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	return ESP_OK;
+}
 
-	i2ce_read(port, addr, 0x3b, buf, sizeof(buf));
 
-	if (accm) {
-		accm[0] = (int16_t)((buf[ 0] << 8) | buf[ 1]);
-		accm[1] = (int16_t)((buf[ 2] << 8) | buf[ 3]);
-		accm[2] = (int16_t)((buf[ 4] << 8) | buf[ 5]);
+esp_err_t mpu9250_enable_master(const mpu9250 *dev,
+                                uint8_t slave, uint8_t reg, uint8_t len)
+{
+	const regio *io = &dev->io;
+
+	if (len > MPU9250_EXT_MAX) {
+		ESP_LOGE(tag, "Cannot fetch %hhu bytes via I2C master!", len);
+		return ESP_ERR_INVALID_SIZE;
 	}
 
+	REGIO_TRY(master_enable(io));
+
+	/* Slave 0 reads `len` bytes from the `reg` of the `slave`. */
+	REGIO_TRY(regio_put(io, 0x25, 0x80 | slave));
+	REGIO_TRY(regio_put(io, 0x26, reg));
+	return regio_put(io, 0x27, 0x80 | len);
+}
+
+
+/*
+ * Run a single byte transfer on the auxiliary bus using slave 4.
+ * It happens during the next sample, so wait for it a bit.
+ */
+static esp_err_t aux_transfer(const regio *io, uint8_t slave, uint8_t reg,
+                              uint8_t value, uint8_t *reply)
+{
+	REGIO_TRY(regio_put(io, 0x31, slave));
+	REGIO_TRY(regio_put(io, 0x32, reg));
+	REGIO_TRY(regio_put(io, 0x33, value));
+	REGIO_TRY(regio_put(io, 0x34, 0x80));
+
+	for (int i = 0; i < 300; i++) {
+		uint8_t buf[1];
+
+		/* Reading the status clears it. */
+		REGIO_TRY(regio_read(io, 0x36, buf, 1));
+
+		if (buf[0] & 0x10) {
+			ESP_LOGE(tag, "Auxiliary slave %#hhx did not ACK!",
+			         (uint8_t)(slave & 0x7f));
+			return ESP_FAIL;
+		}
+
+		if (buf[0] & 0x40)
+			return reply ? regio_read(io, 0x35, reply, 1) : ESP_OK;
+
+		vTaskDelay(pdMS_TO_TICKS(1));
+	}
+
+	ESP_LOGE(tag, "Auxiliary bus transfer timed out!");
+	return ESP_ERR_TIMEOUT;
+}
+
+
+static esp_err_t aux_read(const regio *aux, uint8_t reg,
+                          void *dst, size_t len)
+{
+	const mpu9250 *dev = aux->master;
+	uint8_t *buf = dst;
+
+	for (size_t i = 0; i < len; i++) {
+		REGIO_TRY(aux_transfer(&dev->io, 0x80 | aux->addr, reg + i,
+		                       0, buf + i));
+	}
+
+	return ESP_OK;
+}
+
+
+static esp_err_t aux_write(const regio *aux, uint8_t reg,
+                           const void *src, size_t len)
+{
+	const mpu9250 *dev = aux->master;
+	const uint8_t *buf = src;
+
+	for (size_t i = 0; i < len; i++) {
+		REGIO_TRY(aux_transfer(&dev->io, aux->addr, reg + i,
+		                       buf[i], NULL));
+	}
+
+	return ESP_OK;
+}
+
+
+esp_err_t mpu9250_aux_init(const mpu9250 *dev, regio *aux, uint8_t slave)
+{
+	REGIO_TRY(master_enable(&dev->io));
+
+	*aux = (regio){
+		.read = aux_read,
+		.write = aux_write,
+		.bus = REGIO_AUX,
+		.addr = slave,
+		.master = dev,
+	};
+
+	return ESP_OK;
+}
+
+
+void mpu9250_get_scale(const mpu9250 *dev, float *accm, float *gyro)
+{
+	*accm = dev->accm_scale;
+	*gyro = dev->gyro_scale;
+}
+
+
+/* Convert three big-endian axes to physical units. */
+static void decode(float dst[3], const uint8_t *buf, float scale)
+{
+	dst[0] = (int16_t)((buf[0] << 8) | buf[1]) * scale;
+	dst[1] = (int16_t)((buf[2] << 8) | buf[3]) * scale;
+	dst[2] = (int16_t)((buf[4] << 8) | buf[5]) * scale;
+}
+
+
+/* Convert three big-endian axes to host order. */
+static void decode_counts(int16_t dst[3], const uint8_t *buf)
+{
+	dst[0] = (buf[0] << 8) | buf[1];
+	dst[1] = (buf[2] << 8) | buf[3];
+	dst[2] = (buf[4] << 8) | buf[5];
+}
+
+
+esp_err_t mpu9250_read_raw(const mpu9250 *dev,
+                           float accm[3], float gyro[3], float temp[1])
+{
+	return mpu9250_read_raw_ext(dev, accm, gyro, temp, NULL, 0);
+}
+
+
+esp_err_t mpu9250_read_raw_ext(const mpu9250 *dev,
+                               float accm[3], float gyro[3], float temp[1],
+                               uint8_t *ext, size_t len)
+{
+	/* The sample is followed directly by the EXT_SENS_DATA registers. */
+	uint8_t buf[MPU9250_DATA_LEN + MPU9250_EXT_MAX];
+
+	if (len > MPU9250_EXT_MAX)
+		len = MPU9250_EXT_MAX;
+
+	REGIO_TRY(regio_read_fast(&dev->io, 0x3b, buf, MPU9250_DATA_LEN + len));
+
+	mpu9250_decode(dev, buf, accm, gyro, temp);
+
+	if (ext) {
+		memcpy(ext, buf + MPU9250_DATA_LEN, len);
+	}
+
+	return ESP_OK;
+}
+
+
+esp_err_t mpu9250_read_counts(const mpu9250 *dev,
+                              int16_t accm[3], int16_t gyro[3],
+                              int16_t temp[1], uint8_t *ext, size_t len)
+{
+	/* Same layout as for mpu9250_read_raw_ext(). */
+	uint8_t buf[MPU9250_DATA_LEN + MPU9250_EXT_MAX];
+
+	if (len > MPU9250_EXT_MAX)
+		len = MPU9250_EXT_MAX;
+
+	REGIO_TRY(regio_read_fast(&dev->io, 0x3b, buf, MPU9250_DATA_LEN + len));
+
+	mpu9250_decode_counts(buf, accm, gyro, temp);
+
+	if (ext) {
+		memcpy(ext, buf + MPU9250_DATA_LEN, len);
+	}
+
+	return ESP_OK;
+}
+
+
+void mpu9250_decode(const mpu9250 *dev, const uint8_t buf[MPU9250_DATA_LEN],
+                    float accm[3], float gyro[3], float temp[1])
+{
+	/* Layout: accm(xx yy zz) temp(tt) gyro(xx yy zz) in big-endian. */
+
+	if (accm)
+		decode(accm, buf + 0, dev->accm_scale);
+
 	if (temp) {
-		temp[0] = (int16_t)((buf[ 6] << 8) | buf[ 7]);
+		temp[0] = (int16_t)((buf[6] << 8) | buf[7]) * MPU9250_TEMP_SCALE
+		          + MPU9250_TEMP_OFFSET;
 	}
 
-	if (gyro) {
-		gyro[0] = (int16_t)((buf[ 8] << 8) | buf[ 9]);
-		gyro[1] = (int16_t)((buf[10] << 8) | buf[11]);
-		gyro[2] = (int16_t)((buf[12] << 8) | buf[13]);
+	if (gyro)
+		decode(gyro, buf + 8, dev->gyro_scale);
+}
+
+
+void mpu9250_decode_counts(const uint8_t buf[MPU9250_DATA_LEN],
+                           int16_t accm[3], int16_t gyro[3],
+                           int16_t temp[1])
+{
+	/* Same layout as for mpu9250_decode(). */
+
+	if (accm)
+		decode_counts(accm, buf + 0);
+
+	if (temp)
+		temp[0] = (buf[6] << 8) | buf[7];
+
+	if (gyro)
+		decode_counts(gyro, buf + 8);
+}
+
+
+static esp_err_t fifo_reset(const regio *io)
+{
+	/* Stop writing to the FIFO and reset it. */
+	REGIO_TRY(regio_set(io, 0x6a, 0xbf, 0x04));
+
+	/* Resume writing. */
+	return regio_set(io, 0x6a, 0xff, 0x40);
+}
+
+
+esp_err_t mpu9250_fifo_enable(const mpu9250 *dev)
+{
+	const regio *io = &dev->io;
+
+	ESP_LOGI(tag, "Enabling MPU9250 FIFO...");
+
+	/* Push accelerometer and all gyroscope axes to the FIFO. */
+	REGIO_TRY(regio_put(io, 0x23, 0x78));
+
+	return fifo_reset(io);
+}
+
+
+esp_err_t mpu9250_fifo_read(mpu9250 *dev, mpu9250_frame *dst,
+                            size_t len, size_t *count, bool *overflow)
+{
+	const regio *io = &dev->io;
+	uint8_t *buf = dev->fifo_buf;
+
+	*count = 0;
+	*overflow = false;
+
+	/* Check (and clear) the FIFO overflow interrupt status. */
+	REGIO_TRY(regio_read_fast(io, 0x3a, buf, 1));
+
+	if (buf[0] & 0x10) {
+		/*
+		 * Oldest data were overwritten, most likely in the middle
+		 * of a frame. There is no way to realign, so start over.
+		 */
+		*overflow = true;
+		return fifo_reset(io);
+	}
+
+	/* Determine how many complete frames are ready. */
+	REGIO_TRY(regio_read(io, 0x72, buf, 2));
+
+	size_t bytes = ((buf[0] & 0x1f) << 8) | buf[1];
+	size_t frames = bytes / MPU9250_FRAME_SIZE;
+
+	if (frames > len)
+		frames = len;
+
+	if (!frames)
+		return ESP_OK;
+
+	/*
+	 * Drain them all at once. A failed burst may have consumed some
+	 * of the frames, leaving the rest misaligned, so start over.
+	 */
+	esp_err_t err = regio_read_fast(io, 0x74, buf,
+	                                frames * MPU9250_FRAME_SIZE);
+
+	if (err) {
+		fifo_reset(io);
+		return err;
+	}
+
+	mpu9250_fifo_parse(dev, dst, buf, frames);
+	*count = frames;
+
+	return ESP_OK;
+}
+
+
+void mpu9250_fifo_parse(const mpu9250 *dev, mpu9250_frame *dst,
+                        const uint8_t *src, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		/* Layout: accm(xx yy zz) gyro(xx yy zz) in big-endian. */
+		const uint8_t *buf = src + i * MPU9250_FRAME_SIZE;
+
+		decode(dst[i].accm, buf + 0, dev->accm_scale);
+		decode(dst[i].gyro, buf + 6, dev->gyro_scale);
 	}
 }
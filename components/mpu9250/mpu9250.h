@@ -18,16 +18,233 @@
 #define _COMPONENT_MPU9250_H 1
 
 #include <stdlib.h>
+#include <stdint.h>
 
-#include <i2ce.h>
+#include <regio.h>
 
 
-/* Initialize the accelerometer and gyroscope. */
-void mpu9250_init(i2c_port_t port);
+/* Gyroscope full scale range. */
+enum mpu9250_gyro_fs {
+	MPU9250_GYRO_250DPS = 0,
+	MPU9250_GYRO_500DPS,
+	MPU9250_GYRO_1000DPS,
+	MPU9250_GYRO_2000DPS,
+};
 
+/* Accelerometer full scale range. */
+enum mpu9250_accm_fs {
+	MPU9250_ACCM_2G = 0,
+	MPU9250_ACCM_4G,
+	MPU9250_ACCM_8G,
+	MPU9250_ACCM_16G,
+};
 
-/* Take an accelerometer and gyroscope sample. Axis order is XYZ. */
-void mpu9250_read_raw(float accm[3], float gyro[3], float temp[1]);
+/*
+ * Digital low pass filter bandwidth of the gyroscope. Accelerometer
+ * gets the closest matching one. All of them sample internally at 1 kHz.
+ */
+enum mpu9250_dlpf {
+	MPU9250_DLPF_184HZ = 1,
+	MPU9250_DLPF_92HZ,
+	MPU9250_DLPF_41HZ,
+	MPU9250_DLPF_20HZ,
+	MPU9250_DLPF_10HZ,
+	MPU9250_DLPF_5HZ,
+};
+
+struct mpu9250_config {
+	enum mpu9250_gyro_fs gyro_fs;
+	enum mpu9250_accm_fs accm_fs;
+	enum mpu9250_dlpf dlpf;
+
+	/* Output rate is 1 kHz / (1 + smplrt_div). */
+	uint8_t smplrt_div;
+};
+
+typedef struct mpu9250_config mpu9250_config;
+
+/*
+ * Sample rate divider for the output rate of `hz`. Rates that do not
+ * divide 1 kHz get the nearest faster one that does.
+ */
+#define MPU9250_RATE_DIV(hz) (1000 / (hz) - 1)
+
+/* Time between samples with the divider `div`, in seconds. */
+#define MPU9250_RATE_DT(div) ((1 + (div)) / 1000.0)
+
+/* Power-on ranges with the output rate of 1 kHz. */
+#define MPU9250_CONFIG_DEFAULT {		\
+	.gyro_fs = MPU9250_GYRO_250DPS,		\
+	.accm_fs = MPU9250_ACCM_2G,		\
+	.dlpf = MPU9250_DLPF_184HZ,		\
+	.smplrt_div = 0,			\
+}
+
+
+/* I2C address of the sensor, with AD0 low and high. */
+#define MPU9250_ADDR 0x68
+#define MPU9250_ADDR_ALT 0x69
+
+
+/* Size of the FIFO and of a single frame in it, in bytes. */
+#define MPU9250_FIFO_SIZE 512
+#define MPU9250_FRAME_SIZE 12
+
+/* Maximum number of frames the FIFO can hold. */
+#define MPU9250_FIFO_FRAMES (MPU9250_FIFO_SIZE / MPU9250_FRAME_SIZE)
+
+
+/*
+ * Handle of a single sensor. There can be as many as there are buses
+ * and addresses, each one is only ever used by a single task at once.
+ *
+ * Every function talking to the sensor returns the first error of the
+ * bus, or of the sensor not behaving, and leaves the outputs alone.
+ * Calling the init function again sets the sensor up from scratch.
+ */
+struct mpu9250 {
+	/* How to reach the device. */
+	regio io;
+
+	/* Sensitivity of the current ranges, in physical units per LSB. */
+	float accm_scale;
+	float gyro_scale;
+
+	/* The FIFO is drained here, it is too big for the stack. */
+	uint8_t fifo_buf[MPU9250_FIFO_SIZE];
+};
+
+typedef struct mpu9250 mpu9250;
+
+
+/*
+ * Initialize the accelerometer and gyroscope. On I2C the auxiliary bus
+ * is bridged to the primary one, so that the magnetometer can be
+ * reached directly. On SPI, use mpu9250_aux_init() instead.
+ *
+ * Magnetometers share the same address, so only one sensor on a bus
+ * may stay bridged. Move the others over to mpu9250_aux_init() before
+ * talking to any magnetometer.
+ */
+esp_err_t mpu9250_init(mpu9250 *dev, const regio *io,
+                       const mpu9250_config *cfg);
+
+
+/*
+ * Change ranges, filter and output rate. Samples are scaled to match
+ * from now on.
+ */
+esp_err_t mpu9250_configure(mpu9250 *dev, const mpu9250_config *cfg);
+
+
+/*
+ * Get the current sensitivity, in physical units per LSB, so that the
+ * register values can be recovered from the samples.
+ */
+void mpu9250_get_scale(const mpu9250 *dev, float *accm, float *gyro);
+
+/* Temperature sensitivity (°C/LSB) and offset (°C). */
+#define MPU9250_TEMP_SCALE (1 / 333.87f)
+#define MPU9250_TEMP_OFFSET 21.0f
+
+
+/*
+ * Take an accelerometer and gyroscope sample. Axis order is XYZ.
+ * Acceleration is in m/s², angular rate in rad/s and temperature in °C.
+ */
+esp_err_t mpu9250_read_raw(const mpu9250 *dev,
+                           float accm[3], float gyro[3], float temp[1]);
+
+
+/*
+ * Pulse the INT pin (active high, push-pull) whenever data are ready.
+ * With `latch` the pin is held high until any register is read, so
+ * that it can be used as a level triggered wakeup source.
+ */
+esp_err_t mpu9250_int_enable(const mpu9250 *dev, bool latch);
+
+
+/* Maximum number of bytes the auxiliary I2C master can fetch. */
+#define MPU9250_EXT_MAX 24
+
+/* Length of a sample, which is followed by the external sensor data. */
+#define MPU9250_DATA_LEN 14
+
+
+/*
+ * Leave the bypass mode and let the auxiliary I2C master poll `len`
+ * bytes starting with register `reg` of the external `slave` device
+ * into the EXT_SENS_DATA registers on every sample.
+ */
+esp_err_t mpu9250_enable_master(const mpu9250 *dev,
+                                uint8_t slave, uint8_t reg, uint8_t len);
+
+
+/*
+ * Reach the external `slave` device through the auxiliary I2C master,
+ * one byte at a time. Slow, but enough to set the device up. The `dev`
+ * must outlive the `aux`.
+ */
+esp_err_t mpu9250_aux_init(const mpu9250 *dev, regio *aux, uint8_t slave);
+
+
+/*
+ * Same as mpu9250_read_raw(), but also fetch `len` bytes of the
+ * external sensor data in the very same burst.
+ */
+esp_err_t mpu9250_read_raw_ext(const mpu9250 *dev,
+                               float accm[3], float gyro[3], float temp[1],
+                               uint8_t *ext, size_t len);
+
+/*
+ * Same as mpu9250_read_raw_ext(), but leave the readings in signed
+ * counts of the sensor, see mpu9250_get_scale(). For the callers that
+ * convert them later, all at once.
+ */
+esp_err_t mpu9250_read_counts(const mpu9250 *dev,
+                              int16_t accm[3], int16_t gyro[3],
+                              int16_t temp[1], uint8_t *ext, size_t len);
+
+/*
+ * Decode a sample obtained by other means, the way the two above do.
+ * Any of the readings can be NULL.
+ */
+void mpu9250_decode(const mpu9250 *dev, const uint8_t buf[MPU9250_DATA_LEN],
+                    float accm[3], float gyro[3], float temp[1]);
+void mpu9250_decode_counts(const uint8_t buf[MPU9250_DATA_LEN],
+                           int16_t accm[3], int16_t gyro[3],
+                           int16_t temp[1]);
+
+
+
+/* Accelerometer and gyroscope sample as buffered in the FIFO. */
+struct mpu9250_frame {
+	float accm[3];
+	float gyro[3];
+};
+
+typedef struct mpu9250_frame mpu9250_frame;
+
+
+/*
+ * Buffer accelerometer and gyroscope samples in the FIFO so that none
+ * get lost between reads. At 1 kHz the FIFO fills up in 42 ms.
+ */
+esp_err_t mpu9250_fifo_enable(const mpu9250 *dev);
+
+
+/*
+ * Drain up to `len` oldest frames from the FIFO in a single burst.
+ * Sets `count` to the number of frames read. When the FIFO has
+ * overflown, it is reset, nothing is read and `overflow` is set.
+ */
+esp_err_t mpu9250_fifo_read(mpu9250 *dev, mpu9250_frame *dst,
+                            size_t len, size_t *count, bool *overflow);
+
+
+/* Decode `len` frames of the raw FIFO contents. */
+void mpu9250_fifo_parse(const mpu9250 *dev, mpu9250_frame *dst,
+                        const uint8_t *src, size_t len);
 
 
 #endif				/* !_COMPONENT_MPU9250_H */
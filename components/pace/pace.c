@@ -0,0 +1,64 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pace.h>
+
+
+void pace_init(pace *p, unsigned fail_limit)
+{
+	*p = (pace){
+		.fail_limit = fail_limit ? fail_limit : 1,
+	};
+}
+
+
+bool pace_wait(pace *p, unsigned edges)
+{
+	p->ready = edges > 0;
+
+	if (!edges)
+		p->timeouts++;
+	else
+		p->missed += edges - 1;
+
+	return p->ready;
+}
+
+
+bool pace_read(pace *p, bool ok)
+{
+	if (!ok) {
+		/* Bus is recovered already, the next read may do. */
+		p->dropped++;
+		p->failures++;
+		return false;
+	}
+
+	/* A sensor that lost its settings still answers, but silently. */
+	p->failures = p->ready ? 0 : p->failures + 1;
+	return true;
+}
+
+
+bool pace_restart(pace *p)
+{
+	if (p->failures < p->fail_limit)
+		return false;
+
+	p->failures = 0;
+	p->restarts++;
+	return true;
+}
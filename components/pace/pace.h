@@ -0,0 +1,80 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_PACE_H
+#define _COMPONENT_PACE_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/*
+ * Acquisition Pacing
+ * ==================
+ *
+ * Keeps the books of the acquisition loop. Counts the samples missed
+ * between two data-ready edges, decides which reads to keep and when
+ * the sensors stopped answering for good and have to be restarted.
+ *
+ * Depends on nothing but what it is told, so that the loop can be
+ * driven by simulated interrupts on the host.
+ */
+
+struct pace {
+	/* Failures in a row that call for a restart. */
+	unsigned fail_limit;
+
+	/* Reads in a row that failed or were not announced. */
+	unsigned failures;
+
+	/* Whether the current sample was announced by an edge. */
+	bool ready;
+
+	/* Samples never read, waits that timed out, failed reads. */
+	unsigned missed;
+	unsigned timeouts;
+	unsigned dropped;
+
+	/* Times the sensors were restarted. */
+	unsigned restarts;
+};
+
+typedef struct pace pace;
+
+
+/* Start with clean books. */
+void pace_init(pace *p, unsigned fail_limit);
+
+/*
+ * Note the number of `edges` seen while waiting for a sample, zero
+ * if the wait timed out. Returns whether a sample was announced.
+ */
+bool pace_wait(pace *p, unsigned edges);
+
+/*
+ * Note whether the read that followed went `ok`.
+ * Returns whether to use the sample.
+ */
+bool pace_read(pace *p, bool ok);
+
+/*
+ * Check whether the sensors stopped answering and have to be started
+ * over before the next wait. Counts the restart when they do.
+ */
+bool pace_restart(pace *p);
+
+
+#endif				/* !_COMPONENT_PACE_H */
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <predict.h>
+
+
+void predict_init(predict *p, float horizon)
+{
+	*p = (predict){
+		.horizon = horizon,
+		.smooth = PREDICT_SMOOTH,
+		.noise = PREDICT_NOISE,
+	};
+}
+
+
+quat predict_pose(predict *p, quat q, vec3 rate, float dt)
+{
+	/*
+	 * Differentiate the rate, the result is way too noisy otherwise.
+	 * The first sample has nothing to be compared with.
+	 */
+	if (p->primed && dt > 0) {
+		vec3 diff = vec3scale(1 / dt, vec3add2(rate,
+		                      vec3scale(-1, p->rate)));
+		float a = dt / (p->smooth + dt);
+
+		p->accel = vec3add2(vec3scale(1 - a, p->accel),
+		                    vec3scale(a, diff));
+	}
+
+	p->rate = rate;
+	p->primed = true;
+
+	float speed = vec3mag(rate);
+
+	if (speed <= 0 || p->horizon <= 0)
+		return q;
+
+	/* Deceleration along the current rate, speeding up is ignored. */
+	float decel = maxf(0, -vec3dot(p->accel, rate) / speed);
+	float h = p->horizon;
+
+	if (decel > 0)
+		h = minf(h, speed / decel);
+
+	float angle = speed * h - decel * h * h / 2;
+
+	/* Keep the pose from jittering with the gyroscope noise. */
+	angle *= speed * speed / (speed * speed + p->noise * p->noise);
+
+	vec3 axis = vec3scale(sinf(angle / 2) / speed, rate);
+	quat dq = {cosf(angle / 2), axis.row[0], axis.row[1], axis.row[2]};
+
+	return quatunit(quatmul(q, dq));
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_PREDICT_H
+#define _COMPONENT_PREDICT_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * Pose Prediction
+ * ===============
+ *
+ * Extrapolates the orientation forward by a fixed horizon to hide
+ * the latency between sampling and rendering. The head is assumed
+ * to keep turning around the same axis at the current angular rate.
+ *
+ * Prediction is damped so that it does not overshoot: when the turn
+ * slows down, the head is expected to stop at a constant deceleration,
+ * and rates comparable to the gyroscope noise are mostly ignored.
+ */
+
+struct predict {
+	/* How far ahead to predict, in s. */
+	float horizon;
+
+	/* Time constant of the angular acceleration estimate, in s. */
+	float smooth;
+
+	/* Rate at which the prediction is halved, in rad/s. */
+	float noise;
+
+	/* Previous angular rate and smoothed acceleration. */
+	vec3 rate;
+	vec3 accel;
+	bool primed;
+};
+
+typedef struct predict predict;
+
+
+/* Defaults that suit head motion. */
+#define PREDICT_SMOOTH 0.03f
+#define PREDICT_NOISE 0.05f
+
+
+/* Start predicting `horizon` seconds ahead. */
+void predict_init(predict *p, float horizon);
+
+/*
+ * Feed orientation `q` with the bias-corrected body `rate` of a sample
+ * taken `dt` seconds after the previous one. Returns the orientation
+ * expected after the horizon.
+ */
+quat predict_pose(predict *p, quat q, vec3 rate, float dt);
+
+
+#endif				/* !_COMPONENT_PREDICT_H */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <prof.h>
+
+
+/* Sub-buckets per power of two, as bits. */
+#define SUB_BITS PROF_HIST_SUB_BITS
+
+static unsigned bucket_of(uint32_t value)
+{
+	if (value < (1u << SUB_BITS))
+		return value;
+
+	unsigned exp = 31 - __builtin_clz(value);
+	unsigned shift = exp - SUB_BITS;
+	unsigned sub = (value >> shift) & ((1u << SUB_BITS) - 1);
+
+	return ((shift + 1) << SUB_BITS) + sub;
+}
+
+
+static uint32_t bucket_top(unsigned i)
+{
+	if (i < (1u << SUB_BITS))
+		return i;
+
+	unsigned shift = (i >> SUB_BITS) - 1;
+	uint32_t sub = i & ((1u << SUB_BITS) - 1);
+	uint64_t low = (uint64_t)((1u << SUB_BITS) + sub) << shift;
+
+	return low + ((uint64_t)1 << shift) - 1;
+}
+
+
+void prof_hist_add(prof_hist *h, uint32_t value)
+{
+	h->bucket[bucket_of(value)]++;
+	h->count++;
+
+	if (value > h->max)
+		h->max = value;
+}
+
+
+uint32_t prof_hist_quantile(const prof_hist *h, float q)
+{
+	uint64_t rank = (uint64_t)(q * h->count + 0.5f);
+	uint64_t seen = 0;
+
+	if (rank < 1)
+		rank = 1;
+
+	for (unsigned i = 0; i < PROF_HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+
+		if (seen >= rank)
+			return bucket_top(i) < h->max ? bucket_top(i) : h->max;
+	}
+
+	return h->max;
+}
+
+
+void prof_hist_reset(prof_hist *h)
+{
+	*h = (prof_hist){};
+}
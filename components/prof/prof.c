@@ -0,0 +1,76 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <prof.h>
+
+
+/* Logging tag. */
+static const char *tag = "prof";
+
+
+/* Human readable stage names. */
+static const char *const stage_name[PROF_NUM_STAGES] = {
+	[PROF_READ_MPU9250] = "mpu9250",
+	[PROF_READ_AK8963] = "ak8963",
+	[PROF_READ_SECOND_MPU9250] = "mpu9250b",
+	[PROF_READ_SECOND_AK8963] = "ak8963b",
+	[PROF_CALIBRATE] = "calibrate",
+	[PROF_FUSE] = "fuse",
+	[PROF_ENCODE] = "encode",
+	[PROF_SEND] = "send",
+	[PROF_LATENCY] = "latency",
+};
+
+
+/*
+ * Every stage is only ever recorded from a single task. Reports may
+ * race with recording, which at worst skews a single report slightly.
+ */
+static prof_hist stages[PROF_NUM_STAGES];
+
+
+uint64_t prof_now(void)
+{
+	return esp_timer_get_time();
+}
+
+
+void prof_record(enum prof_stage stage, uint32_t us)
+{
+	prof_hist_add(&stages[stage], us);
+}
+
+
+void prof_report(void)
+{
+	for (unsigned i = 0; i < PROF_NUM_STAGES; i++) {
+		prof_hist *h = &stages[i];
+
+		if (!h->count)
+			continue;
+
+		ESP_LOGI(tag, "%-9s p50 %6u p99 %6u max %6u μs (%u)",
+		         stage_name[i],
+		         (unsigned)prof_hist_quantile(h, 0.50),
+		         (unsigned)prof_hist_quantile(h, 0.99),
+		         (unsigned)h->max, (unsigned)h->count);
+
+		prof_hist_reset(h);
+	}
+}
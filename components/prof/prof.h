@@ -0,0 +1,101 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_PROF_H
+#define _COMPONENT_PROF_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/*
+ * Profiling
+ * =========
+ *
+ * Durations of the individual pipeline stages are collected into
+ * fixed-size histograms with logarithmic buckets, so that recording
+ * never allocates and takes constant time.
+ *
+ * Use PROF_TIME() and PROF_SINCE() at the instrumentation points,
+ * they compile to nothing unless CONFIG_PROF_ENABLE is set.
+ */
+
+/* Number of linear sub-buckets per power of two, as bits. */
+#define PROF_HIST_SUB_BITS 2
+
+/* Enough buckets to cover the whole 32-bit range. */
+#define PROF_HIST_BUCKETS \
+	((32 - PROF_HIST_SUB_BITS + 1) << PROF_HIST_SUB_BITS)
+
+
+struct prof_hist {
+	uint32_t count;
+	uint32_t max;
+	uint32_t bucket[PROF_HIST_BUCKETS];
+};
+
+typedef struct prof_hist prof_hist;
+
+
+/* Record a single value. */
+void prof_hist_add(prof_hist *h, uint32_t value);
+
+/*
+ * Estimate value at quantile `q` between 0 and 1, rounded up to the
+ * upper bound of its bucket. Relative error is below one part in
+ * 2^PROF_HIST_SUB_BITS.
+ */
+uint32_t prof_hist_quantile(const prof_hist *h, float q);
+
+/* Forget all values. */
+void prof_hist_reset(prof_hist *h);
+
+
+/* Instrumented stages. */
+enum prof_stage {
+	PROF_READ_MPU9250 = 0,
+	PROF_READ_AK8963,
+	PROF_READ_SECOND_MPU9250,
+	PROF_READ_SECOND_AK8963,
+	PROF_CALIBRATE,
+	PROF_FUSE,
+	PROF_ENCODE,
+	PROF_SEND,
+	PROF_LATENCY,
+	PROF_NUM_STAGES,
+};
+
+
+/* Current time in μs. */
+uint64_t prof_now(void);
+
+/* Record duration of a stage in μs. */
+void prof_record(enum prof_stage stage, uint32_t us);
+
+/* Log p50/p99/max for every stage and start over. */
+void prof_report(void);
+
+
+#if CONFIG_PROF_ENABLE
+# define PROF_TIME(var) uint64_t var = prof_now()
+# define PROF_SINCE(stage, var) prof_record((stage), prof_now() - (var))
+#else
+# define PROF_TIME(var)
+# define PROF_SINCE(stage, var) do {} while (0)
+#endif
+
+
+#endif				/* !_COMPONENT_PROF_H */
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_idf_version.h>
+#include <driver/gpio.h>
+
+#include <regio.h>
+
+
+static const char *tag = "regio";
+
+
+/* Fastest clock allowed over SPI for all but the sensor data. */
+#define SPI_SLOW_FREQ 1000000
+
+
+static esp_err_t i2c_read(const regio *io, uint8_t reg,
+                          void *dst, size_t len)
+{
+	return i2ce_read(io->port, io->addr, reg, dst, len);
+}
+
+
+static esp_err_t i2c_write(const regio *io, uint8_t reg,
+                           const void *src, size_t len)
+{
+	return i2ce_write(io->port, io->addr, reg, src, len);
+}
+
+
+void regio_i2c_init(regio *io, i2c_port_t port, uint8_t addr)
+{
+	*io = (regio){
+		.read = i2c_read,
+		.write = i2c_write,
+		.bus = REGIO_I2C,
+		.addr = addr,
+		.port = port,
+	};
+}
+
+
+/*
+ * Chip select is driven by hand, because both devices below share it
+ * and the GPIO matrix is able to route only one of them to the pin.
+ */
+static esp_err_t spi_transfer(const regio *io, spi_device_handle_t dev,
+                              spi_transaction_t *t)
+{
+	gpio_set_level(io->spi.cs, 0);
+	esp_err_t err = spi_device_polling_transmit(dev, t);
+	gpio_set_level(io->spi.cs, 1);
+
+	return err;
+}
+
+
+static esp_err_t spi_read_with(const regio *io, spi_device_handle_t dev,
+                               uint8_t reg, void *dst, size_t len)
+{
+	spi_transaction_t t = {
+		.addr = 0x80 | reg,
+		.length = 8 * len,
+		.rxlength = 8 * len,
+		.rx_buffer = dst,
+	};
+
+	return spi_transfer(io, dev, &t);
+}
+
+
+static esp_err_t spi_read(const regio *io, uint8_t reg,
+                          void *dst, size_t len)
+{
+	return spi_read_with(io, io->spi.slow, reg, dst, len);
+}
+
+
+static esp_err_t spi_read_fast(const regio *io, uint8_t reg,
+                               void *dst, size_t len)
+{
+	return spi_read_with(io, io->spi.fast, reg, dst, len);
+}
+
+
+static esp_err_t spi_write(const regio *io, uint8_t reg,
+                           const void *src, size_t len)
+{
+	spi_transaction_t t = {
+		.addr = reg,
+		.length = 8 * len,
+		.tx_buffer = src,
+	};
+
+	return spi_transfer(io, io->spi.slow, &t);
+}
+
+
+static spi_device_handle_t spi_add(spi_host_device_t host, uint32_t freq)
+{
+	spi_device_interface_config_t dev = {
+		.address_bits = 8,
+		.mode = 3,
+		.clock_speed_hz = freq,
+		.spics_io_num = -1,
+		.queue_size = 1,
+	};
+
+	spi_device_handle_t handle;
+	ESP_ERROR_CHECK(spi_bus_add_device(host, &dev, &handle));
+
+	return handle;
+}
+
+
+void regio_spi_init(regio *io, spi_host_device_t host,
+                    int mosi, int miso, int sclk, int cs,
+                    uint32_t freq)
+{
+	ESP_LOGI(tag, "Initializing SPI host %i at %u Hz...",
+	         (int)host, (unsigned)freq);
+
+	spi_bus_config_t bus = {
+		.mosi_io_num = mosi,
+		.miso_io_num = miso,
+		.sclk_io_num = sclk,
+		.quadwp_io_num = -1,
+		.quadhd_io_num = -1,
+	};
+
+	/* Let the FIFO be drained using DMA in a single transfer. */
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+	ESP_ERROR_CHECK(spi_bus_initialize(host, &bus, SPI_DMA_CH_AUTO));
+#else
+	ESP_ERROR_CHECK(spi_bus_initialize(host, &bus, host));
+#endif
+
+	gpio_config_t conf = {
+		.pin_bit_mask = 1ull << cs,
+		.mode = GPIO_MODE_OUTPUT,
+	};
+
+	ESP_ERROR_CHECK(gpio_config(&conf));
+	gpio_set_level(cs, 1);
+
+	*io = (regio){
+		.read = spi_read,
+		.write = spi_write,
+		.read_fast = spi_read_fast,
+		.bus = REGIO_SPI,
+		.spi = {
+			.slow = spi_add(host, freq < SPI_SLOW_FREQ
+			                      ? freq : SPI_SLOW_FREQ),
+			.fast = spi_add(host, freq),
+			.cs = cs,
+		},
+	};
+}
+
+
+esp_err_t regio_read(const regio *io, uint8_t reg, void *dst, size_t len)
+{
+	return io->read(io, reg, dst, len);
+}
+
+
+esp_err_t regio_read_fast(const regio *io, uint8_t reg,
+                          void *dst, size_t len)
+{
+	if (io->read_fast)
+		return io->read_fast(io, reg, dst, len);
+
+	return io->read(io, reg, dst, len);
+}
+
+
+esp_err_t regio_write(const regio *io, uint8_t reg,
+                      const void *src, size_t len)
+{
+	return io->write(io, reg, src, len);
+}
+
+
+esp_err_t regio_put(const regio *io, uint8_t reg, uint8_t value)
+{
+	return io->write(io, reg, &value, 1);
+}
+
+
+esp_err_t regio_set(const regio *io, uint8_t reg,
+                    uint8_t mask, uint8_t bits)
+{
+	uint8_t buf[1];
+
+	REGIO_TRY(io->read(io, reg, buf, 1));
+
+	buf[0] = (buf[0] & mask) | bits;
+
+	return io->write(io, reg, buf, 1);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_REGIO_H
+#define _COMPONENT_REGIO_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include <driver/spi_master.h>
+
+#include <i2ce.h>
+
+
+/*
+ * Register I/O
+ * ============
+ *
+ * Access to registers of a sensor, no matter how it is attached.
+ * Drivers only ever see this interface, so that the same code works
+ * over I2C, SPI or through another chip, such as the MPU9250 auxiliary
+ * I2C master. Anything providing the two methods will do.
+ *
+ * Sensor data have a read of their own, as some buses are allowed to
+ * run faster for them than for the rest of the registers.
+ *
+ * Transfers return the error of the bus, for the drivers to pass on.
+ */
+
+enum regio_bus {
+	REGIO_I2C = 0,
+	REGIO_SPI,
+	REGIO_AUX,
+};
+
+struct regio {
+	/* Read `len` bytes starting with register `reg`. */
+	esp_err_t (*read)(const struct regio *io, uint8_t reg,
+	                  void *dst, size_t len);
+
+	/* Write `len` bytes starting with register `reg`. */
+	esp_err_t (*write)(const struct regio *io, uint8_t reg,
+	                   const void *src, size_t len);
+
+	/* Read sensor data, optional, `read` is used without it. */
+	esp_err_t (*read_fast)(const struct regio *io, uint8_t reg,
+	                       void *dst, size_t len);
+
+	/* What kind of bus the device sits on. */
+	enum regio_bus bus;
+
+	/* Address of the device on I2C buses. */
+	uint8_t addr;
+
+	/* Bus specific state. */
+	union {
+		i2c_port_t port;
+
+		struct {
+			/* Only sensor data may be read faster than 1 MHz. */
+			spi_device_handle_t slow;
+			spi_device_handle_t fast;
+			int cs;
+		} spi;
+
+		/* Driver of the chip providing the auxiliary bus. */
+		const void *master;
+	};
+};
+
+typedef struct regio regio;
+
+
+/* Talk to the device at `addr` using an initialized I2C master. */
+void regio_i2c_init(regio *io, i2c_port_t port, uint8_t addr);
+
+/*
+ * Initialize the SPI bus and talk to a single device using mode 3
+ * and the read/write flag in the top bit of the register address.
+ * Sensor data are read at `freq`, other registers at 1 MHz at most.
+ */
+void regio_spi_init(regio *io, spi_host_device_t host,
+                    int mosi, int miso, int sclk, int cs,
+                    uint32_t freq);
+
+
+/* Read `len` bytes starting with register `reg`. */
+esp_err_t regio_read(const regio *io, uint8_t reg, void *dst, size_t len);
+
+/*
+ * Same, but only for the sensor data and interrupt status registers,
+ * which may be read at the full clock of the bus.
+ */
+esp_err_t regio_read_fast(const regio *io, uint8_t reg,
+                          void *dst, size_t len);
+
+/* Write `len` bytes starting with register `reg`. */
+esp_err_t regio_write(const regio *io, uint8_t reg,
+                      const void *src, size_t len);
+
+/* Write a single register. */
+esp_err_t regio_put(const regio *io, uint8_t reg, uint8_t value);
+
+/* Read a register, apply the mask, set the bits and write it back. */
+esp_err_t regio_set(const regio *io, uint8_t reg,
+                    uint8_t mask, uint8_t bits);
+
+/* Return the error from the enclosing function, if there is one. */
+#define REGIO_TRY(expr) do {			\
+	esp_err_t err_ = (expr);		\
+	if (err_)				\
+		return err_;			\
+} while (0)
+
+
+#endif				/* !_COMPONENT_REGIO_H */
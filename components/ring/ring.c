@@ -0,0 +1,109 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <esp_log.h>
+
+#include <ring.h>
+
+
+/* Logging tag. */
+static const char *tag = "ring";
+
+
+void ring_init(ring *r, void *buf, size_t size, size_t len)
+{
+	if (!len || (len & (len - 1))) {
+		ESP_LOGE(tag, "Ring length %zu is not a power of two!", len);
+		abort();
+	}
+
+	r->buf = buf;
+	r->size = size;
+	r->len = len;
+
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->overruns, 0);
+	atomic_init(&r->peak, 0);
+}
+
+
+bool ring_push(ring *r, const void *item)
+{
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	size_t count = head - tail;
+
+	if (count >= r->len) {
+		atomic_fetch_add_explicit(&r->overruns, 1, memory_order_relaxed);
+		return false;
+	}
+
+	memcpy(r->buf + (head & (r->len - 1)) * r->size, item, r->size);
+
+	/* Publish the item only after it has been written. */
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+	if (count + 1 > atomic_load_explicit(&r->peak, memory_order_relaxed))
+		atomic_store_explicit(&r->peak, count + 1, memory_order_relaxed);
+
+	return true;
+}
+
+
+size_t ring_pop(ring *r, void *dst, size_t max)
+{
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+	size_t count = head - tail;
+
+	if (count > max)
+		count = max;
+
+	for (size_t i = 0; i < count; i++) {
+		size_t pos = (tail + i) & (r->len - 1);
+		memcpy((uint8_t *)dst + i * r->size,
+		       r->buf + pos * r->size, r->size);
+	}
+
+	/* Release the slots only after they have been read. */
+	atomic_store_explicit(&r->tail, tail + count, memory_order_release);
+
+	return count;
+}
+
+
+size_t ring_count(ring *r)
+{
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+	return head - tail;
+}
+
+
+unsigned ring_overruns(ring *r)
+{
+	return atomic_load_explicit(&r->overruns, memory_order_relaxed);
+}
+
+
+size_t ring_peak(ring *r)
+{
+	return atomic_load_explicit(&r->peak, memory_order_relaxed);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_RING_H
+#define _COMPONENT_RING_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+
+/*
+ * Ring Buffer
+ * ===========
+ *
+ * Lock-free queue of fixed-size items for exactly one producer and
+ * exactly one consumer, possibly running on different cores.
+ *
+ * Producer never waits. When the ring is full, the new item is
+ * dropped and counted as an overrun.
+ */
+
+struct ring {
+	/* Storage for `len` items of `size` bytes each. */
+	uint8_t *buf;
+	size_t size, len;
+
+	/* Free-running positions, written by producer and consumer. */
+	atomic_size_t head, tail;
+
+	/* Statistics, written by producer only. */
+	atomic_uint overruns;
+	atomic_size_t peak;
+};
+
+typedef struct ring ring;
+
+
+/* Prepare the ring. The `len` must be a power of two. */
+void ring_init(ring *r, void *buf, size_t size, size_t len);
+
+/* Append an item. Returns false on overrun. Producer only. */
+bool ring_push(ring *r, const void *item);
+
+/* Remove up to `max` oldest items. Returns how many. Consumer only. */
+size_t ring_pop(ring *r, void *dst, size_t max);
+
+/* Number of items currently waiting. */
+size_t ring_count(ring *r);
+
+/* Number of items dropped because the ring was full. */
+unsigned ring_overruns(ring *r);
+
+/* Highest number of items ever waiting. */
+size_t ring_peak(ring *r);
+
+
+#endif				/* !_COMPONENT_RING_H */
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <serout.h>
+
+
+static void put_u16(uint8_t *buf, uint16_t v)
+{
+	buf[0] = v;
+	buf[1] = v >> 8;
+}
+
+
+static void put_u32(uint8_t *buf, uint32_t v)
+{
+	buf[0] = v;
+	buf[1] = v >> 8;
+	buf[2] = v >> 16;
+	buf[3] = v >> 24;
+}
+
+
+static void put_f32(uint8_t *buf, float v)
+{
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	put_u32(buf, u);
+}
+
+
+static uint16_t get_u16(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8);
+}
+
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) |
+	       ((uint32_t)buf[3] << 24);
+}
+
+
+static float get_f32(const uint8_t *buf)
+{
+	uint32_t u = get_u32(buf);
+	float v;
+
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+
+uint16_t serout_crc16(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < len; i++) {
+		crc ^= buf[i] << 8;
+
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+
+	return crc;
+}
+
+
+/*
+ * Replace every zero with the distance to the next one. The first
+ * byte holds the distance to the first zero, there is one past the end.
+ * Runs are short enough to never need the 0xff code.
+ */
+static size_t cobs_encode(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t code = 0, out = 1;
+
+	for (size_t i = 0; i < len; i++) {
+		if (src[i]) {
+			dst[out++] = src[i];
+			continue;
+		}
+
+		dst[code] = out - code;
+		code = out++;
+	}
+
+	dst[code] = out - code;
+	return out;
+}
+
+
+/* Reverse of cobs_encode(), returns 0 when the input is malformed. */
+static size_t cobs_decode(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t out = 0;
+
+	for (size_t i = 0; i < len; /**/) {
+		uint8_t code = src[i++];
+
+		if (!code || i + code - 1 > len)
+			return 0;
+
+		for (int j = 1; j < code; j++) {
+			if (!src[i])
+				return 0;
+
+			dst[out++] = src[i++];
+		}
+
+		/* Every run but the last one ends with a zero. */
+		if (i < len)
+			dst[out++] = 0;
+	}
+
+	return out;
+}
+
+
+size_t serout_encode(uint8_t buf[SEROUT_FRAME_SIZE], const serout_record *r)
+{
+	uint8_t rec[SEROUT_RECORD_SIZE];
+
+	rec[0] = SEROUT_VERSION;
+	rec[1] = r->flags;
+	put_u16(rec + 2, r->seq);
+	put_u32(rec + 4, r->time);
+	put_u32(rec + 8, r->time >> 32);
+
+	put_f32(rec + 12, r->q.w);
+	put_f32(rec + 16, r->q.x);
+	put_f32(rec + 20, r->q.y);
+	put_f32(rec + 24, r->q.z);
+
+	for (int i = 0; i < 3; i++)
+		put_f32(rec + 28 + 4 * i, r->magm.row[i]);
+
+	put_u16(rec + 40, serout_crc16(rec, 40));
+
+	size_t len = cobs_encode(buf, rec, sizeof(rec));
+	buf[len++] = 0;
+
+	return len;
+}
+
+
+bool serout_decode(serout_record *r, const uint8_t *buf, size_t len)
+{
+	uint8_t rec[SEROUT_FRAME_SIZE];
+
+	if (len > sizeof(rec))
+		return false;
+
+	if (cobs_decode(rec, buf, len) != SEROUT_RECORD_SIZE)
+		return false;
+
+	if (rec[0] != SEROUT_VERSION)
+		return false;
+
+	if (get_u16(rec + 40) != serout_crc16(rec, 40))
+		return false;
+
+	r->flags = rec[1];
+	r->seq = get_u16(rec + 2);
+	r->time = get_u32(rec + 4) | (uint64_t)get_u32(rec + 8) << 32;
+
+	r->q.w = get_f32(rec + 12);
+	r->q.x = get_f32(rec + 16);
+	r->q.y = get_f32(rec + 20);
+	r->q.z = get_f32(rec + 24);
+
+	for (int i = 0; i < 3; i++)
+		r->magm.row[i] = get_f32(rec + 28 + 4 * i);
+
+	return true;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_SEROUT_H
+#define _COMPONENT_SEROUT_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * Serial Output
+ * =============
+ *
+ * Binary pose telemetry over the console UART, a fraction of the size
+ * of formatted text and without any float formatting. Records are
+ * written from a dedicated task, so that the caller never blocks on
+ * the UART.
+ *
+ * Every record is protected by a CRC and framed using the Consistent
+ * Overhead Byte Stuffing, so that a zero byte always ends a frame.
+ * Readers resynchronize on the next zero and simply drop frames that
+ * fail the check, such as log messages sharing the UART.
+ *
+ * Record, all fields little-endian:
+ *
+ *   0  u8  version (1)
+ *   1  u8  flags (bit 0: magnetometer valid)
+ *   2  u16 sequence number
+ *   4  u64 timestamp (μs since boot)
+ *  12  f32 quaternion w, x, y, z
+ *  28  f32 calibrated magnetometer x, y, z (μT)
+ *  40  u16 CRC-16/CCITT-FALSE of the preceding bytes
+ */
+
+#define SEROUT_VERSION 1
+#define SEROUT_RECORD_SIZE 42
+
+/* Record with the COBS overhead byte and the trailing zero. */
+#define SEROUT_FRAME_SIZE (SEROUT_RECORD_SIZE + 2)
+
+#define SEROUT_MAGM_OK 0x01
+
+
+struct serout_record {
+	uint16_t seq;
+	uint8_t flags;
+	uint64_t time;
+	quat q;
+	vec3 magm;
+};
+
+typedef struct serout_record serout_record;
+
+
+/* CRC-16/CCITT-FALSE, polynomial 0x1021 starting from 0xffff. */
+uint16_t serout_crc16(const uint8_t *buf, size_t len);
+
+/* Serialize and frame a record. Returns number of bytes used. */
+size_t serout_encode(uint8_t buf[SEROUT_FRAME_SIZE], const serout_record *r);
+
+/*
+ * Unframe and deserialize a record, given the bytes up to, but not
+ * including the terminating zero. Returns false if it is damaged.
+ */
+bool serout_decode(serout_record *r, const uint8_t *buf, size_t len);
+
+
+/*
+ * Install driver of the UART `port`, route the console through it
+ * and start the output task.
+ */
+void serout_init(int port);
+
+/*
+ * Queue record for output, its sequence number is filled in.
+ * Returns false when it was dropped.
+ */
+bool serout_send(const serout_record *r);
+
+
+#endif				/* !_COMPONENT_SEROUT_H */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_vfs_dev.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <driver/uart.h>
+
+#include <serout.h>
+
+
+/* Logging tag. */
+static const char *tag = "serout";
+
+
+/* Records waiting to be written, about 0.3 s at 100 Hz. */
+#define QUEUE_LEN 32
+
+/* Transmit ring buffer of the driver, in bytes. */
+#define TX_BUF_SIZE 2048
+
+
+/* Preallocated queue of pending records. */
+static uint8_t queue_buf[QUEUE_LEN * sizeof(serout_record)];
+static StaticQueue_t queue_mem;
+static QueueHandle_t queue = NULL;
+
+
+/* Where the records go. */
+static uart_port_t uart = UART_NUM_0;
+
+
+/* Next sequence number, to reveal lost records. */
+static uint16_t next_seq = 0;
+
+
+static void serout_task(void *arg)
+{
+	while (true) {
+		serout_record r;
+		uint8_t buf[SEROUT_FRAME_SIZE];
+
+		xQueueReceive(queue, &r, portMAX_DELAY);
+
+		/* Only blocks when the ring buffer of the driver is full. */
+		size_t len = serout_encode(buf, &r);
+		uart_write_bytes(uart, (const char *)buf, len);
+	}
+}
+
+
+void serout_init(int port)
+{
+	ESP_LOGI(tag, "Starting serial output on UART%i...", port);
+
+	uart = port;
+
+	/* Receive buffer has to be larger than the hardware FIFO. */
+	ESP_ERROR_CHECK(uart_driver_install(uart, 2 * UART_FIFO_LEN,
+	                                    TX_BUF_SIZE, 0, NULL, 0));
+
+	/* Console output has to go through the driver as well now. */
+	esp_vfs_dev_uart_use_driver(uart);
+
+	queue = xQueueCreateStatic(QUEUE_LEN, sizeof(serout_record),
+	                           queue_buf, &queue_mem);
+
+	xTaskCreate(serout_task, "serout", 2048, NULL, 4, NULL);
+}
+
+
+bool serout_send(const serout_record *r)
+{
+	serout_record rec = *r;
+	rec.seq = next_seq++;
+
+	return xQueueSend(queue, &rec, 0);
+}
@@ -17,6 +17,91 @@
 #ifndef _COMPONENT_SPATIAL_H
 #define _COMPONENT_SPATIAL_H 1
 
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+ * Fast Approximations
+ * ===================
+ *
+ * Single precision kernels made of multiplications and additions,
+ * apart from one division in atan2f_fast(). Maximum errors over the
+ * whole domain are:
+ *
+ *   rsqrtf_fast()  4.8e-6 relative
+ *   atan2f_fast()  2.0e-6 rad
+ *   asinf_fast()   7.5e-5 rad
+ *
+ * Build with SPATIAL_FAST set to 1 to use them for all normalization,
+ * TRIAD and Euler angles below. Otherwise they are only used by the
+ * functions with the _fast suffix.
+ */
+#ifndef SPATIAL_FAST
+# define SPATIAL_FAST 0
+#endif
+
+
+/* Reciprocal square root, two Newton steps from the usual first guess. */
+inline static float rsqrtf_fast(float x)
+{
+	uint32_t i;
+	float y;
+
+	memcpy(&i, &x, sizeof(i));
+	i = 0x5f375a86 - (i >> 1);
+	memcpy(&y, &i, sizeof(y));
+
+	y = y * (1.5f - 0.5f * x * y * y);
+	y = y * (1.5f - 0.5f * x * y * y);
+
+	return y;
+}
+
+
+/* Minimax polynomial for the first octant, extended by symmetry. */
+inline static float atan2f_fast(float y, float x)
+{
+	float ax = fabsf(x), ay = fabsf(y);
+	float hi = ax > ay ? ax : ay;
+	float lo = ax > ay ? ay : ax;
+
+	if (hi == 0)
+		return 0;
+
+	float z = lo / hi;
+	float z2 = z * z;
+	float r = z * (0.99997726f + z2 * (-0.33262347f
+	               + z2 * (0.19354346f + z2 * (-0.11643287f
+	               + z2 * (0.05265332f + z2 * -0.01172120f)))));
+
+	if (ay > ax)
+		r = (float)M_PI_2 - r;
+
+	if (x < 0)
+		r = (float)M_PI - r;
+
+	return y < 0 ? -r : r;
+}
+
+
+/* Abramowitz and Stegun 4.4.45, clamped to ±π/2 outside of ±1. */
+inline static float asinf_fast(float x)
+{
+	float a = fabsf(x);
+
+	if (a >= 1)
+		return copysignf((float)M_PI_2, x);
+
+	float t = 1 - a;
+	float r = (float)M_PI_2 - t * rsqrtf_fast(t)
+	        * (1.5707288f + a * (-0.2121144f
+	           + a * (0.0742610f + a * -0.0187293f)));
+
+	return copysignf(r, x);
+}
+
 
 struct vec3 {
 	float row[3];
@@ -79,19 +164,29 @@ inline static vec3 vec3add3(vec3 a, vec3 b, vec3 c)
 
 inline static float vec3mag(vec3 a)
 {
-	return sqrt(a.row[0] * a.row[0] +
-	            a.row[1] * a.row[1] +
-	            a.row[2] * a.row[2]);
+	return sqrtf(a.row[0] * a.row[0] +
+	             a.row[1] * a.row[1] +
+	             a.row[2] * a.row[2]);
+}
+
+
+inline static vec3 vec3unit_fast(vec3 a)
+{
+	float mag2 = a.row[0] * a.row[0] +
+	             a.row[1] * a.row[1] +
+	             a.row[2] * a.row[2];
+
+	return vec3scale(rsqrtf_fast(mag2), a);
 }
 
 
 inline static vec3 vec3unit(vec3 a)
 {
-	return (vec3){{
-		a.row[0] / vec3mag(a),
-		a.row[1] / vec3mag(a),
-		a.row[2] / vec3mag(a),
-	}};
+#if SPATIAL_FAST
+	return vec3unit_fast(a);
+#else
+	return vec3scale(1 / vec3mag(a), a);
+#endif
 }
 
 
@@ -141,50 +236,366 @@ inline static mat3 mat3mul(mat3 a, mat3 b)
 }
 
 
+inline static quat quatscale(float c, quat q)
+{
+	return (quat){c * q.w, c * q.x, c * q.y, c * q.z};
+}
+
+
+inline static quat quatadd2(quat a, quat b)
+{
+	return (quat){a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z};
+}
+
+
+inline static quat quatmul(quat a, quat b)
+{
+	return (quat){
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+	};
+}
+
+
+inline static quat quatconj(quat q)
+{
+	return (quat){q.w, -q.x, -q.y, -q.z};
+}
+
+
+inline static float quatmag(quat q)
+{
+	return sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+}
+
+
+inline static quat quatunit_fast(quat q)
+{
+	float mag2 = q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z;
+	return quatscale(rsqrtf_fast(mag2), q);
+}
+
+
+inline static quat quatunit(quat q)
+{
+#if SPATIAL_FAST
+	return quatunit_fast(q);
+#else
+	return quatscale(1 / quatmag(q), q);
+#endif
+}
+
+
+/* Rotate vector `v` by an unit quaternion `q`. */
+inline static vec3 quatrot(quat q, vec3 v)
+{
+	quat p = {0, v.row[0], v.row[1], v.row[2]};
+	p = quatmul(quatmul(q, p), quatconj(q));
+	return (vec3){{p.x, p.y, p.z}};
+}
+
+
+/*
+ * Convert the rotation matrix to a quaternion, dividing by the largest
+ * of the four components so that rotations by nearly 180° stay exact.
+ * Resulting quaternion always has a non-negative real part.
+ */
 inline static quat quat_from_mat3(mat3 a)
 {
-	float w = 1 + a.col[0].row[0] + a.col[1].row[1] + a.col[2].row[2];
-	float x = 1 + a.col[0].row[0] - a.col[1].row[1] - a.col[2].row[2];
-	float y = 1 - a.col[0].row[0] + a.col[1].row[1] - a.col[2].row[2];
-	float z = 1 - a.col[0].row[0] - a.col[1].row[1] + a.col[2].row[2];
+	float m00 = a.col[0].row[0];
+	float m11 = a.col[1].row[1];
+	float m22 = a.col[2].row[2];
 
 	float xs = a.col[2].row[1] - a.col[1].row[2];
 	float ys = a.col[0].row[2] - a.col[2].row[0];
 	float zs = a.col[1].row[0] - a.col[0].row[1];
 
-	return (quat){
-		.w = maxf(0, w) / 2.0,
-		.x = copysign(maxf(0, x) / 2.0, xs),
-		.y = copysign(maxf(0, y) / 2.0, ys),
-		.z = copysign(maxf(0, z) / 2.0, zs),
-	};
+	float xy = a.col[1].row[0] + a.col[0].row[1];
+	float xz = a.col[2].row[0] + a.col[0].row[2];
+	float yz = a.col[2].row[1] + a.col[1].row[2];
+
+	quat q;
+
+	if (m00 + m11 + m22 > 0) {
+		float s = 2 * sqrtf(1 + m00 + m11 + m22);
+		q = (quat){s / 4, xs / s, ys / s, zs / s};
+	} else if (m00 > m11 && m00 > m22) {
+		float s = 2 * sqrtf(1 + m00 - m11 - m22);
+		q = (quat){xs / s, s / 4, xy / s, xz / s};
+	} else if (m11 > m22) {
+		float s = 2 * sqrtf(1 - m00 + m11 - m22);
+		q = (quat){ys / s, xy / s, s / 4, yz / s};
+	} else {
+		float s = 2 * sqrtf(1 - m00 - m11 + m22);
+		q = (quat){zs / s, xz / s, yz / s, s / 4};
+	}
+
+	return q.w < 0 ? quatscale(-1, q) : q;
+}
+
+
+/*
+ * Same as quat_from_mat3(), with the square root and the divisions
+ * folded into a single reciprocal square root. Only as close to unit
+ * length as the matrix is to orthonormal.
+ */
+inline static quat quat_from_mat3_fast(mat3 a)
+{
+	float m00 = a.col[0].row[0];
+	float m11 = a.col[1].row[1];
+	float m22 = a.col[2].row[2];
+
+	float xs = a.col[2].row[1] - a.col[1].row[2];
+	float ys = a.col[0].row[2] - a.col[2].row[0];
+	float zs = a.col[1].row[0] - a.col[0].row[1];
+
+	float xy = a.col[1].row[0] + a.col[0].row[1];
+	float xz = a.col[2].row[0] + a.col[0].row[2];
+	float yz = a.col[2].row[1] + a.col[1].row[2];
+
+	quat q;
+
+	/* With s = 2√t as above, 1/s = r / 2 and s/4 = t r / 2. */
+	if (m00 + m11 + m22 > 0) {
+		float t = 1 + m00 + m11 + m22;
+		float r = 0.5f * rsqrtf_fast(t);
+		q = (quat){t * r, xs * r, ys * r, zs * r};
+	} else if (m00 > m11 && m00 > m22) {
+		float t = 1 + m00 - m11 - m22;
+		float r = 0.5f * rsqrtf_fast(t);
+		q = (quat){xs * r, t * r, xy * r, xz * r};
+	} else if (m11 > m22) {
+		float t = 1 - m00 + m11 - m22;
+		float r = 0.5f * rsqrtf_fast(t);
+		q = (quat){ys * r, xy * r, t * r, yz * r};
+	} else {
+		float t = 1 - m00 - m11 + m22;
+		float r = 0.5f * rsqrtf_fast(t);
+		q = (quat){zs * r, xz * r, yz * r, t * r};
+	}
+
+	return q.w < 0 ? quatscale(-1, q) : q;
+}
+
+
+/*
+ * Determine orientation from gravity and magnetic field alone, using
+ * the {north, east, down} matrix. Neither needs to be normalized. The
+ * fast variant stays within 1e-5 of unit length.
+ */
+inline static quat quat_from_triad_fast(vec3 accm, vec3 magm)
+{
+	vec3 down  = accm;
+	vec3 east  = vec3cross(down, magm);
+	vec3 north = vec3cross(east, down);
+
+	mat3 rm = {{vec3unit_fast(north), vec3unit_fast(east),
+	            vec3unit_fast(down)}};
+
+	return quat_from_mat3_fast(rm);
+}
+
+
+inline static quat quat_from_triad(vec3 accm, vec3 magm)
+{
+#if SPATIAL_FAST
+	return quat_from_triad_fast(accm, magm);
+#else
+	vec3 down  = accm;
+	vec3 east  = vec3cross(down, magm);
+	vec3 north = vec3cross(east, down);
+
+	down  = vec3unit(down);
+	east  = vec3unit(east);
+	north = vec3unit(north);
+
+	mat3 rm = {{north, east, down}};
+	return quat_from_mat3(rm);
+#endif
+}
+
+
+inline static vec3 quat_to_euler_fast(quat q)
+{
+	float sinr_cosp = 2 * (q.w * q.x + q.y * q.z);
+	float cosr_cosp = 1 - 2 * (q.x * q.x + q.y * q.y);
+	float sinp = 2 * (q.w * q.y - q.z * q.x);
+	float siny_cosp = 2 * (q.w * q.z + q.x * q.y);
+	float cosy_cosp = 1 - 2 * (q.y * q.y + q.z * q.z);
+
+	return (vec3){{
+		atan2f_fast(sinr_cosp, cosr_cosp),
+		asinf_fast(sinp),
+		atan2f_fast(siny_cosp, cosy_cosp),
+	}};
 }
 
 
 inline static vec3 quat_to_euler(quat q)
 {
+#if SPATIAL_FAST
+	return quat_to_euler_fast(q);
+#else
 	vec3 angles = {};
 
 	/* roll (x-axis rotation) */
 	float sinr_cosp = 2 * (q.w * q.x + q.y * q.z);
 	float cosr_cosp = 1 - 2 * (q.x * q.x + q.y * q.y);
-	angles.row[0] = atan2(sinr_cosp, cosr_cosp);
+	angles.row[0] = atan2f(sinr_cosp, cosr_cosp);
 
 	/* pitch (y-axis rotation) */
 	float sinp = 2 * (q.w * q.y - q.z * q.x);
-	if (fabs(sinp) >= 1) {
+	if (fabsf(sinp) >= 1) {
 		/* use 90 degrees if out of range */
-		angles.row[1] = copysign(M_PI / 2, sinp);
+		angles.row[1] = copysignf((float)M_PI / 2, sinp);
 	} else {
-		angles.row[1] = asin(sinp);
+		angles.row[1] = asinf(sinp);
 	}
 
 	/* yaw (z-axis rotation) */
 	float siny_cosp = 2 * (q.w * q.z + q.x * q.y);
 	float cosy_cosp = 1 - 2 * (q.y * q.y + q.z * q.z);
-	angles.row[2] = atan2(siny_cosp, cosy_cosp);
+	angles.row[2] = atan2f(siny_cosp, cosy_cosp);
 
 	return angles;
+#endif
+}
+
+
+
+/*
+ * Smallest Three Encoding
+ * =======================
+ *
+ * The largest component of an unit quaternion is dropped and restored
+ * from the other three. We can always make it positive, since q and -q
+ * represent the same rotation. The remaining components then fit into
+ * ±1/√2 and are quantized to `bits` each, giving a total of
+ * QUAT_PACK_BITS(bits) bits. Up to 20 bits per component are supported.
+ *
+ * Worst case angular error stays under 4.9 / (2^bits - 1) radians,
+ * so 10 bits give under 0.3° in 32 bits per quaternion. Beyond 14 bits
+ * the error is dominated by single precision floats.
+ */
+#define QUAT_PACK_BITS(bits) (2 + 3 * (bits))
+
+
+inline static uint64_t quat_pack(quat q, unsigned bits)
+{
+	float c[4] = {q.w, q.x, q.y, q.z};
+	uint64_t max = ((uint64_t)1 << bits) - 1;
+	unsigned big = 0;
+
+	for (unsigned i = 1; i < 4; i++)
+		if (fabsf(c[i]) > fabsf(c[big]))
+			big = i;
+
+	float sign = c[big] < 0 ? -1 : 1;
+	uint64_t v = big;
+	unsigned shift = 2;
+
+	for (unsigned i = 0; i < 4; i++) {
+		if (i == big)
+			continue;
+
+		float x = maxf(-1, minf(1, sign * c[i] * (float)M_SQRT2));
+		v |= (uint64_t)lrintf((x + 1) / 2 * max) << shift;
+		shift += bits;
+	}
+
+	return v;
+}
+
+
+inline static quat quat_unpack(uint64_t v, unsigned bits)
+{
+	uint64_t max = ((uint64_t)1 << bits) - 1;
+	unsigned big = v & 3;
+	unsigned shift = 2;
+	float c[4], sum = 0;
+
+	for (unsigned i = 0; i < 4; i++) {
+		if (i == big)
+			continue;
+
+		float x = (float)((v >> shift) & max) / max * 2 - 1;
+		c[i] = x / (float)M_SQRT2;
+		sum += c[i] * c[i];
+		shift += bits;
+	}
+
+	c[big] = sqrtf(maxf(0, 1 - sum));
+
+	return (quat){c[0], c[1], c[2], c[3]};
+}
+
+
+/*
+ * Attitude and Heading Reference System
+ * =====================================
+ *
+ * Mahony's complementary filter. Gyroscope rate is integrated into
+ * the orientation while its drift is corrected towards the directions
+ * of gravity and of the magnetic field using a PI controller.
+ *
+ * The orientation follows the same convention as quat_from_triad(),
+ * so that both can be used interchangeably.
+ */
+struct ahrs {
+	/* Current orientation estimate. */
+	quat q;
+
+	/* Integral feedback, effectively the gyroscope bias. */
+	vec3 bias;
+
+	/* Proportional and integral gains. */
+	float kp, ki;
+};
+
+typedef struct ahrs ahrs;
+
+
+/*
+ * Advance the filter by `dt` seconds using gyroscope rate in rad/s.
+ * Accelerometer and magnetometer units do not matter. Pass a zero
+ * magnetometer vector when there is no valid reading.
+ */
+inline static ahrs ahrs_update(ahrs f, vec3 gyro, vec3 accm, vec3 magm,
+                               float dt)
+{
+	vec3 e = {{0, 0, 0}};
+
+	if (vec3mag(accm) > 0) {
+		/* Estimated direction of gravity. */
+		vec3 v = quatrot(quatconj(f.q), (vec3){{0, 0, 1}});
+		e = vec3cross(vec3unit(accm), v);
+
+		if (vec3mag(magm) > 0) {
+			magm = vec3unit(magm);
+
+			/* Reference direction of the magnetic field. */
+			vec3 h = quatrot(f.q, magm);
+			vec3 b = {{hypotf(h.row[0], h.row[1]), 0, h.row[2]}};
+
+			/* Estimated direction of the magnetic field. */
+			vec3 w = quatrot(quatconj(f.q), b);
+			e = vec3add2(e, vec3cross(magm, w));
+		}
+	}
+
+	if (f.ki > 0)
+		f.bias = vec3add2(f.bias, vec3scale(f.ki * dt, e));
+
+	gyro = vec3add3(gyro, vec3scale(f.kp, e), f.bias);
+
+	/* Integrate rate of change of the quaternion. */
+	quat r = {0, gyro.row[0], gyro.row[1], gyro.row[2]};
+	quat dq = quatscale(0.5f * dt, quatmul(f.q, r));
+	f.q = quatunit(quatadd2(f.q, dq));
+
+	return f;
 }
 
 
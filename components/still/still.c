@@ -0,0 +1,48 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <still.h>
+
+
+void still_init(still *s, float threshold, float hold, unsigned divider)
+{
+	*s = (still){
+		.threshold = threshold,
+		.hold = hold,
+		.divider = divider ? divider : 1,
+	};
+}
+
+
+bool still_update(still *s, vec3 rate, float dt)
+{
+	if (vec3mag(rate) >= s->threshold) {
+		s->quiet = 0;
+		s->skipped = 0;
+		return true;
+	}
+
+	if (!still_idle(s)) {
+		s->quiet += dt;
+		return true;
+	}
+
+	if (++s->skipped < s->divider)
+		return false;
+
+	s->skipped = 0;
+	return true;
+}
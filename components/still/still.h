@@ -0,0 +1,75 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_STILL_H
+#define _COMPONENT_STILL_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * Stillness Detection
+ * ===================
+ *
+ * Decides how often to output poses based on how fast the head turns.
+ * Once the angular rate stays under the threshold for a while, only
+ * every n-th pose goes out. The very first sample above the threshold
+ * brings the full rate back, so that motion is never delayed.
+ *
+ * Depends on nothing but the samples fed in, so recorded traces can
+ * be replayed through it anywhere.
+ */
+
+struct still {
+	/* Angular rate considered motion, in rad/s. */
+	float threshold;
+
+	/* How long to stay under the threshold before slowing down, in s. */
+	float hold;
+
+	/* Pass every n-th pose while still. */
+	unsigned divider;
+
+	/* Time spent under the threshold so far, in s. */
+	float quiet;
+
+	/* Poses since the last one passed while still. */
+	unsigned skipped;
+};
+
+typedef struct still still;
+
+
+/* Start at full rate. */
+void still_init(still *s, float threshold, float hold, unsigned divider);
+
+/*
+ * Feed the bias-corrected angular `rate` of a sample taken `dt` seconds
+ * after the previous one. Returns whether to output the pose.
+ */
+bool still_update(still *s, vec3 rate, float dt);
+
+/* Check whether the head is currently considered still. */
+inline static bool still_idle(const still *s)
+{
+	return s->quiet >= s->hold;
+}
+
+
+#endif				/* !_COMPONENT_STILL_H */
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+
+#include <trace.h>
+
+
+/* Logging tag. */
+static const char *tag = "trace";
+
+
+/* Records waiting to be sent, about 0.25 s at 1 kHz. */
+#define QUEUE_LEN 256
+
+/* Records to send at once. */
+#define CHUNK_LEN 32
+
+
+struct pending {
+	uint64_t time;
+	trace_record r;
+};
+
+
+/* Preallocated queue of pending records. */
+static uint8_t queue_buf[QUEUE_LEN * sizeof(struct pending)];
+static StaticQueue_t queue_mem;
+static QueueHandle_t queue = NULL;
+
+
+/* Where to send the trace. */
+static const char *dst_host = NULL;
+static const char *dst_port = NULL;
+
+
+/* Header to start every connection with. */
+static trace_header header;
+
+
+/* Connect to the server, retrying until it accepts us. */
+static int connect_socket(void)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_STREAM,
+	};
+
+	while (true) {
+		struct addrinfo *res;
+
+		if (getaddrinfo(dst_host, dst_port, &hints, &res)) {
+			vTaskDelay(pdMS_TO_TICKS(1000));
+			continue;
+		}
+
+		int sock = socket(res->ai_family, res->ai_socktype, 0);
+
+		if (sock >= 0 && connect(sock, res->ai_addr, res->ai_addrlen)) {
+			close(sock);
+			sock = -1;
+		}
+
+		freeaddrinfo(res);
+
+		if (sock >= 0) {
+			ESP_LOGI(tag, "Streaming trace to %s:%s.",
+			         dst_host, dst_port);
+			return sock;
+		}
+
+		vTaskDelay(pdMS_TO_TICKS(1000));
+	}
+}
+
+
+static bool send_all(int sock, const uint8_t *buf, size_t len)
+{
+	while (len) {
+		int n = send(sock, buf, len, 0);
+
+		if (n <= 0)
+			return false;
+
+		buf += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+
+static void trace_task(void *arg)
+{
+	static uint8_t buf[CHUNK_LEN * TRACE_RECORD_SIZE];
+
+	while (true) {
+		int sock = connect_socket();
+		struct pending p;
+
+		/* Drop whatever piled up while we were away. */
+		xQueueReset(queue);
+
+		/* Header carries the time of the first record. */
+		xQueueReceive(queue, &p, portMAX_DELAY);
+		header.time = p.time;
+
+		trace_encode_header(buf, &header);
+		bool ok = send_all(sock, buf, TRACE_HEADER_SIZE);
+
+		uint64_t last = p.time;
+
+		while (ok) {
+			size_t len = 0;
+
+			do {
+				p.r.dt = p.time - last;
+				last = p.time;
+
+				len += trace_encode_record(buf + len, &p.r);
+			} while (len < sizeof(buf) && xQueueReceive(queue, &p, 0));
+
+			ok = send_all(sock, buf, len) &&
+			     xQueueReceive(queue, &p, portMAX_DELAY);
+		}
+
+		ESP_LOGW(tag, "Trace connection lost.");
+		close(sock);
+	}
+}
+
+
+void trace_stream_init(const char *host, const char *port,
+                       const trace_header *h)
+{
+	ESP_LOGI(tag, "Starting trace stream...");
+
+	dst_host = host;
+	dst_port = port;
+	header = *h;
+
+	queue = xQueueCreateStatic(QUEUE_LEN, sizeof(struct pending),
+	                           queue_buf, &queue_mem);
+
+	xTaskCreate(trace_task, "trace", 4096, NULL, 4, NULL);
+}
+
+
+bool trace_stream_push(uint64_t time, const trace_record *r)
+{
+	struct pending p = {
+		.time = time,
+		.r = *r,
+	};
+
+	return xQueueSend(queue, &p, 0);
+}
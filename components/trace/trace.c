@@ -0,0 +1,159 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <trace.h>
+
+
+static void put_u16(uint8_t *buf, uint16_t v)
+{
+	buf[0] = v;
+	buf[1] = v >> 8;
+}
+
+
+static void put_u32(uint8_t *buf, uint32_t v)
+{
+	buf[0] = v;
+	buf[1] = v >> 8;
+	buf[2] = v >> 16;
+	buf[3] = v >> 24;
+}
+
+
+static void put_f32(uint8_t *buf, float v)
+{
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	put_u32(buf, u);
+}
+
+
+static uint16_t get_u16(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8);
+}
+
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) |
+	       ((uint32_t)buf[3] << 24);
+}
+
+
+static float get_f32(const uint8_t *buf)
+{
+	uint32_t u = get_u32(buf);
+	float v;
+
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+
+size_t trace_encode_header(uint8_t buf[TRACE_HEADER_SIZE],
+                           const trace_header *h)
+{
+	memcpy(buf, "HBTR", 4);
+	put_u16(buf + 4, TRACE_VERSION);
+	put_u16(buf + 6, TRACE_HEADER_SIZE);
+	put_u32(buf + 8, h->time);
+	put_u32(buf + 12, h->time >> 32);
+	put_f32(buf + 16, h->accm_scale);
+	put_f32(buf + 20, h->gyro_scale);
+	put_f32(buf + 24, h->magm_scale[0]);
+	put_f32(buf + 28, h->magm_scale[1]);
+	put_f32(buf + 32, h->magm_scale[2]);
+	put_f32(buf + 36, h->temp_scale);
+	put_f32(buf + 40, h->dt);
+
+	return TRACE_HEADER_SIZE;
+}
+
+
+size_t trace_decode_header(trace_header *h, const uint8_t *buf, size_t len)
+{
+	if (len < 8 || memcmp(buf, "HBTR", 4))
+		return 0;
+
+	size_t size = get_u16(buf + 6);
+
+	if (TRACE_VERSION != get_u16(buf + 4) || size < TRACE_HEADER_SIZE ||
+	    len < TRACE_HEADER_SIZE)
+		return 0;
+
+	h->time = get_u32(buf + 8) | ((uint64_t)get_u32(buf + 12) << 32);
+	h->accm_scale = get_f32(buf + 16);
+	h->gyro_scale = get_f32(buf + 20);
+	h->magm_scale[0] = get_f32(buf + 24);
+	h->magm_scale[1] = get_f32(buf + 28);
+	h->magm_scale[2] = get_f32(buf + 32);
+	h->temp_scale = get_f32(buf + 36);
+	h->dt = get_f32(buf + 40);
+
+	return size;
+}
+
+
+size_t trace_encode_record(uint8_t buf[TRACE_RECORD_SIZE],
+                           const trace_record *r)
+{
+	put_u32(buf, r->dt);
+
+	for (int i = 0; i < 3; i++) {
+		put_u16(buf + 4 + 2 * i, r->accm[i]);
+		put_u16(buf + 10 + 2 * i, r->gyro[i]);
+		put_u16(buf + 16 + 2 * i, r->magm[i]);
+	}
+
+	put_u16(buf + 22, r->temp);
+	buf[24] = r->flags;
+
+	return TRACE_RECORD_SIZE;
+}
+
+
+void trace_decode_record(trace_record *r,
+                         const uint8_t buf[TRACE_RECORD_SIZE])
+{
+	r->dt = get_u32(buf);
+
+	for (int i = 0; i < 3; i++) {
+		r->accm[i] = get_u16(buf + 4 + 2 * i);
+		r->gyro[i] = get_u16(buf + 10 + 2 * i);
+		r->magm[i] = get_u16(buf + 16 + 2 * i);
+	}
+
+	r->temp = get_u16(buf + 22);
+	r->flags = buf[24];
+}
+
+
+int16_t trace_raw(float value, float scale)
+{
+	float v = roundf(value / scale);
+
+	if (v > INT16_MAX)
+		return INT16_MAX;
+
+	if (v < INT16_MIN)
+		return INT16_MIN;
+
+	return v;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_TRACE_H
+#define _COMPONENT_TRACE_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ * Sensor Trace
+ * ============
+ *
+ * Compact binary recording of the raw sensor registers, so that real
+ * motion can be replayed through the pipeline later on. A trace is a
+ * header followed by fixed size records, all fields little-endian.
+ *
+ * Header:
+ *
+ *   0  magic "HBTR"
+ *   4  u16 version (1)
+ *   6  u16 header size (44)
+ *   8  u64 time of the first record (μs since boot)
+ *  16  f32 accelerometer sensitivity (m/s² per LSB)
+ *  20  f32 gyroscope sensitivity (rad/s per LSB)
+ *  24  f32 magnetometer sensitivity x, y, z (μT per LSB)
+ *  36  f32 temperature sensitivity (°C per LSB)
+ *  40  f32 nominal time between samples (s)
+ *
+ * Temperature is offset by 21 °C.
+ *
+ * Record:
+ *
+ *   0  u32 time since the previous record (μs)
+ *   4  i16 accelerometer x, y, z
+ *  10  i16 gyroscope x, y, z
+ *  16  i16 magnetometer x, y, z (as reported, before alignment)
+ *  22  i16 temperature
+ *  24  u8  flags (bit 0: magnetometer valid)
+ *
+ * Readers should skip header bytes they do not know about.
+ */
+
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 44
+#define TRACE_RECORD_SIZE 25
+
+#define TRACE_MAGM_OK 0x01
+
+
+struct trace_header {
+	uint64_t time;
+	float accm_scale;
+	float gyro_scale;
+	float magm_scale[3];
+	float temp_scale;
+	float dt;
+};
+
+typedef struct trace_header trace_header;
+
+
+struct trace_record {
+	uint32_t dt;
+	int16_t accm[3];
+	int16_t gyro[3];
+	int16_t magm[3];
+	int16_t temp;
+	uint8_t flags;
+};
+
+typedef struct trace_record trace_record;
+
+
+/* Serialize the header. Returns number of bytes used. */
+size_t trace_encode_header(uint8_t buf[TRACE_HEADER_SIZE],
+                           const trace_header *h);
+
+/*
+ * Deserialize the header. Returns its full size, so that the records
+ * can be found, or 0 when it is not a trace we understand.
+ */
+size_t trace_decode_header(trace_header *h, const uint8_t *buf, size_t len);
+
+/* Serialize a record. Returns number of bytes used. */
+size_t trace_encode_record(uint8_t buf[TRACE_RECORD_SIZE],
+                           const trace_record *r);
+
+/* Deserialize a record. */
+void trace_decode_record(trace_record *r,
+                         const uint8_t buf[TRACE_RECORD_SIZE]);
+
+/* Convert a reading to the register value, given the sensitivity. */
+int16_t trace_raw(float value, float scale);
+
+
+/*
+ * Stream the trace to a TCP server from a dedicated task, starting
+ * with the header on every connection. Records are dropped while
+ * there is no connection or the network cannot keep up.
+ */
+void trace_stream_init(const char *host, const char *port,
+                       const trace_header *h);
+
+/*
+ * Queue record of a sample taken at `time` (μs since boot) for
+ * streaming. Its `dt` is filled in later on. Returns false when it
+ * was dropped.
+ */
+bool trace_stream_push(uint64_t time, const trace_record *r);
+
+
+#endif				/* !_COMPONENT_TRACE_H */
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+
+#include <udpout.h>
+#include <prof.h>
+
+
+/* Logging tag. */
+static const char *tag = "udpout";
+
+
+/* Maximum number of poses waiting to be sent. */
+#define QUEUE_LEN (2 * UDPOUT_BATCH_MAX)
+
+
+/* Pose to send, or a request to send the batch right away. */
+struct item {
+	udpout_pose p;
+	bool flush;
+};
+
+
+/* Preallocated queue of pending poses. */
+static uint8_t queue_buf[QUEUE_LEN * sizeof(struct item)];
+static StaticQueue_t queue_mem;
+static QueueHandle_t queue = NULL;
+
+
+/* Where to send the poses. */
+static const char *dst_host = NULL;
+static const char *dst_port = NULL;
+
+
+/* How to pack the poses. */
+static unsigned batch_len = 1;
+static unsigned pack_bits = 0;
+
+
+/* Next sequence number, to reveal lost packets. */
+static uint32_t next_seq = 0;
+
+/* Whether a pose went out since the last flush request. */
+static bool unflushed = false;
+
+
+/* Resolve the destination, retrying until the network comes up. */
+static int connect_socket(void)
+{
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_DGRAM,
+	};
+
+	while (true) {
+		struct addrinfo *res;
+
+		if (getaddrinfo(dst_host, dst_port, &hints, &res)) {
+			vTaskDelay(pdMS_TO_TICKS(1000));
+			continue;
+		}
+
+		int sock = socket(res->ai_family, res->ai_socktype, 0);
+
+		if (sock >= 0 && connect(sock, res->ai_addr, res->ai_addrlen)) {
+			close(sock);
+			sock = -1;
+		}
+
+		freeaddrinfo(res);
+
+		if (sock >= 0) {
+			ESP_LOGI(tag, "Sending poses to %s:%s.",
+			         dst_host, dst_port);
+			return sock;
+		}
+
+		vTaskDelay(pdMS_TO_TICKS(1000));
+	}
+}
+
+
+static void flush(int sock, const udpout_pose *batch, size_t count)
+{
+	static uint8_t buf[UDPOUT_PACKED_SIZE(UDPOUT_BATCH_MAX,
+	                                      UDPOUT_BITS_MAX)];
+	size_t len;
+
+	if (!count)
+		return;
+
+	PROF_TIME(t0);
+
+	if (pack_bits)
+		len = udpout_encode_packed(buf, batch, count, pack_bits);
+	else
+		len = udpout_encode(buf, batch);
+
+	PROF_SINCE(PROF_ENCODE, t0);
+	PROF_TIME(t1);
+
+	/* Datagrams are lost while the link is down, that is fine. */
+	send(sock, buf, len, 0);
+
+	PROF_SINCE(PROF_SEND, t1);
+
+#if CONFIG_PROF_ENABLE
+	/* Measure how long it took every pose to get out. */
+	for (size_t i = 0; i < count; i++)
+		PROF_SINCE(PROF_LATENCY, batch[i].time);
+#endif
+}
+
+
+/*
+ * Check whether a step between poses is off the period of the batch by
+ * more than a quarter, as when samples were dropped on the way.
+ */
+static bool off_period(uint64_t period, uint64_t step)
+{
+	uint64_t diff = period > step ? period - step : step - period;
+	return 4 * diff > period;
+}
+
+
+static void udpout_task(void *arg)
+{
+	static udpout_pose batch[UDPOUT_BATCH_MAX];
+	size_t count = 0;
+
+	int sock = connect_socket();
+
+	while (true) {
+		struct item it;
+
+		/* Do not hold an incomplete batch back for too long. */
+		TickType_t timeout = count ? pdMS_TO_TICKS(20) : portMAX_DELAY;
+
+		if (!xQueueReceive(queue, &it, timeout) || it.flush) {
+			flush(sock, batch, count);
+			count = 0;
+			continue;
+		}
+
+		udpout_pose p = it.p;
+
+		/* Batches carry only consecutive poses. */
+		if (count && p.seq != batch[count - 1].seq + 1) {
+			flush(sock, batch, count);
+			count = 0;
+		}
+
+		/* Poses must be evenly spaced, start over on any gap. */
+		if (count >= 2 && off_period(batch[1].time - batch[0].time,
+		                             p.time - batch[count - 1].time)) {
+			flush(sock, batch, count);
+			count = 0;
+		}
+
+		batch[count++] = p;
+
+		if (count >= batch_len) {
+			flush(sock, batch, count);
+			count = 0;
+		}
+	}
+}
+
+
+void udpout_init(const char *host, const char *port,
+                 unsigned batch, unsigned bits)
+{
+	ESP_LOGI(tag, "Starting UDP output...");
+
+	if (bits > UDPOUT_BITS_MAX || batch < 1 || batch > UDPOUT_BATCH_MAX) {
+		ESP_LOGE(tag, "Invalid packing: %u poses, %u bits", batch, bits);
+		abort();
+	}
+
+	dst_host = host;
+	dst_port = port;
+	batch_len = bits ? batch : 1;
+	pack_bits = bits;
+
+	queue = xQueueCreateStatic(QUEUE_LEN, sizeof(struct item),
+	                           queue_buf, &queue_mem);
+
+	xTaskCreate(udpout_task, "udpout", 4096, NULL, 5, NULL);
+}
+
+
+bool udpout_send(uint64_t time, quat q)
+{
+	struct item it = {
+		.p = {
+			.seq = next_seq++,
+			.time = time,
+			.q = q,
+		},
+	};
+
+	unflushed = true;
+	return xQueueSend(queue, &it, 0);
+}
+
+
+bool udpout_flush(void)
+{
+	struct item it = {
+		.flush = true,
+	};
+
+	if (!unflushed)
+		return true;
+
+	if (!xQueueSend(queue, &it, 0))
+		return false;
+
+	unflushed = false;
+	return true;
+}
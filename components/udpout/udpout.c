@@ -0,0 +1,178 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <udpout.h>
+
+
+static void put_u32(uint8_t *buf, uint32_t v)
+{
+	buf[0] = v;
+	buf[1] = v >> 8;
+	buf[2] = v >> 16;
+	buf[3] = v >> 24;
+}
+
+
+static void put_f32(uint8_t *buf, float v)
+{
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	put_u32(buf, u);
+}
+
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+
+static float get_f32(const uint8_t *buf)
+{
+	uint32_t u = get_u32(buf);
+	float v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+
+static void put_header(uint8_t *buf, uint8_t type, const udpout_pose *p)
+{
+	buf[0] = 'H';
+	buf[1] = 'B';
+	buf[2] = UDPOUT_VERSION;
+	buf[3] = type;
+
+	put_u32(buf + 4, p->seq);
+	put_u32(buf + 8, p->time);
+	put_u32(buf + 12, p->time >> 32);
+}
+
+
+size_t udpout_encode(uint8_t buf[UDPOUT_QUAT_SIZE], const udpout_pose *p)
+{
+	put_header(buf, UDPOUT_TYPE_QUAT, p);
+
+	put_f32(buf + 16, p->q.w);
+	put_f32(buf + 20, p->q.x);
+	put_f32(buf + 24, p->q.y);
+	put_f32(buf + 28, p->q.z);
+
+	return UDPOUT_QUAT_SIZE;
+}
+
+
+size_t udpout_encode_packed(uint8_t *buf, const udpout_pose *p,
+                            size_t count, unsigned bits)
+{
+	put_header(buf, UDPOUT_TYPE_PACKED, p);
+
+	put_u32(buf + 16, p[count - 1].time - p[0].time);
+	buf[20] = count;
+	buf[21] = bits;
+
+	size_t len = UDPOUT_PACKED_SIZE(count, bits);
+	memset(buf + 22, 0, len - 22);
+
+	/* Append every pose to the bit stream. */
+	unsigned width = QUAT_PACK_BITS(bits);
+	size_t pos = 22 * 8;
+
+	for (size_t i = 0; i < count; i++) {
+		uint64_t v = quat_pack(p[i].q, bits);
+
+		for (unsigned done = 0; done < width; /**/) {
+			unsigned bit = pos % 8;
+			unsigned n = width - done < 8 - bit ? width - done : 8 - bit;
+
+			buf[pos / 8] |= ((v >> done) & ((1u << n) - 1)) << bit;
+			done += n;
+			pos += n;
+		}
+	}
+
+	return len;
+}
+
+
+size_t udpout_decode(udpout_pose *p, const uint8_t *buf, size_t len)
+{
+	if (len < 16 || buf[0] != 'H' || buf[1] != 'B')
+		return 0;
+
+	if (buf[2] != UDPOUT_VERSION)
+		return 0;
+
+	uint32_t seq = get_u32(buf + 4);
+	uint64_t time = get_u32(buf + 8) | (uint64_t)get_u32(buf + 12) << 32;
+
+	if (UDPOUT_TYPE_QUAT == buf[3]) {
+		if (len != UDPOUT_QUAT_SIZE)
+			return 0;
+
+		p->seq = seq;
+		p->time = time;
+		p->q.w = get_f32(buf + 16);
+		p->q.x = get_f32(buf + 20);
+		p->q.y = get_f32(buf + 24);
+		p->q.z = get_f32(buf + 28);
+
+		return 1;
+	}
+
+	if (UDPOUT_TYPE_PACKED != buf[3] || len < 22)
+		return 0;
+
+	uint32_t span = get_u32(buf + 16);
+	size_t count = buf[20];
+	unsigned bits = buf[21];
+
+	if (!count || count > UDPOUT_BATCH_MAX || !bits)
+		return 0;
+
+	if (bits > UDPOUT_BITS_MAX || len != UDPOUT_PACKED_SIZE(count, bits))
+		return 0;
+
+	/* Take every pose from the bit stream. */
+	unsigned width = QUAT_PACK_BITS(bits);
+	size_t pos = 22 * 8;
+
+	for (size_t i = 0; i < count; i++) {
+		uint64_t v = 0;
+
+		for (unsigned done = 0; done < width; /**/) {
+			unsigned bit = pos % 8;
+			unsigned n = width - done < 8 - bit ? width - done : 8 - bit;
+
+			v |= (uint64_t)((buf[pos / 8] >> bit) & ((1u << n) - 1))
+			     << done;
+			done += n;
+			pos += n;
+		}
+
+		p[i].seq = seq + i;
+		p[i].time = time;
+		p[i].q = quat_unpack(v, bits);
+
+		/* Evenly spaced between the first and the last. */
+		if (count > 1)
+			p[i].time += (uint64_t)span * i / (count - 1);
+	}
+
+	return count;
+}
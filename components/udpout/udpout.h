@@ -0,0 +1,123 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_UDPOUT_H
+#define _COMPONENT_UDPOUT_H 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <spatial.h>
+
+
+/*
+ * UDP Output
+ * ==========
+ *
+ * Streams poses to a remote host from a dedicated task, so that the
+ * caller never blocks on the network stack.
+ *
+ * Poses are sent either one per datagram as floats, or in batches
+ * using the smallest three encoding (see quat_pack() in spatial.h).
+ * All fields are little-endian:
+ *
+ *   0  magic "HB"
+ *   2  u8  version (1)
+ *   3  u8  type (0 = float quaternion, 1 = packed batch)
+ *   4  u32 sequence number (of the first pose)
+ *   8  u64 timestamp (of the first pose, μs since boot)
+ *
+ * Float quaternion continues with:
+ *
+ *  16  f32 w, x, y, z
+ *
+ * Packed batch continues with:
+ *
+ *  16  u32 time between the first and the last pose (μs)
+ *  20  u8  number of poses
+ *  21  u8  bits per component
+ *  22  poses as a continuous stream of QUAT_PACK_BITS(bits) wide
+ *      integers, least significant bit first, padded to whole bytes
+ *
+ * Poses within a batch have consecutive sequence numbers and are evenly
+ * spaced in time, so their timestamps are meant to be interpolated.
+ * A batch ends early whenever the next pose is more than a quarter of
+ * the period off, such as when samples were dropped before sending.
+ */
+
+#define UDPOUT_VERSION 1
+#define UDPOUT_TYPE_QUAT 0
+#define UDPOUT_TYPE_PACKED 1
+
+#define UDPOUT_QUAT_SIZE 32
+
+#define UDPOUT_BATCH_MAX 64
+#define UDPOUT_BITS_MAX 20
+#define UDPOUT_PACKED_SIZE(count, bits) \
+	(22 + (QUAT_PACK_BITS(bits) * (count) + 7) / 8)
+
+
+/* Pose with its sequence number and timestamp. */
+struct udpout_pose {
+	uint32_t seq;
+	uint64_t time;
+	quat q;
+};
+
+typedef struct udpout_pose udpout_pose;
+
+
+/* Encode single pose into `buf`. Returns number of bytes used. */
+size_t udpout_encode(uint8_t buf[UDPOUT_QUAT_SIZE], const udpout_pose *p);
+
+/*
+ * Encode `count` poses into `buf` that must be able to hold at least
+ * UDPOUT_PACKED_SIZE(count, bits) bytes. Returns number of bytes used.
+ */
+size_t udpout_encode_packed(uint8_t *buf, const udpout_pose *p,
+                            size_t count, unsigned bits);
+
+/*
+ * Decode datagram of `len` bytes of either type into `p` that must be
+ * able to hold UDPOUT_BATCH_MAX poses. Timestamps within a batch are
+ * interpolated. Returns number of poses, 0 for invalid datagrams.
+ */
+size_t udpout_decode(udpout_pose *p, const uint8_t *buf, size_t len);
+
+/*
+ * Start the sending task. Both `host` and `port` may be names.
+ * With `bits` set to 0 poses are sent as floats, one per datagram.
+ * Otherwise up to `batch` poses are packed into every datagram.
+ */
+void udpout_init(const char *host, const char *port,
+                 unsigned batch, unsigned bits);
+
+/*
+ * Queue pose for sending. Never blocks. Returns false when the queue
+ * is full and the pose had to be dropped.
+ */
+bool udpout_send(uint64_t time, quat q);
+
+/*
+ * Send the poses batched so far right away, because the ones that
+ * would follow are held back. Only the first call after a pose was
+ * queued does anything. Returns false when the queue is full.
+ */
+bool udpout_flush(void);
+
+
+#endif				/* !_COMPONENT_UDPOUT_H */
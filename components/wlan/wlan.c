@@ -0,0 +1,100 @@
+/*
+ * Copyright (C)  Singularita s.r.o. <info@singularita.net>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <esp_wifi.h>
+#include <esp_netif.h>
+
+#include <wlan.h>
+
+
+/* Logging tag. */
+static const char *tag = "wlan";
+
+
+/* Whether we have an address. */
+static volatile bool connected = false;
+
+
+static void on_wifi_event(void *arg, esp_event_base_t base,
+                          int32_t id, void *data)
+{
+	if (WIFI_EVENT_STA_START == id) {
+		ESP_ERROR_CHECK(esp_wifi_connect());
+	} else if (WIFI_EVENT_STA_DISCONNECTED == id) {
+		ESP_LOGW(tag, "Disconnected, reconnecting...");
+		connected = false;
+		esp_wifi_connect();
+	}
+}
+
+
+static void on_ip_event(void *arg, esp_event_base_t base,
+                        int32_t id, void *data)
+{
+	ip_event_got_ip_t *event = data;
+
+	ESP_LOGI(tag, "Got address " IPSTR, IP2STR(&event->ip_info.ip));
+	connected = true;
+}
+
+
+void wlan_init(const char *ssid, const char *password,
+               unsigned listen_interval)
+{
+	ESP_LOGI(tag, "Connecting to %s...", ssid);
+
+	ESP_ERROR_CHECK(esp_netif_init());
+	ESP_ERROR_CHECK(esp_event_loop_create_default());
+	esp_netif_create_default_wifi_sta();
+
+	wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+	ESP_ERROR_CHECK(esp_wifi_init(&init));
+
+	ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+	                                           on_wifi_event, NULL));
+	ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT,
+	                                           IP_EVENT_STA_GOT_IP,
+	                                           on_ip_event, NULL));
+
+	wifi_config_t conf = {};
+	strlcpy((char *)conf.sta.ssid, ssid, sizeof(conf.sta.ssid));
+	strlcpy((char *)conf.sta.password, password,
+	        sizeof(conf.sta.password));
+	conf.sta.listen_interval = listen_interval;
+
+	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+	ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &conf));
+	ESP_ERROR_CHECK(esp_wifi_start());
+
+	/*
+	 * Modem sleep would delay our packets by up to a beacon interval.
+	 * Outgoing ones are affected much less than the incoming ones.
+	 */
+	if (listen_interval)
+		ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
+	else
+		ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+}
+
+
+bool wlan_connected(void)
+{
+	return connected;
+}
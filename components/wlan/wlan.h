@@ -0,0 +1,48 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _COMPONENT_WLAN_H
+#define _COMPONENT_WLAN_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+
+/*
+ * Wireless LAN
+ * ============
+ *
+ * Keeps the station connected to a single access point, reconnecting
+ * whenever the link drops. Sockets can be used as soon as we get an
+ * address, until then sending simply fails.
+ *
+ * WiFi driver keeps its calibration data in the NVS, so make sure to
+ * initialize it first.
+ */
+
+/*
+ * Start connecting to the given network. With non-zero `listen_interval`
+ * the modem sleeps and wakes up only for every n-th beacon, which saves
+ * a lot of power, but delays incoming packets.
+ */
+void wlan_init(const char *ssid, const char *password,
+               unsigned listen_interval);
+
+/* Check whether we currently have an address. */
+bool wlan_connected(void);
+
+
+#endif				/* !_COMPONENT_WLAN_H */
@@ -21,33 +21,439 @@
 #include <esp_err.h>
 #include <esp_log.h>
 #include <esp_pm.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include <i2ce.h>
+#include <regio.h>
+#include <drdy.h>
+#include <pace.h>
 #include <mpu9250.h>
 #include <ak8963.h>
 #include <spatial.h>
+#include <wlan.h>
+#include <udpout.h>
+#include <ring.h>
+#include <prof.h>
+#include <fusion.h>
+#include <still.h>
+#include <predict.h>
+#include <deadband.h>
+#include <serout.h>
+#include <trace.h>
+#include <calstore.h>
+#include <gyrocal.h>
 
 
 /* Tag for logging. */
 static const char tag[] = "main";
 
 
-static void init_i2c(void)
+/* Whether to trade some latency while still for battery life. */
+#if CONFIG_POWER_SAVE
+static const bool power_save = true;
+#else
+static const bool power_save = false;
+#endif
+
+
+/* Whether the MPU9250 polls the magnetometer on its own. */
+#if CONFIG_MPU9250_MAG_MASTER
+static const bool mag_master = true;
+#else
+static const bool mag_master = false;
+#endif
+
+
+#if CONFIG_POWER_SAVE
+/* Output rate control, full rate only while moving. */
+static still motion;
+#endif
+
+
+static void init_power(void)
+{
+#if CONFIG_POWER_SAVE
+	/* Sleep between samples, the data-ready interrupt wakes us up. */
+	esp_pm_config_esp32_t pm = {
+		.max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+		.min_freq_mhz = CONFIG_POWER_MIN_FREQ,
+		.light_sleep_enable = true,
+	};
+
+	ESP_ERROR_CHECK(esp_pm_configure(&pm));
+
+	still_init(&motion, CONFIG_POWER_STILL_THRESHOLD * M_PI / 180,
+	           CONFIG_POWER_STILL_HOLD / 1000.0,
+	           CONFIG_POWER_STILL_DIVIDER);
+#endif
+}
+
+
+static void init_nvs(void)
+{
+	esp_err_t err = nvs_flash_init();
+
+	if (ESP_ERR_NVS_NO_FREE_PAGES == err ||
+	    ESP_ERR_NVS_NEW_VERSION_FOUND == err) {
+		ESP_ERROR_CHECK(nvs_flash_erase());
+		err = nvs_flash_init();
+	}
+
+	ESP_ERROR_CHECK(err);
+}
+
+
+/* Accelerometer with gyroscope and the magnetometer behind it. */
+struct imu {
+	/* How to reach the sensors. */
+	regio mpu_io, mag_io;
+
+	mpu9250 mpu;
+	ak8963 mag;
+
+	/* Whether the MPU9250 fetches magnetometer readings for us. */
+	bool master;
+
+	/* Own stages, the second one is read from its own task. */
+	enum prof_stage prof_mpu, prof_mag;
+};
+
+
+#if CONFIG_MPU9250_SECOND
+#define NUM_IMUS 2
+#else
+#define NUM_IMUS 1
+#endif
+
+static struct imu imus[NUM_IMUS] = {
+	{.prof_mpu = PROF_READ_MPU9250, .prof_mag = PROF_READ_AK8963},
+#if CONFIG_MPU9250_SECOND
+	{.prof_mpu = PROF_READ_SECOND_MPU9250,
+	 .prof_mag = PROF_READ_SECOND_AK8963},
+#endif
+};
+
+
+/* Readings stay in raw counts all the way to the fusion, or not. */
+#if CONFIG_MPU9250_COUNTS
+typedef int16_t reading;
+#else
+typedef float reading;
+#endif
+
+
+static void init_bus(void)
+{
+	struct imu *imu = imus;
+
+#if CONFIG_MPU9250_SPI
+	regio_spi_init(&imu->mpu_io, SPI2_HOST,
+	               CONFIG_MPU9250_MOSI_GPIO,
+	               CONFIG_MPU9250_MISO_GPIO,
+	               CONFIG_MPU9250_SCLK_GPIO,
+	               CONFIG_MPU9250_CS_GPIO,
+	               CONFIG_MPU9250_SPI_FREQ);
+#else
+	ESP_ERROR_CHECK(i2ce_master_init(I2C_NUM_0,
+	                                 CONFIG_MPU9250_SDA_GPIO,
+	                                 CONFIG_MPU9250_SCL_GPIO,
+	                                 CONFIG_MPU9250_I2C_FREQ,
+	                                 CONFIG_MPU9250_I2C_TIMEOUT));
+
+	regio_i2c_init(&imu->mpu_io, I2C_NUM_0, MPU9250_ADDR);
+	regio_i2c_init(&imu->mag_io, I2C_NUM_0, AK8963_ADDR);
+#endif
+
+#if CONFIG_MPU9250_SECOND
+	i2c_port_t port = CONFIG_MPU9250_SECOND_PORT;
+	uint8_t addr = MPU9250_ADDR;
+
+#if CONFIG_MPU9250_SECOND_AD0
+	addr = MPU9250_ADDR_ALT;
+#endif
+
+	if (I2C_NUM_0 == port && MPU9250_ADDR == addr) {
+		ESP_LOGE(tag, "Both sensors at %#hhx on I2C port 0!", addr);
+		abort();
+	}
+
+#if CONFIG_MPU9250_SECOND_PORT
+	ESP_ERROR_CHECK(i2ce_master_init(port,
+	                                 CONFIG_MPU9250_SECOND_SDA_GPIO,
+	                                 CONFIG_MPU9250_SECOND_SCL_GPIO,
+	                                 CONFIG_MPU9250_I2C_FREQ,
+	                                 CONFIG_MPU9250_I2C_TIMEOUT));
+#endif
+
+	regio_i2c_init(&imus[1].mpu_io, port, addr);
+#endif
+}
+
+
+/* Set all the sensors up, from scratch if they already were. */
+static esp_err_t init_sensors(void)
+{
+	mpu9250_config mpu_cfg = {
+		.gyro_fs = CONFIG_MPU9250_GYRO_FS,
+		.accm_fs = CONFIG_MPU9250_ACCEL_FS,
+		.dlpf = CONFIG_MPU9250_DLPF_CFG,
+#if CONFIG_MPU9250_DRDY
+		.smplrt_div = MPU9250_RATE_DIV(CONFIG_MPU9250_RATE),
+#else
+		.smplrt_div = MPU9250_RATE_DIV(1000),
+#endif
+	};
+
+	ak8963_config ak_cfg = {
+#if CONFIG_AK8963_100HZ
+		.mode = AK8963_MODE_100HZ,
+#else
+		.mode = AK8963_MODE_8HZ,
+#endif
+		.bits16 = true,
+	};
+
+	for (int i = 0; i < NUM_IMUS; i++) {
+		struct imu *imu = imus + i;
+
+		/* First enable the accelerometer with gyroscope. */
+		REGIO_TRY(mpu9250_init(&imu->mpu, &imu->mpu_io, &mpu_cfg));
+
+		/*
+		 * Magnetometer hides behind the auxiliary bus on SPI. The
+		 * second one as well, its address would clash otherwise.
+		 */
+		if (REGIO_SPI == imu->mpu_io.bus || i > 0) {
+			REGIO_TRY(mpu9250_aux_init(&imu->mpu, &imu->mag_io,
+			                           AK8963_ADDR));
+		}
+
+		/* Now initialize the magnetometer. */
+		REGIO_TRY(ak8963_init(&imu->mag, &imu->mag_io, &ak_cfg));
+
+		imu->master = mag_master || i > 0;
+
+		/* Finally let the MPU9250 fetch magnetometer readings for us. */
+		if (imu->master) {
+			REGIO_TRY(mpu9250_enable_master(&imu->mpu, AK8963_ADDR,
+			                                AK8963_DATA_REG,
+			                                AK8963_DATA_LEN));
+		}
+	}
+
+#if CONFIG_MPU9250_FIFO
+	REGIO_TRY(mpu9250_fifo_enable(&imus[0].mpu));
+#endif
+
+#if CONFIG_MPU9250_DRDY
+	/* Only a level is able to wake the chip up. */
+	REGIO_TRY(mpu9250_int_enable(&imus[0].mpu, power_save));
+#endif
+
+	return ESP_OK;
+}
+
+
+/* Wait between attempts to set up sensors that do not answer, in ms. */
+#define RETRY_MS 500
+
+
+/* Set the sensors up, tell whether they all answered. */
+static bool start_sensors(void)
+{
+	esp_err_t err = init_sensors();
+
+	if (err)
+		ESP_LOGE(tag, "Sensors failed: %s", esp_err_to_name(err));
+
+	return !err;
+}
+
+
+/* Free the buses from whatever a sensor left them in. */
+static void recover_buses(void)
+{
+#if CONFIG_MPU9250_I2C
+	i2ce_recover(I2C_NUM_0);
+#endif
+
+#if CONFIG_MPU9250_SECOND_PORT
+	i2ce_recover(CONFIG_MPU9250_SECOND_PORT);
+#endif
+}
+
+
+#if CONFIG_MPU9250_FIFO
+/* Frames drained from the FIFO during the last read. */
+static mpu9250_frame frames[MPU9250_FIFO_FRAMES];
+static size_t num_frames = 0;
+
+
+/*
+ * Drain the FIFO and average all new frames into a single sample.
+ * Individual frames are kept around for the orientation filter.
+ */
+static esp_err_t read_fifo(float accm[3], float gyro[3])
+{
+	bool overflow;
+
+	REGIO_TRY(mpu9250_fifo_read(&imus[0].mpu, frames, MPU9250_FIFO_FRAMES,
+	                            &num_frames, &overflow));
+
+	if (overflow)
+		ESP_LOGW(tag, "FIFO overflow, samples lost!");
+
+	if (!num_frames)
+		return ESP_OK;
+
+	for (int i = 0; i < 3; i++) {
+		accm[i] = gyro[i] = 0;
+
+		for (size_t j = 0; j < num_frames; j++) {
+			accm[i] += frames[j].accm[i];
+			gyro[i] += frames[j].gyro[i];
+		}
+
+		accm[i] /= num_frames;
+		gyro[i] /= num_frames;
+	}
+
+	return ESP_OK;
+}
+#endif
+
+
+/* Take a sample of all nine axes, tell whether the magnetometer is ok. */
+static esp_err_t read_imu(const struct imu *imu, reading accm[3],
+                          reading gyro[3], reading temp[1], reading magm[3],
+                          bool *magm_ok)
+{
+	uint8_t ext[AK8963_DATA_LEN];
+
+	PROF_TIME(t0);
+
+#if CONFIG_MPU9250_COUNTS
+	REGIO_TRY(mpu9250_read_counts(&imu->mpu, accm, gyro, temp,
+	                              ext, imu->master ? sizeof(ext) : 0));
+#else
+	if (imu->master) {
+		REGIO_TRY(mpu9250_read_raw_ext(&imu->mpu, accm, gyro, temp,
+		                               ext, sizeof(ext)));
+	} else {
+		REGIO_TRY(mpu9250_read_raw(&imu->mpu, accm, gyro, temp));
+	}
+#endif
+
+#if CONFIG_MPU9250_FIFO
+	/* Prefer all the buffered samples over the latest one. */
+	REGIO_TRY(read_fifo(accm, gyro));
+#endif
+
+	PROF_SINCE(imu->prof_mpu, t0);
+	PROF_TIME(t1);
+
+	esp_err_t err = ESP_OK;
+
+#if CONFIG_MPU9250_COUNTS
+	if (imu->master)
+		*magm_ok = ak8963_decode_counts(ext, magm);
+	else
+		err = ak8963_read_counts(&imu->mag, magm, magm_ok);
+#else
+	if (imu->master)
+		*magm_ok = ak8963_decode(&imu->mag, ext, magm);
+	else
+		err = ak8963_read_raw(&imu->mag, magm, magm_ok);
+#endif
+
+	PROF_SINCE(imu->prof_mag, t1);
+
+	return err;
+}
+
+
+#if CONFIG_MPU9250_SECOND
+/* Sample of the second sensor. */
+static float second_accm[3], second_gyro[3], second_temp, second_magm[3];
+static bool second_ok;
+static esp_err_t second_err;
+
+/* Reads the second sensor on the other I2C port in parallel. */
+static TaskHandle_t second_handle = NULL;
+static StaticSemaphore_t second_done_mem;
+static SemaphoreHandle_t second_done = NULL;
+
+
+static void second_task(void *arg)
+{
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		second_err = read_imu(imus + 1, second_accm, second_gyro,
+		                      &second_temp, second_magm, &second_ok);
+
+		xSemaphoreGive(second_done);
+	}
+}
+
+
+static void init_second(void)
 {
-	i2ce_master_init(I2C_NUM_0,
-	                 CONFIG_MPU9250_SDA_GPIO,
-	                 CONFIG_MPU9250_SCL_GPIO,
-	                 100000);
+	if (I2C_NUM_0 == imus[1].mpu_io.port)
+		return;
+
+	second_done = xSemaphoreCreateBinaryStatic(&second_done_mem);
+	xTaskCreatePinnedToCore(second_task, "second", 2048, NULL, 10,
+	                        &second_handle, PRO_CPU_NUM);
 }
+#endif
 
 
-static void init_sensors(void)
+static esp_err_t read_sensors(reading accm[3], reading gyro[3],
+                              reading temp[1], reading magm[3],
+                              bool *magm_ok)
 {
-	/* First enable the accelerometer with gyroscope. */
-	mpu9250_init(I2C_NUM_0);
+#if CONFIG_MPU9250_SECOND
+	if (second_handle)
+		xTaskNotifyGive(second_handle);
+#endif
+
+	esp_err_t err = read_imu(imus, accm, gyro, temp, magm, magm_ok);
+
+#if CONFIG_MPU9250_SECOND
+	if (second_handle) {
+		xSemaphoreTake(second_done, portMAX_DELAY);
+	} else {
+		second_err = read_imu(imus + 1, second_accm, second_gyro,
+		                      &second_temp, second_magm, &second_ok);
+	}
 
-	/* Now initialize the magnetometer. */
-	ak8963_init(I2C_NUM_0);
+	/* Only whole samples of both are any good. */
+	if (err)
+		return err;
+
+	if (second_err)
+		return second_err;
+
+	/*
+	 * Both sensors face the same way, average them for less noise.
+	 * Magnetometers have offsets of their own, mixing in a reading
+	 * of just one of them would make the calibration jump.
+	 */
+	for (int i = 0; i < 3; i++) {
+		accm[i] = (accm[i] + second_accm[i]) / 2;
+		gyro[i] = (gyro[i] + second_gyro[i]) / 2;
+		magm[i] = (magm[i] + second_magm[i]) / 2;
+	}
+
+	temp[0] = (temp[0] + second_temp) / 2;
+	*magm_ok = *magm_ok && second_ok;
+#endif
+
+	return err;
 }
 
 
@@ -65,83 +471,570 @@ static void delay(unsigned ms)
 }
 
 
-void app_main()
+/* Books of the acquisition loop. */
+static pace pacer;
+
+
+/*
+ * Block until there is a new sample to read. Tell whether the sensor
+ * said so, it does not after losing its settings.
+ */
+static bool wait_for_sample(void)
 {
-	init_i2c();
-	init_sensors();
+#if CONFIG_MPU9250_DRDY
+	unsigned edges = drdy_wait(pdMS_TO_TICKS(100));
 
-	float magm_off[3] = { 470.70,  342.86,  233.05};
-	float magm_neg[3] = {0.94, 1.04, 0.91};
-	float magm_pos[3] = {0.94, 1.02, 1.20};
+	if (!edges)
+		ESP_LOGW(tag, "No data-ready interrupt in 100 ms!");
+	else if (edges > 1)
+		ESP_LOGW(tag, "Missed %u samples!", edges - 1);
+#else
+	unsigned edges = 1;
+	delay(10);
+#endif
+
+	return pace_wait(&pacer, edges);
+}
+
+
+/* Raw sample as passed from acquisition to fusion. */
+struct sample {
+	/* When was it taken, μs since boot. */
+	uint64_t time;
+
+	/*
+	 * Readings in physical units or raw counts, magnetometer only
+	 * valid if `magm_ok`.
+	 */
+	reading accm[3], gyro[3], magm[3], temp;
+	bool magm_ok;
+};
+
+
+/* Samples waiting for fusion, about 0.25 s at 1 kHz. */
+#define RING_LEN 256
+
+static struct sample ring_buf[RING_LEN];
+static ring samples;
+
+
+/* Fusion task to wake up when there are new samples. */
+static TaskHandle_t fusion_handle = NULL;
 
-	for (size_t i = 1; /**/; i++) {
-		float accm[3], gyro[3], tmp[3], magm[3], temp;
 
-		mpu9250_read_raw(accm, gyro, &temp);
+/* Recover the buses and start the sensors over, until they answer. */
+static void restart_sensors(void)
+{
+	ESP_LOGW(tag, "Sensors stopped answering, restarting...");
+
+	recover_buses();
+
+	while (!start_sensors()) {
+		vTaskDelay(pdMS_TO_TICKS(RETRY_MS));
+		recover_buses();
+	}
+}
+
+
+static void acquire_task(void *arg)
+{
+#if CONFIG_MPU9250_DRDY
+	drdy_init(CONFIG_MPU9250_INT_GPIO, xTaskGetCurrentTaskHandle(),
+	          power_save);
+#endif
+
+	pace_init(&pacer, CONFIG_MPU9250_FAIL_LIMIT);
 
-		if (!ak8963_read_raw(tmp)) {
-			ESP_LOGE(tag, "Magnetometer overflow, skipping...");
+	while (true) {
+		struct sample s;
+
+		if (pace_restart(&pacer))
+			restart_sensors();
+
+		wait_for_sample();
+
+		s.time = esp_timer_get_time();
+
+		esp_err_t err = read_sensors(s.accm, s.gyro, &s.temp,
+		                             s.magm, &s.magm_ok);
+
+		if (!pace_read(&pacer, !err))
 			continue;
+
+#if CONFIG_MPU9250_FIFO
+		/* Frames were taken 1 ms apart, the last one just now. */
+		uint64_t now = s.time;
+
+		for (size_t j = 0; j < num_frames; j++) {
+			memcpy(s.accm, frames[j].accm, sizeof(s.accm));
+			memcpy(s.gyro, frames[j].gyro, sizeof(s.gyro));
+			s.time = now - (num_frames - 1 - j) * 1000;
+			ring_push(&samples, &s);
 		}
+#else
+		ring_push(&samples, &s);
+#endif
 
-		/* Scale temperature properly. */
-		temp = temp / 333 + 21;
+		xTaskNotifyGive(fusion_handle);
+	}
+}
 
-		/*
-		 * Align magnetometer with the accelerometer and gyroscope.
-		 * https://github.com/kriswiner/MPU9250/pull/370#issuecomment-491806904
-		 */
-		magm[0] =  tmp[1];
-		magm[1] =  tmp[0];
-		magm[2] = -tmp[2];
 
-		/*
-		 * Remove hard iron effects by subtracting the offsets.
-		 */
-		magm[0] -= magm_off[0];
-		magm[1] -= magm_off[1];
-		magm[2] -= magm_off[2];
+/* Time between two consecutive samples, in seconds. */
+#if CONFIG_MPU9250_DRDY
+static const float sample_dt =
+	MPU9250_RATE_DT(MPU9250_RATE_DIV(CONFIG_MPU9250_RATE));
+#elif CONFIG_MPU9250_FIFO
+static const float sample_dt = 0.001;
+#else
+static const float sample_dt = 0.010;
+#endif
 
-		/*
-		 * Remove soft iron effects by scaling individual axes.
-		 */
-		magm[0] *= magm[0] < 0 ? magm_neg[0] : magm_pos[0];
-		magm[1] *= magm[1] < 0 ? magm_neg[1] : magm_pos[1];
-		magm[2] *= magm[2] < 0 ? magm_neg[2] : magm_pos[2];
 
+#if CONFIG_TRACE_ENABLE
+/* Sensitivities to recover the register values with. */
+static trace_header trace_hdr;
+
+static void init_trace(void)
+{
+	trace_hdr = (trace_header){
+		.temp_scale = MPU9250_TEMP_SCALE,
+		.dt = sample_dt,
+	};
+
+	mpu9250_get_scale(&imus[0].mpu, &trace_hdr.accm_scale,
+	                  &trace_hdr.gyro_scale);
+	ak8963_get_scale(&imus[0].mag, trace_hdr.magm_scale);
+
+	trace_stream_init(CONFIG_SERVER_HOST, CONFIG_TRACE_PORT, &trace_hdr);
+}
+
+
+static void trace_sample(const struct sample *s)
+{
+#if CONFIG_MPU9250_COUNTS
+	/* Already what the trace wants. */
+	trace_record r = {
+		.temp = s->temp,
+		.flags = s->magm_ok ? TRACE_MAGM_OK : 0,
+	};
+
+	for (int i = 0; i < 3; i++) {
+		r.accm[i] = s->accm[i];
+		r.gyro[i] = s->gyro[i];
+		r.magm[i] = s->magm[i];
+	}
+#else
+	trace_record r = {
+		.temp = trace_raw(s->temp - MPU9250_TEMP_OFFSET,
+		                  trace_hdr.temp_scale),
+		.flags = s->magm_ok ? TRACE_MAGM_OK : 0,
+	};
+
+	for (int i = 0; i < 3; i++) {
+		r.accm[i] = trace_raw(s->accm[i], trace_hdr.accm_scale);
+		r.gyro[i] = trace_raw(s->gyro[i], trace_hdr.gyro_scale);
+		r.magm[i] = trace_raw(s->magm[i], trace_hdr.magm_scale[i]);
+	}
+#endif
+
+	trace_stream_push(s->time, &r);
+}
+#endif
+
+
+/* Orientation estimator. */
+static fusion est;
+
+
+#if CONFIG_GYRO_CAL
+/* Gyroscope bias tracked at rest, the filter only corrects what is left. */
+static gyrocal gcal;
+
+
+/* Temperature of a sample, in °C. */
+static float sample_temp(const struct sample *s)
+{
+#if CONFIG_MPU9250_COUNTS
+	return s->temp * MPU9250_TEMP_SCALE + MPU9250_TEMP_OFFSET;
+#else
+	return s->temp;
+#endif
+}
+
+
+/* Track the gyroscope bias and remove it from the reading. */
+static void remove_bias(const struct sample *s, const float accm[3],
+                        const float gyro[3], float res[3])
+{
+	vec3 a = {{accm[0], accm[1], accm[2]}};
+	vec3 w = {{gyro[0], gyro[1], gyro[2]}};
+
+	w = gyrocal_update(&gcal, a, w, sample_temp(s));
+
+	for (int i = 0; i < 3; i++)
+		res[i] = w.row[i];
+}
+#endif
+
+
+/* Continue with the calibration stored by the last run, if any. */
+static void load_calibration(void)
+{
+	calstore cs;
+
+	if (!calstore_load(&cs))
+		return;
+
+	est.mcal.hard = cs.mag_hard;
+	est.mcal.soft = cs.mag_soft;
+	est.accm_scale = cs.accm_scale;
+
+#if CONFIG_GYRO_CAL
+	/* Stored as the correction, the opposite of the bias. */
+	gyrocal_set_bias(&gcal, vec3scale(-1, cs.gyro_bias));
+#else
+	est.filter.bias = cs.gyro_bias;
+#endif
+}
+
+
+#if CONFIG_MPU9250_COUNTS
+/* Fold sensitivities and calibration into the integer pipeline. */
+static void fold_counts(void)
+{
+	float accm, gyro, magm[3];
+
+	mpu9250_get_scale(&imus[0].mpu, &accm, &gyro);
+	ak8963_get_scale(&imus[0].mag, magm);
+	fusion_fold(&est, accm, gyro, magm);
+}
+#endif
+
+
+/* Store current calibration, calstore limits how often it really writes. */
+static void save_calibration(void)
+{
+	calstore cs = {
+		.mag_hard = est.mcal.hard,
+		.mag_soft = est.mcal.soft,
+		.gyro_bias = est.filter.bias,
+		.accm_scale = est.accm_scale,
+	};
+
+#if CONFIG_GYRO_CAL
+	/* Same format as without, the filter corrects after the tracker. */
+	vec3 tracked = gyrocal_bias(&gcal);
+	cs.gyro_bias = vec3add2(cs.gyro_bias, vec3scale(-1, tracked));
+#endif
+
+	calstore_save(&cs);
+}
+
+
+/* Calibrate magnetometer reading, reporting calibration changes. */
+static vec3 calibrate_magm(const reading magm[3])
+{
+	bool updated;
+
+#if CONFIG_MPU9250_COUNTS
+	vec3 res = fusion_magm_counts(&est, magm, &updated);
+#else
+	vec3 res = fusion_magm(&est, magm, &updated);
+#endif
+
+	if (updated) {
+		vec3 hard = est.mcal.hard;
+
+		ESP_LOGI(tag, "Magnetometer calibration updated, "
+		              "offset [%.1f, %.1f, %.1f]",
+		         hard.row[0], hard.row[1], hard.row[2]);
+	}
+
+	return res;
+}
+
+
+#if CONFIG_SERVER_PREDICT_MS
+/* Extrapolates poses to make up for the latency. */
+static predict ahead;
+#endif
+
+
+/* Angular rate of a sample without the gyroscope bias. */
+static vec3 body_rate(const float gyro[3])
+{
+	vec3 rate = {{gyro[0], gyro[1], gyro[2]}};
+	return vec3add2(rate, est.filter.bias);
+}
+
+
+#if CONFIG_SERVER_DEADBAND
+/* Holds back poses that hardly differ from the last one. */
+static deadband band;
+#endif
+
+
+/* Decide whether the pose after this sample is worth sending. */
+static bool should_send(uint64_t time, quat q, vec3 rate)
+{
+#if CONFIG_POWER_SAVE
+	if (!still_update(&motion, rate, sample_dt))
+		return false;
+#endif
+
+#if CONFIG_SERVER_DEADBAND
+	return deadband_update(&band, time, q, rate);
+#else
+	return true;
+#endif
+}
+
+
+/* Log pipeline statistics every so often. */
+static void report_stats(uint64_t now)
+{
+	static uint64_t last = 0;
+
+	if (now - last < 10000000)
+		return;
+
+	last = now;
+
+	ESP_LOGI(tag, "Ring: %zu/%u waiting, %zu peak, %u overruns",
+	         ring_count(&samples), RING_LEN,
+	         ring_peak(&samples), ring_overruns(&samples));
+
+	ESP_LOGI(tag, "Sensors: %u samples missed, %u dropped, %u restarts",
+	         pacer.missed, pacer.dropped, pacer.restarts);
+
+#if CONFIG_MPU9250_I2C
+	for (int port = 0; port < I2C_NUM_MAX; port++) {
+		i2ce_stats st = i2ce_get_stats(port);
+
+		if (st.errors || st.recoveries) {
+			ESP_LOGI(tag, "I2C %i: %u errors, %u timeouts,"
+			              " %u recoveries", port, st.errors,
+			         st.timeouts, st.recoveries);
+		}
+	}
+#endif
+
+#if CONFIG_PROF_ENABLE
+	prof_report();
+#endif
+
+#if CONFIG_GYRO_CAL
+	vec3 bias = vec3scale(180 / M_PI, gyrocal_bias(&gcal));
+
+	ESP_LOGI(tag, "Gyro: bias [%.2f, %.2f, %.2f] °/s at %.1f °C%s",
+	         bias.row[0], bias.row[1], bias.row[2], gcal.temp,
+	         gcal.resting ? ", resting" : "");
+#endif
+
+	/* Wait for the filter to settle before storing its bias. */
+	if (est.ready)
+		save_calibration();
+}
+
+
+static void fusion_task(void *arg)
+{
+	static struct sample batch[32];
+
+	while (true) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		size_t len;
+
+		while ((len = ring_pop(&samples, batch, 32))) {
+			struct sample *s = NULL;
+			vec3 magm = {{0, 0, 0}};
+			/* Last sample that got its pose out, and its field. */
+			struct sample *shown = NULL;
+			quat pose = {1, 0, 0, 0};
+			vec3 shown_magm = {{0, 0, 0}};
+
+			for (size_t i = 0; i < len; i++) {
+				s = batch + i;
+
+#if CONFIG_TRACE_ENABLE
+				trace_sample(s);
+#endif
+
+				PROF_TIME(t0);
+
+#if CONFIG_MPU9250_COUNTS
+				float conv_accm[3], conv_gyro[3];
+				fusion_convert(&est, s->accm, s->gyro,
+				               conv_accm, conv_gyro);
+
+				const float *accm = conv_accm;
+				const float *gyro = conv_gyro;
+#else
+				const float *accm = s->accm, *gyro = s->gyro;
+#endif
+
+#if CONFIG_GYRO_CAL
+				float unbiased[3];
+				remove_bias(s, accm, gyro, unbiased);
+				gyro = unbiased;
+#endif
+
+				/* Let the filter run on the other sensors only. */
+				if (s->magm_ok)
+					magm = calibrate_magm(s->magm);
+				else
+					magm = (vec3){{0, 0, 0}};
+
+				PROF_SINCE(PROF_CALIBRATE, t0);
+				PROF_TIME(t1);
+
+				fusion_update(&est, accm, gyro, magm);
+
+				PROF_SINCE(PROF_FUSE, t1);
+
+				if (!est.ready)
+					continue;
+
+				vec3 rate = body_rate(gyro);
+				quat q = est.filter.q;
+
+#if CONFIG_SERVER_PREDICT_MS
+				/* Keep predicting even while poses are held back. */
+				q = predict_pose(&ahead, q, rate, sample_dt);
+#endif
+
+				if (!should_send(s->time, q, rate)) {
+#if CONFIG_SERVER_ENABLE
+					/* Poses before the gap are not to wait. */
+					udpout_flush();
+#endif
+					continue;
+				}
+
+				pose = q;
+				shown = s;
+				shown_magm = magm;
+
+#if CONFIG_SERVER_ENABLE
+				if (!udpout_send(s->time, q))
+					ESP_LOGW(tag, "Output queue full, pose dropped.");
+#endif
+			}
+
+			/* Console is way too slow for every sample. */
 #if 0
-		printf("%6.0f %6.0f %6.0f / %6.0f %6.0f %6.0f / %6.0f %6.0f %6.0f / %4.0f°C\n",
-		       accm[0], accm[1], accm[2],
-		       gyro[0], gyro[1], gyro[2],
-		       magm[0], magm[1], magm[2],
-		       temp);
+			printf("%6.2f %6.2f %6.2f / %6.2f %6.2f %6.2f / %6.1f %6.1f %6.1f / %4.0f°C\n",
+			       s->accm[0], s->accm[1], s->accm[2],
+			       s->gyro[0], s->gyro[1], s->gyro[2],
+			       magm.row[0], magm.row[1], magm.row[2],
+			       s->temp);
 #endif
 
-#if 1
-		printf("MAG: [%f, %f, %f]\n", magm[0], magm[1], magm[2]);
+#if CONFIG_CONSOLE_TEXT
+			/* Same output policy as for the server. */
+			if (shown) {
+				if (shown->magm_ok)
+					printf("MAG: [%f, %f, %f]\n",
+					       shown_magm.row[0], shown_magm.row[1],
+					       shown_magm.row[2]);
 
-		vec3 down  = {{accm[0], accm[1], accm[2]}};
-		vec3 east  = {{magm[0], magm[1], magm[2]}};
-		east = vec3cross(down, east);
-		vec3 north = vec3cross(east, down);
+				vec3 euler = quat_to_euler(pose);
 
-		down  = vec3unit(down);
-		east  = vec3unit(east);
-		north = vec3unit(north);
+				printf("QTR: [%f, %f, %f, %f]\n",
+				       pose.w, pose.x, pose.y, pose.z);
+
+				printf("RPY: [%f, %f, %f]\n",
+				       euler.row[0] * 180 / M_PI,
+				       euler.row[1] * 180 / M_PI,
+				       euler.row[2] * 180 / M_PI);
+			}
+#elif CONFIG_CONSOLE_BINARY
+			if (shown) {
+				serout_record r = {
+					.flags = shown->magm_ok ? SEROUT_MAGM_OK : 0,
+					.time = shown->time,
+					.q = pose,
+					.magm = shown_magm,
+				};
+
+				serout_send(&r);
+			}
+#endif
+
+			report_stats(s->time);
+		}
+	}
+}
 
-		mat3 rm = {{north, east, down}};
-		quat q = quat_from_mat3(rm);
-		vec3 euler = quat_to_euler(q);
 
-		printf("QTR: [%f, %f, %f, %f]\n",
-		       q.w, q.x, q.y, q.z);
+void app_main()
+{
+	init_nvs();
 
-		printf("RPY: [%f, %f, %f]\n",
-		       euler.row[0] * 180 / M_PI,
-		       euler.row[1] * 180 / M_PI,
-		       euler.row[2] * 180 / M_PI);
+#if CONFIG_CONSOLE_BINARY
+	serout_init(CONFIG_ESP_CONSOLE_UART_NUM);
 #endif
+	init_power();
+	init_bus();
 
-		delay(10);
+	/* Nothing to do without the sensors, keep trying. */
+	while (!start_sensors()) {
+		vTaskDelay(pdMS_TO_TICKS(RETRY_MS));
+		recover_buses();
 	}
+
+#if CONFIG_MPU9250_SECOND
+	init_second();
+#endif
+
+#if CONFIG_SERVER_ENABLE
+	wlan_init(CONFIG_WIFI_SSID, CONFIG_WIFI_PASSWORD,
+	          power_save ? CONFIG_WIFI_LISTEN_INTERVAL : 0);
+#if CONFIG_SERVER_QUAT_BITS
+	udpout_init(CONFIG_SERVER_HOST, CONFIG_SERVER_PORT,
+	            CONFIG_SERVER_BATCH, CONFIG_SERVER_QUAT_BITS);
+#else
+	udpout_init(CONFIG_SERVER_HOST, CONFIG_SERVER_PORT, 1, 0);
+#endif
+#if CONFIG_TRACE_ENABLE
+	init_trace();
+#endif
+#endif
+
+	ring_init(&samples, ring_buf, sizeof(*ring_buf), RING_LEN);
+	fusion_init(&est, sample_dt);
+
+#if CONFIG_GYRO_CAL
+	gyrocal_init(&gcal, CONFIG_GYRO_CAL_ACCM_SPREAD / 1000.0,
+	             CONFIG_GYRO_CAL_GYRO_SPREAD * M_PI / 18000,
+	             CONFIG_GYRO_CAL_TIME, sample_dt);
+#endif
+
+	load_calibration();
+
+#if CONFIG_MPU9250_COUNTS
+	fold_counts();
+#endif
+
+#if CONFIG_SERVER_PREDICT_MS
+	predict_init(&ahead, CONFIG_SERVER_PREDICT_MS / 1000.0);
+#endif
+
+#if CONFIG_SERVER_DEADBAND
+	deadband_init(&band, CONFIG_SERVER_DEADBAND * M_PI / 18000,
+	              CONFIG_SERVER_HEARTBEAT * 1000ull,
+	              CONFIG_SERVER_ONSET * M_PI / 180);
+#endif
+
+	/*
+	 * Fusion and output share the protocol core with the WiFi stack,
+	 * while acquisition gets the application core for itself and runs
+	 * above everything else but the system tasks.
+	 */
+	xTaskCreatePinnedToCore(fusion_task, "fusion", 4096, NULL, 5,
+	                        &fusion_handle, PRO_CPU_NUM);
+	xTaskCreatePinnedToCore(acquire_task, "acquire", 4096, NULL, 10,
+	                        NULL, APP_CPU_NUM);
 }
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Time conversion of raw register contents into calibrated readings,
+ * once through the float decoding of the drivers and fusion_magm() and
+ * once through their counts decoding and the fixed-point maps, and
+ * check that both agree within 2⁻¹² of the full scale output on random
+ * register contents. Both include the magnetometer calibration update,
+ * so they are timed once with the magnetometer moving, when every
+ * reading refines the calibration, and once with it still, when the
+ * update skips them all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <mpu9250.h>
+#include <ak8963.h>
+#include <fusion.h>
+
+
+/* Largest allowed difference, relative to the full scale output. */
+#define TOLERANCE (1.0f / 4096)
+
+
+/* Registers of one sample: MPU9250 from 0x3b, AK8963 from 0x03. */
+struct regs {
+	uint8_t mpu[MPU9250_DATA_LEN];
+	uint8_t ak[AK8963_DATA_LEN];
+};
+
+/* Calibrated readings. */
+struct out {
+	vec3 accm, gyro, magm;
+};
+
+
+/* Sensitivities of the default configuration, ASA of a real part. */
+static const float accm_lsb = 2 * 9.80665f / 32768;
+static const float gyro_lsb = 250 * (float)M_PI / 180 / 32768;
+static const float magm_lsb[3] = {0.1828, 0.1834, 0.1723};
+
+
+static uint32_t xorshift(uint32_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+
+/* Drivers set up for the sensitivities above. */
+static mpu9250 mpu;
+static ak8963 mag;
+
+
+/* What the float readers and fusion_magm() do. */
+static void float_path(fusion *f, struct out *o, const struct regs *r)
+{
+	float accm[3], gyro[3], magm[3];
+	bool updated;
+
+	mpu9250_decode(&mpu, r->mpu, accm, gyro, NULL);
+	ak8963_decode(&mag, r->ak, magm);
+
+	o->accm = (vec3){{accm[0], accm[1], accm[2]}};
+	o->gyro = (vec3){{gyro[0], gyro[1], gyro[2]}};
+	o->magm = fusion_magm(f, magm, &updated);
+}
+
+
+/* What the counts readers, fusion_convert() and fusion_magm_counts() do. */
+static void fixed_path(fusion *f, struct out *o, const struct regs *r)
+{
+	int16_t accm[3], gyro[3], magm[3];
+	float a[3], g[3];
+	bool updated;
+
+	mpu9250_decode_counts(r->mpu, accm, gyro, NULL);
+	ak8963_decode_counts(r->ak, magm);
+	fusion_convert(f, accm, gyro, a, g);
+
+	o->accm = (vec3){{a[0], a[1], a[2]}};
+	o->gyro = (vec3){{g[0], g[1], g[2]}};
+	o->magm = fusion_magm_counts(f, magm, &updated);
+}
+
+
+/* Keeps the compiler from dropping the results. */
+volatile float sink;
+
+
+typedef void (*path)(fusion *f, struct out *o, const struct regs *r);
+
+
+/* Run the path over all samples a few times, return ns and cycles. */
+static void bench(const char *name, path p, const fusion *init,
+                  const struct regs *r, size_t len, unsigned rounds)
+{
+	fusion copy = *init, *f = &copy;
+	struct out o;
+
+	double t0 = now();
+	uint64_t c0 = cycles();
+
+	for (unsigned k = 0; k < rounds; k++) {
+		for (size_t i = 0; i < len; i++) {
+			p(f, &o, r + i);
+			sink = o.accm.row[0] + o.gyro.row[0] + o.magm.row[0];
+		}
+	}
+
+	uint64_t c1 = cycles();
+	double t1 = now();
+	double n = (double)len * rounds;
+
+	printf("%-14s %6.1f ns", name, (t1 - t0) * 1e9 / n);
+
+	if (c1 > c0)
+		printf(" %7.1f cycles", (c1 - c0) / n);
+
+	printf(" per sample\n");
+}
+
+
+/* Largest difference relative to the full scale of the quantity. */
+static void worst(vec3 a, vec3 b, float scale, float *dst)
+{
+	for (int i = 0; i < 3; i++) {
+		float d = fabsf(a.row[i] - b.row[i]) / scale;
+		*dst = maxf(*dst, d);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	size_t len = 4096;
+	unsigned rounds = 1000;
+	uint32_t seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			len = atoi(optarg);
+			break;
+
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-n SAMPLES] [-r ROUNDS]"
+			                " [-s SEED]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (!len || !rounds || !seed)
+		return 2;
+
+	/* Calibration with a bit of everything, like a real fit. */
+	fusion f;
+	fusion_init(&f, 0.01);
+
+	f.mcal.soft = (mat3){{
+		{{0.94, 0.02, -0.01}},
+		{{0.02, 1.03, 0.03}},
+		{{-0.01, 0.03, 1.05}},
+	}};
+
+	fusion_fold(&f, accm_lsb, gyro_lsb, magm_lsb);
+
+	mpu.accm_scale = accm_lsb;
+	mpu.gyro_scale = gyro_lsb;
+
+	for (int i = 0; i < 3; i++)
+		mag.scale[i] = magm_lsb[i];
+
+	struct regs *r = malloc(len * sizeof(*r));
+
+	for (size_t i = 0; i < len; i++) {
+		for (size_t j = 0; j < sizeof(r[i].mpu); j++)
+			r[i].mpu[j] = xorshift(&seed);
+
+		for (size_t j = 0; j < sizeof(r[i].ak); j++)
+			r[i].ak[j] = xorshift(&seed);
+	}
+
+	/* Registers at the very ends of the ranges. */
+	memset(r[0].mpu, 0x80, sizeof(r[0].mpu));
+	memset(r[0].ak, 0x80, sizeof(r[0].ak));
+	memset(r[len - 1].mpu, 0x7f, sizeof(r[0].mpu));
+	memset(r[len - 1].ak, 0x7f, sizeof(r[0].ak));
+
+	float accm = 0, gyro = 0, magm = 0;
+	size_t exact = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		/* Both start from the same calibration every time. */
+		fusion fa = f, fb = f;
+		struct out a, b;
+
+		float_path(&fa, &a, r + i);
+		fixed_path(&fb, &b, r + i);
+
+		worst(a.accm, b.accm, 32768 * accm_lsb, &accm);
+		worst(a.gyro, b.gyro, 32768 * gyro_lsb, &gyro);
+		worst(a.magm, b.magm, 32768 * magm_lsb[0] * 1.1f, &magm);
+
+		exact += !memcmp(&a, &b, sizeof(a));
+	}
+
+	printf("Q%i accelerometer, Q%i gyroscope, Q%i magnetometer\n",
+	       f.accm_map.frac, f.gyro_map.frac, f.magm_map.frac);
+
+	printf("Largest difference: %.2g accelerometer, %.2g gyroscope,"
+	       " %.2g magnetometer of full scale, tolerance %.2g\n",
+	       accm, gyro, magm, TOLERANCE);
+
+	printf("%zu of %zu samples bit-exact\n", exact, len);
+
+	bench("float, moving", float_path, &f, r, len, rounds);
+	bench("fixed, moving", fixed_path, &f, r, len, rounds);
+
+	/* Same magnetometer registers all the time. */
+	for (size_t i = 0; i < len; i++)
+		memcpy(r[i].ak, r[len / 2].ak, sizeof(r[i].ak));
+
+	bench("float, still", float_path, &f, r, len, rounds);
+	bench("fixed, still", fixed_path, &f, r, len, rounds);
+
+	free(r);
+
+	return accm > TOLERANCE || gyro > TOLERANCE || magm > TOLERANCE;
+}
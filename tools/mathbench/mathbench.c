@@ -0,0 +1,323 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Time the exact orientation math against the fast approximations
+ * from spatial.h and report the largest difference between them on
+ * random inputs. The filter update and the whole path of a sample are
+ * timed as built, so build with SPATIAL_FAST set to 1 to compare them,
+ * the Makefile does both and `make bench` runs them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <spatial.h>
+#include <fusion.h>
+
+
+/* Keeps the compiler from dropping the results. */
+volatile float sink;
+
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+
+static uint32_t xorshift(uint32_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+
+/* Uniform in [lo, hi). */
+static float uniform(uint32_t *s, float lo, float hi)
+{
+	return lo + (hi - lo) * (xorshift(s) >> 8) / 16777216.0f;
+}
+
+
+static vec3 random_vec3(uint32_t *s, float mag)
+{
+	return (vec3){{uniform(s, -mag, mag), uniform(s, -mag, mag),
+	               uniform(s, -mag, mag)}};
+}
+
+
+/* Angle between two rotations, in radians. */
+static double angle(quat a, quat b)
+{
+	quat d = quatmul(quatconj(a), b);
+	double v = sqrt((double)d.x * d.x + (double)d.y * d.y +
+	                (double)d.z * d.z);
+
+	return 2 * atan2(v, fabs(d.w));
+}
+
+
+static double t0;
+static uint64_t c0;
+
+static void start(void)
+{
+	t0 = now();
+	c0 = cycles();
+}
+
+static void stop(const char *name, double n)
+{
+	uint64_t c1 = cycles();
+	double t1 = now();
+
+	printf("  %-22s %7.1f ns", name, (t1 - t0) * 1e9 / n);
+
+	if (c1 > c0)
+		printf(" %8.1f cycles", (c1 - c0) / n);
+
+	printf("\n");
+}
+
+
+/* Exact TRIAD, even when built with SPATIAL_FAST. */
+static quat triad(vec3 accm, vec3 magm)
+{
+	vec3 down  = accm;
+	vec3 east  = vec3cross(down, magm);
+	vec3 north = vec3cross(east, down);
+
+	mat3 rm = {{
+		vec3scale(1 / vec3mag(north), north),
+		vec3scale(1 / vec3mag(east), east),
+		vec3scale(1 / vec3mag(down), down),
+	}};
+
+	return quat_from_mat3(rm);
+}
+
+
+/* Sums of all components, so that none can be optimized out. */
+static float quatsum(quat q)
+{
+	return q.w + q.x + q.y + q.z;
+}
+
+static float vec3sum(vec3 v)
+{
+	return v.row[0] + v.row[1] + v.row[2];
+}
+
+
+/* Time `expr` over all inputs, `i` indexes them. */
+#define BENCH(name, expr)					\
+	do {							\
+		start();					\
+		for (unsigned k = 0; k < rounds; k++)		\
+			for (size_t i = 0; i < len; i++)	\
+				sink = (expr);			\
+		stop((name), (double)len * rounds);		\
+	} while (0)
+
+
+int main(int argc, char **argv)
+{
+	size_t len = 4096;
+	unsigned rounds = 1000;
+	uint32_t seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			len = atoi(optarg);
+			break;
+
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "Usage: %s [-n SAMPLES] [-r ROUNDS]"
+			                " [-s SEED]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (!len || !rounds || !seed)
+		return 2;
+
+	float *x = malloc(len * sizeof(*x));
+	float *y = malloc(len * sizeof(*y));
+	float *u = malloc(len * sizeof(*u));
+	vec3 *accm = malloc(len * sizeof(*accm));
+	vec3 *magm = malloc(len * sizeof(*magm));
+	quat *q = malloc(len * sizeof(*q));
+
+	for (size_t i = 0; i < len; i++) {
+		x[i] = uniform(&seed, -10, 10);
+		y[i] = uniform(&seed, -10, 10);
+		u[i] = uniform(&seed, -1, 1);
+
+		/* Sensor readings in their usual units. */
+		accm[i] = random_vec3(&seed, 9.81);
+		magm[i] = random_vec3(&seed, 45);
+
+		quat r = {uniform(&seed, -1, 1), uniform(&seed, -1, 1),
+		          uniform(&seed, -1, 1), uniform(&seed, -1, 1)};
+		q[i] = quatscale(1 / quatmag(r), r);
+	}
+
+	/* Largest differences from the exact results. */
+	double rsqrt_err = 0, atan2_err = 0, asin_err = 0;
+	double triad_err = 0, norm_err = 0, euler_err = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		double m2 = vec3dot(accm[i], accm[i]);
+		double e = fabs(rsqrtf_fast(m2) * sqrt(m2) - 1);
+		rsqrt_err = fmax(rsqrt_err, e);
+
+		e = fabs(atan2f_fast(y[i], x[i]) - atan2(y[i], x[i]));
+		atan2_err = fmax(atan2_err, e);
+
+		e = fabs(asinf_fast(u[i]) - asin(u[i]));
+		asin_err = fmax(asin_err, e);
+
+		quat exact = triad(accm[i], magm[i]);
+		quat fast = quat_from_triad_fast(accm[i], magm[i]);
+		triad_err = fmax(triad_err, angle(exact, fast));
+		norm_err = fmax(norm_err, fabs(quatmag(fast) - 1));
+
+		vec3 a = quat_to_euler(q[i]);
+		vec3 b = quat_to_euler_fast(q[i]);
+
+		for (int j = 0; j < 3; j++) {
+			e = fabs(remainder(a.row[j] - b.row[j], 2 * M_PI));
+
+			/* Roll and yaw are meaningless near ±90° pitch. */
+			if (j != 1 && fabsf(a.row[1]) > 1.5)
+				continue;
+
+			euler_err = fmax(euler_err, e);
+		}
+	}
+
+	printf("Largest difference of the fast kernels:\n");
+	printf("  rsqrtf_fast            %.2g relative\n", rsqrt_err);
+	printf("  atan2f_fast            %.2g rad\n", atan2_err);
+	printf("  asinf_fast             %.2g rad\n", asin_err);
+	printf("  quat_from_triad_fast   %.2g rad, %.2g off unit length\n",
+	       triad_err, norm_err);
+	printf("  quat_to_euler_fast     %.2g rad\n", euler_err);
+
+	printf("Time per call:\n");
+
+	BENCH("1 / sqrt", 1 / sqrt(x[i] * x[i] + 1));
+	BENCH("1 / sqrtf", 1 / sqrtf(x[i] * x[i] + 1));
+	BENCH("rsqrtf_fast", rsqrtf_fast(x[i] * x[i] + 1));
+
+	BENCH("atan2", atan2(y[i], x[i]));
+	BENCH("atan2f", atan2f(y[i], x[i]));
+	BENCH("atan2f_fast", atan2f_fast(y[i], x[i]));
+
+	BENCH("asin", asin(u[i]));
+	BENCH("asinf", asinf(u[i]));
+	BENCH("asinf_fast", asinf_fast(u[i]));
+
+	BENCH("quat_from_triad", quatsum(quat_from_triad(accm[i], magm[i])));
+	BENCH("quat_from_triad_fast",
+	      quatsum(quat_from_triad_fast(accm[i], magm[i])));
+
+	BENCH("quat_to_euler", vec3sum(quat_to_euler(q[i])));
+	BENCH("quat_to_euler_fast", vec3sum(quat_to_euler_fast(q[i])));
+
+	/* Whole filter update, exact or fast depending on the build. */
+	ahrs f = {.q = {1, 0, 0, 0}, .kp = 2.0, .ki = 0.005};
+	vec3 gyro = {{0.01, -0.02, 0.005}};
+
+	printf("With SPATIAL_FAST %i:\n", SPATIAL_FAST);
+
+	start();
+
+	for (unsigned k = 0; k < rounds; k++) {
+		for (size_t i = 0; i < len; i++)
+			f = ahrs_update(f, gyro, accm[i], magm[i], 0.01);
+	}
+
+	sink = f.q.w;
+	stop("ahrs_update", (double)len * rounds);
+
+	/*
+	 * Whole path of a sample, as in the fusion task: calibrate the
+	 * magnetometer, run the filter, then the Euler angles for the
+	 * console and the packed pose for the server.
+	 */
+	fusion est;
+	fusion_init(&est, 0.01);
+
+	uint64_t packed = 0;
+
+	start();
+
+	for (unsigned k = 0; k < rounds; k++) {
+		for (size_t i = 0; i < len; i++) {
+			bool updated;
+			vec3 m = fusion_magm(&est, magm[i].row, &updated);
+			fusion_update(&est, accm[i].row, gyro.row, m);
+
+			vec3 e = quat_to_euler(est.filter.q);
+			packed += quat_pack(est.filter.q, 10);
+			sink = e.row[0];
+		}
+	}
+
+	sink = packed;
+	stop("sample path", (double)len * rounds);
+
+	free(x);
+	free(y);
+	free(u);
+	free(accm);
+	free(magm);
+	free(q);
+
+	return 0;
+}
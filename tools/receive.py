@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# Receive poses streamed by the headband and print them out.
+#
+
+import argparse
+import math
+import socket
+import struct
+
+HEADER = struct.Struct('<2sBBIQ')
+QUAT = struct.Struct('<4f')
+PACKED = struct.Struct('<IBB')
+
+
+def unpack_quat(v, bits):
+    """
+    Restore quaternion from the smallest three encoding.
+    """
+
+    top = (1 << bits) - 1
+    big = v & 3
+    v >>= 2
+
+    c = [0.0] * 4
+
+    for i in range(4):
+        if i == big:
+            continue
+
+        c[i] = ((v & top) / top * 2 - 1) / math.sqrt(2)
+        v >>= bits
+
+    c[big] = math.sqrt(max(0, 1 - sum(x * x for x in c)))
+    return c
+
+
+def decode(data):
+    """
+    Yield (seq, time, quat) for every pose in the datagram.
+    """
+
+    if len(data) < HEADER.size:
+        return
+
+    magic, version, kind, seq, time = HEADER.unpack_from(data)
+
+    if magic != b'HB' or version != 1:
+        return
+
+    if kind == 0 and len(data) == HEADER.size + QUAT.size:
+        yield seq, time, QUAT.unpack_from(data, HEADER.size)
+
+    elif kind == 1 and len(data) >= HEADER.size + PACKED.size:
+        span, count, bits = PACKED.unpack_from(data, HEADER.size)
+        width = 2 + 3 * bits
+
+        stream = int.from_bytes(data[HEADER.size + PACKED.size:], 'little')
+
+        for i in range(count):
+            v = (stream >> (i * width)) & ((1 << width) - 1)
+            dt = span * i // (count - 1) if count > 1 else 0
+            yield seq + i, time + dt, unpack_quat(v, bits)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('-b', '--bind', default='0.0.0.0',
+                        help='Address to listen on')
+    parser.add_argument('-p', '--port', type=int, default=9003,
+                        help='Port to listen on')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+
+    last = None
+
+    while True:
+        data, peer = sock.recvfrom(1500)
+
+        for seq, time, (w, x, y, z) in decode(data):
+            if last is not None and seq != (last + 1) & 0xffffffff:
+                print('# lost', (seq - last - 1) & 0xffffffff)
+
+            last = seq
+
+            print('{} {:.6f} {:.6f} {:.6f} {:.6f} {:.6f}'.format(
+                seq, time / 1e6, w, x, y, z))
+
+
+if __name__ == '__main__':
+    main()
+
+
+# vim:set sw=4 ts=4 et:
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Replay a raw sensor trace through the calibration and fusion code
+ * of the firmware, as fast as possible. Prints one pose per sample,
+ * followed by timing statistics on the standard error.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <trace.h>
+#include <fusion.h>
+#include <deadband.h>
+#include <still.h>
+
+
+static void usage(const char *self)
+{
+	fprintf(stderr, "Usage: %s [-q] [-e] [-s DEG] [-d DEG [-k MS]] TRACE\n"
+	                "  -q  do not print poses, just measure\n"
+	                "  -e  print roll, pitch and yaw in degrees\n"
+	                "  -s  power save, fewer poses below DEG °/s\n"
+	                "  -d  output deadband, print only poses passed\n"
+	                "  -k  heartbeat interval for the deadband (1000)\n",
+	        self);
+	exit(2);
+}
+
+
+static uint8_t *load(const char *path, size_t *len)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (!fp) {
+		perror(path);
+		exit(1);
+	}
+
+	size_t size = 1 << 20;
+	uint8_t *buf = malloc(size);
+	*len = 0;
+
+	while (buf) {
+		*len += fread(buf + *len, 1, size - *len, fp);
+
+		if (*len < size)
+			break;
+
+		buf = realloc(buf, size *= 2);
+	}
+
+	if (!buf || ferror(fp)) {
+		perror(path);
+		exit(1);
+	}
+
+	fclose(fp);
+	return buf;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+int main(int argc, char **argv)
+{
+	bool quiet = false, euler = false;
+	double band_deg = 0, heartbeat = 1000, still_deg = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qes:d:k:")) != -1) {
+		switch (opt) {
+		case 'q':
+			quiet = true;
+			break;
+
+		case 'e':
+			euler = true;
+			break;
+
+		case 's':
+			still_deg = atof(optarg);
+			break;
+
+		case 'd':
+			band_deg = atof(optarg);
+			break;
+
+		case 'k':
+			heartbeat = atof(optarg);
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 != argc)
+		usage(argv[0]);
+
+	size_t len;
+	uint8_t *buf = load(argv[optind], &len);
+
+	trace_header h;
+	size_t pos = trace_decode_header(&h, buf, len);
+
+	if (!pos) {
+		fprintf(stderr, "%s: not a trace\n", argv[optind]);
+		return 1;
+	}
+
+	fusion est;
+	fusion_init(&est, h.dt);
+
+	/* Onset threshold as the firmware defaults to. */
+	deadband band;
+	deadband_init(&band, band_deg * M_PI / 180, heartbeat * 1000,
+	              5 * M_PI / 180);
+
+	/* Hold and divider as the firmware defaults to. */
+	still motion;
+	still_init(&motion, still_deg * M_PI / 180, 1.0, 10);
+
+	uint64_t time = h.time;
+	size_t count = 0, updates = 0, ready = 0, poses = 0, idle = 0;
+	quat held = {1, 0, 0, 0};
+	double held_sum = 0, held_max = 0;
+	double start = now();
+
+	for (/**/; pos + TRACE_RECORD_SIZE <= len; pos += TRACE_RECORD_SIZE) {
+		trace_record r;
+		trace_decode_record(&r, buf + pos);
+
+		float accm[3], gyro[3], magm[3];
+
+		for (int i = 0; i < 3; i++) {
+			accm[i] = r.accm[i] * h.accm_scale;
+			gyro[i] = r.gyro[i] * h.gyro_scale;
+			magm[i] = r.magm[i] * h.magm_scale[i];
+		}
+
+		vec3 m = {{0, 0, 0}};
+
+		if (r.flags & TRACE_MAGM_OK) {
+			bool updated;
+			m = fusion_magm(&est, magm, &updated);
+			updates += updated;
+		}
+
+		fusion_update(&est, accm, gyro, m);
+
+		time += r.dt;
+		count++;
+
+		if (!est.ready)
+			continue;
+
+		quat q = est.filter.q;
+		ready++;
+
+		/* Same order and the same rate as in the firmware. */
+		vec3 rate = {{gyro[0], gyro[1], gyro[2]}};
+		rate = vec3add2(rate, est.filter.bias);
+
+		bool passed = true;
+
+		if (still_deg > 0 && !still_update(&motion, rate, h.dt)) {
+			passed = false;
+			idle++;
+		}
+
+		if (band_deg > 0) {
+			if (passed)
+				passed = deadband_update(&band, time, q, rate);
+
+			if (passed)
+				held = q;
+
+			/* How far off is the receiver with the last pose. */
+			float c = fabsf(quatmul(quatconj(held), q).w);
+			float err = 2 * acosf(minf(c, 1)) * 180 / M_PI;
+
+			held_sum += err;
+			held_max = fmax(held_max, err);
+		}
+
+		if (!passed)
+			continue;
+
+		poses++;
+
+		if (quiet)
+			continue;
+
+		if (euler) {
+			vec3 e = quat_to_euler(q);
+
+			printf("%.6f %f %f %f\n", time * 1e-6,
+			       e.row[0] * 180 / M_PI,
+			       e.row[1] * 180 / M_PI,
+			       e.row[2] * 180 / M_PI);
+		} else {
+			printf("%.6f %f %f %f %f\n", time * 1e-6,
+			       q.w, q.x, q.y, q.z);
+		}
+	}
+
+	double elapsed = now() - start;
+
+	/* Keep the statistics after the poses when both go to a pipe. */
+	fflush(stdout);
+
+	fprintf(stderr, "%zu samples, %.1f s of motion, %zu calibration "
+	                "updates\n", count, (time - h.time) * 1e-6, updates);
+	fprintf(stderr, "%.3f s elapsed, %.0f ns per sample\n",
+	        elapsed, count ? elapsed * 1e9 / count : 0.0);
+
+	if (still_deg > 0 && ready) {
+		fprintf(stderr, "%zu of %zu poses held back while still "
+		                "(%.1f %%)\n", idle, ready, 100.0 * idle / ready);
+	}
+
+	if (band_deg > 0 && ready) {
+		fprintf(stderr, "%zu of %zu poses passed (%.1f %%), receiver "
+		                "off by %.3f° mean, %.3f° max\n",
+		        poses, ready, 100.0 * poses / ready,
+		        held_sum / ready, held_max);
+	}
+
+	free(buf);
+	return 0;
+}
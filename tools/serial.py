@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+#
+# Decode binary poses written to the console UART by the headband.
+#
+
+import argparse
+import math
+import os
+import struct
+import sys
+import termios
+import tty
+
+RECORD = struct.Struct('<BBHQ4f3fH')
+
+SPEEDS = {
+    9600: termios.B9600,
+    19200: termios.B19200,
+    38400: termios.B38400,
+    57600: termios.B57600,
+    115200: termios.B115200,
+    230400: termios.B230400,
+    460800: getattr(termios, 'B460800', None),
+    921600: getattr(termios, 'B921600', None),
+}
+
+
+def crc16(data):
+    """
+    CRC-16/CCITT-FALSE, same as serout_crc16().
+    """
+
+    crc = 0xffff
+
+    for b in data:
+        crc ^= b << 8
+
+        for i in range(8):
+            crc = (crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1
+
+        crc &= 0xffff
+
+    return crc
+
+
+def cobs_decode(frame):
+    """
+    Undo the byte stuffing, return None if the frame is malformed.
+    """
+
+    out = bytearray()
+    i = 0
+
+    while i < len(frame):
+        code = frame[i]
+
+        if code == 0 or i + code > len(frame):
+            return None
+
+        out += frame[i + 1:i + code]
+        i += code
+
+        if code < 0xff and i < len(frame):
+            out.append(0)
+
+    return bytes(out)
+
+
+def decode(frame):
+    """
+    Return (seq, flags, time, quat, magm) or None for damaged frames.
+    """
+
+    data = cobs_decode(frame)
+
+    if data is None or len(data) != RECORD.size:
+        return None
+
+    if crc16(data[:-2]) != RECORD.unpack(data)[-1]:
+        return None
+
+    version, flags, seq, time, *rest = RECORD.unpack(data)
+
+    if version != 1:
+        return None
+
+    return seq, flags, time, rest[0:4], rest[4:7]
+
+
+def frames(f):
+    """
+    Yield frames between zero bytes. The first one is usually incomplete.
+    """
+
+    buf = b''
+
+    while True:
+        chunk = os.read(f, 4096)
+
+        if not chunk:
+            return
+
+        buf += chunk
+        *done, buf = buf.split(b'\0')
+
+        yield from done
+
+
+def to_euler(w, x, y, z):
+    """
+    Roll, pitch and yaw in degrees, same as quat_to_euler().
+    """
+
+    roll = math.atan2(2 * (w * x + y * z), 1 - 2 * (x * x + y * y))
+    pitch = math.asin(max(-1, min(1, 2 * (w * y - z * x))))
+    yaw = math.atan2(2 * (w * z + x * y), 1 - 2 * (y * y + z * z))
+
+    return [math.degrees(a) for a in (roll, pitch, yaw)]
+
+
+def open_port(path, baud):
+    f = os.open(path, os.O_RDONLY | os.O_NOCTTY)
+
+    if os.isatty(f):
+        tty.setraw(f)
+        attr = termios.tcgetattr(f)
+        attr[4] = attr[5] = SPEEDS[baud]
+        termios.tcsetattr(f, termios.TCSANOW, attr)
+
+    return f
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('-b', '--baud', type=int, default=115200,
+                        choices=[k for k, v in SPEEDS.items() if v],
+                        help='Speed of the serial port')
+    parser.add_argument('-c', '--csv', action='store_true',
+                        help='Print comma separated values')
+    parser.add_argument('device', nargs='?', default='/dev/ttyUSB0',
+                        help='Serial port or a captured stream, - for stdin')
+    args = parser.parse_args()
+
+    if args.device == '-':
+        f = sys.stdin.fileno()
+    else:
+        f = open_port(args.device, args.baud)
+
+    if args.csv:
+        print('seq,time,w,x,y,z,roll,pitch,yaw,mx,my,mz')
+
+    last = None
+    bad = 0
+
+    try:
+        for frame in frames(f):
+            rec = decode(frame)
+
+            if rec is None:
+                bad += 1
+                continue
+
+            seq, flags, time, q, m = rec
+
+            if last is not None and seq != (last + 1) & 0xffff:
+                print('# lost', (seq - last - 1) & 0xffff, file=sys.stderr)
+
+            last = seq
+
+            rpy = to_euler(*q)
+            mag = m if flags & 1 else [math.nan] * 3
+
+            if args.csv:
+                print(','.join(['{}'.format(seq), '{:.6f}'.format(time / 1e6)]
+                               + ['{:.6f}'.format(v) for v in q]
+                               + ['{:.2f}'.format(v) for v in rpy + mag]))
+            else:
+                print('{} {:.6f} {:.6f} {:.6f} {:.6f} {:.6f} / '
+                      '{:7.2f} {:7.2f} {:7.2f} / {:6.1f} {:6.1f} {:6.1f}'
+                      .format(seq, time / 1e6, *q, *rpy, *mag))
+
+    except KeyboardInterrupt:
+        pass
+
+    print('# {} bad frames'.format(bad), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
+
+
+# vim:set sw=4 ts=4 et:
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Host implementation of <i2ce.h>, routing every transaction to the
+ * emulated devices instead of the I2C peripheral. Simulated time runs
+ * while the bus is busy, so that slow transfers cost what they would.
+ *
+ * Faults are injected as configured: transactions go unacknowledged,
+ * the bus gets stuck until recovered, sensors go away for a while.
+ * Failures are counted and a stuck bus recovered the same way the
+ * real implementation does.
+ */
+
+#include <esp_log.h>
+#include <esp_err.h>
+
+#include <i2ce.h>
+
+#include "sim.h"
+
+
+static const char *tag = "i2ce";
+
+
+/* Time it takes to clock the bus free and install the driver anew. */
+#define RECOVER_TIME 200e-6
+
+
+/* Clock of every port, 0 when not initialized. */
+static uint32_t bus_freq[I2C_NUM_MAX];
+
+/* How long a transaction on a stuck bus takes to time out. */
+static double bus_timeout[I2C_NUM_MAX];
+
+/* Whether a slave holds SDA low. */
+static bool bus_stuck[I2C_NUM_MAX];
+
+static sim_stats stats[I2C_NUM_MAX];
+static i2ce_stats failures[I2C_NUM_MAX];
+
+
+esp_err_t i2ce_master_init(i2c_port_t port,
+                           uint8_t sda, uint8_t scl,
+                           uint32_t freq, unsigned timeout)
+{
+	if (freq > I2CE_FREQ_MAX) {
+		ESP_LOGW(tag, "Clamping I2C clock to %u Hz.", I2CE_FREQ_MAX);
+		freq = I2CE_FREQ_MAX;
+	}
+
+	ESP_LOGI(tag, "Initializing I2C master %i...", (int)port);
+	bus_freq[port] = freq;
+
+	/* Same rounding as on the chip, with 1 ms ticks. */
+	bus_timeout[port] = (timeout + 1) / 1000.0;
+
+	return ESP_OK;
+}
+
+
+esp_err_t i2ce_recover(i2c_port_t port)
+{
+	ESP_LOGW(tag, "Recovering I2C bus %i...", (int)port);
+	failures[port].recoveries++;
+
+	bus_stuck[port] = false;
+	sim_step(RECOVER_TIME);
+
+	return ESP_OK;
+}
+
+
+/* Count the failure, recover the bus when it timed out. */
+static esp_err_t fail(i2c_port_t port, esp_err_t err)
+{
+	failures[port].errors++;
+
+	if (ESP_ERR_TIMEOUT == err) {
+		failures[port].timeouts++;
+		i2ce_recover(port);
+	}
+
+	return err;
+}
+
+
+/* Whether the bus is or just got stuck, costing the whole timeout. */
+static bool stuck(i2c_port_t port)
+{
+	if (!bus_stuck[port] && !sim_chance(sim_cfg.stuck_rate))
+		return false;
+
+	bus_stuck[port] = true;
+	sim_step(bus_timeout[port]);
+
+	return true;
+}
+
+
+/* Account for `bytes` worth of traffic and let the time pass. */
+static void occupy(i2c_port_t port, size_t bytes, int starts)
+{
+	/* Every byte is acknowledged, add start and stop conditions. */
+	double busy = (9.0 * bytes + starts + 1) / bus_freq[port];
+
+	stats[port].transactions++;
+	stats[port].bytes += bytes;
+	stats[port].busy += busy;
+
+	sim_step(busy);
+}
+
+
+/* Find the device that is to answer, there must be exactly one. */
+static esp_err_t find_device(i2c_port_t port, uint8_t addr,
+                             sim_mpu **mpu, sim_ak **ak)
+{
+	if (port < 0 || port >= I2C_NUM_MAX || !bus_freq[port]) {
+		ESP_LOGE(tag, "I2C master %i not initialized!", (int)port);
+		abort();
+	}
+
+	/* Nobody answers without power or sometimes just because. */
+	if (sim_unplugged() || sim_chance(sim_cfg.nack_rate))
+		return ESP_FAIL;
+
+	int found = sim_find(port, addr, mpu, ak);
+
+	if (found > 1) {
+		ESP_LOGE(tag, "Devices clash at %#hhx on port %i!",
+		         addr, (int)port);
+	}
+
+	return 1 == found ? ESP_OK : ESP_FAIL;
+}
+
+
+static esp_err_t do_write(i2c_port_t port, uint8_t addr, uint8_t cmd,
+                          const uint8_t *src, size_t len)
+{
+	sim_mpu *mpu;
+	sim_ak *ak;
+
+	if (stuck(port))
+		return fail(port, ESP_ERR_TIMEOUT);
+
+	esp_err_t err = find_device(port, addr, &mpu, &ak);
+
+	occupy(port, err ? 1 : 2 + len, 1);
+
+	if (err)
+		return fail(port, err);
+
+	for (size_t i = 0; i < len; i++) {
+		if (mpu)
+			mpu_write(mpu, cmd, src[i]);
+		else
+			ak_write(ak, cmd, src[i]);
+
+		if (!mpu || !mpu_no_increment(cmd))
+			cmd++;
+	}
+
+	return ESP_OK;
+}
+
+
+static esp_err_t do_read(i2c_port_t port, uint8_t addr, uint8_t cmd,
+                         uint8_t *dst, size_t len)
+{
+	sim_mpu *mpu;
+	sim_ak *ak;
+
+	if (stuck(port))
+		return fail(port, ESP_ERR_TIMEOUT);
+
+	esp_err_t err = find_device(port, addr, &mpu, &ak);
+
+	occupy(port, err ? 1 : 3 + len, 2);
+
+	if (err)
+		return fail(port, err);
+
+	for (size_t i = 0; i < len; i++) {
+		dst[i] = mpu ? mpu_read(mpu, cmd) : ak_read(ak, cmd);
+
+		if (!mpu || !mpu_no_increment(cmd))
+			cmd++;
+	}
+
+	return ESP_OK;
+}
+
+
+esp_err_t i2ce_write(i2c_port_t port,
+                     uint8_t addr, uint8_t cmd,
+                     const void *src, size_t len)
+{
+	if (len > I2CE_WRITE_MAX)
+		return ESP_ERR_INVALID_SIZE;
+
+	return do_write(port, addr, cmd, src, len);
+}
+
+
+esp_err_t i2ce_put(i2c_port_t port, uint8_t addr, uint8_t cmd, uint8_t value)
+{
+	return i2ce_write(port, addr, cmd, &value, 1);
+}
+
+
+esp_err_t i2ce_read(i2c_port_t port,
+                    uint8_t addr, uint8_t cmd,
+                    void *dst, size_t len)
+{
+	if (!len)
+		return ESP_ERR_INVALID_SIZE;
+
+	return do_read(port, addr, cmd, dst, len);
+}
+
+
+esp_err_t i2ce_set(i2c_port_t port,
+                   uint8_t addr, uint8_t cmd,
+                   uint8_t mask, uint8_t bits)
+{
+	uint8_t buf[1];
+	esp_err_t err = i2ce_read(port, addr, cmd, &buf, 1);
+
+	if (err)
+		return err;
+
+	buf[0] = (buf[0] & mask) | bits;
+
+	return i2ce_write(port, addr, cmd, buf, 1);
+}
+
+
+i2ce_stats i2ce_get_stats(i2c_port_t port)
+{
+	return failures[port];
+}
+
+
+sim_stats sim_get_stats(i2c_port_t port)
+{
+	return stats[port];
+}
@@ -0,0 +1,22 @@
+/* Host stand-in for the ESP-IDF header, see tools/sim/spi.c. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+
+typedef int gpio_num_t;
+
+typedef enum {
+	GPIO_MODE_INPUT,
+	GPIO_MODE_OUTPUT,
+} gpio_mode_t;
+
+typedef struct {
+	uint64_t pin_bit_mask;
+	gpio_mode_t mode;
+} gpio_config_t;
+
+esp_err_t gpio_config(const gpio_config_t *conf);
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level);
@@ -0,0 +1,17 @@
+/* Host stand-in for the ESP-IDF header, see tools/sim/i2ce.c. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_err.h>
+
+typedef int i2c_port_t;
+
+#define I2C_NUM_0 0
+#define I2C_NUM_1 1
+#define I2C_NUM_MAX 2
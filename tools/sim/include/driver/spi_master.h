@@ -0,0 +1,56 @@
+/* Host stand-in for the ESP-IDF header, see tools/sim/spi.c. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <esp_err.h>
+
+typedef int spi_host_device_t;
+
+#define SPI2_HOST 1
+#define SPI3_HOST 2
+
+typedef struct {
+	int mosi_io_num;
+	int miso_io_num;
+	int sclk_io_num;
+	int quadwp_io_num;
+	int quadhd_io_num;
+	int max_transfer_sz;
+} spi_bus_config_t;
+
+typedef struct {
+	uint8_t command_bits;
+	uint8_t address_bits;
+	uint8_t dummy_bits;
+	uint8_t mode;
+	int clock_speed_hz;
+	int spics_io_num;
+	uint32_t flags;
+	int queue_size;
+} spi_device_interface_config_t;
+
+typedef struct {
+	uint32_t flags;
+	uint16_t cmd;
+	uint64_t addr;
+	size_t length;
+	size_t rxlength;
+	void *user;
+	const void *tx_buffer;
+	void *rx_buffer;
+} spi_transaction_t;
+
+typedef struct spi_device *spi_device_handle_t;
+
+#define SPI_DMA_CH_AUTO 3
+
+esp_err_t spi_bus_initialize(spi_host_device_t host,
+                             const spi_bus_config_t *bus, int dma);
+esp_err_t spi_bus_add_device(spi_host_device_t host,
+                             const spi_device_interface_config_t *dev,
+                             spi_device_handle_t *handle);
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle,
+                                      spi_transaction_t *t);
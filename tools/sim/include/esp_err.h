@@ -0,0 +1,49 @@
+/* Host stand-in for the ESP-IDF header, just enough for the drivers. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+
+#define ESP_ERROR_CHECK(x) do {						\
+		esp_err_t _err = (x);					\
+		if (_err != ESP_OK) {					\
+			fprintf(stderr, "%s:%d: %s failed: %d\n",	\
+			        __FILE__, __LINE__, #x, _err);		\
+			abort();					\
+		}							\
+	} while (0)
+
+static inline const char *esp_err_to_name(esp_err_t err)
+{
+	switch (err) {
+	case ESP_OK:
+		return "ESP_OK";
+	case ESP_ERR_INVALID_ARG:
+		return "ESP_ERR_INVALID_ARG";
+	case ESP_ERR_INVALID_STATE:
+		return "ESP_ERR_INVALID_STATE";
+	case ESP_ERR_INVALID_SIZE:
+		return "ESP_ERR_INVALID_SIZE";
+	case ESP_ERR_NOT_FOUND:
+		return "ESP_ERR_NOT_FOUND";
+	case ESP_ERR_TIMEOUT:
+		return "ESP_ERR_TIMEOUT";
+	case ESP_ERR_INVALID_RESPONSE:
+		return "ESP_ERR_INVALID_RESPONSE";
+	default:
+		return "ESP_FAIL";
+	}
+}
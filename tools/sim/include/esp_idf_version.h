@@ -0,0 +1,8 @@
+/* Host stand-in for the ESP-IDF header, pretends to be the pinned one. */
+
+#pragma once
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) \
+	(((major) << 16) | ((minor) << 8) | (patch))
+
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(4, 2, 0)
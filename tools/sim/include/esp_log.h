@@ -0,0 +1,19 @@
+/* Host stand-in for the ESP-IDF header, informative messages on demand. */
+
+#pragma once
+
+#include <stdio.h>
+
+extern int sim_verbose;
+
+#define ESP_LOGE(tag, fmt, ...) \
+	fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGW(tag, fmt, ...) \
+	fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGI(tag, fmt, ...) do {					\
+		if (sim_verbose)					\
+			fprintf(stderr, "I %s: " fmt "\n",		\
+			        tag, ##__VA_ARGS__);			\
+	} while (0)
@@ -0,0 +1,11 @@
+/* Host stand-in for the FreeRTOS header, ticks are milliseconds. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
@@ -0,0 +1,7 @@
+/* Host stand-in for the FreeRTOS header, delays advance simulated time. */
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+void vTaskDelay(TickType_t ticks);
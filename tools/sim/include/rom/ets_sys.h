@@ -0,0 +1,8 @@
+/* Host stand-in for the ESP-IDF header. */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Advances the simulation, just like vTaskDelay(). */
+void ets_delay_us(uint32_t us);
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Register level model of the AK8963 magnetometer, which samples
+ * the field in its own axes: X and Y swapped and Z pointing down
+ * relative to the MPU9250.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+
+
+/* Measurement limit of the sensor, in μT. */
+#define RANGE 4912
+
+
+void ak_reset(sim_ak *a, const uint8_t asa[3])
+{
+	if (asa)
+		memcpy(a->asa, asa, sizeof(a->asa));
+
+	memset(a->r, 0, sizeof(a->r));
+	a->r[0x00] = 0x48;
+	a->r[0x01] = 0x9a;
+	a->r[0x02] = 0x0a;
+
+	a->next = sim_time();
+	a->down = sim_time();
+}
+
+
+static void measure(sim_ak *a, double t)
+{
+	vec3 b = sim_magm(t);
+	vec3 m = {{b.row[1], b.row[0], -b.row[2]}};
+
+	m = vec3add2(m, sim_cfg.hard);
+
+	bool bits16 = a->r[0x0a] & 0x10;
+	float lsb = bits16 ? 0.15f : 0.6f;
+	float limit = bits16 ? 32760 : 8190;
+
+	float sum = fabsf(m.row[0]) + fabsf(m.row[1]) + fabsf(m.row[2]);
+	bool hofl = sum >= RANGE;
+
+	for (int i = 0; i < 3; i++) {
+		float adj = (a->asa[i] - 128) / 256.0f + 1;
+		float v = (m.row[i] + sim_noise(sim_cfg.magm_noise)) / adj / lsb;
+		long raw = lroundf(fmaxf(-limit, fminf(limit, v)));
+
+		a->r[0x03 + 2 * i] = raw;
+		a->r[0x04 + 2 * i] = (uint16_t)raw >> 8;
+	}
+
+	/* Unread data were overwritten. */
+	if (a->r[0x02] & 0x01)
+		a->r[0x02] |= 0x02;
+
+	a->r[0x02] |= 0x01;
+	a->r[0x09] = (bits16 ? 0x10 : 0x00) | (hofl ? 0x08 : 0x00);
+}
+
+
+void ak_tick(sim_ak *a, double t)
+{
+	unsigned mode = a->r[0x0a] & 0x0f;
+	double period = 0x02 == mode ? 1 / 8.0 : 0x06 == mode ? 1 / 100.0 : 0;
+
+	if (!period) {
+		a->next = t;
+		return;
+	}
+
+	while (a->next <= t) {
+		measure(a, a->next);
+		a->next += period;
+	}
+}
+
+
+uint8_t ak_read(sim_ak *a, uint8_t reg)
+{
+	if (reg >= 0x10 && reg <= 0x12)
+		return 0x0f == (a->r[0x0a] & 0x0f) ? a->asa[reg - 0x10] : 0;
+
+	if (reg >= sizeof(a->r))
+		return 0;
+
+	uint8_t v = a->r[reg];
+
+	/* Reading ST2 ends the data read out. */
+	if (0x09 == reg)
+		a->r[0x02] &= ~0x03;
+
+	return v;
+}
+
+
+void ak_write(sim_ak *a, uint8_t reg, uint8_t value)
+{
+	if (0x0b == reg && (value & 0x01)) {
+		ak_reset(a, NULL);
+		return;
+	}
+
+	if (0x0a == reg) {
+		unsigned mode = value & 0x0f;
+
+		/* Other modes are only entered from a settled power-down. */
+		bool settled = sim_time() - a->down > 100e-6 - 1e-9;
+
+		if (mode && ((a->r[reg] & 0x0f) || !settled))
+			return;
+
+		if (!mode)
+			a->down = sim_time();
+
+		a->r[reg] = value;
+		a->next = sim_time();
+		return;
+	}
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Register level model of the MPU9250, just the parts the driver uses.
+ * Samples are produced at the configured output rate from the motion
+ * generator and make their way to the data registers, the FIFO and,
+ * with the I2C master enabled, the external sensor data registers.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+
+
+/* Standard gravity, in m/s². */
+#define GRAVITY 9.80665f
+
+void mpu_reset(sim_mpu *m)
+{
+	memset(m->r, 0, sizeof(m->r));
+
+	/* Power management defaults and the WHO_AM_I. */
+	m->r[0x6b] = 0x01;
+	m->r[0x75] = 0x71;
+
+	m->fifo_head = m->fifo_len = 0;
+	m->next = sim_time();
+}
+
+
+/* Interval between samples, in seconds. */
+static double period(const sim_mpu *m)
+{
+	/* With the DLPF bypassed, the internal rate is 8 kHz. */
+	unsigned dlpf = m->r[0x1a] & 0x07;
+	double rate = (dlpf >= 1 && dlpf <= 6) ? 1000 : 8000;
+
+	return (1 + m->r[0x19]) / rate;
+}
+
+
+static void put16(uint8_t *dst, float value)
+{
+	long v = lroundf(value);
+	v = v > 32767 ? 32767 : v < -32768 ? -32768 : v;
+
+	dst[0] = (uint16_t)v >> 8;
+	dst[1] = v;
+}
+
+
+static void fifo_push(sim_mpu *m, const uint8_t *src, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (m->fifo_len == SIM_FIFO_SIZE) {
+			/* Oldest byte goes away. */
+			m->fifo_head = (m->fifo_head + 1) % SIM_FIFO_SIZE;
+			m->fifo_len--;
+			m->r[0x3a] |= 0x10;
+		}
+
+		m->fifo[(m->fifo_head + m->fifo_len++) % SIM_FIFO_SIZE] = src[i];
+	}
+}
+
+
+static uint8_t fifo_pop(sim_mpu *m)
+{
+	if (!m->fifo_len)
+		return 0xff;
+
+	uint8_t v = m->fifo[m->fifo_head];
+	m->fifo_head = (m->fifo_head + 1) % SIM_FIFO_SIZE;
+	m->fifo_len--;
+
+	return v;
+}
+
+
+static void sample(sim_mpu *m, double t)
+{
+	float accm_lsb = (2 << ((m->r[0x1c] >> 3) & 3)) * GRAVITY / 32768;
+	float gyro_lsb = (250 << ((m->r[0x1b] >> 3) & 3)) * M_PI / 180 / 32768;
+
+	vec3 accm = sim_accm(t);
+	vec3 gyro = vec3add2(sim_gyro(t), sim_gyro_bias(t));
+
+	for (int i = 0; i < 3; i++) {
+		accm.row[i] += sim_noise(sim_cfg.accm_noise);
+		gyro.row[i] += sim_noise(sim_cfg.gyro_noise);
+
+		put16(m->r + 0x3b + 2 * i, accm.row[i] / accm_lsb);
+		put16(m->r + 0x43 + 2 * i, gyro.row[i] / gyro_lsb);
+	}
+
+	put16(m->r + 0x41, (sim_temp(t) - 21) * 333.87f);
+
+	/* External sensor data via slave 0. */
+	if ((m->r[0x6a] & 0x20) && (m->r[0x27] & 0x80) &&
+	    0x0c == (m->r[0x25] & 0x7f) && (m->r[0x25] & 0x80)) {
+		unsigned len = m->r[0x27] & 0x0f;
+
+		for (unsigned i = 0; i < len && 0x49 + i < 0x61; i++)
+			m->r[0x49 + i] = ak_read(&m->ak, m->r[0x26] + i);
+	}
+
+	/* FIFO, in the register order. */
+	if (m->r[0x6a] & 0x40) {
+		if (m->r[0x23] & 0x08)
+			fifo_push(m, m->r + 0x3b, 6);
+
+		if (m->r[0x23] & 0x80)
+			fifo_push(m, m->r + 0x41, 2);
+
+		for (int i = 0; i < 3; i++)
+			if (m->r[0x23] & (0x40 >> i))
+				fifo_push(m, m->r + 0x43 + 2 * i, 2);
+	}
+
+	m->r[0x3a] |= 0x01;
+}
+
+
+void mpu_tick(sim_mpu *m, double t)
+{
+	while (m->next <= t) {
+		sample(m, m->next);
+		m->next += period(m);
+	}
+}
+
+
+/* Immediate slave 4 transfer on the auxiliary bus. */
+static void slv4_transfer(sim_mpu *m)
+{
+	m->r[0x34] &= 0x7f;
+
+	if (!(m->r[0x6a] & 0x20))
+		return;
+
+	if (0x0c != (m->r[0x31] & 0x7f)) {
+		m->r[0x36] |= 0x10;
+		return;
+	}
+
+	if (m->r[0x31] & 0x80)
+		m->r[0x35] = ak_read(&m->ak, m->r[0x32]);
+	else
+		ak_write(&m->ak, m->r[0x32], m->r[0x33]);
+
+	m->r[0x36] |= 0x40;
+}
+
+
+uint8_t mpu_read(sim_mpu *m, uint8_t reg)
+{
+	reg &= 0x7f;
+
+	uint8_t v = m->r[reg];
+
+	switch (reg) {
+	case 0x74:
+		return fifo_pop(m);
+
+	case 0x72:
+		return m->fifo_len >> 8;
+
+	case 0x73:
+		return m->fifo_len;
+
+	case 0x3a:
+	case 0x36:
+		/* Reading the status clears it. */
+		m->r[reg] = 0;
+		break;
+	}
+
+	return v;
+}
+
+
+void mpu_write(sim_mpu *m, uint8_t reg, uint8_t value)
+{
+	reg &= 0x7f;
+
+	switch (reg) {
+	case 0x6b:
+		if (value & 0x80) {
+			mpu_reset(m);
+			return;
+		}
+		break;
+
+	case 0x6a:
+		if (value & 0x04)
+			m->fifo_head = m->fifo_len = 0;
+
+		/* Reset bits clear themselves. */
+		value &= ~0x07;
+		break;
+
+	case 0x75:
+	case 0x72:
+	case 0x73:
+	case 0x3a:
+	case 0x36:
+		/* Read-only. */
+		return;
+
+	case 0x74:
+		fifo_push(m, &value, 1);
+		return;
+	}
+
+	m->r[reg] = value;
+
+	if (0x34 == reg && (value & 0x80))
+		slv4_transfer(m);
+}
+
+
+bool mpu_bypass(const sim_mpu *m)
+{
+	return (m->r[0x37] & 0x02) && !(m->r[0x6a] & 0x20);
+}
+
+
+bool mpu_no_increment(uint8_t reg)
+{
+	/* FIFO data are read out from the same address. */
+	return 0x74 == (reg & 0x7f);
+}
+
+
+bool mpu_fast_read(uint8_t reg)
+{
+	/* Only sensor data and interrupt status go at 20 MHz over SPI. */
+	reg &= 0x7f;
+	return (reg >= 0x3a && reg <= 0x60) || 0x74 == reg;
+}
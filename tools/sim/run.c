@@ -0,0 +1,662 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Run the sensor drivers against the simulated bus, the same way
+ * the firmware acquires and fuses its samples, and report how busy
+ * the bus was, how much time the host spent and how far the pose
+ * drifted from the simulated truth. With faults injected, also how
+ * many samples were lost to them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <esp_log.h>
+
+#include <i2ce.h>
+#include <regio.h>
+#include <mpu9250.h>
+#include <ak8963.h>
+#include <fusion.h>
+#include <predict.h>
+#include <gyrocal.h>
+#include <pace.h>
+
+#include "sim.h"
+
+
+/* Settling time before the pose is compared with the truth. */
+#define SETTLE 2.0
+
+/* Failed reads in a row before the sensors are restarted. */
+#define FAIL_LIMIT 5
+
+/* Wait between attempts to restart sensors that do not answer, in ms. */
+#define RETRY_MS 500
+
+/* Prediction horizons to evaluate, in ms. */
+static const unsigned horizons[] = {10, 20, 30, 50, 75, 100};
+
+#define NUM_HORIZONS (sizeof(horizons) / sizeof(*horizons))
+
+
+/* Where the sensors sit, the first one can use the bypass mode. */
+static const struct {
+	i2c_port_t port;
+	uint8_t addr;
+} places[] = {
+	{I2C_NUM_0, MPU9250_ADDR},
+	{I2C_NUM_1, MPU9250_ADDR},
+	{I2C_NUM_0, MPU9250_ADDR_ALT},
+};
+
+#define MAX_IMUS (sizeof(places) / sizeof(*places))
+
+
+/* Same as in the firmware. */
+struct imu {
+	regio mpu_io, mag_io;
+	mpu9250 mpu;
+	ak8963 mag;
+	bool master;
+};
+
+static struct imu imus[MAX_IMUS];
+
+
+static esp_err_t read_imu(const struct imu *imu, float accm[3],
+                          float gyro[3], float temp[1], float magm[3],
+                          bool *ok)
+{
+	uint8_t ext[AK8963_DATA_LEN];
+
+	if (!imu->master) {
+		REGIO_TRY(mpu9250_read_raw(&imu->mpu, accm, gyro, temp));
+		return ak8963_read_raw(&imu->mag, magm, ok);
+	}
+
+	REGIO_TRY(mpu9250_read_raw_ext(&imu->mpu, accm, gyro, temp,
+	                               ext, sizeof(ext)));
+
+	*ok = ak8963_decode(&imu->mag, ext, magm);
+	return ESP_OK;
+}
+
+
+/* Same, but in raw counts for the integer pipeline. */
+static esp_err_t read_counts(const struct imu *imu, int16_t accm[3],
+                             int16_t gyro[3], int16_t temp[1],
+                             int16_t magm[3], bool *ok)
+{
+	uint8_t ext[AK8963_DATA_LEN];
+
+	REGIO_TRY(mpu9250_read_counts(&imu->mpu, accm, gyro, temp,
+	                              ext, imu->master ? sizeof(ext) : 0));
+
+	if (!imu->master)
+		return ak8963_read_counts(&imu->mag, magm, ok);
+
+	*ok = ak8963_decode_counts(ext, magm);
+	return ESP_OK;
+}
+
+
+/* What init_sensors() does, from scratch if done already. */
+static esp_err_t init_sensors(unsigned num_imus, bool bypass, bool fifo,
+                              const mpu9250_config *mpu_cfg,
+                              const ak8963_config *ak_cfg)
+{
+	for (unsigned i = 0; i < num_imus; i++) {
+		struct imu *imu = imus + i;
+
+		REGIO_TRY(mpu9250_init(&imu->mpu, &imu->mpu_io, mpu_cfg));
+
+		if (i > 0) {
+			REGIO_TRY(mpu9250_aux_init(&imu->mpu, &imu->mag_io,
+			                           AK8963_ADDR));
+		}
+
+		REGIO_TRY(ak8963_init(&imu->mag, &imu->mag_io, ak_cfg));
+
+		imu->master = !bypass || i > 0;
+
+		if (imu->master) {
+			REGIO_TRY(mpu9250_enable_master(&imu->mpu, AK8963_ADDR,
+			                                AK8963_DATA_REG,
+			                                AK8963_DATA_LEN));
+		}
+	}
+
+	if (fifo)
+		REGIO_TRY(mpu9250_fifo_enable(&imus[0].mpu));
+
+	return ESP_OK;
+}
+
+
+static void usage(const char *self)
+{
+	fprintf(stderr, "Usage: %s [-bfgpvxM] [-i N] [-t SECS] [-r HZ] [-F HZ]"
+	                " [-n SCALE] [-m SCALE] [-s SEED]\n"
+	                "          [-w SECS] [-T RATE] [-e P] [-E P]"
+	                " [-u RATE] [-o MS]\n"
+	                "  -b  read magnetometer in bypass mode, not via"
+	                " the I2C master\n"
+	                "  -f  drain the FIFO every 10 ms at 1 kHz\n"
+	                "  -g  track the gyroscope bias at rest\n"
+	                "  -p  evaluate pose prediction horizons\n"
+	                "  -i  average 1 to 3 sensors: port 0 at 0x68,"
+	                " port 1 at 0x68\n"
+	                "      and port 0 at 0x69\n"
+	                "  -v  log what the drivers say\n"
+	                "  -x  pass raw counts through the integer pipeline\n"
+	                "  -M  ignore the magnetometer once the pose is known\n"
+	                "  -t  seconds of simulated motion (10)\n"
+	                "  -r  sample rate when polling (100)\n"
+	                "  -F  I2C clock (400000)\n"
+	                "  -n  noise scale, 0 for none (1)\n"
+	                "  -m  motion speed scale, 0 to hold still (1)\n"
+	                "  -s  noise seed (1)\n"
+	                "  -w  alternate seconds of motion and of rest (0)\n"
+	                "  -T  temperature change in °C/s (0)\n"
+	                "  -e  chance of a transaction not being"
+	                " acknowledged (0)\n"
+	                "  -E  chance of a transaction getting the bus"
+	                " stuck (0)\n"
+	                "  -u  sensors lose power for 50 ms this often"
+	                " per second (0)\n"
+	                "  -o  I2C transaction timeout in ms (10)\n",
+	        self);
+	exit(2);
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* Angle of the rotation, in degrees. */
+static float angle(quat q)
+{
+	float w = fabsf(q.w) / quatmag(q);
+	return 2 * acosf(minf(w, 1)) * 180 / M_PI;
+}
+
+
+int main(int argc, char **argv)
+{
+	bool bypass = false, fifo = false, prediction = false, counts = false;
+	bool gyro_cal = false, no_magm = false;
+	double duration = 10, noise = 1, speed = 1, rest = 0, temp_rate = 0;
+	double nack_rate = 0, stuck_rate = 0, unplug_rate = 0;
+	unsigned rate = 100, freq = I2CE_FREQ_MAX, seed = 1, num_imus = 1;
+	unsigned timeout = 10;
+	int opt;
+
+	const char *opts = "bfgpvxMi:t:r:F:n:m:s:w:T:e:E:u:o:";
+
+	while ((opt = getopt(argc, argv, opts)) != -1) {
+		switch (opt) {
+		case 'b':
+			bypass = true;
+			break;
+
+		case 'f':
+			fifo = true;
+			break;
+
+		case 'g':
+			gyro_cal = true;
+			break;
+
+		case 'p':
+			prediction = true;
+			break;
+
+		case 'v':
+			sim_verbose = 1;
+			break;
+
+		case 'x':
+			counts = true;
+			break;
+
+		case 'M':
+			no_magm = true;
+			break;
+
+		case 'i':
+			num_imus = atoi(optarg);
+			break;
+
+		case 't':
+			duration = atof(optarg);
+			break;
+
+		case 'r':
+			rate = atoi(optarg);
+			break;
+
+		case 'F':
+			freq = atoi(optarg);
+			break;
+
+		case 'n':
+			noise = atof(optarg);
+			break;
+
+		case 'm':
+			speed = atof(optarg);
+			break;
+
+		case 's':
+			seed = atoi(optarg);
+			break;
+
+		case 'w':
+			rest = atof(optarg);
+			break;
+
+		case 'T':
+			temp_rate = atof(optarg);
+			break;
+
+		case 'e':
+			nack_rate = atof(optarg);
+			break;
+
+		case 'E':
+			stuck_rate = atof(optarg);
+			break;
+
+		case 'u':
+			unplug_rate = atof(optarg);
+			break;
+
+		case 'o':
+			timeout = atoi(optarg);
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc || rate < 4 || rate > 1000 || duration <= SETTLE)
+		usage(argv[0]);
+
+	if (num_imus < 1 || num_imus > MAX_IMUS || (fifo && num_imus > 1))
+		usage(argv[0]);
+
+	/* Same limits as for the firmware. */
+	if (counts && (fifo || num_imus > 1))
+		usage(argv[0]);
+
+	/* Calibration sees the samples one by one. */
+	if (gyro_cal && fifo)
+		usage(argv[0]);
+
+	/*
+	 * Slow nodding and looking around, with a bit of noise and bias
+	 * that drifts as the board warms up.
+	 */
+	sim_config cfg = {
+		.amplitude = {{0.3, 0.5, 1.2}},
+		.frequency = {{0.13 * speed, 0.29 * speed, 0.07 * speed}},
+		.accm_noise = noise * 0.03,
+		.gyro_noise = noise * 0.002,
+		.magm_noise = noise * 0.3,
+		.rest = rest,
+		.gyro_bias = {{0.010, -0.020, 0.005}},
+		.gyro_drift = {{0.0005, -0.0008, 0.0006}},
+		.temp = 25,
+		.temp_rate = temp_rate,
+		.nack_rate = nack_rate,
+		.stuck_rate = stuck_rate,
+		.unplug_rate = unplug_rate,
+		.unplug_time = 0.050,
+		.hard = {{51.43, 70.61, -34.96}},
+		.asa = {176, 177, 165},
+		.seed = seed,
+	};
+
+	sim_init(&cfg);
+
+	/* What init_bus() and init_sensors() do with I2C. */
+	ESP_ERROR_CHECK(i2ce_master_init(I2C_NUM_0, 26, 25, freq, timeout));
+	ESP_ERROR_CHECK(i2ce_master_init(I2C_NUM_1, 32, 33, freq, timeout));
+
+	for (unsigned i = 0; i < num_imus; i++) {
+		sim_attach(places[i].port, places[i].addr);
+		regio_i2c_init(&imus[i].mpu_io, places[i].port, places[i].addr);
+	}
+
+	regio_i2c_init(&imus[0].mag_io, I2C_NUM_0, AK8963_ADDR);
+
+	mpu9250_config mpu_cfg = MPU9250_CONFIG_DEFAULT;
+	mpu_cfg.smplrt_div = MPU9250_RATE_DIV(fifo ? 1000 : rate);
+
+	ak8963_config ak_cfg = {
+		.mode = AK8963_MODE_100HZ,
+		.bits16 = true,
+	};
+
+	/* Keep trying, same as the firmware. */
+	while (init_sensors(num_imus, bypass, fifo, &mpu_cfg, &ak_cfg)) {
+		vTaskDelay(pdMS_TO_TICKS(RETRY_MS));
+
+		for (int p = 0; p < I2C_NUM_MAX; p++)
+			i2ce_recover(p);
+	}
+
+	/* Only count the steady state. */
+	sim_stats base[I2C_NUM_MAX];
+
+	for (int p = 0; p < I2C_NUM_MAX; p++)
+		base[p] = sim_get_stats(p);
+
+	double start = sim_time();
+	double period = fifo ? 0.010 : MPU9250_RATE_DT(mpu_cfg.smplrt_div);
+
+	fusion est;
+	fusion_init(&est, fifo ? 0.001 : period);
+
+	if (counts) {
+		float accm_lsb, gyro_lsb, magm_lsb[3];
+
+		mpu9250_get_scale(&imus[0].mpu, &accm_lsb, &gyro_lsb);
+		ak8963_get_scale(&imus[0].mag, magm_lsb);
+		fusion_fold(&est, accm_lsb, gyro_lsb, magm_lsb);
+	}
+
+	/* Same thresholds and time constant as main by default. */
+	gyrocal gcal;
+	gyrocal_init(&gcal, 0.1, 0.5 * M_PI / 180, 10, period);
+
+	static mpu9250_frame frames[MPU9250_FIFO_FRAMES];
+	size_t reads = 0, samples = 0, lost = 0, compared = 0, slot = 0;
+	pace pacer;
+	double last_good = start, gap_max = 0;
+	double cpu_drv = 0, cpu_fuse = 0, err_sum = 0, gyro_sq = 0;
+	float err_max = 0;
+	double bias_sq = 0;
+	size_t rest_hits[2][2] = {{0}};
+	quat offset = {1, 0, 0, 0};
+
+	/* Held and predicted poses against the truth after each horizon. */
+	predict ahead[NUM_HORIZONS];
+	quat predicted[NUM_HORIZONS];
+	double held_sum[NUM_HORIZONS] = {0}, pred_sum[NUM_HORIZONS] = {0};
+	float pred_max[NUM_HORIZONS] = {0};
+
+	for (size_t j = 0; j < NUM_HORIZONS; j++)
+		predict_init(ahead + j, horizons[j] / 1000.0);
+
+	pace_init(&pacer, FAIL_LIMIT);
+
+	while (sim_time() - start < duration) {
+		if (pace_restart(&pacer)) {
+			/* What restart_sensors() does. */
+			for (int p = 0; p < I2C_NUM_MAX; p++)
+				i2ce_recover(p);
+
+			while (init_sensors(num_imus, bypass, fifo,
+			                    &mpu_cfg, &ak_cfg)) {
+				vTaskDelay(pdMS_TO_TICKS(RETRY_MS));
+
+				for (int p = 0; p < I2C_NUM_MAX; p++)
+					i2ce_recover(p);
+			}
+		}
+
+		/* Wait for the next sample, skip those missed while away. */
+		size_t late = (sim_time() - start) / period;
+		size_t next = slot + 1 > late + 1 ? slot + 1 : late + 1;
+
+		pace_wait(&pacer, next - slot);
+		slot = next;
+
+		double wake = start + slot * period;
+
+		if (sim_time() < wake)
+			sim_step(wake - sim_time());
+
+		double t0 = now();
+
+		float accm[3], gyro[3], temp[1], magm[3];
+		int16_t magm_counts[3];
+		size_t count = 1;
+		esp_err_t fault;
+		bool ok;
+
+		reads++;
+
+		if (counts) {
+			int16_t a[3], g[3], t[1];
+
+			fault = read_counts(imus, a, g, t, magm_counts, &ok);
+
+			if (!fault)
+				fusion_convert(&est, a, g, accm, gyro);
+
+			temp[0] = t[0] * MPU9250_TEMP_SCALE + MPU9250_TEMP_OFFSET;
+		} else {
+			fault = read_imu(imus, accm, gyro, temp, magm, &ok);
+		}
+
+		/* Average the others in, as the firmware does. */
+		for (unsigned j = 1; j < num_imus && !fault; j++) {
+			float a[3], g[3], t[1], m[3];
+			bool m_ok;
+
+			fault = read_imu(imus + j, a, g, t, m, &m_ok);
+			ok = ok && m_ok;
+
+			for (int i = 0; i < 3; i++) {
+				accm[i] += a[i];
+				gyro[i] += g[i];
+				magm[i] += m[i];
+			}
+		}
+
+		for (int i = 0; i < 3; i++) {
+			accm[i] /= num_imus;
+			gyro[i] /= num_imus;
+			magm[i] /= num_imus;
+		}
+
+		if (fifo && !fault) {
+			bool overflow;
+			fault = mpu9250_fifo_read(&imus[0].mpu, frames,
+			                        MPU9250_FIFO_FRAMES, &count,
+			                        &overflow);
+			lost += overflow;
+		}
+
+		if (!pace_read(&pacer, !fault))
+			continue;
+
+		gap_max = fmax(gap_max, sim_time() - last_good);
+		last_good = sim_time();
+
+		/* Compare with the truth, exact with the motion stopped. */
+		vec3 true_bias = sim_gyro_bias(sim_time());
+		vec3 true_gyro = vec3add2(sim_gyro(sim_time()), true_bias);
+
+		for (int i = 0; i < 3; i++) {
+			float d = gyro[i] - true_gyro.row[i];
+			gyro_sq += d * d;
+		}
+
+		if (gyro_cal) {
+			vec3 a = {{accm[0], accm[1], accm[2]}};
+			vec3 g = {{gyro[0], gyro[1], gyro[2]}};
+
+			g = gyrocal_update(&gcal, a, g, temp[0]);
+
+			for (int i = 0; i < 3; i++)
+				gyro[i] = g.row[i];
+
+			vec3 d = vec3add2(gyrocal_bias(&gcal),
+			                  vec3scale(-1, true_bias));
+			bias_sq += vec3dot(d, d);
+			rest_hits[sim_resting(sim_time())][gcal.resting]++;
+		}
+
+		double t1 = now();
+
+		vec3 m = {{0, 0, 0}};
+
+		if (ok && !(no_magm && est.ready)) {
+			bool updated;
+
+			if (counts)
+				m = fusion_magm_counts(&est, magm_counts, &updated);
+			else
+				m = fusion_magm(&est, magm, &updated);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			float *g = fifo ? frames[i].gyro : gyro;
+
+			if (fifo)
+				fusion_update(&est, frames[i].accm, g, m);
+			else
+				fusion_update(&est, accm, gyro, m);
+
+			if (!prediction || !est.ready)
+				continue;
+
+			/* Same as the firmware does before sending the pose. */
+			vec3 rate = {{g[0], g[1], g[2]}};
+			rate = vec3add2(rate, est.filter.bias);
+
+			for (size_t j = 0; j < NUM_HORIZONS; j++)
+				predicted[j] = predict_pose(ahead + j, est.filter.q,
+				                            rate, est.dt);
+		}
+
+		double t2 = now();
+
+		cpu_drv += t1 - t0;
+		cpu_fuse += t2 - t1;
+		samples += count;
+
+		if (!est.ready || sim_time() - start < SETTLE)
+			continue;
+
+		/* Filter and simulator worlds differ by a fixed rotation. */
+		quat rel = quatmul(est.filter.q, quatconj(sim_truth(sim_time())));
+
+		if (!compared++)
+			offset = rel;
+
+		float err = angle(quatmul(quatconj(offset), rel));
+		err_sum += err;
+		err_max = maxf(err_max, err);
+
+		for (size_t j = 0; prediction && j < NUM_HORIZONS; j++) {
+			quat future = sim_truth(sim_time() + horizons[j] / 1000.0);
+			future = quatmul(offset, future);
+
+			held_sum[j] += angle(quatmul(quatconj(future),
+			                             est.filter.q));
+
+			err = angle(quatmul(quatconj(future), predicted[j]));
+			pred_sum[j] += err;
+			pred_max[j] = maxf(pred_max[j], err);
+		}
+	}
+
+	double elapsed = sim_time() - start;
+
+	printf("%zu reads, %zu samples, %zu overflows in %.1f s\n",
+	       reads, samples, lost, elapsed);
+
+	for (int p = 0; p < I2C_NUM_MAX; p++) {
+		sim_stats st = sim_get_stats(p);
+		unsigned long trans = st.transactions - base[p].transactions;
+		unsigned long bytes = st.bytes - base[p].bytes;
+
+		if (!trans)
+			continue;
+
+		printf("Bus %i: %.1f transactions and %.1f bytes per read,"
+		       " %.1f %% busy at %u Hz\n", p,
+		       (double)trans / reads, (double)bytes / reads,
+		       100 * (st.busy - base[p].busy) / elapsed, freq);
+	}
+
+	if (nack_rate > 0 || stuck_rate > 0 || unplug_rate > 0) {
+		printf("Faults: %u reads failed, %u restarts,"
+		       " %.0f ms longest gap\n",
+		       pacer.dropped, pacer.restarts, gap_max * 1000);
+
+		for (int p = 0; p < I2C_NUM_MAX; p++) {
+			i2ce_stats st = i2ce_get_stats(p);
+
+			if (!st.errors && !st.recoveries)
+				continue;
+
+			printf("Bus %i: %u errors, %u timeouts,"
+			       " %u recoveries\n", p, st.errors,
+			       st.timeouts, st.recoveries);
+		}
+	}
+
+	printf("Gyro: %.5f rad/s RMS error per axis\n",
+	       sqrt(gyro_sq / (3 * (reads - pacer.dropped))));
+
+	if (gyro_cal) {
+		vec3 d = vec3add2(gyrocal_bias(&gcal),
+		                  vec3scale(-1, sim_gyro_bias(sim_time())));
+
+		printf("Bias: %.5f rad/s RMS, %.5f rad/s final error"
+		       " per axis\n",
+		       sqrt(bias_sq / (3 * (reads - pacer.dropped))),
+		       sqrt(vec3dot(d, d) / 3));
+		printf("Rest: %zu of %zu resting and %zu of %zu moving"
+		       " samples detected\n",
+		       rest_hits[1][1], rest_hits[1][0] + rest_hits[1][1],
+		       rest_hits[0][1], rest_hits[0][0] + rest_hits[0][1]);
+	}
+	printf("Host: %.0f ns driver and simulator, %.0f ns fusion"
+	       " per sample\n", cpu_drv * 1e9 / samples,
+	       cpu_fuse * 1e9 / samples);
+
+	if (compared)
+		printf("Pose: %.2f° mean, %.2f° max error after %.0f s\n",
+		       err_sum / compared, err_max, SETTLE);
+
+	if (compared && prediction) {
+		printf("Horizon  Held mean  Predicted mean  Predicted max\n");
+
+		for (size_t j = 0; j < NUM_HORIZONS; j++)
+			printf("%4u ms  %8.2f°  %13.2f°  %12.2f°\n",
+			       horizons[j], held_sum[j] / compared,
+			       pred_sum[j] / compared, pred_max[j]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <freertos/task.h>
+#include <rom/ets_sys.h>
+
+#include "sim.h"
+
+
+/* Standard gravity, in m/s². */
+#define GRAVITY 9.80665f
+
+/* Local geomagnetic field, north and vertical components, in μT. */
+static const vec3 field = {{20, 0, -44}};
+
+
+sim_config sim_cfg;
+int sim_verbose = 0;
+
+
+/* Simulated time, in seconds. */
+static double now = 0;
+
+/* Attached sensors. */
+#define MAX_DEVICES 4
+
+static sim_mpu devices[MAX_DEVICES];
+static int num_devices = 0;
+
+/* Noise and fault generator states, apart to keep the noise the same. */
+static uint64_t rng = 1;
+static uint64_t fault_rng = 1;
+
+/* When the sensors lose power next and when they get it back. */
+static double unplug_at = INFINITY;
+static double plug_at = 0;
+
+
+/* Uniform sample from (0, 1). */
+static double uniform(uint64_t *state)
+{
+	/* xorshift64* */
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	uint64_t v = *state * 0x2545f4914f6cdd1dull;
+	return ((v >> 11) + 0.5) / (double)(1ull << 53);
+}
+
+
+/* Time until the next unplug, exponentially distributed. */
+static double unplug_interval(void)
+{
+	if (sim_cfg.unplug_rate <= 0)
+		return INFINITY;
+
+	return -log(uniform(&fault_rng)) / sim_cfg.unplug_rate;
+}
+
+
+void sim_init(const sim_config *cfg)
+{
+	sim_cfg = *cfg;
+	rng = cfg->seed ? cfg->seed : 1;
+	fault_rng = rng ^ 0x9e3779b97f4a7c15ull;
+	num_devices = 0;
+	plug_at = 0;
+	unplug_at = now + unplug_interval();
+}
+
+
+void sim_attach(i2c_port_t port, uint8_t addr)
+{
+	if (num_devices >= MAX_DEVICES)
+		abort();
+
+	sim_mpu *m = devices + num_devices++;
+
+	m->port = port;
+	m->addr = addr;
+	m->cs = -1;
+	mpu_reset(m);
+	ak_reset(&m->ak, sim_cfg.asa);
+}
+
+
+void sim_attach_spi(int cs)
+{
+	sim_attach(-1, 0);
+	devices[num_devices - 1].cs = cs;
+}
+
+
+int sim_find(i2c_port_t port, uint8_t addr, sim_mpu **mpu, sim_ak **ak)
+{
+	int found = 0;
+
+	*mpu = NULL;
+	*ak = NULL;
+
+	for (int i = 0; i < num_devices; i++) {
+		sim_mpu *m = devices + i;
+
+		if (m->port != port)
+			continue;
+
+		if (m->addr == addr) {
+			*mpu = m;
+			found++;
+		} else if (0x0c == addr && mpu_bypass(m)) {
+			*ak = &m->ak;
+			found++;
+		}
+	}
+
+	return found;
+}
+
+
+sim_mpu *sim_find_spi(int cs)
+{
+	for (int i = 0; i < num_devices; i++)
+		if (devices[i].cs == cs)
+			return devices + i;
+
+	return NULL;
+}
+
+
+void sim_step(double dt)
+{
+	now += dt;
+
+	if (now >= unplug_at) {
+		plug_at = unplug_at + sim_cfg.unplug_time;
+		unplug_at = plug_at + unplug_interval();
+	}
+
+	if (sim_unplugged())
+		return;
+
+	/* Power comes back, every register at its default. */
+	if (plug_at > 0) {
+		for (int i = 0; i < num_devices; i++) {
+			mpu_reset(devices + i);
+			ak_reset(&devices[i].ak, sim_cfg.asa);
+		}
+
+		plug_at = 0;
+	}
+
+	for (int i = 0; i < num_devices; i++) {
+		mpu_tick(devices + i, now);
+		ak_tick(&devices[i].ak, now);
+	}
+}
+
+
+double sim_time(void)
+{
+	return now;
+}
+
+
+bool sim_unplugged(void)
+{
+	return now < plug_at;
+}
+
+
+bool sim_chance(float p)
+{
+	return p > 0 && uniform(&fault_rng) < p;
+}
+
+
+/* Rotation around a single axis. */
+static quat axis_angle(int axis, float angle)
+{
+	quat q = {cosf(angle / 2), 0, 0, 0};
+	float s = sinf(angle / 2);
+
+	if (0 == axis)
+		q.x = s;
+	else if (1 == axis)
+		q.y = s;
+	else
+		q.z = s;
+
+	return q;
+}
+
+
+bool sim_resting(double t)
+{
+	if (sim_cfg.rest <= 0)
+		return false;
+
+	return fmod(t, 2 * sim_cfg.rest) >= sim_cfg.rest;
+}
+
+
+/* Time spent moving up to `t`, motion just pauses while resting. */
+static double motion_time(double t)
+{
+	if (sim_cfg.rest <= 0)
+		return t;
+
+	double cycles = floor(t / (2 * sim_cfg.rest));
+	double part = t - cycles * 2 * sim_cfg.rest;
+
+	return cycles * sim_cfg.rest + fmin(part, sim_cfg.rest);
+}
+
+
+/* Orientation at time `t`: yaw, then pitch, then roll. */
+static quat orientation(double t)
+{
+	float angle[3];
+
+	t = motion_time(t);
+
+	for (int i = 0; i < 3; i++) {
+		double phase = 2 * M_PI * sim_cfg.frequency.row[i] * t + i;
+		angle[i] = sim_cfg.amplitude.row[i] * sin(phase);
+	}
+
+	quat q = axis_angle(2, angle[2]);
+	q = quatmul(q, axis_angle(1, angle[1]));
+	q = quatmul(q, axis_angle(0, angle[0]));
+
+	return q;
+}
+
+
+quat sim_truth(double t)
+{
+	return orientation(t);
+}
+
+
+vec3 sim_accm(double t)
+{
+	/* Only gravity, the head turns but does not move. */
+	vec3 up = {{0, 0, GRAVITY}};
+	return quatrot(quatconj(orientation(t)), up);
+}
+
+
+vec3 sim_gyro(double t)
+{
+	/* Central difference of the orientation. */
+	const double h = 1e-3;
+	quat dq = quatmul(quatconj(orientation(t - h / 2)),
+	                  orientation(t + h / 2));
+
+	vec3 rate = {{dq.x, dq.y, dq.z}};
+	return vec3scale(2 / h, rate);
+}
+
+
+vec3 sim_magm(double t)
+{
+	return quatrot(quatconj(orientation(t)), field);
+}
+
+
+float sim_temp(double t)
+{
+	return sim_cfg.temp + sim_cfg.temp_rate * t;
+}
+
+
+vec3 sim_gyro_bias(double t)
+{
+	float warm = sim_temp(t) - 25;
+	return vec3add2(sim_cfg.gyro_bias, vec3scale(warm, sim_cfg.gyro_drift));
+}
+
+
+float sim_noise(float sigma)
+{
+	if (sigma <= 0)
+		return 0;
+
+	double u[2];
+
+	for (int i = 0; i < 2; i++)
+		u[i] = uniform(&rng);
+
+	/* Box-Muller transform. */
+	return sigma * sqrt(-2 * log(u[0])) * cos(2 * M_PI * u[1]);
+}
+
+
+void vTaskDelay(TickType_t ticks)
+{
+	sim_step(ticks / 1000.0);
+}
+
+
+void ets_delay_us(uint32_t us)
+{
+	sim_step(us / 1e6);
+}
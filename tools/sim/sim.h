@@ -0,0 +1,224 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <driver/i2c.h>
+
+#include <spatial.h>
+
+
+/*
+ * Sensor Simulator
+ * ================
+ *
+ * Stands in for the ESP-IDF I2C and SPI drivers on a Linux host. Transfers
+ * issued through i2ce or SPI land in emulated MPU9250 and AK8963 registers,
+ * which are fed by a motion generator, so that the real drivers run
+ * unmodified.
+ *
+ * The world frame has X pointing to the magnetic north and Z up.
+ */
+
+struct sim_config {
+	/* Swing around X, Y and Z, amplitude in rad and frequency in Hz. */
+	vec3 amplitude;
+	vec3 frequency;
+
+	/* Alternate this many seconds of motion and of rest, 0 never rests. */
+	float rest;
+
+	/* Gaussian noise, in m/s², rad/s and μT. */
+	float accm_noise;
+	float gyro_noise;
+	float magm_noise;
+
+	/* Gyroscope bias at 25 °C in rad/s, and its change per °C. */
+	vec3 gyro_bias;
+	vec3 gyro_drift;
+
+	/* Temperature at the start in °C, and its change per second. */
+	float temp;
+	float temp_rate;
+
+	/* Hard iron offset in the magnetometer axes, in μT. */
+	vec3 hard;
+
+	/* Magnetometer sensitivity adjustment fuse ROM values. */
+	uint8_t asa[3];
+
+	/*
+	 * Chance of a transaction not being acknowledged and of one
+	 * leaving SDA held low until the bus is recovered.
+	 */
+	float nack_rate;
+	float stuck_rate;
+
+	/*
+	 * How often per second the sensors lose power and for how long,
+	 * in seconds. They come back with their registers reset.
+	 */
+	float unplug_rate;
+	float unplug_time;
+
+	/* Seed of the noise and fault generators. */
+	unsigned seed;
+};
+
+typedef struct sim_config sim_config;
+
+
+/* Bus statistics of a port, since the start. */
+struct sim_stats {
+	/* Number of transactions, those not acknowledged included. */
+	unsigned long transactions;
+
+	/* Bytes moved, including addresses and register numbers. */
+	unsigned long bytes;
+
+	/* Time the bus was busy at its frequency, in seconds. */
+	double busy;
+
+	/* Transactions clocked faster than the registers allow (SPI). */
+	unsigned long too_fast;
+};
+
+typedef struct sim_stats sim_stats;
+
+
+/* Start over without any sensors. */
+void sim_init(const sim_config *cfg);
+
+/*
+ * Power up an MPU9250 with its AK8963 at `addr` on the I2C `port`.
+ * All of them are mounted the same way and move together.
+ */
+void sim_attach(i2c_port_t port, uint8_t addr);
+
+/* Same for an MPU9250 on the SPI bus, selected by the `cs` pin. */
+void sim_attach_spi(int cs);
+
+/* Let `dt` seconds of simulated time pass. */
+void sim_step(double dt);
+
+/* Current simulated time, in seconds. */
+double sim_time(void);
+
+/* Whether the sensors are without power right now. */
+bool sim_unplugged(void);
+
+/* Draw a fault that happens with probability `p`. */
+bool sim_chance(float p);
+
+/* Orientation of the sensor at time `t`, body to world. */
+quat sim_truth(double t);
+
+/* Bus statistics so far. */
+sim_stats sim_get_stats(i2c_port_t port);
+sim_stats sim_get_spi_stats(void);
+
+
+/*
+ * Interface between the bus and the device models. Addresses auto
+ * increment, except for the registers that say otherwise.
+ */
+
+/* AK8963 */
+struct sim_ak {
+	uint8_t r[0x20];
+	uint8_t asa[3];
+
+	/* Time of the next measurement. */
+	double next;
+
+	/* When it last entered the power-down mode. */
+	double down;
+};
+
+typedef struct sim_ak sim_ak;
+
+void ak_reset(sim_ak *a, const uint8_t asa[3]);
+void ak_tick(sim_ak *a, double t);
+uint8_t ak_read(sim_ak *a, uint8_t reg);
+void ak_write(sim_ak *a, uint8_t reg, uint8_t value);
+
+/* MPU9250 with the magnetometer on its auxiliary bus. */
+#define SIM_FIFO_SIZE 512
+
+struct sim_mpu {
+	i2c_port_t port;
+	uint8_t addr;
+
+	/* Chip select pin on SPI, -1 on I2C. */
+	int cs;
+
+	uint8_t r[128];
+
+	/* FIFO ring buffer. */
+	uint8_t fifo[SIM_FIFO_SIZE];
+	unsigned fifo_head, fifo_len;
+
+	/* Time of the next sample. */
+	double next;
+
+	sim_ak ak;
+};
+
+typedef struct sim_mpu sim_mpu;
+
+void mpu_reset(sim_mpu *m);
+void mpu_tick(sim_mpu *m, double t);
+uint8_t mpu_read(sim_mpu *m, uint8_t reg);
+void mpu_write(sim_mpu *m, uint8_t reg, uint8_t value);
+bool mpu_bypass(const sim_mpu *m);
+bool mpu_no_increment(uint8_t reg);
+bool mpu_fast_read(uint8_t reg);
+
+/*
+ * Find the device at `addr` on the `port`, return the number of
+ * candidates. Magnetometers in bypass mode answer all at once.
+ */
+int sim_find(i2c_port_t port, uint8_t addr, sim_mpu **mpu, sim_ak **ak);
+
+/* Find the device selected by the `cs` pin, NULL if there is none. */
+sim_mpu *sim_find_spi(int cs);
+
+
+/* Sensor readings in the body frame at time `t`, without noise. */
+vec3 sim_accm(double t);
+vec3 sim_gyro(double t);
+vec3 sim_magm(double t);
+
+/* Temperature and the gyroscope bias it causes at time `t`. */
+float sim_temp(double t);
+vec3 sim_gyro_bias(double t);
+
+/* Whether the sensor is at rest at time `t`. */
+bool sim_resting(double t);
+
+/* Sample of a zero mean Gaussian noise. */
+float sim_noise(float sigma);
+
+/* Configuration in use. */
+extern sim_config sim_cfg;
+
+
+#endif				/* !_SIM_H */
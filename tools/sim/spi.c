@@ -0,0 +1,195 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Host implementation of the ESP-IDF SPI master and GPIO drivers. Chip
+ * select pins driven low pick the emulated device every transfer goes
+ * to. Simulated time runs while the bus is busy, and transfers clocked
+ * faster than the registers they touch allow are counted.
+ */
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_err.h>
+#include <driver/gpio.h>
+#include <driver/spi_master.h>
+
+#include "sim.h"
+
+
+static const char *tag = "spi";
+
+
+/* Fastest clock for any register but the sensor data ones. */
+#define SLOW_FREQ 1000000
+
+/* And for the sensor data ones. */
+#define FAST_FREQ 20000000
+
+
+/* Levels of the pins, high until driven otherwise. */
+#define NUM_PINS 40
+
+static uint32_t level[NUM_PINS];
+static bool output[NUM_PINS];
+
+
+struct spi_device {
+	int freq;
+};
+
+#define MAX_HANDLES 8
+
+static struct spi_device handles[MAX_HANDLES];
+static int num_handles = 0;
+
+static sim_stats stats;
+
+
+esp_err_t gpio_config(const gpio_config_t *conf)
+{
+	for (int i = 0; i < NUM_PINS; i++) {
+		if (!(conf->pin_bit_mask & (1ull << i)))
+			continue;
+
+		output[i] = GPIO_MODE_OUTPUT == conf->mode;
+		level[i] = 1;
+	}
+
+	return ESP_OK;
+}
+
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t value)
+{
+	if (gpio < 0 || gpio >= NUM_PINS || !output[gpio])
+		return ESP_ERR_INVALID_ARG;
+
+	level[gpio] = !!value;
+	return ESP_OK;
+}
+
+
+esp_err_t spi_bus_initialize(spi_host_device_t host,
+                             const spi_bus_config_t *bus, int dma)
+{
+	return ESP_OK;
+}
+
+
+esp_err_t spi_bus_add_device(spi_host_device_t host,
+                             const spi_device_interface_config_t *dev,
+                             spi_device_handle_t *handle)
+{
+	if (num_handles >= MAX_HANDLES || dev->clock_speed_hz > FAST_FREQ)
+		return ESP_ERR_INVALID_ARG;
+
+	handles[num_handles].freq = dev->clock_speed_hz;
+	*handle = handles + num_handles++;
+
+	return ESP_OK;
+}
+
+
+/* Find the one device with its chip select low. */
+static sim_mpu *selected(void)
+{
+	sim_mpu *found = NULL;
+
+	for (int i = 0; i < NUM_PINS; i++) {
+		sim_mpu *m = level[i] ? NULL : sim_find_spi(i);
+
+		if (m && found) {
+			ESP_LOGE(tag, "Devices clash, two selected at once!");
+			abort();
+		}
+
+		found = m ? m : found;
+	}
+
+	return found;
+}
+
+
+/* Whether every register of the transfer may be clocked at `freq`. */
+static bool allowed(uint8_t reg, bool read, size_t len, int freq)
+{
+	if (freq <= SLOW_FREQ)
+		return true;
+
+	if (!read)
+		return false;
+
+	for (size_t i = 0; i < len; i++) {
+		if (!mpu_fast_read(reg))
+			return false;
+
+		if (!mpu_no_increment(reg))
+			reg++;
+	}
+
+	return true;
+}
+
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle,
+                                      spi_transaction_t *t)
+{
+	uint8_t reg = t->addr & 0x7f;
+	bool read = t->addr & 0x80;
+	size_t len = t->length / 8;
+	double busy = (8.0 + t->length) / handle->freq;
+
+	stats.transactions++;
+	stats.bytes += 1 + len;
+	stats.busy += busy;
+	sim_step(busy);
+
+	if (!allowed(reg, read, len, handle->freq)) {
+		ESP_LOGW(tag, "%s of %#hhx at %i Hz is too fast!",
+		         read ? "Read" : "Write", reg, handle->freq);
+		stats.too_fast++;
+	}
+
+	sim_mpu *m = selected();
+
+	/* Nobody drives MISO without power or with nothing selected. */
+	if (!m || sim_unplugged()) {
+		if (read)
+			memset(t->rx_buffer, 0xff, len);
+
+		return ESP_OK;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (read)
+			((uint8_t *)t->rx_buffer)[i] = mpu_read(m, reg);
+		else
+			mpu_write(m, reg, ((const uint8_t *)t->tx_buffer)[i]);
+
+		if (!mpu_no_increment(reg))
+			reg++;
+	}
+
+	return ESP_OK;
+}
+
+
+sim_stats sim_get_spi_stats(void)
+{
+	return stats;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Minimal harness shared by the host tests. A failed check reports
+ * where and what, then the test carries on. The exit status tells
+ * whether all of them passed.
+ */
+
+#ifndef _CHECK_H
+#define _CHECK_H 1
+
+#include <stdio.h>
+#include <math.h>
+
+
+/* Number of failed checks so far. */
+static int check_failed = 0;
+
+
+#define CHECK(cond) do {						\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s\n",			\
+			        __FILE__, __LINE__, #cond);		\
+			check_failed++;					\
+		}							\
+	} while (0)
+
+
+/* Compare two numbers, print both when they differ too much. */
+#define CHECK_NEAR(a, b, tol) do {					\
+		double a_ = (a), b_ = (b);				\
+		if (!(fabs(a_ - b_) <= (tol))) {			\
+			fprintf(stderr, "%s:%d: %s = %g, %s = %g\n",	\
+			        __FILE__, __LINE__, #a, a_, #b, b_);	\
+			check_failed++;					\
+		}							\
+	} while (0)
+
+
+/* Report the outcome, return the exit status of the test. */
+static inline int check_done(const char *name)
+{
+	printf("%-16s %s\n", name, check_failed ? "FAILED" : "ok");
+	return check_failed ? 1 : 0;
+}
+
+
+#endif				/* !_CHECK_H */
@@ -0,0 +1,30 @@
+/* Host stand-in for the ESP-IDF header, the bus lines are always free. */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+
+typedef int gpio_num_t;
+
+typedef enum {
+	GPIO_MODE_INPUT,
+	GPIO_MODE_OUTPUT,
+	GPIO_MODE_INPUT_OUTPUT_OD,
+} gpio_mode_t;
+
+typedef enum {
+	GPIO_PULLUP_DISABLE,
+	GPIO_PULLUP_ENABLE,
+} gpio_pullup_t;
+
+typedef struct {
+	uint64_t pin_bit_mask;
+	gpio_mode_t mode;
+	gpio_pullup_t pull_up_en;
+} gpio_config_t;
+
+esp_err_t gpio_config(const gpio_config_t *conf);
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level);
+int gpio_get_level(gpio_num_t gpio);
@@ -0,0 +1,38 @@
+/* Host stand-in for the ESP-IDF header, see tools/test/mock_i2c.c. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <esp_err.h>
+
+typedef int i2c_port_t;
+
+#define I2C_NUM_0 0
+#define I2C_NUM_1 1
+#define I2C_NUM_MAX 2
+
+typedef enum {
+	I2C_MODE_SLAVE,
+	I2C_MODE_MASTER,
+} i2c_mode_t;
+
+#define I2C_MASTER_WRITE 0
+#define I2C_MASTER_READ 1
+
+typedef struct {
+	i2c_mode_t mode;
+	int sda_io_num;
+	int scl_io_num;
+
+	struct {
+		uint32_t clk_speed;
+	} master;
+} i2c_config_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf);
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode,
+                             size_t rx_len, size_t tx_len, int flags);
+esp_err_t i2c_driver_delete(i2c_port_t port);
@@ -0,0 +1,7 @@
+/* Host stand-in for the ESP-IDF header, time moves on every reading. */
+
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,7 @@
+/* Host stand-in for the ESP-IDF header. */
+
+#pragma once
+
+#include <stdint.h>
+
+void ets_delay_us(uint32_t us);
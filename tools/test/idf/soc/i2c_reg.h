@@ -0,0 +1,25 @@
+/* Host stand-in for the ESP-IDF header, the registers we program. */
+
+#pragma once
+
+#include <soc/soc.h>
+
+#define REG_I2C_BASE(i) (0x3ff53000 + (i) * 0x14000)
+
+#define I2C_CTR_REG(i) (REG_I2C_BASE(i) + 0x0004)
+#define I2C_FIFO_CONF_REG(i) (REG_I2C_BASE(i) + 0x0018)
+#define I2C_DATA_APB_REG(i) (REG_I2C_BASE(i) + 0x001c)
+#define I2C_INT_RAW_REG(i) (REG_I2C_BASE(i) + 0x0020)
+#define I2C_INT_CLR_REG(i) (REG_I2C_BASE(i) + 0x0024)
+#define I2C_INT_ENA_REG(i) (REG_I2C_BASE(i) + 0x0028)
+#define I2C_COMD0_REG(i) (REG_I2C_BASE(i) + 0x0058)
+
+#define I2C_TRANS_START BIT(5)
+#define I2C_RX_FIFO_RST BIT(12)
+#define I2C_TX_FIFO_RST BIT(13)
+
+#define I2C_END_DETECT_INT_RAW BIT(3)
+#define I2C_ARBITRATION_LOST_INT_RAW BIT(5)
+#define I2C_TRANS_COMPLETE_INT_RAW BIT(7)
+#define I2C_TIME_OUT_INT_RAW BIT(8)
+#define I2C_ACK_ERR_INT_RAW BIT(10)
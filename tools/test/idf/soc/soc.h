@@ -0,0 +1,19 @@
+/* Host stand-in for the ESP-IDF header, registers are emulated. */
+
+#pragma once
+
+#include <stdint.h>
+
+#define BIT(n) (1u << (n))
+
+uint32_t mock_reg_read(uint32_t addr);
+void mock_reg_write(uint32_t addr, uint32_t value);
+
+#define READ_PERI_REG(addr) mock_reg_read(addr)
+#define WRITE_PERI_REG(addr, value) mock_reg_write(addr, value)
+
+#define SET_PERI_REG_MASK(addr, mask) \
+	WRITE_PERI_REG(addr, READ_PERI_REG(addr) | (mask))
+
+#define CLEAR_PERI_REG_MASK(addr, mask) \
+	WRITE_PERI_REG(addr, READ_PERI_REG(addr) & ~(mask))
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <driver/i2c.h>
+#include <driver/gpio.h>
+#include <soc/i2c_reg.h>
+#include <esp_timer.h>
+#include <rom/ets_sys.h>
+
+#include "mock_i2c.h"
+
+
+/* Consulted by <esp_log.h>. */
+int sim_verbose = 0;
+
+uint8_t mock_regs[256];
+bool mock_hang;
+unsigned mock_transactions;
+unsigned mock_installs;
+unsigned mock_faults;
+
+
+/* Depth of the FIFOs and the number of command registers. */
+#define FIFO_LEN 32
+#define NUM_CMDS 16
+
+/* Where the firmware pushes bytes into the TX FIFO. */
+#define FIFO_AHB 0x6001301c
+
+
+/* State of the port 0 controller and of the slave behind it. */
+static struct {
+	uint32_t ctr, fifo_conf, int_raw, int_ena;
+	uint32_t cmd[NUM_CMDS];
+
+	/* Rings, heads and tails only ever grow. */
+	uint8_t tx[FIFO_LEN];
+	unsigned tx_head, tx_tail;
+
+	uint8_t rx[FIFO_LEN];
+	unsigned rx_head, rx_tail;
+
+	/* Slave selected, next byte is the address, register pointer. */
+	bool selected, reading, addressed;
+	bool expect_addr;
+	uint8_t ptr;
+} hw;
+
+
+static void fault(const char *what)
+{
+	fprintf(stderr, "mock_i2c: %s\n", what);
+	mock_faults++;
+}
+
+
+static uint8_t tx_pop(void)
+{
+	if (hw.tx_head == hw.tx_tail) {
+		fault("TX FIFO underflow");
+		return 0xff;
+	}
+
+	return hw.tx[hw.tx_head++ % FIFO_LEN];
+}
+
+
+static void rx_push(uint8_t byte)
+{
+	if (hw.rx_tail - hw.rx_head == FIFO_LEN) {
+		fault("RX FIFO overflow");
+		return;
+	}
+
+	hw.rx[hw.rx_tail++ % FIFO_LEN] = byte;
+}
+
+
+/* Returns whether the slave acknowledged. */
+static bool slave_write(uint8_t byte)
+{
+	if (hw.expect_addr) {
+		hw.expect_addr = false;
+		hw.selected = (byte >> 1) == MOCK_SLAVE;
+		hw.reading = byte & I2C_MASTER_READ;
+		return hw.selected;
+	}
+
+	if (!hw.selected)
+		return false;
+
+	if (hw.reading) {
+		fault("write during a read");
+		return false;
+	}
+
+	if (!hw.addressed) {
+		hw.ptr = byte;
+		hw.addressed = true;
+		return true;
+	}
+
+	mock_regs[hw.ptr++] = byte;
+	return true;
+}
+
+
+/* Run the commands from the first one until a stop or an end. */
+static void run(void)
+{
+	if (mock_hang)
+		return;
+
+	for (int i = 0; i < NUM_CMDS; i++) {
+		unsigned op = (hw.cmd[i] >> 11) & 7;
+		unsigned len = hw.cmd[i] & 0xff;
+		bool ack_check = hw.cmd[i] & BIT(8);
+
+		switch (op) {
+		case 0:
+			hw.expect_addr = true;
+			break;
+
+		case 1:
+			for (unsigned j = 0; j < len; j++) {
+				if (!slave_write(tx_pop()) && ack_check) {
+					hw.int_raw |= I2C_ACK_ERR_INT_RAW;
+					hw.selected = hw.addressed = false;
+					return;
+				}
+			}
+			break;
+
+		case 2:
+			if (!hw.selected || !hw.reading)
+				fault("read from no one");
+
+			for (unsigned j = 0; j < len; j++)
+				rx_push(mock_regs[hw.ptr++]);
+			break;
+
+		case 3:
+			hw.selected = hw.addressed = false;
+			hw.int_raw |= I2C_TRANS_COMPLETE_INT_RAW;
+			mock_transactions++;
+			return;
+
+		case 4:
+			hw.int_raw |= I2C_END_DETECT_INT_RAW;
+			return;
+
+		default:
+			fault("unknown command");
+			return;
+		}
+	}
+
+	fault("ran past the last command");
+}
+
+
+uint32_t mock_reg_read(uint32_t addr)
+{
+	if (addr == I2C_CTR_REG(0))
+		return hw.ctr;
+
+	if (addr == I2C_FIFO_CONF_REG(0))
+		return hw.fifo_conf;
+
+	if (addr == I2C_INT_RAW_REG(0))
+		return hw.int_raw;
+
+	if (addr == I2C_INT_ENA_REG(0))
+		return hw.int_ena;
+
+	if (addr == I2C_DATA_APB_REG(0)) {
+		if (hw.rx_head == hw.rx_tail) {
+			fault("RX FIFO underflow");
+			return 0xff;
+		}
+
+		return hw.rx[hw.rx_head++ % FIFO_LEN];
+	}
+
+	fault("read of an unknown register");
+	return 0;
+}
+
+
+void mock_reg_write(uint32_t addr, uint32_t value)
+{
+	if (addr == I2C_CTR_REG(0)) {
+		hw.ctr = value & ~I2C_TRANS_START;
+
+		if (value & I2C_TRANS_START)
+			run();
+	} else if (addr == I2C_FIFO_CONF_REG(0)) {
+		hw.fifo_conf = value;
+
+		if (value & I2C_TX_FIFO_RST)
+			hw.tx_head = hw.tx_tail = 0;
+
+		if (value & I2C_RX_FIFO_RST)
+			hw.rx_head = hw.rx_tail = 0;
+	} else if (addr == I2C_INT_CLR_REG(0)) {
+		hw.int_raw &= ~value;
+	} else if (addr == I2C_INT_ENA_REG(0)) {
+		hw.int_ena = value;
+	} else if (addr == FIFO_AHB) {
+		if (hw.tx_tail - hw.tx_head == FIFO_LEN)
+			fault("TX FIFO overflow");
+		else
+			hw.tx[hw.tx_tail++ % FIFO_LEN] = value;
+	} else if (addr >= I2C_COMD0_REG(0) &&
+	           addr < I2C_COMD0_REG(0) + 4 * NUM_CMDS) {
+		hw.cmd[(addr - I2C_COMD0_REG(0)) / 4] = value;
+	} else {
+		fault("write of an unknown register");
+	}
+}
+
+
+/* Every reading takes a while, so that waiting has an end. */
+int64_t esp_timer_get_time(void)
+{
+	static int64_t now;
+	return now += 100;
+}
+
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *conf)
+{
+	return port == I2C_NUM_0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode,
+                             size_t rx_len, size_t tx_len, int flags)
+{
+	memset(&hw, 0, sizeof(hw));
+	mock_installs++;
+	return ESP_OK;
+}
+
+
+esp_err_t i2c_driver_delete(i2c_port_t port)
+{
+	return ESP_OK;
+}
+
+
+esp_err_t gpio_config(const gpio_config_t *conf)
+{
+	return ESP_OK;
+}
+
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+	return ESP_OK;
+}
+
+
+int gpio_get_level(gpio_num_t gpio)
+{
+	return 1;
+}
+
+
+void ets_delay_us(uint32_t us)
+{
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Emulation of the I2C controller of the ESP32 just deep enough for
+ * components/i2ce to run against it, with a single slave that holds
+ * 256 registers and increments the register address as it goes.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Address of the only slave on the bus. */
+#define MOCK_SLAVE 0x68
+
+/* Registers of the slave. */
+extern uint8_t mock_regs[256];
+
+/* Keep the bus busy forever, no interrupt is ever raised. */
+extern bool mock_hang;
+
+/* Transactions completed with a stop, driver installations. */
+extern unsigned mock_transactions;
+extern unsigned mock_installs;
+
+/* Misuses of the controller, any of them is a bug. */
+extern unsigned mock_faults;
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+
+#include "mock_lwip.h"
+
+
+atomic_bool mock_lwip_accept;
+atomic_bool mock_lwip_broken;
+
+
+/* Everything sent over a connection, and where every send ended. */
+#define CONN_SIZE 65536
+#define CONN_SENDS 1024
+
+/* Descriptors are offset, so that zero and stdio are never used. */
+#define FD_BASE 100
+
+
+struct conn {
+	uint8_t data[CONN_SIZE];
+	size_t len;
+	size_t ends[CONN_SENDS];
+	unsigned sends;
+	bool datagram, connected, closed;
+};
+
+static struct conn conns[MOCK_LWIP_CONNS];
+
+static unsigned num_conns;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+int lwip_getaddrinfo(const char *node, const char *service,
+                     const struct addrinfo *hints, struct addrinfo **res)
+{
+	struct addrinfo *ai = calloc(1, sizeof(*ai) + sizeof(struct sockaddr));
+
+	ai->ai_family = hints->ai_family;
+	ai->ai_socktype = hints->ai_socktype;
+	ai->ai_addr = (struct sockaddr *)(ai + 1);
+	ai->ai_addrlen = sizeof(struct sockaddr);
+
+	*res = ai;
+	return 0;
+}
+
+
+void lwip_freeaddrinfo(struct addrinfo *ai)
+{
+	free(ai);
+}
+
+
+int lwip_socket(int domain, int type, int protocol)
+{
+	pthread_mutex_lock(&lock);
+
+	int fd = -1;
+
+	if (num_conns < MOCK_LWIP_CONNS) {
+		conns[num_conns].datagram = SOCK_DGRAM == type;
+		fd = FD_BASE + num_conns++;
+	}
+
+	pthread_mutex_unlock(&lock);
+	return fd;
+}
+
+
+static bool valid(int s)
+{
+	return s >= FD_BASE && s < FD_BASE + (int)num_conns;
+}
+
+
+int lwip_connect(int s, const struct sockaddr *name, socklen_t namelen)
+{
+	pthread_mutex_lock(&lock);
+
+	int ret = -1;
+
+	if (valid(s) && mock_lwip_accept) {
+		conns[s - FD_BASE].connected = true;
+		ret = 0;
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (ret)
+		errno = ECONNREFUSED;
+
+	return ret;
+}
+
+
+ssize_t lwip_send(int s, const void *data, size_t size, int flags)
+{
+	pthread_mutex_lock(&lock);
+
+	ssize_t n = -1;
+
+	if (valid(s) && conns[s - FD_BASE].connected && !mock_lwip_broken) {
+		struct conn *c = conns + s - FD_BASE;
+
+		/* Datagrams go whole. */
+		n = size < MOCK_LWIP_CHUNK || c->datagram ? size
+		                                          : MOCK_LWIP_CHUNK;
+
+		if (c->len + n > CONN_SIZE || c->sends >= CONN_SENDS)
+			abort();
+
+		memcpy(c->data + c->len, data, n);
+		c->len += n;
+		c->ends[c->sends++] = c->len;
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (n < 0)
+		errno = ECONNRESET;
+
+	return n;
+}
+
+
+int lwip_close(int s)
+{
+	pthread_mutex_lock(&lock);
+
+	int ret = -1;
+
+	if (valid(s)) {
+		conns[s - FD_BASE].closed = true;
+		ret = 0;
+
+		/* Refused ones are forgotten, there can be many. */
+		if (!conns[s - FD_BASE].connected &&
+		    s == FD_BASE + (int)num_conns - 1) {
+			memset(&conns[--num_conns], 0, sizeof(*conns));
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+
+unsigned mock_lwip_connections(void)
+{
+	pthread_mutex_lock(&lock);
+
+	unsigned n = 0;
+
+	for (unsigned i = 0; i < num_conns; i++)
+		n += conns[i].connected;
+
+	pthread_mutex_unlock(&lock);
+	return n;
+}
+
+
+/* Index of the n-th connection actually made. */
+static int find(unsigned conn)
+{
+	for (unsigned i = 0; i < num_conns; i++)
+		if (conns[i].connected && !conn--)
+			return i;
+
+	return -1;
+}
+
+
+bool mock_lwip_closed(unsigned conn)
+{
+	pthread_mutex_lock(&lock);
+
+	int i = find(conn);
+	bool closed = i >= 0 && conns[i].closed;
+
+	pthread_mutex_unlock(&lock);
+	return closed;
+}
+
+
+size_t mock_lwip_received(unsigned conn, uint8_t *buf, size_t size)
+{
+	pthread_mutex_lock(&lock);
+
+	int i = find(conn);
+	size_t len = 0;
+
+	if (i >= 0) {
+		len = conns[i].len < size ? conns[i].len : size;
+		memcpy(buf, conns[i].data, len);
+	}
+
+	pthread_mutex_unlock(&lock);
+	return len;
+}
+
+
+size_t mock_lwip_sent(unsigned conn, unsigned n, uint8_t *buf, size_t size)
+{
+	pthread_mutex_lock(&lock);
+
+	int i = find(conn);
+	size_t len = 0;
+
+	if (i >= 0 && n < conns[i].sends) {
+		size_t start = n ? conns[i].ends[n - 1] : 0;
+
+		len = conns[i].ends[n] - start;
+		len = len < size ? len : size;
+		memcpy(buf, conns[i].data + start, len);
+	}
+
+	pthread_mutex_unlock(&lock);
+	return len;
+}
+
+
+unsigned mock_lwip_sends(unsigned conn)
+{
+	pthread_mutex_lock(&lock);
+
+	int i = find(conn);
+	unsigned sends = i >= 0 ? conns[i].sends : 0;
+
+	pthread_mutex_unlock(&lock);
+	return sends;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Socket layer stand-in that records everything sent over every TCP
+ * connection and every datagram sent over an UDP one, for the tests to
+ * decode. Connections can be refused and broken at will, and streams
+ * only ever take a few bytes at a time.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+
+/* Connections the tests can look at, later ones are refused. */
+#define MOCK_LWIP_CONNS 4
+
+/* Most bytes a single send over a stream takes. */
+#define MOCK_LWIP_CHUNK 7
+
+
+/* Accept new connections. */
+extern atomic_bool mock_lwip_accept;
+
+/* Fail sends on the open connection, which then counts as closed. */
+extern atomic_bool mock_lwip_broken;
+
+
+/* Number of connections made so far. */
+unsigned mock_lwip_connections(void);
+
+/* Whether the connection has been closed by the client. */
+bool mock_lwip_closed(unsigned conn);
+
+/* Copy what was sent over the connection, returns its length. */
+size_t mock_lwip_received(unsigned conn, uint8_t *buf, size_t size);
+
+/* Number of sends over the connection, each one a datagram for UDP. */
+unsigned mock_lwip_sends(unsigned conn);
+
+/* Copy the n-th send over the connection, returns its length. */
+size_t mock_lwip_sent(unsigned conn, unsigned n, uint8_t *buf, size_t size);
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <nvs.h>
+
+#include "mock_nvs.h"
+
+
+const char *mock_nvs_dir;
+unsigned mock_nvs_commits;
+bool mock_nvs_broken;
+
+
+/* Largest blob, namespaces and keys are limited to 15 characters. */
+#define MAX_BLOB 512
+#define MAX_NAME 16
+
+/* Open handles, zero is never given out. */
+#define MAX_HANDLES 4
+
+
+/* Blob written but not yet committed. */
+struct pending {
+	char key[MAX_NAME];
+	uint8_t buf[MAX_BLOB];
+	size_t len;
+};
+
+static struct {
+	bool used, writable;
+	char name[MAX_NAME];
+	struct pending pending;
+} handles[MAX_HANDLES + 1];
+
+
+static void blob_path(char *path, size_t size, const char *name,
+                      const char *key)
+{
+	snprintf(path, size, "%s/%s.%s", mock_nvs_dir, name, key);
+}
+
+
+long mock_nvs_peek(const char *name, const char *key, uint8_t *buf,
+                   size_t size)
+{
+	char path[256];
+	blob_path(path, sizeof(path), name, key);
+
+	FILE *f = fopen(path, "rb");
+
+	if (!f)
+		return -1;
+
+	long len = fread(buf, 1, size, f);
+	fclose(f);
+
+	return len;
+}
+
+
+void mock_nvs_plant(const char *name, const char *key, const uint8_t *buf,
+                    size_t len)
+{
+	char path[256], tmp[260];
+	blob_path(path, sizeof(path), name, key);
+	snprintf(tmp, sizeof(tmp), "%s.new", path);
+
+	/* Replace atomically, as the NVS would. */
+	FILE *f = fopen(tmp, "wb");
+
+	if (!f || fwrite(buf, 1, len, f) != len || fclose(f)) {
+		perror(tmp);
+		abort();
+	}
+
+	if (rename(tmp, path)) {
+		perror(path);
+		abort();
+	}
+}
+
+
+void mock_nvs_erase(void)
+{
+	DIR *dir = opendir(mock_nvs_dir);
+
+	if (!dir)
+		return;
+
+	struct dirent *e;
+
+	while ((e = readdir(dir))) {
+		if ('.' == e->d_name[0])
+			continue;
+
+		char path[512];
+		snprintf(path, sizeof(path), "%s/%s", mock_nvs_dir, e->d_name);
+		unlink(path);
+	}
+
+	closedir(dir);
+}
+
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode,
+                   nvs_handle_t *handle)
+{
+	if (strlen(name) >= MAX_NAME)
+		return ESP_ERR_INVALID_ARG;
+
+	for (nvs_handle_t h = 1; h <= MAX_HANDLES; h++) {
+		if (handles[h].used)
+			continue;
+
+		memset(&handles[h], 0, sizeof(handles[h]));
+		handles[h].used = true;
+		handles[h].writable = NVS_READWRITE == mode;
+		strcpy(handles[h].name, name);
+
+		*handle = h;
+		return ESP_OK;
+	}
+
+	return ESP_ERR_NOT_FOUND;
+}
+
+
+static bool valid(nvs_handle_t h)
+{
+	return h && h <= MAX_HANDLES && handles[h].used;
+}
+
+
+void nvs_close(nvs_handle_t handle)
+{
+	/* Uncommitted writes are lost. */
+	if (valid(handle))
+		handles[handle].used = false;
+}
+
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value,
+                       size_t *length)
+{
+	if (!valid(handle))
+		return ESP_ERR_NVS_INVALID_HANDLE;
+
+	uint8_t buf[MAX_BLOB];
+	long len = mock_nvs_peek(handles[handle].name, key, buf, sizeof(buf));
+
+	if (len < 0)
+		return ESP_ERR_NVS_NOT_FOUND;
+
+	/* Only report the length when there is no buffer. */
+	if (!value) {
+		*length = len;
+		return ESP_OK;
+	}
+
+	if (*length < (size_t)len)
+		return ESP_ERR_NVS_INVALID_LENGTH;
+
+	memcpy(value, buf, len);
+	*length = len;
+
+	return ESP_OK;
+}
+
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key,
+                       const void *value, size_t length)
+{
+	if (!valid(handle))
+		return ESP_ERR_NVS_INVALID_HANDLE;
+
+	if (!handles[handle].writable)
+		return ESP_ERR_NVS_READ_ONLY;
+
+	if (strlen(key) >= MAX_NAME || length > MAX_BLOB)
+		return ESP_ERR_INVALID_ARG;
+
+	if (mock_nvs_broken)
+		return ESP_FAIL;
+
+	struct pending *p = &handles[handle].pending;
+
+	strcpy(p->key, key);
+	memcpy(p->buf, value, length);
+	p->len = length;
+
+	return ESP_OK;
+}
+
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+	if (!valid(handle))
+		return ESP_ERR_NVS_INVALID_HANDLE;
+
+	struct pending *p = &handles[handle].pending;
+
+	if (!p->key[0])
+		return ESP_OK;
+
+	mock_nvs_plant(handles[handle].name, p->key, p->buf, p->len);
+	mock_nvs_commits++;
+	p->key[0] = 0;
+
+	return ESP_OK;
+}
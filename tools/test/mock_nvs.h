@@ -0,0 +1,50 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * NVS stand-in that keeps every blob in a file of its own, named after
+ * the namespace and the key, so that the contents outlive a simulated
+ * reboot and can be inspected or planted by the tests. Writes only
+ * reach the file on commit, like with the real thing.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* Directory holding the blobs, must be set before the first use. */
+extern const char *mock_nvs_dir;
+
+/* Blobs committed so far. */
+extern unsigned mock_nvs_commits;
+
+/* Make every write fail. */
+extern bool mock_nvs_broken;
+
+
+/* Read the file of a blob, returns its length or -1 when missing. */
+long mock_nvs_peek(const char *name, const char *key, uint8_t *buf,
+                   size_t size);
+
+/* Replace the file of a blob directly. */
+void mock_nvs_plant(const char *name, const char *key, const uint8_t *buf,
+                    size_t len);
+
+/* Remove all blobs. */
+void mock_nvs_erase(void);
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Just enough of FreeRTOS for a component task to run on a host, with
+ * tasks as threads and queues as rings guarded by a mutex.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+#include "mock_rtos.h"
+
+
+atomic_uint mock_rtos_waiting;
+
+
+struct start {
+	TaskFunction_t fn;
+	void *arg;
+};
+
+
+static void *run(void *arg)
+{
+	struct start s = *(struct start *)arg;
+	free(arg);
+
+	s.fn(s.arg);
+	return NULL;
+}
+
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name,
+                       uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle)
+{
+	struct start *s = malloc(sizeof(*s));
+	pthread_t thread;
+
+	*s = (struct start){fn, arg};
+
+	if (pthread_create(&thread, NULL, run, s)) {
+		perror(name);
+		abort();
+	}
+
+	pthread_detach(thread);
+
+	if (handle)
+		*handle = NULL;
+
+	return pdPASS;
+}
+
+
+void vTaskDelay(TickType_t ticks)
+{
+	usleep(ticks * 10);
+}
+
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t len, UBaseType_t size,
+                                 uint8_t *buf, StaticQueue_t *mem)
+{
+	memset(mem, 0, sizeof(*mem));
+	pthread_mutex_init(&mem->lock, NULL);
+	pthread_cond_init(&mem->cond, NULL);
+
+	mem->buf = buf;
+	mem->size = size;
+	mem->len = len;
+
+	return mem;
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+	/* Producers in the firmware never wait. */
+	if (wait) {
+		fprintf(stderr, "mock_rtos: blocking send not supported\n");
+		abort();
+	}
+
+	pthread_mutex_lock(&q->lock);
+
+	bool ok = q->count < q->len;
+
+	if (ok) {
+		size_t tail = (q->head + q->count++) % q->len;
+		memcpy(q->buf + tail * q->size, item, q->size);
+		pthread_cond_broadcast(&q->cond);
+	}
+
+	pthread_mutex_unlock(&q->lock);
+	return ok;
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+	struct timespec until;
+
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += wait / 1000;
+	until.tv_nsec += (wait % 1000) * 1000000l;
+
+	if (until.tv_nsec >= 1000000000l) {
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000l;
+	}
+
+	pthread_mutex_lock(&q->lock);
+
+	while (!q->count && wait) {
+		int err = 0;
+
+		mock_rtos_waiting++;
+
+		if (portMAX_DELAY == wait)
+			pthread_cond_wait(&q->cond, &q->lock);
+		else
+			err = pthread_cond_timedwait(&q->cond, &q->lock, &until);
+
+		mock_rtos_waiting--;
+
+		if (err)
+			break;
+	}
+
+	bool ok = q->count > 0;
+
+	if (ok) {
+		memcpy(item, q->buf + q->head * q->size, q->size);
+		q->head = (q->head + 1) % q->len;
+		q->count--;
+	}
+
+	pthread_mutex_unlock(&q->lock);
+	return ok;
+}
+
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->head = q->count = 0;
+	pthread_mutex_unlock(&q->lock);
+
+	return pdPASS;
+}
@@ -0,0 +1,18 @@
+/* Host stand-in for the FreeRTOS header, see tools/test/mock_rtos.c. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
@@ -0,0 +1,26 @@
+/* Host stand-in for the FreeRTOS header, queues are guarded rings. */
+
+#pragma once
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include <freertos/FreeRTOS.h>
+
+struct mock_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	uint8_t *buf;
+	size_t size, len;
+	size_t head, count;
+};
+
+typedef struct mock_queue StaticQueue_t;
+typedef struct mock_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t len, UBaseType_t size,
+                                 uint8_t *buf, StaticQueue_t *mem);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait);
+BaseType_t xQueueReset(QueueHandle_t q);
@@ -0,0 +1,15 @@
+/* Host stand-in for the FreeRTOS header, tasks are threads. */
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+typedef void (*TaskFunction_t)(void *arg);
+typedef struct mock_task *TaskHandle_t;
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name,
+                       uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle);
+
+/* Time runs a hundred times faster. */
+void vTaskDelay(TickType_t ticks);
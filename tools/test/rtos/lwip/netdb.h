@@ -0,0 +1,12 @@
+/* Host stand-in for the lwIP header, see tools/test/mock_lwip.c. */
+
+#pragma once
+
+#include <netdb.h>
+
+int lwip_getaddrinfo(const char *node, const char *service,
+                     const struct addrinfo *hints, struct addrinfo **res);
+void lwip_freeaddrinfo(struct addrinfo *ai);
+
+#define getaddrinfo(n, s, h, r) lwip_getaddrinfo(n, s, h, r)
+#define freeaddrinfo(ai) lwip_freeaddrinfo(ai)
@@ -0,0 +1,18 @@
+/* Host stand-in for the lwIP header, see tools/test/mock_lwip.c. */
+
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+int lwip_socket(int domain, int type, int protocol);
+int lwip_connect(int s, const struct sockaddr *name, socklen_t namelen);
+ssize_t lwip_send(int s, const void *data, size_t size, int flags);
+int lwip_close(int s);
+
+/* Same names as with LWIP_COMPAT_SOCKETS. */
+#define socket(d, t, p) lwip_socket(d, t, p)
+#define connect(s, n, l) lwip_connect(s, n, l)
+#define send(s, d, n, f) lwip_send(s, d, n, f)
+#define close(s) lwip_close(s)
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Store and load the calibration through a file-backed NVS stand-in,
+ * convert records of the older version and make sure the flash is
+ * only written when there is something new, and not too often.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <esp_timer.h>
+#include <calstore.h>
+
+#include "mock_nvs.h"
+#include "check.h"
+
+
+/* Consulted by <esp_log.h>. */
+int sim_verbose = 0;
+
+
+/* Where calstore keeps the record. */
+#define NAMESPACE "headband"
+#define KEY "cal"
+
+
+/* Time as seen by calstore, in μs. */
+static int64_t now;
+
+int64_t esp_timer_get_time(void)
+{
+	return now;
+}
+
+
+static const calstore sample = {
+	.mag_hard = {{12.5, -3.25, 40}},
+	.mag_soft = {{{{1.1, 0.02, -0.01}},
+	              {{0.02, 0.95, 0.03}},
+	              {{-0.01, 0.03, 0.98}}}},
+	.gyro_bias = {{0.001, -0.002, 0.0005}},
+	.accm_scale = {{1, 1, 1}},
+};
+
+
+static bool same(const calstore *a, const calstore *b)
+{
+	return !memcmp(a, b, sizeof(*a));
+}
+
+
+/* Records that must and must not decode. */
+static void test_codec(void)
+{
+	uint8_t buf[CALSTORE_SIZE];
+	calstore c;
+
+	CHECK(CALSTORE_SIZE == calstore_encode(buf, &sample));
+	CHECK(CALSTORE_VERSION == buf[0] && 0 == buf[1]);
+	CHECK(calstore_decode(&c, buf, sizeof(buf)) && same(&c, &sample));
+
+	/* Little-endian no matter the host, 12.5 is 0x41480000. */
+	CHECK(0x00 == buf[4] && 0x00 == buf[5]);
+	CHECK(0x48 == buf[6] && 0x41 == buf[7]);
+
+	/* Too short, from the future, of the wrong size, with a NaN. */
+	calstore untouched = sample;
+
+	CHECK(!calstore_decode(&untouched, buf, sizeof(buf) - 1));
+	CHECK(!calstore_decode(&untouched, buf, 3));
+
+	buf[0] = CALSTORE_VERSION + 1;
+	CHECK(!calstore_decode(&untouched, buf, sizeof(buf)));
+
+	buf[0] = 0;
+	CHECK(!calstore_decode(&untouched, buf, sizeof(buf)));
+
+	calstore_encode(buf, &sample);
+	buf[2]++;
+	CHECK(!calstore_decode(&untouched, buf, sizeof(buf)));
+
+	calstore_encode(buf, &sample);
+	memset(buf + 56, 0xff, 4);
+	CHECK(!calstore_decode(&untouched, buf, sizeof(buf)));
+
+	CHECK(same(&untouched, &sample));
+}
+
+
+/* Version 1 had the hard iron in magnetometer LSB. */
+static void v1_record(uint8_t buf[CALSTORE_SIZE])
+{
+	calstore old = sample;
+	old.mag_hard = (vec3){{100, -20, 300}};
+
+	calstore_encode(buf, &old);
+	buf[0] = 1;
+}
+
+
+static void test_v1(void)
+{
+	uint8_t buf[CALSTORE_SIZE];
+	calstore c;
+
+	v1_record(buf);
+
+	CHECK(calstore_decode(&c, buf, sizeof(buf)));
+	CHECK_NEAR(c.mag_hard.row[0], 15, 1e-5);
+	CHECK_NEAR(c.mag_hard.row[1], -3, 1e-5);
+	CHECK_NEAR(c.mag_hard.row[2], 45, 1e-5);
+	CHECK(!memcmp(&c.mag_soft, &sample.mag_soft, sizeof(c.mag_soft)));
+	CHECK(!memcmp(&c.gyro_bias, &sample.gyro_bias, sizeof(c.gyro_bias)));
+}
+
+
+/*
+ * Lifetime of a device: nothing stored, first calibration, reboots,
+ * a record from an older firmware and a damaged one. The state of
+ * calstore carries over from one step to the next, as on the device.
+ */
+static void test_nvs(void)
+{
+	uint8_t buf[CALSTORE_SIZE], stored[CALSTORE_SIZE + 1];
+	calstore c;
+
+	mock_nvs_erase();
+	CHECK(!calstore_load(&c));
+
+	/* First save goes right through. */
+	now = 0;
+	calstore_save(&sample);
+
+	calstore_encode(buf, &sample);
+	CHECK(1 == mock_nvs_commits);
+	CHECK(CALSTORE_SIZE == mock_nvs_peek(NAMESPACE, KEY, stored,
+	                                     sizeof(stored)));
+	CHECK(!memcmp(stored, buf, CALSTORE_SIZE));
+
+	CHECK(calstore_load(&c) && same(&c, &sample));
+
+	/* Changes are held back for five minutes. */
+	calstore moved = sample;
+	moved.gyro_bias.row[2] = -0.001;
+
+	now = 299 * 1000000ll;
+	calstore_save(&moved);
+	CHECK(1 == mock_nvs_commits);
+
+	now = 300 * 1000000ll;
+	calstore_save(&moved);
+	CHECK(2 == mock_nvs_commits);
+	CHECK(calstore_load(&c) && same(&c, &moved));
+
+	/* Nothing new, nothing written. */
+	now = 3600 * 1000000ll;
+	calstore_save(&moved);
+	CHECK(2 == mock_nvs_commits);
+
+	/* Failed writes are not retried right away either. */
+	mock_nvs_broken = true;
+	calstore_save(&sample);
+
+	mock_nvs_broken = false;
+	now += 1000000;
+	calstore_save(&sample);
+	CHECK(2 == mock_nvs_commits);
+
+	now += 300 * 1000000ll;
+	calstore_save(&sample);
+	CHECK(3 == mock_nvs_commits);
+
+	/* Older firmware left a version 1 record behind. */
+	v1_record(buf);
+	mock_nvs_plant(NAMESPACE, KEY, buf, sizeof(buf));
+
+	CHECK(calstore_load(&c));
+	CHECK_NEAR(c.mag_hard.row[0], 15, 1e-5);
+
+	/* Saving the same calibration replaces it with version 2. */
+	now += 300 * 1000000ll;
+	calstore_save(&c);
+
+	CHECK(4 == mock_nvs_commits);
+	CHECK(CALSTORE_SIZE == mock_nvs_peek(NAMESPACE, KEY, stored,
+	                                     sizeof(stored)));
+	CHECK(CALSTORE_VERSION == stored[0]);
+
+	calstore again;
+	CHECK(calstore_load(&again) && same(&again, &c));
+
+	/* Damaged record is ignored and does not touch the output. */
+	calstore_encode(buf, &sample);
+	memset(buf + 16, 0xff, 4);
+	mock_nvs_plant(NAMESPACE, KEY, buf, sizeof(buf));
+
+	again = moved;
+	CHECK(!calstore_load(&again) && same(&again, &moved));
+
+	/* As is one longer than expected. */
+	uint8_t longer[CALSTORE_SIZE + 4] = {0};
+	calstore_encode(longer, &sample);
+	mock_nvs_plant(NAMESPACE, KEY, longer, sizeof(longer));
+
+	CHECK(!calstore_load(&again) && same(&again, &moved));
+}
+
+
+int main(void)
+{
+	char dir[] = "/tmp/calstore.XXXXXX";
+
+	if (!mkdtemp(dir)) {
+		perror(dir);
+		return 1;
+	}
+
+	mock_nvs_dir = dir;
+
+	test_codec();
+	test_v1();
+	test_nvs();
+
+	mock_nvs_erase();
+	rmdir(dir);
+
+	return check_done("calstore");
+}
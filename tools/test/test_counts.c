@@ -0,0 +1,243 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Run both sample pipelines side by side against the register level
+ * models of the simulator, with the sensor swinging around and the
+ * magnetometer off by a hard iron offset: floats as read by the
+ * drivers through fusion_magm(), and raw counts through the folded
+ * fixed-point maps. Every reading must agree within 2⁻¹² of the full
+ * scale, while the magnetometer calibration keeps being refined, and
+ * the poses both filters arrive at must match.
+ */
+
+#include <string.h>
+
+#include <i2ce.h>
+#include <regio.h>
+#include <mpu9250.h>
+#include <ak8963.h>
+#include <fusion.h>
+
+#include "sim.h"
+#include "check.h"
+
+
+/* Rate of the firmware polling, in Hz. */
+#define RATE 100
+
+/* Largest allowed difference, relative to the full scale output. */
+#define TOLERANCE (1.0 / 4096)
+
+
+static regio mpu_io, mag_io;
+static mpu9250 mpu;
+static ak8963 mag;
+static sim_mpu *model;
+
+
+/* Swinging sensor on port 0, magnetometer behind the I2C master. */
+static void setup(void)
+{
+	sim_config cfg = {
+		.amplitude = {{0.8, 0.6, 1.2}},
+		.frequency = {{0.13, 0.21, 0.07}},
+		.accm_noise = 0.05,
+		.gyro_noise = 0.005,
+		.magm_noise = 0.3,
+		.temp = 25,
+		.hard = {{30, -20, 10}},
+		.asa = {176, 177, 165},
+		.seed = 1,
+	};
+
+	mpu9250_config mpu_cfg = MPU9250_CONFIG_DEFAULT;
+	ak8963_config ak_cfg = AK8963_CONFIG_DEFAULT;
+	sim_ak *ak;
+
+	mpu_cfg.smplrt_div = MPU9250_RATE_DIV(RATE);
+
+	sim_init(&cfg);
+	sim_attach(I2C_NUM_0, MPU9250_ADDR);
+	CHECK(1 == sim_find(I2C_NUM_0, MPU9250_ADDR, &model, &ak));
+
+	regio_i2c_init(&mpu_io, I2C_NUM_0, MPU9250_ADDR);
+	regio_i2c_init(&mag_io, I2C_NUM_0, AK8963_ADDR);
+
+	CHECK(!mpu9250_init(&mpu, &mpu_io, &mpu_cfg));
+	CHECK(!ak8963_init(&mag, &mag_io, &ak_cfg));
+	CHECK(!mpu9250_enable_master(&mpu, AK8963_ADDR, AK8963_DATA_REG,
+	                             AK8963_DATA_LEN));
+
+	sim_step(0.05);
+}
+
+
+/*
+ * Step right onto the next sample, so that both pipelines read the
+ * very same one, even though every transfer takes its time.
+ */
+static void next_sample(void)
+{
+	sim_step(model->next - sim_time());
+}
+
+
+/* Counts must decode to exactly what the float readers return. */
+static void test_decode(void)
+{
+	float accm_lsb, gyro_lsb, magm_lsb[3];
+
+	setup();
+
+	mpu9250_get_scale(&mpu, &accm_lsb, &gyro_lsb);
+	ak8963_get_scale(&mag, magm_lsb);
+
+	for (int n = 0; n < RATE; n++) {
+		next_sample();
+
+		float accm[3], gyro[3], temp[1], magm[3];
+		int16_t ac[3], gc[3], tc[1], mc[3];
+		uint8_t ext[AK8963_DATA_LEN], ext_c[AK8963_DATA_LEN];
+
+		CHECK(!mpu9250_read_raw_ext(&mpu, accm, gyro, temp,
+		                            ext, sizeof(ext)));
+		CHECK(!mpu9250_read_counts(&mpu, ac, gc, tc,
+		                           ext_c, sizeof(ext_c)));
+
+		bool ok = ak8963_decode(&mag, ext, magm);
+		CHECK(ok == ak8963_decode_counts(ext_c, mc));
+		CHECK(ok);
+
+		for (int i = 0; i < 3; i++) {
+			CHECK(accm[i] == ac[i] * accm_lsb);
+			CHECK(gyro[i] == gc[i] * gyro_lsb);
+			CHECK(magm[i] == mc[i] * magm_lsb[i]);
+		}
+
+		CHECK(temp[0] == tc[0] * MPU9250_TEMP_SCALE
+		                 + MPU9250_TEMP_OFFSET);
+	}
+
+	/* Overflow is reported the same way. */
+	uint8_t hofl[AK8963_DATA_LEN] = {[6] = 0x08};
+	float magm[3];
+	int16_t mc[3];
+
+	CHECK(!ak8963_decode(&mag, hofl, magm));
+	CHECK(!ak8963_decode_counts(hofl, mc));
+}
+
+
+/* Angle between two orientations, in degrees. */
+static float error(quat a, quat b)
+{
+	quat d = quatmul(quatconj(a), b);
+	float w = fabsf(d.w) / quatmag(d);
+
+	return 2 * acosf(minf(w, 1)) * 180 / M_PI;
+}
+
+
+static void check_close(vec3 a, vec3 b, float full_scale)
+{
+	for (int i = 0; i < 3; i++)
+		CHECK_NEAR(a.row[i], b.row[i], TOLERANCE * full_scale);
+}
+
+
+/* Both pipelines through a minute of motion. */
+static void test_pipeline(void)
+{
+	float accm_lsb, gyro_lsb, magm_lsb[3];
+	fusion ff, fc;
+	unsigned updates = 0, samples = 0;
+
+	setup();
+
+	mpu9250_get_scale(&mpu, &accm_lsb, &gyro_lsb);
+	ak8963_get_scale(&mag, magm_lsb);
+
+	fusion_init(&ff, 1.0 / RATE);
+	fusion_init(&fc, 1.0 / RATE);
+	fusion_fold(&fc, accm_lsb, gyro_lsb, magm_lsb);
+
+	/* Folding must not touch anything the floats use. */
+	CHECK(!memcmp(&ff.mcal, &fc.mcal, sizeof(ff.mcal)));
+
+	/* The soft iron scale of the default calibration included. */
+	float magm_full = 32768 * magm_lsb[0] * 1.1f;
+
+	for (int n = 0; n < 60 * RATE; n++) {
+		next_sample();
+
+		float accm[3], gyro[3], magm[3];
+		int16_t ac[3], gc[3], mc[3];
+		uint8_t ext[AK8963_DATA_LEN];
+
+		CHECK(!mpu9250_read_raw_ext(&mpu, accm, gyro, NULL,
+		                            ext, sizeof(ext)));
+		CHECK(!mpu9250_read_counts(&mpu, ac, gc, NULL, NULL, 0));
+
+		bool ok = ak8963_decode(&mag, ext, magm);
+		ak8963_decode_counts(ext, mc);
+
+		/* Integer pipeline all the way to the floats. */
+		float a[3], g[3];
+		fusion_convert(&fc, ac, gc, a, g);
+
+		for (int i = 0; i < 3; i++) {
+			CHECK_NEAR(a[i], accm[i], TOLERANCE * 32768 * accm_lsb);
+			CHECK_NEAR(g[i], gyro[i], TOLERANCE * 32768 * gyro_lsb);
+		}
+
+		vec3 mf = {{0, 0, 0}}, mcv = {{0, 0, 0}};
+
+		if (ok) {
+			bool uf, uc;
+
+			mf = fusion_magm(&ff, magm, &uf);
+			mcv = fusion_magm_counts(&fc, mc, &uc);
+
+			check_close(mf, mcv, magm_full);
+			updates += uc;
+			samples++;
+		}
+
+		fusion_update(&ff, accm, gyro, mf);
+		fusion_update(&fc, a, g, mcv);
+	}
+
+	/* The calibration did change, and the maps followed. */
+	CHECK(updates > 0);
+	CHECK(samples > 50 * RATE);
+
+	check_close(ff.mcal.hard, fc.mcal.hard, magm_full);
+
+	CHECK(ff.ready && fc.ready);
+	CHECK(error(ff.filter.q, fc.filter.q) < 0.1);
+}
+
+
+int main(void)
+{
+	ESP_ERROR_CHECK(i2ce_master_init(I2C_NUM_0, 26, 25, I2CE_FREQ_MAX, 10));
+
+	test_decode();
+	test_pipeline();
+
+	return check_done("counts");
+}
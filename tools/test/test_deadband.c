@@ -0,0 +1,163 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Record a trace of a head resting, turning, creeping slower than the
+ * onset rate and resting again, then replay it with tools/replay through
+ * the output deadband and check which poses make it out and how far off
+ * the receiver is left in between.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "yaw_trace.h"
+#include "check.h"
+
+
+#define RATE YAW_TRACE_RATE
+
+/* Length of the trace in samples. */
+#define SAMPLES (12 * RATE)
+
+/* Firmware defaults: threshold in °, heartbeat in ms, onset in °/s. */
+#define THRESHOLD 1
+#define HEARTBEAT 1000
+#define ONSET 5
+
+/* Heartbeat in samples. */
+#define BEAT (HEARTBEAT * RATE / 1000)
+
+/* Slack for the filter, which lags the exact truth a little, in °. */
+#define SLACK 0.05
+
+
+/* Turning rate about the vertical axis at sample `i`, in °/s. */
+static double yaw_rate(int i)
+{
+	if (i >= 2 * RATE && i < 4 * RATE)
+		return 30;
+
+	/* Creeping, too slow to count as motion. */
+	if (i >= 6 * RATE && i < 10 * RATE)
+		return 2;
+
+	return 0;
+}
+
+
+static bool moving(int i)
+{
+	return yaw_rate(i) >= ONSET;
+}
+
+
+int main(void)
+{
+	char path[32];
+	yaw_trace_write(path, SAMPLES, yaw_rate);
+
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "%s -d %i -k %i %s 2>&1",
+	         REPLAY, THRESHOLD, HEARTBEAT, path);
+
+	FILE *out = popen(cmd, "r");
+
+	if (!out) {
+		perror(cmd);
+		return 1;
+	}
+
+	bool passed[SAMPLES] = {0};
+	size_t poses = 0, ready = 0;
+	double mean = -1, max = -1;
+	char line[256];
+
+	while (fgets(line, sizeof(line), out)) {
+		double t, w, x, y, z;
+
+		if (5 == sscanf(line, "%lf %lf %lf %lf %lf", &t, &w, &x, &y, &z)) {
+			int i = yaw_trace_index(t);
+
+			if (i >= 0 && i < SAMPLES)
+				passed[i] = true;
+		}
+
+		sscanf(line, "%zu of %zu poses passed (%*f %%), receiver "
+		             "off by %lf° mean, %lf° max", &poses, &ready,
+		       &mean, &max);
+	}
+
+	CHECK(0 == pclose(out));
+	unlink(path);
+
+	CHECK(SAMPLES == ready);
+
+	/* Where the head truly was at every sample, in °. */
+	double yaw[SAMPLES], sum = 0;
+
+	for (int i = 0; i < SAMPLES; i++)
+		yaw[i] = sum += yaw_rate(i) / RATE;
+
+	int last = -1;
+	size_t count = 0;
+	bool ok = true;
+
+	for (int i = 0; i < SAMPLES; i++) {
+		/* Motion starts or ends, the heartbeat is due. */
+		bool edge = i > 0 && moving(i) != moving(i - 1);
+		bool beat = last >= 0 && i - last >= BEAT;
+		double off = last < 0 ? INFINITY : fabs(yaw[i] - yaw[last]);
+
+		bool expect = last < 0 || edge || beat || off > THRESHOLD;
+
+		/* Right at the threshold, the filter decides. */
+		bool either = fabs(off - THRESHOLD) < SLACK;
+
+		if (passed[i] != expect && !either) {
+			fprintf(stderr, "sample %i at %.2f s, %.3f° off: %s\n",
+			        i, (double)i / RATE, off,
+			        expect ? "missing" : "unexpected");
+			ok = false;
+		}
+
+		if (passed[i]) {
+			last = i;
+			count++;
+		}
+	}
+
+	CHECK(ok);
+	CHECK(count == poses);
+
+	/* Motion onset, its end and the very first pose go out. */
+	CHECK(passed[0] && passed[2 * RATE] && passed[4 * RATE]);
+
+	/* Heartbeats only while resting, including right before creeping. */
+	CHECK(passed[5 * RATE] && passed[6 * RATE]);
+	CHECK(!passed[4 * RATE + BEAT - 1] && !passed[5 * RATE + 1]);
+
+	/* The receiver never lags by more than the threshold. */
+	CHECK(max >= 0 && max <= THRESHOLD + SLACK);
+	CHECK(mean >= 0 && mean < THRESHOLD / 2.0);
+
+	/* At most a quarter of the poses are needed for all of that. */
+	CHECK(4 * poses < ready);
+
+	return check_done("deadband");
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Evaluate fixed-point maps of all shapes over the whole range of the
+ * counts and check them against the same maps in doubles, within the
+ * promised 2⁻¹² of the full scale output.
+ */
+
+#include <stdlib.h>
+
+#include <fixmap.h>
+
+#include "check.h"
+
+
+/* Largest allowed difference, relative to the full scale output. */
+#define TOLERANCE (1.0 / 4096)
+
+
+/* Counts at both ends of the range and a few in between. */
+static const int16_t edges[] = {-32768, -32767, -1, 0, 1, 255, 32767};
+#define NUM_EDGES (sizeof(edges) / sizeof(*edges))
+
+
+static uint32_t xorshift(uint32_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+
+/* Largest output magnitude, with the counts at their extremes. */
+static double full_scale(mat3 m, vec3 b)
+{
+	double worst = 0;
+
+	for (int i = 0; i < 3; i++) {
+		double sum = fabs(b.row[i]);
+
+		for (int j = 0; j < 3; j++)
+			sum += 32768.0 * fabs(m.col[j].row[i]);
+
+		worst = fmax(worst, sum);
+	}
+
+	return worst;
+}
+
+
+/* Compare the map with doubles on the counts `c`. */
+static void check_one(const fixmap *f, mat3 m, vec3 b, const int16_t c[3])
+{
+	double tol = TOLERANCE * full_scale(m, b);
+	vec3 v = fixmap_vec3(f, c);
+
+	for (int i = 0; i < 3; i++) {
+		double want = b.row[i];
+
+		for (int j = 0; j < 3; j++)
+			want += (double)m.col[j].row[i] * c[j];
+
+		CHECK_NEAR(v.row[i], want, tol);
+	}
+}
+
+
+/* Every combination of the edges, then random counts. */
+static void check_map(mat3 m, vec3 b)
+{
+	fixmap f;
+	uint32_t seed = 1;
+
+	fixmap_init(&f, m, b);
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++)
+			CHECK(abs(f.m[i][j]) < FIXMAP_COEF_MAX);
+
+		CHECK(abs(f.b[i]) < FIXMAP_OFFSET_MAX);
+	}
+
+	CHECK(f.lsb == ldexpf(1, -f.frac));
+
+	for (size_t x = 0; x < NUM_EDGES; x++) {
+		for (size_t y = 0; y < NUM_EDGES; y++) {
+			for (size_t z = 0; z < NUM_EDGES; z++) {
+				int16_t c[3] = {edges[x], edges[y], edges[z]};
+				check_one(&f, m, b, c);
+			}
+		}
+	}
+
+	for (int k = 0; k < 10000; k++) {
+		int16_t c[3] = {xorshift(&seed), xorshift(&seed),
+		                xorshift(&seed)};
+		check_one(&f, m, b, c);
+	}
+}
+
+
+/* Plain sensitivity, as for the accelerometer and the gyroscope. */
+static void test_diagonal(void)
+{
+	float lsb = 2 * 9.80665f / 32768;
+	mat3 m = {{{{lsb, 0, 0}}, {{0, lsb, 0}}, {{0, 0, lsb}}}};
+	vec3 zero = {{0, 0, 0}};
+	fixmap f;
+
+	fixmap_init(&f, m, zero);
+
+	CHECK(f.diagonal);
+
+	/* The coefficient uses all the bits it may. */
+	CHECK(f.m[0][0] >= FIXMAP_COEF_MAX / 2);
+
+	check_map(m, zero);
+}
+
+
+/* Alignment and calibration of the magnetometer, with an offset. */
+static void test_full(void)
+{
+	/* soft * align, with align swapping X and Y and negating Z. */
+	mat3 m = {{
+		{{0.004, 0.1834 * 1.03, 0.006}},
+		{{0.1828 * 0.94, 0.003, -0.002}},
+		{{0.001, -0.005, -0.1723 * 1.05}},
+	}};
+	vec3 b = {{-66.4, -52.9, -36.7}};
+	fixmap f;
+
+	fixmap_init(&f, m, b);
+
+	CHECK(!f.diagonal);
+	check_map(m, b);
+
+	/* Even a lone offset turns the full evaluation on. */
+	mat3 d = {{{{0.18, 0, 0}}, {{0, 0.18, 0}}, {{0, 0, 0.18}}}};
+	vec3 o = {{0, 0, 1}};
+
+	fixmap_init(&f, d, o);
+
+	CHECK(!f.diagonal);
+	check_map(d, o);
+}
+
+
+/* An offset far above the products limits the fraction instead. */
+static void test_offset(void)
+{
+	mat3 m = {{{{0.01, 0, 0}}, {{0, 0.01, 0}}, {{0, 0, 0.01}}}};
+	vec3 b = {{1e6, -1e6, 0}};
+	fixmap f, g;
+	vec3 zero = {{0, 0, 0}};
+
+	fixmap_init(&f, m, b);
+	fixmap_init(&g, m, zero);
+
+	CHECK(f.frac < g.frac);
+	check_map(m, b);
+}
+
+
+/* Coefficients above one need a negative fraction at the extreme. */
+static void test_range(void)
+{
+	mat3 m = {{{{3e4, 0, 0}}, {{0, -1, 0}}, {{0, 0, 1e-5}}}};
+	vec3 zero = {{0, 0, 0}};
+	fixmap f;
+
+	fixmap_init(&f, m, zero);
+
+	CHECK(f.frac <= 0);
+	check_map(m, zero);
+}
+
+
+int main(void)
+{
+	test_diagonal();
+	test_full();
+	test_offset();
+	test_range();
+
+	return check_done("fixmap");
+}
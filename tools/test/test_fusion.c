@@ -0,0 +1,198 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Feed the fusion with exact readings of a known motion and check
+ * that the pose converges to the truth and stays there, even with
+ * the gyroscope drifting.
+ */
+
+#include <math.h>
+
+#include <fusion.h>
+
+#include "check.h"
+
+
+/* Rate of the firmware polling, in Hz. */
+#define RATE 100
+
+/* Gravity and the magnetic field, in the world frame. */
+static const vec3 up = {{0, 0, 9.80665}};
+static const vec3 field = {{20, 0, -44}};
+
+
+/* Rotation by `rad` about the `axis`. */
+static quat rotation(vec3 axis, float rad)
+{
+	axis = vec3unit(axis);
+
+	return (quat){
+		cosf(rad / 2),
+		sinf(rad / 2) * axis.row[0],
+		sinf(rad / 2) * axis.row[1],
+		sinf(rad / 2) * axis.row[2],
+	};
+}
+
+
+/* Angle between two orientations, in degrees. */
+static float error(quat a, quat b)
+{
+	quat d = quatmul(quatconj(a), b);
+	float w = fabsf(d.w) / quatmag(d);
+
+	return 2 * acosf(minf(w, 1)) * 180 / M_PI;
+}
+
+
+/*
+ * Feed readings of the `truth` turning at `rate` in the body frame,
+ * with the gyroscope off by `bias`. Returns the largest error after
+ * the first `settle` seconds.
+ */
+static float track(fusion *f, quat *truth, vec3 rate, vec3 bias,
+                   float secs, float settle)
+{
+	float worst = 0;
+
+	for (int i = 0; i < secs * RATE; i++) {
+		vec3 a = quatrot(quatconj(*truth), up);
+		vec3 m = quatrot(quatconj(*truth), field);
+		vec3 g = vec3add2(rate, bias);
+
+		float accm[3] = {a.row[0], a.row[1], a.row[2]};
+		float gyro[3] = {g.row[0], g.row[1], g.row[2]};
+
+		fusion_update(f, accm, gyro, m);
+
+		/* Exact integration, the rate is constant. */
+		float mag = vec3mag(rate);
+
+		if (mag > 0)
+			*truth = quatmul(*truth, rotation(rate, mag / RATE));
+
+		if (i >= settle * RATE && f->ready)
+			worst = maxf(worst, error(f->filter.q, *truth));
+	}
+
+	return worst;
+}
+
+
+/* A single sample is enough to start with the right pose. */
+static void test_snapshot(void)
+{
+	fusion f;
+	quat truth = rotation((vec3){{1, 2, 3}}, 1.0);
+	vec3 zero = {{0, 0, 0}};
+
+	fusion_init(&f, 1.0 / RATE);
+	track(&f, &truth, zero, zero, 1.0 / RATE, 0);
+
+	CHECK(f.ready);
+	CHECK(error(f.filter.q, truth) < 0.01);
+}
+
+
+/*
+ * From a pose way off, the filter converges. It takes a while, the
+ * corrections are weak near the opposite pose, and the integral then
+ * holds a bias it has to unlearn over minutes.
+ */
+static void test_converge(void)
+{
+	fusion f;
+	quat truth = rotation((vec3){{-1, 0.5, 0.2}}, 0.7);
+	vec3 zero = {{0, 0, 0}};
+
+	fusion_init(&f, 1.0 / RATE);
+	f.filter.q = quatmul(truth, rotation((vec3){{0.3, -1, 2}}, 2.5));
+	f.ready = true;
+
+	CHECK(error(f.filter.q, truth) > 100);
+	CHECK(track(&f, &truth, zero, zero, 60, 40) < 2);
+
+	/* A few degrees off are forgotten in half a minute. */
+	fusion_init(&f, 1.0 / RATE);
+	f.filter.q = quatmul(truth, rotation((vec3){{1, 1, 0}}, 0.1));
+	f.ready = true;
+
+	CHECK(track(&f, &truth, zero, zero, 30, 20) < 0.5);
+}
+
+
+/* Turning continuously, the pose keeps up. */
+static void test_motion(void)
+{
+	fusion f;
+	quat truth = {1, 0, 0, 0};
+	vec3 zero = {{0, 0, 0}};
+	vec3 rate = {{0.5, -0.3, 1.2}};
+
+	fusion_init(&f, 1.0 / RATE);
+	CHECK(track(&f, &truth, rate, zero, 20, 0) < 1);
+}
+
+
+/*
+ * Gyroscope bias would make the pose drift away, the corrections keep
+ * it within a few degrees and the integral slowly takes it over. The
+ * heading is held by the horizontal part of the field alone, that is
+ * where most of the error goes.
+ */
+static void test_drift(void)
+{
+	fusion f;
+	quat truth = rotation((vec3){{0, 1, 0}}, 0.3);
+	vec3 zero = {{0, 0, 0}};
+	vec3 bias = {{0.01, -0.02, 0.015}};
+
+	/* Without any correction. */
+	fusion_init(&f, 1.0 / RATE);
+	track(&f, &truth, zero, zero, 1.0 / RATE, 0);
+	f.filter.kp = f.filter.ki = 0;
+
+	CHECK(track(&f, &truth, zero, bias, 60, 0) > 60);
+
+	/* With the corrections. */
+	fusion_init(&f, 1.0 / RATE);
+	float early = track(&f, &truth, zero, bias, 10, 0);
+	float taken = -vec3dot(f.filter.bias, bias) / vec3dot(bias, bias);
+
+	CHECK(early < 5);
+
+	float late = track(&f, &truth, zero, bias, 110, 100);
+	float later = -vec3dot(f.filter.bias, bias) / vec3dot(bias, bias);
+
+	CHECK(late < early);
+	CHECK(taken < later && later < 1);
+
+	/* Under rotation as well. */
+	vec3 rate = {{0.2, 0.4, -0.6}};
+	CHECK(track(&f, &truth, rate, bias, 60, 0) < 5);
+}
+
+
+int main(void)
+{
+	test_snapshot();
+	test_converge();
+	test_motion();
+	test_drift();
+
+	return check_done("fusion");
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Feed the gyroscope calibration with synthetic samples of a device
+ * at rest and on the move, with the bias following the temperature,
+ * and check what it takes for rest and how the bias estimate tracks
+ * the truth.
+ */
+
+#include <gyrocal.h>
+
+#include "check.h"
+
+
+/* Rate of the firmware polling, in Hz. */
+#define RATE 100
+
+/* Time constant of the bias, in seconds. */
+#define TAU 2.0
+
+/* Rest thresholds, as the simulator uses them. */
+#define ACCM_SPREAD 0.1
+#define GYRO_SPREAD (0.5 * M_PI / 180)
+
+/* Noise of the samples, well below the thresholds. */
+#define ACCM_NOISE 0.01
+#define GYRO_NOISE 0.001
+
+
+static const vec3 up = {{0, 0, 9.80665}};
+static const vec3 zero = {{0, 0, 0}};
+
+/* Bias at 25 °C and its change per °C, in rad/s. */
+static const vec3 bias25 = {{0.02, -0.015, 0.03}};
+static const vec3 drift = {{0.002, 0.001, -0.0015}};
+
+
+static uint32_t seed = 1;
+
+
+/* Roughly Gaussian noise, a sum of uniform samples. */
+static float noise(float sigma)
+{
+	float sum = 0;
+
+	for (int i = 0; i < 12; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		sum += seed / 4294967296.0f;
+	}
+
+	return (sum - 6) * sigma;
+}
+
+
+static vec3 noisy(vec3 v, float sigma)
+{
+	return (vec3){{v.row[0] + noise(sigma),
+	               v.row[1] + noise(sigma),
+	               v.row[2] + noise(sigma)}};
+}
+
+
+static vec3 true_bias(float temp)
+{
+	return vec3add2(bias25, vec3scale(temp - 25, drift));
+}
+
+
+/* Nodding the head at 1 Hz, as seen by both sensors. */
+static void moving(float t, vec3 *accm, vec3 *gyro)
+{
+	float angle = 0.3f * sinf(2 * M_PI * t);
+	float rate = 0.3f * 2 * M_PI * cosf(2 * M_PI * t);
+
+	*accm = (vec3){{0, 9.80665f * sinf(angle), 9.80665f * cosf(angle)}};
+	*gyro = (vec3){{rate, 0, 0}};
+}
+
+
+/* Feed a sample, `move` or rest, at temperature `temp`. */
+static vec3 feed(gyrocal *g, int n, bool move, float temp)
+{
+	vec3 accm = up, gyro = zero;
+
+	if (move)
+		moving((float)n / RATE, &accm, &gyro);
+
+	gyro = vec3add2(gyro, true_bias(temp));
+
+	return gyrocal_update(g, noisy(accm, ACCM_NOISE),
+	                      noisy(gyro, GYRO_NOISE), temp);
+}
+
+
+static float distance(vec3 a, vec3 b)
+{
+	return vec3mag(vec3add2(a, vec3scale(-1, b)));
+}
+
+
+static void setup(gyrocal *g)
+{
+	gyrocal_init(g, ACCM_SPREAD, GYRO_SPREAD, TAU, 1.0 / RATE);
+	seed = 1;
+}
+
+
+/* A full window of a constant bias is rest, of nodding it is not. */
+static void test_rest(void)
+{
+	gyrocal g;
+	int n = 0;
+
+	setup(&g);
+
+	/* Not before the window fills up. */
+	for (; n < GYROCAL_WINDOW - 1; n++) {
+		feed(&g, n, false, 25);
+		CHECK(!g.resting);
+	}
+
+	for (; n < 5 * RATE; n++) {
+		feed(&g, n, false, 25);
+		CHECK(g.resting);
+	}
+
+	/* Motion is noticed with the very first sample. */
+	for (int i = 0; i < 5 * RATE; i++, n++) {
+		feed(&g, n, true, 25);
+		CHECK(!g.resting);
+	}
+
+	/* Nothing learned on the move, however long it goes on. */
+	gyrocal m;
+	setup(&m);
+
+	for (n = 0; n < 60 * RATE; n++) {
+		feed(&m, n, true, 25);
+		CHECK(!m.resting);
+	}
+
+	CHECK(0 == vec3mag(gyrocal_bias(&m)));
+}
+
+
+/* At rest, the bias converges with the time constant. */
+static void test_converge(void)
+{
+	gyrocal g;
+	int n = 0;
+
+	setup(&g);
+
+	/* Rest only counts once the window is full. */
+	for (; n < GYROCAL_WINDOW - 1; n++)
+		feed(&g, n, false, 25);
+
+	float start = vec3mag(bias25);
+
+	/* Less than halfway there after half the time constant... */
+	for (int i = 0; i < TAU / 2 * RATE; i++, n++)
+		feed(&g, n, false, 25);
+
+	CHECK(distance(gyrocal_bias(&g), bias25) > 0.5 * start);
+
+	/* ...but within e⁻⁵ after five of them, noise aside. */
+	for (int i = 0; i < 4.5 * TAU * RATE; i++, n++)
+		feed(&g, n, false, 25);
+
+	CHECK(distance(gyrocal_bias(&g), bias25) < 0.01 * start);
+
+	/* The corrected reading is then close to zero. */
+	vec3 w = feed(&g, n, false, 25);
+	CHECK(vec3mag(w) < 4 * GYRO_NOISE);
+}
+
+
+/*
+ * Warm up at rest so that the slope gets fitted, then keep warming up
+ * on the move. The bias must follow the temperature all the way.
+ */
+static void test_ramp(void)
+{
+	const float heating = 0.05;
+	gyrocal g;
+	int n = 0;
+
+	setup(&g);
+
+	for (; n < 120 * RATE; n++)
+		feed(&g, n, false, 25 + heating * n / RATE);
+
+	for (int i = 0; i < 3; i++)
+		CHECK_NEAR(g.slope.row[i], drift.row[i], 0.1 * vec3mag(drift));
+
+	float temp = 0;
+
+	for (int i = 0; i < 40 * RATE; i++, n++) {
+		temp = 25 + heating * n / RATE;
+		feed(&g, n, true, temp);
+		CHECK(!g.resting);
+	}
+
+	/* Two degrees later, the bias moved far more than it is off by. */
+	float moved = distance(true_bias(temp), true_bias(temp - 2));
+	float off = distance(gyrocal_bias(&g), true_bias(temp));
+
+	CHECK(off < 0.1 * moved);
+}
+
+
+/* A stored bias applies at the temperature of the next sample. */
+static void test_set_bias(void)
+{
+	const vec3 stored = {{0.01, 0.02, -0.03}};
+	gyrocal g;
+	int n = 0;
+
+	setup(&g);
+
+	/* Learn some slope first. */
+	for (; n < 120 * RATE; n++)
+		feed(&g, n, false, 25 + 0.05f * n / RATE);
+
+	vec3 slope = g.slope;
+	CHECK(vec3mag(slope) > 0);
+
+	gyrocal_set_bias(&g, stored);
+
+	/* Whatever the temperature, the stored bias is taken as is. */
+	feed(&g, n++, true, 40);
+
+	CHECK(!g.resting);
+	CHECK(0 == distance(gyrocal_bias(&g), stored));
+	CHECK(40 == g.ref_temp);
+
+	/* The slope is kept and continues from there. */
+	feed(&g, n++, true, 41);
+
+	CHECK(0 == distance(g.slope, slope));
+	CHECK(distance(gyrocal_bias(&g), vec3add2(stored, slope)) < 1e-6);
+}
+
+
+int main(void)
+{
+	test_rest();
+	test_converge();
+	test_ramp();
+	test_set_bias();
+
+	return check_done("gyrocal");
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Run the register level transactions of components/i2ce against an
+ * emulated controller, counting the allocations and the transactions
+ * it takes to read a sample.
+ */
+
+#include <stdlib.h>
+
+#include <i2ce.h>
+
+#include "mock_i2c.h"
+#include "check.h"
+
+
+/* Allocations made since the last reset, see the Makefile. */
+static unsigned allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	allocs++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __real_realloc(ptr, size);
+}
+
+
+/* Whether `buf` holds the registers from `cmd` on. */
+static bool holds(const uint8_t *buf, uint8_t cmd, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		if (buf[i] != mock_regs[(uint8_t)(cmd + i)])
+			return false;
+
+	return true;
+}
+
+
+/* What a sample takes, with a reply too long for the FIFO. */
+static void test_sample(void)
+{
+	uint8_t mpu[21], mag[8], fifo[120];
+	bool ok = true;
+
+	allocs = 0;
+	mock_transactions = 0;
+
+	for (int i = 0; i < 1000; i++) {
+		ok &= !i2ce_put(I2C_NUM_0, MOCK_SLAVE, 0x0a, i);
+		ok &= !i2ce_read(I2C_NUM_0, MOCK_SLAVE, 0x3b, mpu, sizeof(mpu));
+		ok &= !i2ce_read(I2C_NUM_0, MOCK_SLAVE, 0x03, mag, sizeof(mag));
+		ok &= !i2ce_read(I2C_NUM_0, MOCK_SLAVE, 0x80, fifo, sizeof(fifo));
+
+		ok &= holds(mpu, 0x3b, sizeof(mpu));
+		ok &= holds(mag, 0x03, sizeof(mag));
+		ok &= holds(fifo, 0x80, sizeof(fifo));
+		ok &= mock_regs[0x0a] == (uint8_t)i;
+	}
+
+	CHECK(ok);
+	CHECK(0 == allocs);
+	CHECK(4000 == mock_transactions);
+}
+
+
+/* Longest write there is, in a single FIFO. */
+static void test_write(void)
+{
+	uint8_t buf[I2CE_WRITE_MAX + 1];
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = 0xa0 + i;
+
+	CHECK(!i2ce_write(I2C_NUM_0, MOCK_SLAVE, 0x20, buf, I2CE_WRITE_MAX));
+	CHECK(holds(buf, 0x20, I2CE_WRITE_MAX));
+
+	CHECK(ESP_ERR_INVALID_SIZE == i2ce_write(I2C_NUM_0, MOCK_SLAVE, 0x20,
+	                                         buf, sizeof(buf)));
+	CHECK(ESP_ERR_INVALID_SIZE == i2ce_read(I2C_NUM_0, MOCK_SLAVE, 0x20,
+	                                        buf, 0));
+}
+
+
+/* An absent slave is an error, but the bus is fine. */
+static void test_nack(void)
+{
+	uint8_t buf[6];
+	i2ce_stats before = i2ce_get_stats(I2C_NUM_0);
+
+	CHECK(ESP_FAIL == i2ce_read(I2C_NUM_0, 0x50, 0x00, buf, sizeof(buf)));
+	CHECK(ESP_FAIL == i2ce_put(I2C_NUM_0, 0x50, 0x00, 0));
+
+	i2ce_stats after = i2ce_get_stats(I2C_NUM_0);
+	CHECK(after.errors == before.errors + 2);
+	CHECK(after.recoveries == before.recoveries);
+
+	CHECK(!i2ce_read(I2C_NUM_0, MOCK_SLAVE, 0x00, buf, sizeof(buf)));
+	CHECK(holds(buf, 0x00, sizeof(buf)));
+}
+
+
+/* A stuck bus times out and gets recovered for the next one. */
+static void test_hang(void)
+{
+	uint8_t buf[6];
+	unsigned installs = mock_installs;
+	i2ce_stats before = i2ce_get_stats(I2C_NUM_0);
+
+	mock_hang = true;
+	CHECK(ESP_ERR_TIMEOUT == i2ce_read(I2C_NUM_0, MOCK_SLAVE, 0x00,
+	                                   buf, sizeof(buf)));
+	mock_hang = false;
+
+	i2ce_stats after = i2ce_get_stats(I2C_NUM_0);
+	CHECK(after.timeouts == before.timeouts + 1);
+	CHECK(after.recoveries == before.recoveries + 1);
+	CHECK(mock_installs == installs + 1);
+
+	CHECK(!i2ce_read(I2C_NUM_0, MOCK_SLAVE, 0x00, buf, sizeof(buf)));
+	CHECK(holds(buf, 0x00, sizeof(buf)));
+}
+
+
+int main(void)
+{
+	for (int i = 0; i < 256; i++)
+		mock_regs[i] = i * 7 + 3;
+
+	CHECK(!i2ce_master_init(I2C_NUM_0, 26, 25, I2CE_FREQ_MAX, 10));
+
+	test_sample();
+	test_write();
+	test_nack();
+	test_hang();
+
+	CHECK(0 == mock_faults);
+	return check_done("i2ce");
+}
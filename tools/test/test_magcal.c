@@ -0,0 +1,243 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Feed the magnetometer calibration with readings of a known sphere
+ * and of known ellipsoids, with and without noise, and check that it
+ * recovers the hard and soft iron.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <magcal.h>
+
+#include "check.h"
+
+
+/* Magnitude of the field, in µT. */
+#define FIELD 45.0
+
+/* Readings per run, comfortably more than the fit needs. */
+#define READINGS 3000
+
+
+struct distortion {
+	/* Offset of the center. */
+	vec3 hard;
+
+	/* Symmetric, maps the sphere onto the ellipsoid. */
+	mat3 soft;
+};
+
+typedef struct distortion distortion;
+
+
+static double gauss(void)
+{
+	return sqrt(-2 * log(1 - drand48())) * cos(2 * M_PI * drand48());
+}
+
+
+/* Uniformly distributed direction, times the field. */
+static vec3 random_field(void)
+{
+	vec3 v;
+
+	do {
+		for (int i = 0; i < 3; i++)
+			v.row[i] = 2 * drand48() - 1;
+	} while (vec3mag(v) > 1 || vec3mag(v) < 0.1);
+
+	return vec3scale(FIELD, vec3unit(v));
+}
+
+
+static vec3 distort(const distortion *d, vec3 v, double noise)
+{
+	vec3 raw = vec3add2(d->hard, vec3add3(
+		vec3scale(v.row[0], d->soft.col[0]),
+		vec3scale(v.row[1], d->soft.col[1]),
+		vec3scale(v.row[2], d->soft.col[2])));
+
+	for (int i = 0; i < 3; i++)
+		raw.row[i] += noise * gauss();
+
+	return raw;
+}
+
+
+/*
+ * Run the calibration on readings of the distorted sphere. Returns
+ * the worst relative error of the calibrated magnitude afterwards,
+ * measured on fresh readings without noise.
+ */
+static double run(magcal *c, const distortion *d, double noise)
+{
+	mat3 id = {{{{1, 0, 0}}, {{0, 1, 0}}, {{0, 0, 1}}}};
+	magcal_init(c, (vec3){{0, 0, 0}}, id, 1 / FIELD);
+
+	unsigned solved = 0;
+
+	for (int i = 0; i < READINGS; i++)
+		solved += magcal_update(c, distort(d, random_field(), noise));
+
+	CHECK(solved > 0);
+
+	double lo = INFINITY, hi = 0;
+
+	for (int i = 0; i < 1000; i++) {
+		double m = vec3mag(magcal_apply(c, distort(d, random_field(), 0)));
+		lo = fmin(lo, m);
+		hi = fmax(hi, m);
+	}
+
+	return (hi - lo) / (hi + lo);
+}
+
+
+/* Largest difference between the entries, relative to `scale`. */
+static double mat3err(mat3 a, mat3 b, double scale)
+{
+	double err = 0;
+
+	for (int c = 0; c < 3; c++)
+		for (int r = 0; r < 3; r++)
+			err = fmax(err, fabs(a.col[c].row[r] - b.col[c].row[r]));
+
+	return err / scale;
+}
+
+
+/* Hard iron only, the soft iron must come out as identity. */
+static void test_sphere(void)
+{
+	distortion d = {
+		.hard = {{30, -12, 55}},
+		.soft = {{{{1, 0, 0}}, {{0, 1, 0}}, {{0, 0, 1}}}},
+	};
+
+	magcal c;
+	double spread = run(&c, &d, 0);
+
+	CHECK(spread < 1e-3);
+	CHECK_NEAR(vec3mag(vec3add2(c.hard, vec3scale(-1, d.hard))), 0, 0.05);
+	CHECK(mat3err(c.soft, d.soft, 1) < 1e-3);
+
+	/* Noise of 1 µT, a realistic amount. */
+	spread = run(&c, &d, 1);
+
+	CHECK(spread < 0.02);
+	CHECK_NEAR(vec3mag(vec3add2(c.hard, vec3scale(-1, d.hard))), 0, 0.5);
+	CHECK(mat3err(c.soft, d.soft, 1) < 0.02);
+}
+
+
+/*
+ * Tilted ellipsoid with axes 1.3, 1.0 and 0.8. The calibration maps it
+ * onto a sphere of the same mean radius, the soft iron must therefore
+ * come out as the inverse of the distortion times its cube root of the
+ * determinant.
+ */
+static void test_ellipsoid(void)
+{
+	quat tilt = quatunit((quat){0.9, 0.2, -0.3, 0.25});
+	vec3 axes = {{1.3, 1.0, 0.8}};
+	distortion d = {.hard = {{-20, 35, 8}}};
+	mat3 inverse;
+
+	/* R diag(axes) Rᵀ and its inverse. */
+	for (int c = 0; c < 3; c++) {
+		vec3 e = {{c == 0, c == 1, c == 2}};
+		vec3 v = quatrot(quatconj(tilt), e);
+
+		for (int i = 0; i < 3; i++)
+			v.row[i] *= axes.row[i];
+
+		d.soft.col[c] = quatrot(tilt, v);
+
+		v = quatrot(quatconj(tilt), e);
+
+		for (int i = 0; i < 3; i++)
+			v.row[i] /= axes.row[i];
+
+		inverse.col[c] = quatrot(tilt, v);
+	}
+
+	float mean = cbrtf(axes.row[0] * axes.row[1] * axes.row[2]);
+	mat3 expect = mat3scale(mean, inverse);
+
+	magcal c;
+	double spread = run(&c, &d, 0);
+
+	CHECK(spread < 1e-3);
+	CHECK_NEAR(vec3mag(vec3add2(c.hard, vec3scale(-1, d.hard))), 0, 0.05);
+	CHECK(mat3err(c.soft, expect, 1) < 2e-3);
+
+	/*
+	 * Noise biases the algebraic fit, the more so the flatter the
+	 * ellipsoid. Still well within what the heading can live with.
+	 */
+	spread = run(&c, &d, 1);
+
+	CHECK(spread < 0.05);
+	CHECK_NEAR(vec3mag(vec3add2(c.hard, vec3scale(-1, d.hard))), 0, 1.5);
+	CHECK(mat3err(c.soft, expect, 1) < 0.03);
+}
+
+
+/* Readings in a single plane do not determine the ellipsoid. */
+static void test_plane(void)
+{
+	mat3 id = {{{{1, 0, 0}}, {{0, 1, 0}}, {{0, 0, 1}}}};
+	vec3 hard = {{5, 5, 5}};
+	magcal c;
+
+	magcal_init(&c, hard, id, 1 / FIELD);
+
+	for (int i = 0; i < READINGS; i++) {
+		double a = 2 * M_PI * drand48();
+		vec3 v = {{FIELD * cos(a), FIELD * sin(a), 0}};
+
+		magcal_update(&c, vec3add2(hard, v));
+	}
+
+	/* Whatever it settles on, the readings must stay on a circle. */
+	double lo = INFINITY, hi = 0;
+
+	for (int i = 0; i < 360; i++) {
+		double a = i * M_PI / 180;
+		vec3 v = {{FIELD * cos(a), FIELD * sin(a), 0}};
+		double m = vec3mag(magcal_apply(&c, vec3add2(hard, v)));
+
+		lo = fmin(lo, m);
+		hi = fmax(hi, m);
+	}
+
+	CHECK((hi - lo) / (hi + lo) < 0.01);
+}
+
+
+int main(void)
+{
+	srand48(1);
+
+	test_sphere();
+	test_ellipsoid();
+	test_plane();
+
+	return check_done("magcal");
+}
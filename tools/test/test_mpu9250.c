@@ -0,0 +1,469 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Run the MPU9250 and AK8963 drivers against the register level
+ * models of the simulator, with the sensor held still and without
+ * any noise, so that every reading is known in advance. Both I2C and
+ * SPI attachment are covered.
+ */
+
+#include <string.h>
+
+#include <i2ce.h>
+#include <regio.h>
+#include <mpu9250.h>
+#include <ak8963.h>
+
+#include "sim.h"
+#include "check.h"
+
+
+/* Field the magnetometer sees when level, in its own axes, in μT. */
+static const float field[3] = {0, 20, 44};
+
+
+static regio mpu_io, mag_io;
+static mpu9250 mpu;
+static ak8963 mag;
+
+
+/* Fresh sensor on port 0, set up with the defaults. */
+static void setup(void)
+{
+	sim_config cfg = {
+		.temp = 25,
+		.asa = {176, 177, 165},
+		.seed = 1,
+	};
+
+	mpu9250_config mpu_cfg = MPU9250_CONFIG_DEFAULT;
+	ak8963_config ak_cfg = AK8963_CONFIG_DEFAULT;
+
+	sim_init(&cfg);
+	sim_attach(I2C_NUM_0, MPU9250_ADDR);
+
+	regio_i2c_init(&mpu_io, I2C_NUM_0, MPU9250_ADDR);
+	regio_i2c_init(&mag_io, I2C_NUM_0, AK8963_ADDR);
+
+	CHECK(!mpu9250_init(&mpu, &mpu_io, &mpu_cfg));
+	CHECK(!ak8963_init(&mag, &mag_io, &ak_cfg));
+
+	/* Let both take a few samples. */
+	sim_step(0.05);
+}
+
+
+static unsigned long transactions(void)
+{
+	return sim_get_stats(I2C_NUM_0).transactions;
+}
+
+
+static void check_sample(const float accm[3], const float gyro[3],
+                         float temp, const float magm[3])
+{
+	for (int i = 0; i < 3; i++) {
+		CHECK_NEAR(accm[i], 2 == i ? 9.80665 : 0, 1e-3);
+		CHECK_NEAR(gyro[i], 0, 1e-4);
+		CHECK_NEAR(magm[i], field[i], 0.1);
+	}
+
+	CHECK_NEAR(temp, 25, 0.01);
+}
+
+
+/* The fallback, two transactions straight to both chips. */
+static void test_bypass(void)
+{
+	float accm[3], gyro[3], temp, magm[3];
+	bool ok = false;
+
+	setup();
+
+	unsigned long before = transactions();
+
+	CHECK(!mpu9250_read_raw(&mpu, accm, gyro, &temp));
+	CHECK(!ak8963_read_raw(&mag, magm, &ok));
+
+	CHECK(2 == transactions() - before);
+	CHECK(ok);
+	check_sample(accm, gyro, temp, magm);
+}
+
+
+/* All nine axes in a single burst, fetched by the I2C master. */
+static void test_master(void)
+{
+	float accm[3], gyro[3], temp, magm[3];
+	uint8_t ext[AK8963_DATA_LEN];
+
+	setup();
+
+	CHECK(!mpu9250_enable_master(&mpu, AK8963_ADDR, AK8963_DATA_REG,
+	                             AK8963_DATA_LEN));
+
+	/* Magnetometer is no longer reachable directly. */
+	bool ok = false;
+	CHECK(ak8963_read_raw(&mag, magm, &ok));
+
+	/* External sensor data get loaded with the next sample. */
+	sim_step(0.02);
+
+	unsigned long before = transactions();
+
+	CHECK(!mpu9250_read_raw_ext(&mpu, accm, gyro, &temp,
+	                            ext, sizeof(ext)));
+
+	CHECK(1 == transactions() - before);
+	CHECK(ak8963_decode(&mag, ext, magm));
+	check_sample(accm, gyro, temp, magm);
+}
+
+
+/*
+ * Second sensor on the same bus at the other address. Its magnetometer
+ * is set up through the auxiliary master, because the bridged one of
+ * the first sensor already answers at the same address.
+ */
+static void test_aux(void)
+{
+	regio io, aux;
+	mpu9250 dev;
+	ak8963 dev_mag;
+	mpu9250_config mpu_cfg = MPU9250_CONFIG_DEFAULT;
+	ak8963_config ak_cfg = AK8963_CONFIG_DEFAULT;
+	float accm[3], gyro[3], temp, magm[3];
+	uint8_t ext[AK8963_DATA_LEN];
+
+	setup();
+	sim_attach(I2C_NUM_0, MPU9250_ADDR_ALT);
+	regio_i2c_init(&io, I2C_NUM_0, MPU9250_ADDR_ALT);
+
+	CHECK(!mpu9250_init(&dev, &io, &mpu_cfg));
+	CHECK(!mpu9250_aux_init(&dev, &aux, AK8963_ADDR));
+
+	/* Only the first magnetometer is bridged now. */
+	CHECK(!mpu9250_enable_master(&mpu, AK8963_ADDR, AK8963_DATA_REG,
+	                             AK8963_DATA_LEN));
+
+	CHECK(!ak8963_init(&dev_mag, &aux, &ak_cfg));
+	CHECK(!mpu9250_enable_master(&dev, AK8963_ADDR, AK8963_DATA_REG,
+	                             AK8963_DATA_LEN));
+
+	sim_step(0.02);
+
+	CHECK(!mpu9250_read_raw_ext(&dev, accm, gyro, &temp,
+	                            ext, sizeof(ext)));
+	CHECK(ak8963_decode(&dev_mag, ext, magm));
+	check_sample(accm, gyro, temp, magm);
+}
+
+
+/* Over SPI, register access is limited to 1 MHz but for sensor data. */
+static void test_spi(void)
+{
+	sim_config cfg = {
+		.temp = 25,
+		.asa = {176, 177, 165},
+		.seed = 1,
+	};
+
+	/* Slow enough for the FIFO to hold a tenth of a second. */
+	mpu9250_config mpu_cfg = MPU9250_CONFIG_DEFAULT;
+	mpu_cfg.smplrt_div = MPU9250_RATE_DIV(100);
+
+	regio io, aux;
+	mpu9250 dev;
+	ak8963 dev_mag;
+	ak8963_config ak_cfg = AK8963_CONFIG_DEFAULT;
+	float accm[3], gyro[3], temp, magm[3];
+	uint8_t ext[AK8963_DATA_LEN];
+
+	sim_init(&cfg);
+	sim_attach_spi(5);
+
+	regio_spi_init(&io, SPI2_HOST, 23, 19, 18, 5, 20000000);
+
+	CHECK(!mpu9250_init(&dev, &io, &mpu_cfg));
+	CHECK(!mpu9250_aux_init(&dev, &aux, AK8963_ADDR));
+	CHECK(!ak8963_init(&dev_mag, &aux, &ak_cfg));
+	CHECK(!mpu9250_enable_master(&dev, AK8963_ADDR, AK8963_DATA_REG,
+	                             AK8963_DATA_LEN));
+
+	sim_step(0.02);
+
+	/* Whole sample, magnetometer included, in a handful of μs. */
+	sim_stats before = sim_get_spi_stats();
+
+	CHECK(!mpu9250_read_raw_ext(&dev, accm, gyro, &temp,
+	                            ext, sizeof(ext)));
+	CHECK(ak8963_decode(&dev_mag, ext, magm));
+	check_sample(accm, gyro, temp, magm);
+
+	CHECK(sim_get_spi_stats().busy - before.busy < 20e-6);
+
+	/* Same for the FIFO. */
+	mpu9250_frame frames[MPU9250_FIFO_FRAMES];
+	size_t count;
+	bool overflow;
+
+	CHECK(!mpu9250_fifo_enable(&dev));
+	sim_step(0.1);
+
+	CHECK(!mpu9250_fifo_read(&dev, frames, MPU9250_FIFO_FRAMES,
+	                         &count, &overflow));
+	CHECK(!overflow);
+	CHECK(count >= 9 && count <= 11);
+
+	sim_stats stats = sim_get_spi_stats();
+	CHECK(stats.transactions > 0);
+	CHECK(0 == stats.too_fast);
+}
+
+
+/* Frames are big-endian accelerometer and gyroscope counts. */
+static void test_fifo_parse(void)
+{
+	static const uint8_t raw[2 * MPU9250_FRAME_SIZE] = {
+		0x01, 0x00, 0xff, 0x00, 0x7f, 0xff,
+		0x80, 0x00, 0x00, 0x01, 0xff, 0xff,
+		0x00, 0x00, 0x40, 0x00, 0xc0, 0x00,
+		0x12, 0x34, 0xed, 0xcc, 0x00, 0x00,
+	};
+
+	static const int16_t counts[2][6] = {
+		{256, -256, 32767, -32768, 1, -1},
+		{0, 16384, -16384, 0x1234, -0x1234, 0},
+	};
+
+	mpu9250_frame frames[2];
+	float accm, gyro;
+
+	setup();
+	mpu9250_get_scale(&mpu, &accm, &gyro);
+	mpu9250_fifo_parse(&mpu, frames, raw, 2);
+
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 3; j++) {
+			CHECK_NEAR(frames[i].accm[j], counts[i][j] * accm, 1e-6);
+			CHECK_NEAR(frames[i].gyro[j], counts[i][3 + j] * gyro,
+			           1e-6);
+		}
+	}
+}
+
+
+/* Every sample arrives, until the FIFO overflows and starts over. */
+static void test_fifo(void)
+{
+	mpu9250_frame frames[MPU9250_FIFO_FRAMES];
+	size_t count;
+	bool overflow;
+
+	setup();
+	CHECK(!mpu9250_fifo_enable(&mpu));
+
+	/*
+	 * Ten samples at 1 kHz, read in two goes. The bus is slow enough
+	 * for another sample or two to arrive meanwhile.
+	 */
+	sim_step(0.0105);
+
+	CHECK(!mpu9250_fifo_read(&mpu, frames, 4, &count, &overflow));
+	CHECK(!overflow);
+	CHECK(4 == count);
+
+	CHECK(!mpu9250_fifo_read(&mpu, frames + 4, MPU9250_FIFO_FRAMES - 4,
+	                         &count, &overflow));
+	CHECK(!overflow);
+	CHECK(count >= 6 && count <= 8);
+
+	for (size_t i = 0; i < 4 + count; i++) {
+		for (int j = 0; j < 3; j++) {
+			CHECK_NEAR(frames[i].accm[j], 2 == j ? 9.80665 : 0,
+			           1e-3);
+			CHECK_NEAR(frames[i].gyro[j], 0, 1e-4);
+		}
+	}
+
+	/* The FIFO only holds 42 frames. */
+	sim_step(0.05);
+
+	CHECK(!mpu9250_fifo_read(&mpu, frames, MPU9250_FIFO_FRAMES,
+	                         &count, &overflow));
+	CHECK(overflow);
+	CHECK(0 == count);
+
+	/* After the reset, frames are aligned again. */
+	sim_step(0.0035);
+
+	CHECK(!mpu9250_fifo_read(&mpu, frames, MPU9250_FIFO_FRAMES,
+	                         &count, &overflow));
+	CHECK(!overflow);
+	CHECK(count >= 3 && count <= 5);
+
+	for (size_t i = 0; i < count; i++)
+		CHECK_NEAR(frames[i].accm[2], 9.80665, 1e-3);
+}
+
+
+/* Ranges, filters and the rate land in their bits, the rest stays. */
+static void test_configure(void)
+{
+	mpu9250_config cfg = {
+		.gyro_fs = MPU9250_GYRO_1000DPS,
+		.accm_fs = MPU9250_ACCM_8G,
+		.dlpf = MPU9250_DLPF_41HZ,
+		.smplrt_div = MPU9250_RATE_DIV(100),
+	};
+
+	sim_mpu *m;
+	sim_ak *ak;
+
+	setup();
+	CHECK(1 == sim_find(I2C_NUM_0, MPU9250_ADDR, &m, &ak));
+
+	/*
+	 * External sync and self test bits belong to someone else. The
+	 * filter choice bits must come out cleared, or the DLPF and the
+	 * rate divider would be bypassed.
+	 */
+	m->r[0x1a] = 0x38 | 0x07;
+	m->r[0x1b] = 0xe0 | 0x03;
+	m->r[0x1c] = 0xe0;
+	m->r[0x1d] = 0x30 | 0x08 | 0x07;
+
+	CHECK(!mpu9250_configure(&mpu, &cfg));
+
+	CHECK(0x3b == m->r[0x1a]);
+	CHECK(0xf0 == m->r[0x1b]);
+	CHECK(0xf0 == m->r[0x1c]);
+	CHECK(0x33 == m->r[0x1d]);
+	CHECK(9 == m->r[0x19]);
+
+	float accm_lsb, gyro_lsb;
+	mpu9250_get_scale(&mpu, &accm_lsb, &gyro_lsb);
+
+	CHECK_NEAR(accm_lsb, 8 * 9.80665 / 32768, 1e-9);
+	CHECK_NEAR(gyro_lsb, 1000 * M_PI / 180 / 32768, 1e-9);
+
+	/* Readings still come out in physical units. */
+	float accm[3], gyro[3], temp, magm[3];
+	bool ok;
+
+	sim_step(0.02);
+
+	CHECK(!mpu9250_read_raw(&mpu, accm, gyro, &temp));
+	CHECK(!ak8963_read_raw(&mag, magm, &ok));
+	check_sample(accm, gyro, temp, magm);
+
+	/* Ten samples in a tenth of a second, as counted by the FIFO. */
+	mpu9250_frame frames[MPU9250_FIFO_FRAMES];
+	size_t count;
+	bool overflow;
+
+	CHECK(!mpu9250_fifo_enable(&mpu));
+	sim_step(0.1);
+
+	CHECK(!mpu9250_fifo_read(&mpu, frames, MPU9250_FIFO_FRAMES,
+	                         &count, &overflow));
+	CHECK(!overflow);
+	CHECK(count >= 9 && count <= 11);
+
+	/* Out of range settings are refused without touching anything. */
+	static const mpu9250_config bad[] = {
+		{.dlpf = 0},
+		{.dlpf = MPU9250_DLPF_5HZ + 1},
+		{.gyro_fs = MPU9250_GYRO_2000DPS + 1, .dlpf = 1},
+		{.accm_fs = MPU9250_ACCM_16G + 1, .dlpf = 1},
+	};
+
+	uint8_t before[sizeof(m->r)];
+	memcpy(before, m->r, sizeof(before));
+
+	for (size_t i = 0; i < sizeof(bad) / sizeof(*bad); i++)
+		CHECK(ESP_ERR_INVALID_ARG == mpu9250_configure(&mpu, bad + i));
+
+	CHECK(!memcmp(before, m->r, sizeof(before)));
+}
+
+
+/* Modes only change by way of a settled power-down, even on restart. */
+static void test_reinit(void)
+{
+	ak8963_config ak_cfg = AK8963_CONFIG_DEFAULT;
+	float scale[3], magm[3];
+	sim_mpu *m;
+	sim_ak *ak;
+	bool ok;
+
+	setup();
+	CHECK(1 == sim_find(I2C_NUM_0, AK8963_ADDR, &m, &ak) && ak);
+	CHECK(0x16 == ak->r[0x0a]);
+
+	/* The model ignores mode changes that skip the power-down. */
+	ak_write(ak, 0x0a, 0x0f);
+	CHECK(0x16 == ak->r[0x0a]);
+
+	ak_write(ak, 0x0a, 0x00);
+	ak_write(ak, 0x0a, 0x0f);
+	CHECK(0x00 == ak->r[0x0a]);
+
+	sim_step(100e-6);
+	ak_write(ak, 0x0a, 0x0f);
+	CHECK(0x0f == ak->r[0x0a]);
+
+	/* Back to measuring, the driver has to get out of it first. */
+	ak_write(ak, 0x0a, 0x00);
+	sim_step(100e-6);
+	ak_write(ak, 0x0a, 0x16);
+	CHECK(0x16 == ak->r[0x0a]);
+
+	CHECK(!ak8963_init(&mag, &mag_io, &ak_cfg));
+	CHECK(0x16 == ak->r[0x0a]);
+
+	/* Sensitivity adjustments came from the fuse ROM once again. */
+	ak8963_get_scale(&mag, scale);
+	CHECK_NEAR(scale[0], 0.15 * (48 / 256.0 + 1), 1e-6);
+	CHECK_NEAR(scale[1], 0.15 * (49 / 256.0 + 1), 1e-6);
+	CHECK_NEAR(scale[2], 0.15 * (37 / 256.0 + 1), 1e-6);
+
+	sim_step(0.02);
+
+	CHECK(!ak8963_read_raw(&mag, magm, &ok));
+	CHECK(ok);
+
+	for (int i = 0; i < 3; i++)
+		CHECK_NEAR(magm[i], field[i], 0.1);
+}
+
+
+int main(void)
+{
+	ESP_ERROR_CHECK(i2ce_master_init(I2C_NUM_0, 26, 25, I2CE_FREQ_MAX, 10));
+
+	test_bypass();
+	test_master();
+	test_aux();
+	test_spi();
+	test_fifo_parse();
+	test_fifo();
+	test_configure();
+	test_reinit();
+
+	return check_done("mpu9250");
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Drive the books of the acquisition loop by a simulated data-ready
+ * line, through stalls, a sensor that lost its settings and a bus
+ * that stopped answering.
+ */
+
+#include <pace.h>
+
+#include "check.h"
+
+
+/* Failures in a row before a restart, as in main by default. */
+#define FAIL_LIMIT 5
+
+/* Sample period and the wait timeout, in μs. */
+#define PERIOD 1000
+#define TIMEOUT 100000
+
+
+/* Sensor raising the line every period, while it is configured. */
+static struct {
+	long now, next;
+	bool configured;
+	bool answers;
+} sensor;
+
+
+/* What drdy_wait() would return, edges since the last call. */
+static unsigned drdy_wait(void)
+{
+	if (!sensor.configured) {
+		sensor.now += TIMEOUT;
+		return 0;
+	}
+
+	/* Sleep until the next edge, unless it is here already. */
+	if (sensor.now < sensor.next)
+		sensor.now = sensor.next;
+
+	unsigned edges = (sensor.now - sensor.next) / PERIOD + 1;
+	sensor.next += edges * PERIOD;
+
+	return edges;
+}
+
+
+/* What restart_sensors() would do. */
+static void restart(void)
+{
+	sensor.configured = true;
+	sensor.answers = true;
+	sensor.next = sensor.now + PERIOD;
+}
+
+
+/* Turns of acquire_task(), returns the samples kept. */
+static unsigned run(pace *p, unsigned turns, long stall)
+{
+	unsigned kept = 0;
+
+	for (unsigned i = 0; i < turns; i++) {
+		if (pace_restart(p))
+			restart();
+
+		pace_wait(p, drdy_wait());
+
+		/* Reading takes its time, sometimes way too much. */
+		sensor.now += 200 + stall;
+
+		kept += pace_read(p, sensor.answers);
+	}
+
+	return kept;
+}
+
+
+/* Every edge is a sample. */
+static void test_steady(void)
+{
+	pace p;
+
+	pace_init(&p, FAIL_LIMIT);
+	restart();
+
+	CHECK(1000 == run(&p, 1000, 0));
+	CHECK(0 == p.missed + p.timeouts + p.dropped + p.restarts);
+	CHECK(0 == p.failures);
+}
+
+
+/* Samples that came while the reads were slow are counted missed. */
+static void test_stall(void)
+{
+	pace p;
+
+	pace_init(&p, FAIL_LIMIT);
+	restart();
+
+	/* Every read takes 2.2 periods, 1.2 edges go unanswered. */
+	CHECK(100 == run(&p, 100, 2000));
+	CHECK(p.missed >= 118 && p.missed <= 120);
+	CHECK(0 == p.timeouts + p.dropped + p.restarts);
+
+	/* Back to normal, once the last stall is over. */
+	unsigned missed = p.missed;
+	CHECK(100 == run(&p, 100, 0));
+	CHECK(missed + 2 >= p.missed);
+}
+
+
+/*
+ * Sensor that lost its settings still answers, but never raises the
+ * line. Its samples are used until it is restarted.
+ */
+static void test_silent(void)
+{
+	pace p;
+
+	pace_init(&p, FAIL_LIMIT);
+	restart();
+	run(&p, 10, 0);
+
+	sensor.configured = false;
+
+	CHECK(FAIL_LIMIT == run(&p, FAIL_LIMIT, 0));
+	CHECK(FAIL_LIMIT == p.timeouts);
+	CHECK(0 == p.restarts);
+
+	/* Restarted at the start of the next turn. */
+	CHECK(10 == run(&p, 10, 0));
+	CHECK(1 == p.restarts);
+	CHECK(sensor.configured);
+	CHECK(0 == p.failures);
+}
+
+
+/* Failed reads are dropped, a restart follows after enough of them. */
+static void test_bus(void)
+{
+	pace p;
+
+	pace_init(&p, FAIL_LIMIT);
+	restart();
+
+	/* A single good read in between saves the day. */
+	sensor.answers = false;
+	CHECK(0 == run(&p, FAIL_LIMIT - 1, 0));
+
+	sensor.answers = true;
+	CHECK(1 == run(&p, 1, 0));
+	CHECK(0 == p.failures);
+
+	sensor.answers = false;
+	CHECK(0 == run(&p, FAIL_LIMIT, 0));
+	CHECK(0 == p.restarts);
+	CHECK(2 * FAIL_LIMIT - 1 == p.dropped);
+
+	CHECK(10 == run(&p, 10, 0));
+	CHECK(1 == p.restarts);
+	CHECK(2 * FAIL_LIMIT - 1 == p.dropped);
+}
+
+
+/* Silent samples and failed reads add up. */
+static void test_mixed(void)
+{
+	pace p;
+
+	pace_init(&p, FAIL_LIMIT);
+	restart();
+
+	sensor.answers = false;
+	run(&p, 2, 0);
+
+	sensor.answers = true;
+	sensor.configured = false;
+	run(&p, FAIL_LIMIT - 2, 0);
+
+	CHECK(FAIL_LIMIT == p.failures);
+	CHECK(pace_restart(&p));
+	CHECK(!pace_restart(&p));
+}
+
+
+int main(void)
+{
+	test_steady();
+	test_stall();
+	test_silent();
+	test_bus();
+	test_mixed();
+
+	return check_done("pace");
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Feed the prediction with known rotations and compare what it expects
+ * with where they actually end up after the horizon.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <predict.h>
+
+#include "check.h"
+
+
+/* Rate of the firmware polling, in Hz. */
+#define RATE 100
+#define DT (1.0f / RATE)
+
+/* How far ahead to predict, in s. */
+#define HORIZON 0.05f
+
+
+/* Rotation by `rad` about the `axis`. */
+static quat rotation(vec3 axis, float rad)
+{
+	axis = vec3unit(axis);
+
+	return (quat){
+		cosf(rad / 2),
+		sinf(rad / 2) * axis.row[0],
+		sinf(rad / 2) * axis.row[1],
+		sinf(rad / 2) * axis.row[2],
+	};
+}
+
+
+/* Angle between two orientations, in rad. */
+static float error(quat a, quat b)
+{
+	quat d = quatmul(quatconj(a), b);
+	float w = fabsf(d.w) / quatmag(d);
+
+	return 2 * acosf(minf(w, 1));
+}
+
+
+/* Where the head starts from, anything but the identity. */
+static quat start(void)
+{
+	return rotation((vec3){{1, -1, 2}}, 0.7);
+}
+
+
+static void test_still(void)
+{
+	predict p;
+	quat q = start(), r;
+	vec3 rate = {{2, -1, 0.5}};
+
+	/* Nothing to predict without a horizon. */
+	predict_init(&p, 0);
+
+	for (int i = 0; i < 3; i++) {
+		r = predict_pose(&p, q, rate, DT);
+		CHECK(!memcmp(&q, &r, sizeof(q)));
+	}
+
+	/* Or without any motion. */
+	predict_init(&p, HORIZON);
+
+	for (int i = 0; i < 3; i++) {
+		r = predict_pose(&p, q, (vec3){{0, 0, 0}}, DT);
+		CHECK(!memcmp(&q, &r, sizeof(q)));
+	}
+}
+
+
+/* Steady turn, the prediction lands where the head ends up. */
+static void test_constant(void)
+{
+	const vec3 axis = vec3unit((vec3){{1, 2, -2}});
+	const float speed = 3;
+	const vec3 rate = vec3scale(speed, axis);
+
+	predict p;
+	predict_init(&p, HORIZON);
+
+	for (int i = 0; i < RATE; i++) {
+		float t = i * DT;
+		float ahead = t + HORIZON;
+		quat q = quatmul(start(), rotation(axis, speed * t));
+		quat truth = quatmul(start(), rotation(axis, speed * ahead));
+
+		/* Damping of the noise costs speed * h * (noise / speed)². */
+		CHECK(error(predict_pose(&p, q, rate, DT), truth) < 1e-3);
+
+		/* Not even the first sample may seem to accelerate. */
+		CHECK(vec3mag(p.accel) < 1e-3);
+	}
+}
+
+
+/* Turn slowing down to a halt, the prediction must stop short of it. */
+static void test_decelerating(void)
+{
+	const vec3 axis = vec3unit((vec3){{0, 1, 3}});
+	const float speed = 4, decel = 8;
+	const float stop = speed / decel;
+	const float stop_angle = speed * stop / 2;
+
+	predict p;
+	predict_init(&p, HORIZON);
+
+	float worst = 0;
+
+	for (int i = 0; i < 2 * stop * RATE; i++) {
+		float t = minf(i * DT, stop);
+		float angle = speed * t - decel * t * t / 2;
+		float now = maxf(0, speed - decel * i * DT);
+
+		quat q = quatmul(start(), rotation(axis, angle));
+		quat r = predict_pose(&p, q, vec3scale(now, axis), DT);
+
+		/* How far along the turn the prediction went, signed. */
+		quat d = quatmul(quatconj(start()), r);
+		float along = 2 * atan2f(vec3dot((vec3){{d.x, d.y, d.z}}, axis),
+		                         d.w);
+
+		CHECK(along <= stop_angle + 1e-4);
+
+		/* Once the head stops, so does the prediction. */
+		if (now <= 0)
+			CHECK(!memcmp(&q, &r, sizeof(q)));
+
+		/* Never further off the truth than holding the pose is. */
+		float ahead = minf(t + HORIZON, stop);
+		float angle_ahead = speed * ahead - decel * ahead * ahead / 2;
+		quat truth = quatmul(start(), rotation(axis, angle_ahead));
+
+		CHECK(error(r, truth) <= error(q, truth) + 1e-4);
+		worst = maxf(worst, error(r, truth));
+	}
+
+	/* The deceleration takes a few samples to be noticed. */
+	CHECK(worst < 0.02);
+}
+
+
+int main(void)
+{
+	test_still();
+	test_constant();
+	test_decelerating();
+
+	return check_done("predict");
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Check the profiling histograms: every value lands in a bucket whose
+ * upper bound is within the promised relative error, and quantiles of
+ * known distributions come out where they should.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <prof.h>
+
+#include "check.h"
+
+
+/* Quantile of a histogram that only ever saw `value`. */
+static uint32_t alone(uint32_t value)
+{
+	prof_hist h = {0};
+
+	prof_hist_add(&h, value);
+	return prof_hist_quantile(&h, 0.5);
+}
+
+
+/* Estimate of `value` among larger ones, so that max does not cap it. */
+static uint32_t estimate(uint32_t value)
+{
+	prof_hist h = {0};
+
+	prof_hist_add(&h, value);
+	prof_hist_add(&h, UINT32_MAX);
+	prof_hist_add(&h, UINT32_MAX);
+
+	return prof_hist_quantile(&h, 0);
+}
+
+
+/* Estimates never undershoot, and overshoot by less than promised. */
+static void test_buckets(void)
+{
+	bool ok = true;
+
+	for (uint64_t v = 0; v <= UINT32_MAX; v += 1 + v / 1000) {
+		uint32_t e = estimate(v);
+
+		ok &= e >= v;
+		ok &= e - v <= (v >> PROF_HIST_SUB_BITS);
+		ok &= alone(v) == v;
+	}
+
+	CHECK(ok);
+
+	/* Small values are exact. */
+	for (uint32_t v = 0; v < 1u << PROF_HIST_SUB_BITS; v++)
+		CHECK(estimate(v) == v);
+
+	/* Both ends of the range. */
+	CHECK(estimate(UINT32_MAX) == UINT32_MAX);
+	CHECK(alone(UINT32_MAX) == UINT32_MAX);
+}
+
+
+/* Uniform durations from 1 to 1000 μs. */
+static void test_quantiles(void)
+{
+	prof_hist h = {0};
+
+	for (int i = 0; i < 100; i++)
+		for (uint32_t v = 1; v <= 1000; v++)
+			prof_hist_add(&h, v);
+
+	CHECK(100000 == h.count);
+	CHECK(1000 == h.max);
+
+	uint32_t p50 = prof_hist_quantile(&h, 0.50);
+	uint32_t p99 = prof_hist_quantile(&h, 0.99);
+
+	CHECK(p50 >= 500 && p50 <= 500 * 5 / 4);
+	CHECK(p99 >= 990 && p99 <= 1000);
+	CHECK(prof_hist_quantile(&h, 1) == 1000);
+	CHECK(prof_hist_quantile(&h, 0) == 1);
+
+	/* Rare outliers only show in the tail. */
+	for (int i = 0; i < 100; i++)
+		prof_hist_add(&h, 50000);
+
+	CHECK(prof_hist_quantile(&h, 0.50) == p50);
+	CHECK(prof_hist_quantile(&h, 0.9995) >= 50000);
+	CHECK(50000 == h.max);
+
+	prof_hist_reset(&h);
+	CHECK(0 == h.count && 0 == h.max);
+	CHECK(0 == prof_hist_quantile(&h, 0.5));
+}
+
+
+int main(void)
+{
+	test_buckets();
+	test_quantiles();
+
+	return check_done("prof");
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Push items from one thread and pop them from another as fast as
+ * possible, checking that every item arrives whole, in order and that
+ * those that did not fit are counted as overruns.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include <ring.h>
+
+#include "check.h"
+
+
+/* Consulted by <esp_log.h>. */
+int sim_verbose = 0;
+
+
+/* Items to pass, and a ring small enough to fill up often. */
+#define ITEMS 5000000
+#define RING_LEN 16
+
+
+/* About the size of a sample, filled from its sequence number. */
+struct item {
+	uint32_t seq;
+	uint32_t data[13];
+};
+
+static void fill(struct item *it, uint32_t seq)
+{
+	it->seq = seq;
+
+	for (int i = 0; i < 13; i++)
+		it->data[i] = seq * 2654435761u + i;
+}
+
+static bool intact(const struct item *it)
+{
+	struct item ref;
+	fill(&ref, it->seq);
+	return !memcmp(it, &ref, sizeof(ref));
+}
+
+
+static struct item ring_buf[RING_LEN];
+static ring items;
+
+/* Items the producer got into the ring. */
+static unsigned long pushed;
+static atomic_bool done;
+
+
+static void *produce(void *arg)
+{
+	for (uint32_t seq = 0; seq < ITEMS; seq++) {
+		struct item it;
+
+		fill(&it, seq);
+		pushed += ring_push(&items, &it);
+	}
+
+	atomic_store(&done, true);
+	return NULL;
+}
+
+
+/* Consumer results. */
+static unsigned long popped, torn, reordered;
+
+
+static void *consume(void *arg)
+{
+	struct item got[RING_LEN / 2];
+	long last = -1;
+
+	while (true) {
+		/* Check whether done before popping, nothing may follow. */
+		bool finished = atomic_load(&done);
+		size_t n = ring_pop(&items, got, RING_LEN / 2);
+
+		for (size_t i = 0; i < n; i++) {
+			torn += !intact(got + i);
+			reordered += (long)got[i].seq <= last;
+			last = got[i].seq;
+		}
+
+		popped += n;
+
+		if (finished && !n)
+			break;
+
+		/* Fall behind now and then, so that the ring overruns. */
+		if (!(popped % 1000))
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+
+int main(void)
+{
+	pthread_t producer, consumer;
+
+	ring_init(&items, ring_buf, sizeof(*ring_buf), RING_LEN);
+
+	CHECK(!pthread_create(&consumer, NULL, consume, NULL));
+	CHECK(!pthread_create(&producer, NULL, produce, NULL));
+
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+
+	CHECK(0 == torn);
+	CHECK(0 == reordered);
+	CHECK(popped == pushed);
+	CHECK(pushed + ring_overruns(&items) == ITEMS);
+	CHECK(ring_peak(&items) <= RING_LEN);
+	CHECK(0 == ring_count(&items));
+
+	/* Both sides really had to deal with one another. */
+	CHECK(ring_overruns(&items) > 0);
+	CHECK(ring_peak(&items) == RING_LEN);
+
+	return check_done("ring");
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Frame records the way the firmware does and check that they survive
+ * the way back, that damage is caught and that a reader picks them out
+ * of a stream shared with log messages.
+ */
+
+#include <string.h>
+
+#include <serout.h>
+
+#include "check.h"
+
+
+static bool same_record(const serout_record *a, const serout_record *b)
+{
+	return a->seq == b->seq && a->flags == b->flags &&
+	       a->time == b->time &&
+	       !memcmp(&a->q, &b->q, sizeof(a->q)) &&
+	       !memcmp(&a->magm, &b->magm, sizeof(a->magm));
+}
+
+
+/* Distinct records, some full of zeros and some without any. */
+static serout_record record(unsigned i)
+{
+	if (i % 3 == 0)
+		return (serout_record){.seq = i};
+
+	return (serout_record){
+		.seq = 0x0101 * i,
+		.flags = i % 2 ? SEROUT_MAGM_OK : 0,
+		.time = 0x0123456789abcdefull + i,
+		.q = {0.5f + i, -0.5f, 0.25f, -0.125f * i},
+		.magm = {{21.5f, -3.75f * i, 40.125f}},
+	};
+}
+
+
+static void test_crc(void)
+{
+	/* The check value of CRC-16/CCITT-FALSE. */
+	CHECK(0x29b1 == serout_crc16((const uint8_t *)"123456789", 9));
+	CHECK(0xffff == serout_crc16(NULL, 0));
+}
+
+
+static void test_round_trip(void)
+{
+	for (unsigned i = 0; i < 12; i++) {
+		uint8_t buf[SEROUT_FRAME_SIZE];
+		serout_record r = record(i), got;
+
+		size_t len = serout_encode(buf, &r);
+		CHECK(SEROUT_FRAME_SIZE == len);
+
+		/* The only zero ends the frame. */
+		CHECK(0 == buf[len - 1]);
+		CHECK(NULL == memchr(buf, 0, len - 1));
+
+		memset(&got, 0xa5, sizeof(got));
+		CHECK(serout_decode(&got, buf, len - 1));
+		CHECK(same_record(&r, &got));
+	}
+}
+
+
+static void test_damage(void)
+{
+	uint8_t buf[SEROUT_FRAME_SIZE], bad[SEROUT_FRAME_SIZE + 1];
+	serout_record r = record(5), got;
+	size_t len = serout_encode(buf, &r) - 1;
+
+	/* Any flipped bit is caught, either by COBS or by the CRC. */
+	for (size_t i = 0; i < len; i++) {
+		for (int bit = 0; bit < 8; bit++) {
+			memcpy(bad, buf, len);
+			bad[i] ^= 1 << bit;
+			CHECK(!serout_decode(&got, bad, len));
+		}
+	}
+
+	/* Frames cut short or run together with the next one. */
+	for (size_t n = 0; n < len; n++)
+		CHECK(!serout_decode(&got, buf, n));
+
+	memcpy(bad, buf, len);
+	bad[len] = 1;
+	CHECK(!serout_decode(&got, bad, len + 1));
+
+	/* Records of another version, even with the right CRC. */
+	uint8_t rec[SEROUT_RECORD_SIZE] = {SEROUT_VERSION + 1, 1, 1, 1};
+
+	for (size_t i = 4; i < 40; i++)
+		rec[i] = i;
+
+	uint16_t crc = serout_crc16(rec, 40);
+	rec[40] = crc;
+	rec[41] = crc >> 8;
+
+	/* No zeros to stuff, just the overhead byte up front. */
+	CHECK(rec[40] && rec[41]);
+	bad[0] = SEROUT_RECORD_SIZE + 1;
+	memcpy(bad + 1, rec, sizeof(rec));
+
+	CHECK(!serout_decode(&got, bad, SEROUT_RECORD_SIZE + 1));
+
+	/* While the same record of the right version passes. */
+	rec[0] = SEROUT_VERSION;
+	crc = serout_crc16(rec, 40);
+	rec[40] = crc;
+	rec[41] = crc >> 8;
+
+	CHECK(rec[40] && rec[41]);
+	memcpy(bad + 1, rec, sizeof(rec));
+
+	CHECK(serout_decode(&got, bad, SEROUT_RECORD_SIZE + 1));
+}
+
+
+static void test_stream(void)
+{
+	static const char junk[] = "I (1234) main: hello\n";
+	uint8_t stream[2 * sizeof(junk) + 4 * SEROUT_FRAME_SIZE];
+	size_t len = 0;
+
+	/* Log messages between the records, a reader joins halfway. */
+	for (unsigned i = 0; i < 4; i++) {
+		serout_record r = record(i);
+
+		if (i % 2 == 0) {
+			memcpy(stream + len, junk, sizeof(junk) - 1);
+			len += sizeof(junk) - 1;
+		}
+
+		len += serout_encode(stream + len, &r);
+	}
+
+	unsigned found = 0;
+	size_t start = 7;
+
+	for (size_t i = start; i < len; i++) {
+		serout_record got;
+
+		if (stream[i])
+			continue;
+
+		if (serout_decode(&got, stream + start, i - start)) {
+			/* Records right after a message are lost with it. */
+			serout_record r = record(2 * found++ + 1);
+			CHECK(same_record(&r, &got));
+		}
+
+		start = i + 1;
+	}
+
+	CHECK(2 == found);
+}
+
+
+int main(void)
+{
+	test_crc();
+	test_round_trip();
+	test_damage();
+	test_stream();
+
+	return check_done("serout");
+}
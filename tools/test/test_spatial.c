@@ -0,0 +1,510 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Check the math of spatial.h against double precision, including the
+ * rotations by 180° and the gimbal lock. Also report how precise and
+ * how large the packed quaternions are. Built both with and without
+ * SPATIAL_FAST, the approximations are then held to looser bounds.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <spatial.h>
+#include <udpout.h>
+
+#include "check.h"
+
+
+/* Worst case error of quat_pack(), in radians. */
+#define PACK_BOUND(bits) (4.9 / ((1 << (bits)) - 1))
+
+/* Bound for the exact math, or for the approximations when enabled. */
+#define BOUND(exact, fast) (SPATIAL_FAST ? (fast) : (exact))
+
+/* Random inputs per function. */
+#define ROUNDS 100000
+
+
+/* Components uniform within ±mag. */
+static vec3 random_vec3(double mag)
+{
+	return (vec3){{
+		mag * (2 * drand48() - 1),
+		mag * (2 * drand48() - 1),
+		mag * (2 * drand48() - 1),
+	}};
+}
+
+
+/* Largest difference from the reference, relative to `scale`. */
+static double vec3err(vec3 v, const double ref[3], double scale)
+{
+	double err = 0;
+
+	for (int i = 0; i < 3; i++)
+		err = fmax(err, fabs(v.row[i] - ref[i]));
+
+	return err / scale;
+}
+
+
+static double dmag(const double v[3])
+{
+	return sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+}
+
+
+/* Rotation matrix of an unit quaternion, m[row][col]. */
+static void dmat(double m[3][3], quat q)
+{
+	double w = q.w, x = q.x, y = q.y, z = q.z;
+
+	m[0][0] = 1 - 2 * (y * y + z * z);
+	m[0][1] = 2 * (x * y - w * z);
+	m[0][2] = 2 * (x * z + w * y);
+	m[1][0] = 2 * (x * y + w * z);
+	m[1][1] = 1 - 2 * (x * x + z * z);
+	m[1][2] = 2 * (y * z - w * x);
+	m[2][0] = 2 * (x * z - w * y);
+	m[2][1] = 2 * (y * z + w * x);
+	m[2][2] = 1 - 2 * (x * x + y * y);
+}
+
+
+/*
+ * Columns for quat_from_mat3(): the world axes in the body frame,
+ * which makes it the transpose of the rotation.
+ */
+static mat3 axes_mat3(double m[3][3])
+{
+	mat3 a;
+
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			a.col[c].row[r] = m[c][r];
+
+	return a;
+}
+
+
+/* Rotation by `rad` about the `axis`, in double precision. */
+static quat rotation(double x, double y, double z, double rad)
+{
+	double n = sqrt(x * x + y * y + z * z);
+	double s = sin(rad / 2) / n;
+
+	return (quat){cos(rad / 2), x * s, y * s, z * s};
+}
+
+
+/* Uniformly distributed orientation, after Shoemake. */
+static quat random_quat(void)
+{
+	double u1 = drand48(), u2 = 2 * M_PI * drand48();
+	double u3 = 2 * M_PI * drand48();
+
+	return (quat){
+		sqrt(1 - u1) * sin(u2), sqrt(1 - u1) * cos(u2),
+		sqrt(u1) * sin(u3), sqrt(u1) * cos(u3),
+	};
+}
+
+
+/*
+ * Angle between two orientations, in radians. Near zero, the cosine
+ * would drown in the rounding of the components, the sine does not.
+ */
+static double angle(quat a, quat b)
+{
+	double w = (double)a.w * b.w + (double)a.x * b.x +
+	           (double)a.y * b.y + (double)a.z * b.z;
+	double x = (double)a.w * b.x - (double)a.x * b.w -
+	           (double)a.y * b.z + (double)a.z * b.y;
+	double y = (double)a.w * b.y + (double)a.x * b.z -
+	           (double)a.y * b.w - (double)a.z * b.x;
+	double z = (double)a.w * b.z - (double)a.x * b.y +
+	           (double)a.y * b.x - (double)a.z * b.w;
+
+	return 2 * atan2(sqrt(x * x + y * y + z * z), fabs(w));
+}
+
+
+/* Vector operations, relative to the size of their operands. */
+static void test_vec3(void)
+{
+	double scale = 0, add2 = 0, add3 = 0, dot = 0, cross = 0;
+	double mag = 0, unit = 0, unit_fast = 0;
+
+	for (int n = 0; n < ROUNDS; n++) {
+		vec3 a = random_vec3(100), b = random_vec3(1);
+		vec3 c = random_vec3(1e-3);
+		float k = 10 * (2 * drand48() - 1);
+		double ref[3];
+
+		const float *x = a.row, *y = b.row, *z = c.row;
+		double size = dmag((double[]){x[0], x[1], x[2]});
+
+		for (int i = 0; i < 3; i++)
+			ref[i] = (double)k * x[i];
+
+		scale = fmax(scale, vec3err(vec3scale(k, a), ref, fabs(k) * size));
+
+		for (int i = 0; i < 3; i++)
+			ref[i] = (double)x[i] + y[i];
+
+		add2 = fmax(add2, vec3err(vec3add2(a, b), ref, size));
+
+		for (int i = 0; i < 3; i++)
+			ref[i] = (double)x[i] + y[i] + z[i];
+
+		add3 = fmax(add3, vec3err(vec3add3(a, b, c), ref, size));
+
+		double d = (double)x[0] * y[0] + (double)x[1] * y[1] +
+		           (double)x[2] * y[2];
+		double bsize = dmag((double[]){y[0], y[1], y[2]});
+
+		dot = fmax(dot, fabs(vec3dot(a, b) - d) / (size * bsize));
+
+		ref[0] = (double)x[1] * y[2] - (double)x[2] * y[1];
+		ref[1] = (double)x[2] * y[0] - (double)x[0] * y[2];
+		ref[2] = (double)x[0] * y[1] - (double)x[1] * y[0];
+
+		cross = fmax(cross, vec3err(vec3cross(a, b), ref, size * bsize));
+
+		mag = fmax(mag, fabs(vec3mag(a) - size) / size);
+
+		for (int i = 0; i < 3; i++)
+			ref[i] = x[i] / size;
+
+		unit = fmax(unit, vec3err(vec3unit(a), ref, 1));
+		unit_fast = fmax(unit_fast, vec3err(vec3unit_fast(a), ref, 1));
+	}
+
+	CHECK(scale < 1e-7);
+	CHECK(add2 < 1e-7);
+	CHECK(add3 < 2e-7);
+	CHECK(dot < 2e-7);
+	CHECK(cross < 2e-7);
+	CHECK(mag < 2e-7);
+	CHECK(unit < BOUND(2e-7, 1e-5));
+	CHECK(unit_fast < 1e-5);
+}
+
+
+/* Products of random matrices, columns as in spatial.h. */
+static void test_mat3(void)
+{
+	double worst = 0;
+
+	for (int n = 0; n < ROUNDS; n++) {
+		mat3 a = {{random_vec3(10), random_vec3(10), random_vec3(10)}};
+		mat3 b = {{random_vec3(1), random_vec3(1), random_vec3(1)}};
+		mat3 p = mat3mul(a, b);
+
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				double ref = 0;
+
+				for (int k = 0; k < 3; k++)
+					ref += (double)a.col[k].row[r] *
+					       b.col[c].row[k];
+
+				worst = fmax(worst, fabs(p.col[c].row[r] - ref));
+			}
+		}
+	}
+
+	/* Largest possible entry is 30. */
+	CHECK(worst / 30 < 2e-7);
+
+	/* Multiplication by identity is exact. */
+	mat3 id = {{{{1, 0, 0}}, {{0, 1, 0}}, {{0, 0, 1}}}};
+	mat3 a = {{random_vec3(10), random_vec3(10), random_vec3(10)}};
+	mat3 p = mat3mul(a, id), q = mat3mul(id, a);
+
+	CHECK(!memcmp(&p, &a, sizeof(a)) && !memcmp(&q, &a, sizeof(a)));
+}
+
+
+/* Quaternion products and rotations of vectors. */
+static void test_quat(void)
+{
+	double mul = 0, rot = 0, unit = 0;
+
+	for (int n = 0; n < ROUNDS; n++) {
+		quat a = random_quat(), b = random_quat();
+		quat p = quatmul(a, b);
+		double m[3][3], ref[3];
+
+		/* Rotation by the product is rotation by both. */
+		double ma[3][3], mb[3][3];
+		dmat(ma, a);
+		dmat(mb, b);
+		dmat(m, p);
+
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				double ab = 0;
+
+				for (int k = 0; k < 3; k++)
+					ab += ma[r][k] * mb[k][c];
+
+				mul = fmax(mul, fabs(m[r][c] - ab));
+			}
+		}
+
+		vec3 v = random_vec3(10);
+		dmat(m, a);
+
+		for (int r = 0; r < 3; r++)
+			ref[r] = m[r][0] * v.row[0] + m[r][1] * v.row[1] +
+			         m[r][2] * v.row[2];
+
+		rot = fmax(rot, vec3err(quatrot(a, v), ref, vec3mag(v)));
+
+		quat s = quatunit(quatscale(37, a));
+		unit = fmax(unit, fabs(quatmag(s) - 1));
+	}
+
+	CHECK(mul < 1e-6);
+	CHECK(rot < 1e-6);
+	CHECK(unit < BOUND(2e-7, 1e-5));
+
+	/* Conjugate undoes the rotation. */
+	quat q = random_quat();
+	quat i = quatmul(q, quatconj(q));
+
+	CHECK(fabsf(i.w - 1) < 1e-6);
+	CHECK(fabsf(i.x) + fabsf(i.y) + fabsf(i.z) < 1e-6);
+}
+
+
+/* Matrix to quaternion, in every branch and at 180°. */
+static void test_from_mat3(void)
+{
+	static const float axes[][3] = {
+		{1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 0}, {1, 0, -1},
+		{0, -1, 1}, {1, 1, 1}, {-1, 2, 3},
+	};
+
+	static const double angles[] = {
+		0, 1e-4, 0.5, M_PI / 2, 2, M_PI - 1e-3, M_PI,
+	};
+
+	double worst = 0, worst_fast = 0;
+	bool positive = true;
+
+	for (size_t i = 0; i < sizeof(axes) / sizeof(*axes); i++) {
+		for (size_t j = 0; j < sizeof(angles) / sizeof(*angles); j++) {
+			const float *x = axes[i];
+			quat q = rotation(x[0], x[1], x[2], angles[j]);
+			double m[3][3];
+
+			dmat(m, q);
+
+			quat e = quat_from_mat3(axes_mat3(m));
+			quat f = quat_from_mat3_fast(axes_mat3(m));
+
+			worst = fmax(worst, angle(q, e));
+			worst_fast = fmax(worst_fast, angle(q, f));
+			positive &= e.w >= 0 && f.w >= 0;
+		}
+	}
+
+	for (int n = 0; n < ROUNDS; n++) {
+		quat q = random_quat();
+		double m[3][3];
+
+		dmat(m, q);
+
+		quat e = quat_from_mat3(axes_mat3(m));
+		quat f = quat_from_mat3_fast(axes_mat3(m));
+
+		worst = fmax(worst, angle(q, e));
+		worst_fast = fmax(worst_fast, angle(q, f));
+		positive &= e.w >= 0 && f.w >= 0;
+	}
+
+	CHECK(worst < 1e-6);
+	CHECK(worst_fast < 1e-5);
+	CHECK(positive);
+}
+
+
+/* Roll, pitch and yaw of the reference, in double precision. */
+static void deuler(double e[3], quat q)
+{
+	double w = q.w, x = q.x, y = q.y, z = q.z;
+
+	e[0] = atan2(2 * (w * x + y * z), 1 - 2 * (x * x + y * y));
+	e[1] = asin(fmax(-1, fmin(1, 2 * (w * y - z * x))));
+	e[2] = atan2(2 * (w * z + x * y), 1 - 2 * (y * y + z * z));
+}
+
+
+/* Back from roll, pitch and yaw. */
+static quat compose(vec3 e)
+{
+	quat roll = rotation(1, 0, 0, e.row[0]);
+	quat pitch = rotation(0, 1, 0, e.row[1]);
+	quat yaw = rotation(0, 0, 1, e.row[2]);
+
+	return quatmul(yaw, quatmul(pitch, roll));
+}
+
+
+/* Euler angles away from, near and right at the gimbal lock. */
+static void test_euler(void)
+{
+	double worst = 0, worst_fast = 0, back = 0;
+	bool same = true;
+
+	for (int n = 0; n < ROUNDS; n++) {
+		quat q = random_quat();
+		vec3 e = quat_to_euler(q);
+		vec3 f = quat_to_euler_fast(q);
+		double ref[3];
+
+		deuler(ref, q);
+
+		/* Roll and yaw get ill-conditioned towards the lock. */
+		if (fabs(ref[1]) < 85 * M_PI / 180) {
+			for (int i = 0; i < 3; i++) {
+				double d = remainder(e.row[i] - ref[i], 2 * M_PI);
+				double g = remainder(f.row[i] - ref[i], 2 * M_PI);
+
+				worst = fmax(worst, fabs(d));
+				worst_fast = fmax(worst_fast, fabs(g));
+			}
+
+			back = fmax(back, angle(compose(e), q));
+		}
+
+		/* Sign of the quaternion does not matter. */
+		vec3 m = quat_to_euler(quatscale(-1, q));
+		same &= !memcmp(&m, &e, sizeof(m));
+	}
+
+	CHECK(worst < BOUND(1e-5, 2e-4));
+	CHECK(worst_fast < 2e-4);
+	CHECK(back < BOUND(1e-5, 2e-4));
+	CHECK(same);
+
+	/* Pitching up and down by 90°, whatever the roll and yaw. */
+	bool locked = true;
+
+	for (int sign = -1; sign <= 1; sign += 2) {
+		for (double a = -3; a <= 3; a += 0.5) {
+			quat q = quatmul(rotation(0, 0, 1, a),
+			                 quatmul(rotation(0, sign, 0, M_PI / 2),
+			                         rotation(1, 0, 0, 0.3 - a)));
+			vec3 e = quat_to_euler(q);
+			vec3 f = quat_to_euler_fast(q);
+
+			for (int i = 0; i < 3; i++)
+				locked &= isfinite(e.row[i]) && isfinite(f.row[i]);
+
+			locked &= fabs(e.row[1] - sign * M_PI / 2) < 1e-3;
+			locked &= fabs(f.row[1] - sign * M_PI / 2) < 1e-3;
+		}
+	}
+
+	CHECK(locked);
+}
+
+
+/* Round trip through the packing of `bits` per component. */
+static double pack_error(quat q, unsigned bits)
+{
+	uint64_t v = quat_pack(q, bits);
+
+	CHECK(v < (uint64_t)1 << QUAT_PACK_BITS(bits));
+	return angle(q, quat_unpack(v, bits));
+}
+
+
+/* Orientations that stress the choice of the dropped component. */
+static void test_pack_edges(void)
+{
+	const float h = 0.5, r = M_SQRT1_2;
+	const quat edges[] = {
+		{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1},
+		{-1, 0, 0, 0}, {0, 0, -1, 0},
+		{h, h, h, h}, {-h, h, -h, h}, {h, -h, -h, -h},
+		{r, r, 0, 0}, {0, -r, r, 0}, {r, 0, 0, -r},
+	};
+
+	for (unsigned bits = 4; bits <= 20; bits++) {
+		for (size_t i = 0; i < sizeof(edges) / sizeof(*edges); i++) {
+			quat q = edges[i];
+			quat n = quatscale(-1, q);
+
+			CHECK(pack_error(q, bits) <= PACK_BOUND(bits));
+			CHECK(quat_pack(q, bits) == quat_pack(n, bits) ||
+			      pack_error(n, bits) <= PACK_BOUND(bits));
+		}
+	}
+}
+
+
+/* Random orientations, reported along with the size on the wire. */
+static void test_pack(void)
+{
+	printf("bits  bytes per pose (1/8/64)  mean err (°)  max err (°)\n");
+
+	for (unsigned bits = 4; bits <= UDPOUT_BITS_MAX; bits++) {
+		double sum = 0, worst = 0;
+		const int n = 100000;
+
+		for (int i = 0; i < n; i++) {
+			double err = pack_error(random_quat(), bits);
+
+			sum += err;
+			worst = fmax(worst, err);
+		}
+
+		CHECK(worst <= PACK_BOUND(bits));
+
+		printf("%4u  %6.2f %6.2f %6.2f       %12.6f %12.6f\n", bits,
+		       UDPOUT_PACKED_SIZE(1, bits) / 1.0,
+		       UDPOUT_PACKED_SIZE(8, bits) / 8.0,
+		       UDPOUT_PACKED_SIZE(64, bits) / 64.0,
+		       sum / n * 180 / M_PI, worst * 180 / M_PI);
+	}
+
+	printf("float %6.2f                      %12.6f %12.6f\n",
+	       (double)UDPOUT_QUAT_SIZE, 0.0, 0.0);
+}
+
+
+int main(void)
+{
+	srand48(1);
+
+	test_vec3();
+	test_mat3();
+	test_quat();
+	test_from_mat3();
+	test_euler();
+	test_pack_edges();
+	test_pack();
+
+	return check_done("spatial");
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Record a trace of a head resting, turning and getting nudged, then
+ * replay it with tools/replay in the power saving mode and check which
+ * poses make it out. Motion must always go at the full rate, from its
+ * very first sample, and stillness must thin the poses out only after
+ * the hold time.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "yaw_trace.h"
+#include "check.h"
+
+
+/* Samples per second, as in the firmware. */
+#define RATE YAW_TRACE_RATE
+
+/* Length of the trace in samples. */
+#define SAMPLES (11 * RATE)
+
+/* Firmware defaults: threshold in °/s, hold in samples, divider. */
+#define THRESHOLD 3
+#define HOLD RATE
+#define DIVIDER 10
+
+
+/* Turning rate about the vertical axis at sample `i`, in °/s. */
+static double yaw_rate(int i)
+{
+	if (i >= 3 * RATE && i < 5 * RATE)
+		return 20;
+
+	/* Just over the threshold. */
+	if (i >= 8 * RATE && i < 8.5 * RATE)
+		return 5;
+
+	/* A short nudge. */
+	if (i >= 10 * RATE && i < 10 * RATE + 2)
+		return -50;
+
+	return 0;
+}
+
+
+static bool moving(int i)
+{
+	return yaw_rate(i) != 0;
+}
+
+
+int main(void)
+{
+	char path[32];
+	yaw_trace_write(path, SAMPLES, yaw_rate);
+
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "%s -s %i %s 2>&1", REPLAY, THRESHOLD, path);
+
+	FILE *out = popen(cmd, "r");
+
+	if (!out) {
+		perror(cmd);
+		return 1;
+	}
+
+	/* Which samples got their pose out. */
+	bool passed[SAMPLES] = {0};
+	size_t held = 0, ready = 0;
+	char line[256];
+
+	while (fgets(line, sizeof(line), out)) {
+		double t, w, x, y, z;
+
+		if (5 == sscanf(line, "%lf %lf %lf %lf %lf", &t, &w, &x, &y, &z)) {
+			int i = yaw_trace_index(t);
+
+			if (i >= 0 && i < SAMPLES)
+				passed[i] = true;
+		}
+
+		sscanf(line, "%zu of %zu poses held back", &held, &ready);
+	}
+
+	CHECK(0 == pclose(out));
+	unlink(path);
+
+	/* Fusion gets ready right with the first sample. */
+	CHECK(SAMPLES == ready);
+
+	/*
+	 * Motion and the hold time after it go at the full rate. Then
+	 * exactly every DIVIDER-th pose, the sample right at the end of
+	 * the hold may go either way.
+	 */
+	int quiet = 0, last = -DIVIDER;
+	size_t count = 0;
+	bool ok = true;
+
+	for (int i = 0; i < SAMPLES; i++) {
+		quiet = moving(i) ? 0 : quiet + 1;
+
+		bool expect = quiet <= HOLD || i - last >= DIVIDER;
+		bool either = quiet == HOLD + 1;
+
+		if (passed[i] != expect && !either) {
+			fprintf(stderr, "sample %i at %.2f s: %s\n", i,
+			        (double)i / RATE,
+			        expect ? "missing" : "unexpected");
+			ok = false;
+		}
+
+		if (passed[i]) {
+			last = i;
+			count++;
+		}
+	}
+
+	CHECK(ok);
+	CHECK(SAMPLES - count == held);
+
+	/* Nothing lost at rest, nothing delayed when moving. */
+	CHECK(passed[3 * RATE] && passed[8 * RATE] && passed[10 * RATE]);
+
+	return check_done("still");
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Encode and decode traces, then stream them from the real task over
+ * a mock socket layer that refuses, accepts and breaks connections on
+ * demand, and check what arrives on every one of them.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <trace.h>
+
+#include "mock_rtos.h"
+#include "mock_lwip.h"
+#include "check.h"
+
+
+/* Consulted by <esp_log.h>. */
+int sim_verbose = 0;
+
+
+/* Wait up to two seconds for the task to get somewhere. */
+#define WAIT_FOR(cond) do {						\
+		for (int n_ = 0; !(cond) && n_ < 2000; n_++)		\
+			usleep(1000);					\
+	} while (0)
+
+
+static const trace_header header = {
+	.time = 0x123456789abull,
+	.accm_scale = 9.80665 * 2 / 32768,
+	.gyro_scale = 250 * M_PI / 180 / 32768,
+	.magm_scale = {0.15, 0.15, 0.15},
+	.temp_scale = 1 / 333.87,
+	.dt = 0.01,
+};
+
+
+/* Distinct, signed and at both ends of the range. */
+static trace_record record(unsigned i)
+{
+	return (trace_record){
+		.accm = {i, -(int)i, INT16_MAX - i},
+		.gyro = {INT16_MIN + i, 3 * i, -3 * (int)i},
+		.magm = {100 + i, -100, 7},
+		.temp = -2000 + i,
+		.flags = i % 2 ? TRACE_MAGM_OK : 0,
+	};
+}
+
+
+static bool same_record(const trace_record *a, const trace_record *b)
+{
+	return !memcmp(a->accm, b->accm, sizeof(a->accm)) &&
+	       !memcmp(a->gyro, b->gyro, sizeof(a->gyro)) &&
+	       !memcmp(a->magm, b->magm, sizeof(a->magm)) &&
+	       a->temp == b->temp && a->flags == b->flags;
+}
+
+
+static void test_codec(void)
+{
+	uint8_t buf[TRACE_HEADER_SIZE + 4];
+	trace_header h;
+
+	CHECK(TRACE_HEADER_SIZE == trace_encode_header(buf, &header));
+	CHECK(!memcmp(buf, "HBTR", 4));
+	CHECK(TRACE_HEADER_SIZE == trace_decode_header(&h, buf, sizeof(buf)));
+	CHECK(!memcmp(&h, &header, sizeof(h)));
+
+	/* Newer writers may append to the header. */
+	buf[6] = TRACE_HEADER_SIZE + 4;
+	CHECK(TRACE_HEADER_SIZE + 4 == trace_decode_header(&h, buf,
+	                                                   sizeof(buf)));
+
+	/* Short, foreign or of another version. */
+	trace_encode_header(buf, &header);
+	CHECK(!trace_decode_header(&h, buf, TRACE_HEADER_SIZE - 1));
+
+	buf[4] = TRACE_VERSION + 1;
+	CHECK(!trace_decode_header(&h, buf, sizeof(buf)));
+
+	trace_encode_header(buf, &header);
+	buf[6] = TRACE_HEADER_SIZE - 1;
+	CHECK(!trace_decode_header(&h, buf, sizeof(buf)));
+
+	trace_encode_header(buf, &header);
+	buf[0] = 'X';
+	CHECK(!trace_decode_header(&h, buf, sizeof(buf)));
+
+	/* Records, little-endian. */
+	trace_record r = record(5), back;
+	r.dt = 0x01020304;
+
+	CHECK(TRACE_RECORD_SIZE == trace_encode_record(buf, &r));
+	CHECK(0x04 == buf[0] && 0x01 == buf[3]);
+	CHECK(0xfb == buf[6] && 0xff == buf[7]);
+
+	trace_decode_record(&back, buf);
+	CHECK(back.dt == r.dt && same_record(&back, &r));
+
+	/* Rounded to the nearest count, saturated at the ends. */
+	CHECK(3 == trace_raw(0.29, 0.1));
+	CHECK(-3 == trace_raw(-0.31, 0.1));
+	CHECK(INT16_MAX == trace_raw(1e6, 1));
+	CHECK(INT16_MIN == trace_raw(-1e6, 1));
+}
+
+
+/*
+ * Decode what arrived over the connection. Records must have been
+ * taken at `times` and carry the contents of record(first + i).
+ */
+static void check_stream(unsigned conn, const uint64_t *times, size_t len,
+                         unsigned first)
+{
+	static uint8_t buf[65536];
+	size_t size = mock_lwip_received(conn, buf, sizeof(buf));
+
+	CHECK(TRACE_HEADER_SIZE + len * TRACE_RECORD_SIZE == size);
+
+	trace_header h;
+	size_t pos = trace_decode_header(&h, buf, size);
+
+	CHECK(TRACE_HEADER_SIZE == pos);
+	CHECK(times[0] == h.time);
+	CHECK(header.dt == h.dt && header.accm_scale == h.accm_scale);
+
+	uint64_t time = h.time;
+	bool ok = true;
+
+	for (size_t i = 0; i < len && pos + TRACE_RECORD_SIZE <= size; i++) {
+		trace_record r, expect = record(first + i);
+
+		trace_decode_record(&r, buf + pos);
+		pos += TRACE_RECORD_SIZE;
+		time += r.dt;
+
+		ok &= time == times[i] && same_record(&r, &expect);
+	}
+
+	CHECK(ok);
+}
+
+
+/* Bytes that arrived over the connection so far. */
+static size_t received(unsigned conn)
+{
+	static uint8_t buf[65536];
+	return mock_lwip_received(conn, buf, sizeof(buf));
+}
+
+
+static void test_stream(void)
+{
+	uint64_t first[100], second[10];
+
+	trace_stream_init("localhost", "9004", &header);
+
+	/* Nobody listens, the queue fills up and then drops. */
+	unsigned queued = 0;
+
+	for (unsigned i = 0; i < 300; i++) {
+		trace_record r = record(i);
+		queued += trace_stream_push(1000 * i, &r);
+	}
+
+	CHECK(256 == queued);
+	CHECK(0 == mock_lwip_connections());
+
+	/* Backlog is dropped on connect, the header waits for a record. */
+	mock_lwip_accept = true;
+
+	WAIT_FOR(1 == mock_lwip_connections() && mock_rtos_waiting);
+	CHECK(1 == mock_lwip_connections() && mock_rtos_waiting);
+	CHECK(0 == received(0));
+
+	/* Uneven intervals and bursts, sent in chunks of a few bytes. */
+	for (unsigned i = 0; i < 100; i++) {
+		trace_record r = record(i);
+		first[i] = 5000000 + 10000 * i + (i % 7) * 13;
+
+		CHECK(trace_stream_push(first[i], &r));
+
+		if (i % 10 == 9)
+			usleep(2000);
+	}
+
+	size_t size = TRACE_HEADER_SIZE + 100 * TRACE_RECORD_SIZE;
+
+	WAIT_FOR(size == received(0) && mock_rtos_waiting);
+	check_stream(0, first, 100, 0);
+
+	/* Connection breaks, the next one starts with a fresh header. */
+	mock_lwip_broken = true;
+
+	trace_record lost = record(999);
+	CHECK(trace_stream_push(6000000, &lost));
+
+	WAIT_FOR(mock_lwip_closed(0) && 2 == mock_lwip_connections() &&
+	         mock_rtos_waiting);
+	CHECK(mock_lwip_closed(0) && 2 == mock_lwip_connections());
+
+	mock_lwip_broken = false;
+
+	for (unsigned i = 0; i < 10; i++) {
+		trace_record r = record(200 + i);
+		second[i] = 7000000 + 10000 * i;
+
+		CHECK(trace_stream_push(second[i], &r));
+	}
+
+	size = TRACE_HEADER_SIZE + 10 * TRACE_RECORD_SIZE;
+
+	WAIT_FOR(size == received(1));
+	check_stream(0, first, 100, 0);
+	check_stream(1, second, 10, 200);
+	CHECK(!mock_lwip_closed(1));
+}
+
+
+int main(void)
+{
+	test_codec();
+	test_stream();
+
+	return check_done("trace");
+}
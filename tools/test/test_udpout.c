@@ -0,0 +1,203 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Encode poses the way the firmware does, send them over the loopback
+ * and check that the receiving end decodes what was sent.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <udpout.h>
+
+#include "check.h"
+
+
+/* Worst case error of quat_pack(), in radians. */
+#define PACK_BOUND(bits) (4.9 / ((1 << (bits)) - 1))
+
+
+/* Both ends of a connected loopback link. */
+static int tx = -1, rx = -1;
+
+
+static void link_open(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+
+	CHECK(!bind(rx, (struct sockaddr *)&addr, sizeof(addr)));
+	CHECK(!getsockname(rx, (struct sockaddr *)&addr, &len));
+	CHECK(!connect(tx, (struct sockaddr *)&addr, sizeof(addr)));
+}
+
+
+/* Pass a datagram through the link, returns the poses it carried. */
+static size_t transfer(udpout_pose *dst, const uint8_t *buf, size_t len)
+{
+	uint8_t got[UDPOUT_PACKED_SIZE(UDPOUT_BATCH_MAX, UDPOUT_BITS_MAX)];
+
+	CHECK(send(tx, buf, len, 0) == (ssize_t)len);
+
+	ssize_t n = recv(rx, got, sizeof(got), 0);
+	CHECK(n == (ssize_t)len);
+
+	return udpout_decode(dst, got, n > 0 ? n : 0);
+}
+
+
+/* Random orientation, not quite uniform, does not matter. */
+static quat random_quat(void)
+{
+	quat q = {
+		drand48() - 0.5, drand48() - 0.5,
+		drand48() - 0.5, drand48() - 0.5,
+	};
+
+	return quatunit(q);
+}
+
+
+/*
+ * Angle between two orientations, in radians. Near zero, the cosine
+ * would drown in the rounding of the components, the sine does not.
+ */
+static double angle(quat a, quat b)
+{
+	double w = (double)a.w * b.w + (double)a.x * b.x +
+	           (double)a.y * b.y + (double)a.z * b.z;
+	double x = (double)a.w * b.x - (double)a.x * b.w -
+	           (double)a.y * b.z + (double)a.z * b.y;
+	double y = (double)a.w * b.y + (double)a.x * b.z -
+	           (double)a.y * b.w - (double)a.z * b.x;
+	double z = (double)a.w * b.z - (double)a.x * b.y +
+	           (double)a.y * b.x - (double)a.z * b.w;
+
+	return 2 * atan2(sqrt(x * x + y * y + z * z), fabs(w));
+}
+
+
+/* Floats arrive bit for bit. */
+static void test_quat(void)
+{
+	uint8_t buf[UDPOUT_QUAT_SIZE];
+	udpout_pose got[UDPOUT_BATCH_MAX];
+	udpout_pose p = {
+		.seq = 0xdeadbeef,
+		.time = 0x0123456789abcdefull,
+		.q = random_quat(),
+	};
+
+	size_t len = udpout_encode(buf, &p);
+
+	CHECK(UDPOUT_QUAT_SIZE == len);
+	CHECK(1 == transfer(got, buf, len));
+	CHECK(got[0].seq == p.seq);
+	CHECK(got[0].time == p.time);
+	CHECK(!memcmp(&got[0].q, &p.q, sizeof(quat)));
+}
+
+
+/* Batches within the precision of the packing. */
+static void test_packed(unsigned count, unsigned bits)
+{
+	static uint8_t buf[UDPOUT_PACKED_SIZE(UDPOUT_BATCH_MAX,
+	                                      UDPOUT_BITS_MAX)];
+	udpout_pose poses[UDPOUT_BATCH_MAX], got[UDPOUT_BATCH_MAX];
+	double worst = 0;
+
+	for (unsigned i = 0; i < count; i++) {
+		poses[i] = (udpout_pose){
+			.seq = 0xfffffff0 + i,
+			.time = 5000000000ull + 10000 * i,
+			.q = random_quat(),
+		};
+	}
+
+	size_t len = udpout_encode_packed(buf, poses, count, bits);
+
+	CHECK(UDPOUT_PACKED_SIZE(count, bits) == len);
+	CHECK(count == transfer(got, buf, len));
+
+	for (unsigned i = 0; i < count; i++) {
+		CHECK(got[i].seq == poses[i].seq);
+		CHECK(got[i].time == poses[i].time);
+		worst = fmax(worst, angle(got[i].q, poses[i].q));
+	}
+
+	CHECK(worst <= PACK_BOUND(bits));
+}
+
+
+/* Damaged datagrams are refused. */
+static void test_invalid(void)
+{
+	uint8_t buf[UDPOUT_PACKED_SIZE(8, 10)];
+	udpout_pose poses[8] = {{0}}, got[UDPOUT_BATCH_MAX];
+
+	for (int i = 0; i < 8; i++)
+		poses[i].q = random_quat();
+
+	size_t len = udpout_encode_packed(buf, poses, 8, 10);
+
+	CHECK(8 == udpout_decode(got, buf, len));
+	CHECK(0 == udpout_decode(got, buf, len - 1));
+	CHECK(0 == udpout_decode(got, buf, 10));
+
+	buf[0] = 'X';
+	CHECK(0 == udpout_decode(got, buf, len));
+	buf[0] = 'H';
+
+	buf[21] = UDPOUT_BITS_MAX + 1;
+	CHECK(0 == udpout_decode(got, buf, len));
+	buf[21] = 10;
+
+	buf[20] = 0;
+	CHECK(0 == udpout_decode(got, buf, len));
+}
+
+
+int main(void)
+{
+	srand48(1);
+	link_open();
+
+	test_quat();
+
+	for (unsigned bits = 4; bits <= UDPOUT_BITS_MAX; bits++) {
+		test_packed(1, bits);
+		test_packed(7, bits);
+		test_packed(UDPOUT_BATCH_MAX, bits);
+	}
+
+	test_invalid();
+
+	close(tx);
+	close(rx);
+
+	return check_done("udpout");
+}
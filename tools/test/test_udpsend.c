@@ -0,0 +1,134 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Run the real sending task over a mock socket layer and check that
+ * poses held back by the caller do not hold the batch back with them,
+ * and that batches only ever carry evenly spaced poses.
+ */
+
+#include <unistd.h>
+
+#include <udpout.h>
+
+#include "mock_rtos.h"
+#include "mock_lwip.h"
+#include "check.h"
+
+
+/* Consulted by <esp_log.h>. */
+int sim_verbose = 0;
+
+
+/* Wait up to two seconds for the task to get somewhere. */
+#define WAIT_FOR(cond) do {						\
+		for (int n_ = 0; !(cond) && n_ < 2000; n_++)		\
+			usleep(1000);					\
+	} while (0)
+
+
+#define BATCH 8
+#define BITS 10
+
+
+/* Time of the next pose. */
+static uint64_t next_time = 1000000;
+
+
+/* Queue poses 10 ms apart, as the fusion task would. */
+static void send_poses(unsigned count)
+{
+	for (unsigned i = 0; i < count; i++, next_time += 10000)
+		CHECK(udpout_send(next_time, (quat){1, 0, 0, 0}));
+}
+
+
+/* Decode the n-th datagram, returns number of poses in it. */
+static size_t datagram(unsigned n, udpout_pose *p)
+{
+	uint8_t buf[UDPOUT_PACKED_SIZE(UDPOUT_BATCH_MAX, UDPOUT_BITS_MAX)];
+	size_t len = mock_lwip_sent(0, n, buf, sizeof(buf));
+	return udpout_decode(p, buf, len);
+}
+
+
+int main(void)
+{
+	udpout_pose p[UDPOUT_BATCH_MAX];
+
+	mock_lwip_accept = true;
+	udpout_init("localhost", "9003", BATCH, BITS);
+
+	WAIT_FOR(1 == mock_lwip_connections() && mock_rtos_waiting);
+	CHECK(1 == mock_lwip_connections() && mock_rtos_waiting);
+
+	/* Nothing went out, there is nothing to flush. */
+	CHECK(udpout_flush());
+
+	/* A gap after three poses, then five more. */
+	send_poses(3);
+	CHECK(udpout_flush());
+	send_poses(5);
+
+	/* The rest only goes after the timeout. */
+	WAIT_FOR(2 == mock_lwip_sends(0));
+	CHECK(2 == mock_lwip_sends(0));
+
+	CHECK(3 == datagram(0, p));
+	CHECK(0 == p[0].seq && 1000000 == p[0].time);
+	CHECK(5 == datagram(1, p));
+	CHECK(3 == p[0].seq && 1030000 == p[0].time);
+
+	/* Longer gap only flushes once. */
+	for (int i = 0; i < 10; i++)
+		CHECK(udpout_flush());
+
+	/* A full batch goes at once, flushing after it sends nothing. */
+	send_poses(BATCH);
+	CHECK(udpout_flush());
+
+	WAIT_FOR(3 == mock_lwip_sends(0) && mock_rtos_waiting);
+	usleep(50000);
+
+	CHECK(3 == mock_lwip_sends(0));
+	CHECK(BATCH == datagram(2, p));
+	CHECK(8 == p[0].seq);
+
+	/* Jitter within a quarter of the period keeps the batch whole. */
+	for (unsigned i = 0; i < BATCH; i++, next_time += 10000)
+		CHECK(udpout_send(next_time + (i % 2 ? 1000 : 0),
+		                  (quat){1, 0, 0, 0}));
+
+	/* A sample dropped after the second pose, then after the first. */
+	send_poses(2);
+	next_time += 10000;
+	send_poses(1);
+	next_time += 10000;
+	send_poses(2);
+
+	WAIT_FOR(7 == mock_lwip_sends(0));
+	CHECK(7 == mock_lwip_sends(0));
+
+	CHECK(BATCH == datagram(3, p));
+	CHECK(2 == datagram(4, p));
+	CHECK(24 == p[0].seq && 10000 == p[1].time - p[0].time);
+	CHECK(2 == datagram(5, p));
+	CHECK(26 == p[0].seq && 20000 == p[1].time - p[0].time);
+	CHECK(1 == datagram(6, p));
+	CHECK(28 == p[0].seq);
+
+	return check_done("udpsend");
+}
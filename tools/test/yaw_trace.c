@@ -0,0 +1,101 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <trace.h>
+
+#include "yaw_trace.h"
+
+
+/* Initial magnetometer calibration in fusion_init(). */
+static const double hard[3] = {70.61, 51.43, 34.96};
+static const double soft[3] = {0.94, 1.03, 1.05};
+
+
+void yaw_trace_write(char *path, int samples, double (*rate)(int i))
+{
+	trace_header h = {
+		.time = YAW_TRACE_START * 1000000,
+		.accm_scale = 2 * 9.80665 / 32768,
+		.gyro_scale = 250 * M_PI / 180 / 32768,
+		.magm_scale = {0.15, 0.15, 0.15},
+		.temp_scale = 1 / 333.87,
+		.dt = 1.0 / YAW_TRACE_RATE,
+	};
+
+	strcpy(path, "/tmp/trace.XXXXXX");
+
+	int fd = mkstemp(path);
+	FILE *fp = fd < 0 ? NULL : fdopen(fd, "wb");
+	uint8_t buf[TRACE_HEADER_SIZE];
+
+	if (!fp) {
+		perror(path);
+		exit(1);
+	}
+
+	fwrite(buf, trace_encode_header(buf, &h), 1, fp);
+
+	double yaw = 0;
+
+	for (int i = 0; i < samples; i++) {
+		double w = rate(i) * M_PI / 180;
+		yaw += w / YAW_TRACE_RATE;
+
+		/* Level, field of 20 μT north and 44 μT down, turned by yaw. */
+		double field[3] = {20 * cos(yaw), -20 * sin(yaw), -44};
+		double raw[3];
+
+		/* Distorted as the default calibration of fusion expects. */
+		for (int j = 0; j < 3; j++)
+			raw[j] = hard[j] + field[j] / soft[j];
+
+		trace_record r = {
+			.dt = i ? 1000000 / YAW_TRACE_RATE : 0,
+			.accm = {0, 0, trace_raw(9.80665, h.accm_scale)},
+			.gyro = {0, 0, trace_raw(w, h.gyro_scale)},
+
+			/* In the axes of the magnetometer. */
+			.magm = {
+				trace_raw(raw[1], h.magm_scale[0]),
+				trace_raw(raw[0], h.magm_scale[1]),
+				trace_raw(-raw[2], h.magm_scale[2]),
+			},
+
+			.temp = 0,
+			.flags = TRACE_MAGM_OK,
+		};
+
+		uint8_t rec[TRACE_RECORD_SIZE];
+		fwrite(rec, trace_encode_record(rec, &r), 1, fp);
+	}
+
+	if (fclose(fp)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+
+int yaw_trace_index(double t)
+{
+	return lround((t - YAW_TRACE_START) * YAW_TRACE_RATE);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C)  Jan Hamal Dvořák <mordae@anilinux.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Synthetic traces of a level head turning about the vertical axis,
+ * with exact readings, for the tests to replay through tools/replay.
+ */
+
+#pragma once
+
+
+/* Samples per second, as in the firmware. */
+#define YAW_TRACE_RATE 100
+
+/* Time of the first sample, in s. */
+#define YAW_TRACE_START 1.0
+
+
+/*
+ * Write `samples` samples turning at `rate(i)` °/s into a new temporary
+ * file, fill its name into `path` that must hold at least 32 bytes.
+ * Exits on failure.
+ */
+void yaw_trace_write(char *path, int samples, double (*rate)(int i));
+
+/* Sample index of a time printed by the replay. */
+int yaw_trace_index(double t);